@@ -0,0 +1,205 @@
+#!/bin/sh
+
+# This script runs the simbus benchmark. For each combination of
+# protocol, device count, data width and transport, it writes a bus
+# configuration that has the server start a set of bench_client
+# processes, runs the server with profiling on, and prints a line of
+# results. The sweep is controlled by these environment variables:
+#
+#   BENCH_PROTOCOLS   (default "pci axi4 pcie-tlp p2p")
+#   BENCH_DEVICES     Total clients, hosts included (default "2 4 8 16 32 64")
+#   BENCH_WIDTHS      Data widths (default depends on the protocol)
+#   BENCH_TRANSPORTS  (default "pipe tcp")
+#   BENCH_SECONDS     Wall clock seconds per run (default 2)
+#   BENCH_PORT        First TCP port to use (default 47100)
+#   BENCH_RESULTS     Results file (default results.txt)
+#   BENCH_CLOCK_PHASES  CLOCK_phases bus option, 2 or 4 (default 4)
+#
+# A pci bus has up to 16 clients, so larger device counts are split
+# into several pci busses. The other protocols have exactly 2 clients
+# (a host and a device) per bus, so the device count sets the number
+# of busses. All the busses run at once in the same server.
+#
+# The results are:
+#
+#   phases/s    Bus steps per wall second, summed over the busses.
+#   msgs/s      Protocol messages (both ways) per wall second.
+#   bytes/phase Protocol bytes (both ways) per bus step.
+#   cpu_us/phase  Server and client CPU time per bus step.
+
+protocols=${BENCH_PROTOCOLS:-"pci axi4 pcie-tlp p2p"}
+devices=${BENCH_DEVICES:-"2 4 8 16 32 64"}
+transports=${BENCH_TRANSPORTS:-"pipe tcp"}
+seconds=${BENCH_SECONDS:-2}
+port=${BENCH_PORT:-47100}
+results=${BENCH_RESULTS:-results.txt}
+clock_phases=${BENCH_CLOCK_PHASES:-4}
+
+bench_dir=`pwd`
+server=$bench_dir/../server/simbus_server
+client=$bench_dir/bench_client
+run_dir=$bench_dir/run
+
+case $results in
+    /*) ;;
+    *) results=$bench_dir/$results ;;
+esac
+
+default_widths() {
+    case $1 in
+	pci|axi4) echo "32 64" ;;
+	pcie-tlp) echo "2 16" ;;
+	p2p) echo "8 64 1024" ;;
+    esac
+}
+
+# write_config <protocol> <devices> <width> <transport>
+#
+# Write the bench.bus file into the current directory, and set
+# the nbus variable to the number of busses.
+write_config() {
+    proto=$1 ndev=$2 width=$3 trans=$4
+
+    if [ $proto = pci ]; then
+	per_bus=$ndev
+	[ $per_bus -gt 16 ] && per_bus=16
+    else
+	per_bus=2
+    fi
+    nbus=`expr $ndev / $per_bus`
+
+    case $proto in
+	pci) bus_protocol=pci ;;
+	axi4) bus_protocol=AXI4 ;;
+	pcie-tlp) bus_protocol=pcie-tlp ;;
+	p2p) bus_protocol=point-to-point ;;
+    esac
+
+    : > bench.bus
+    b=0
+    while [ $b -lt $nbus ]; do
+	if [ $trans = tcp ]; then
+	    addr=`expr $port + $b`
+	    bus_port="port = $addr;"
+	else
+	    addr=pipe:bench$b.pipe
+	    bus_port="pipe = \"bench$b.pipe\";"
+	fi
+
+	{
+	    echo "bus {"
+	    echo "    protocol = \"$bus_protocol\";"
+	    echo "    name = \"bus$b\";"
+	    echo "    $bus_port"
+	    echo "    CLOCK_phases = \"$clock_phases\";"
+	    if [ $proto != pci ]; then
+		echo "    CLOCK_high = 5000;"
+		echo "    CLOCK_low  = 5000;"
+		echo "    CLOCK_hold = 1000;"
+		echo "    CLOCK_setup = 1000;"
+	    fi
+	    if [ $proto = p2p ]; then
+		echo "    WIDTH_I = \"$width\";"
+		echo "    WIDTH_O = \"$width\";"
+	    fi
+	    if [ $proto = pci ]; then
+		echo "    host 15 \"host$b\";"
+		d=0
+		while [ $d -lt `expr $per_bus - 1` ]; do
+		    echo "    device $d \"dev$b.$d\";"
+		    d=`expr $d + 1`
+		done
+	    else
+		echo "    host 0 \"host$b\";"
+		echo "    device 1 \"dev$b.0\";"
+	    fi
+	    echo "}"
+
+	    opts="-p $proto -w $width -s $addr"
+	    echo "process {"
+	    echo "    name = \"host$b\";"
+	    echo "    exec = \"$client $opts -r host -n `expr $per_bus - 1` -t $seconds -d host$b\";"
+	    echo "    stdout = \"host$b.out\";"
+	    echo "}"
+	    d=0
+	    while [ $d -lt `expr $per_bus - 1` ]; do
+		echo "process {"
+		echo "    name = \"dev$b.$d\";"
+		echo "    exec = \"$client $opts -r device -i $d -d dev$b.$d\";"
+		echo "    stdout = \"dev$b.$d.out\";"
+		echo "}"
+		d=`expr $d + 1`
+	    done
+	} >> bench.bus
+	b=`expr $b + 1`
+    done
+}
+
+# Wait for all the clients to write their last line. The server does
+# not wait for the processes it starts.
+wait_clients() {
+    tries=0
+    while [ $tries -lt 50 ]; do
+	done_count=`cat *.out 2>/dev/null | grep -c '^bench_client '`
+	[ $done_count -ge $1 ] && return 0
+	sleep 0.1
+	tries=`expr $tries + 1`
+    done
+    return 1
+}
+
+header="protocol transport devices width busses phases/s msgs/s bytes/phase cpu_us/phase"
+echo "$header" | awk '{ printf "%-10s %-9s %7s %5s %6s %12s %12s %11s %12s\n", $1,$2,$3,$4,$5,$6,$7,$8,$9 }' > $results
+cat $results
+
+for proto in $protocols; do
+    widths=${BENCH_WIDTHS:-`default_widths $proto`}
+    for trans in $transports; do
+	for ndev in $devices; do
+	    for width in $widths; do
+		rm -rf $run_dir
+		mkdir -p $run_dir
+		cd $run_dir
+
+		write_config $proto $ndev $width $trans
+		$server -c bench.bus -p report.txt -P 0 > server.log 2>&1
+		if ! wait_clients $ndev; then
+		    echo "$proto $trans $ndev $width: clients did not finish (see $run_dir)" >&2
+		fi
+
+		cat report.txt *.out | awk -v proto=$proto -v trans=$trans \
+		    -v ndev=$ndev -v width=$width '
+		    function field(name,   i, kv) {
+			for (i = 2 ; i <= NF ; i += 1) {
+			    split($i, kv, "=")
+			    if (kv[1] == name) return kv[2]
+			}
+			return 0
+		    }
+		    $1 == "server" { cpu += field("cpu_user_ns") + field("cpu_sys_ns") }
+		    $1 == "bus" {
+			busses += 1
+			phases += field("phases")
+			rate += field("phases_per_sec")
+			if (field("wall_ns") > wall) wall = field("wall_ns")
+		    }
+		    $1 == "device" {
+			msgs += field("msgs_in") + field("msgs_out")
+			bytes += field("bytes_in") + field("bytes_out")
+		    }
+		    $1 == "bench_client" { cpu += field("cpu_ns") }
+		    END {
+			if (phases == 0 || wall == 0) {
+			    printf "%-10s %-9s %7s %5s %6s %12s\n", proto, trans, ndev, width, busses, "failed"
+			    exit
+			}
+			printf "%-10s %-9s %7d %5d %6d %12.0f %12.0f %11.1f %12.2f\n",
+			    proto, trans, ndev, width, busses, rate,
+			    msgs / (wall / 1e9), bytes / phases, cpu / phases / 1e3
+		    }' | tee -a $results
+
+		cd $bench_dir
+	    done
+	done
+    done
+done
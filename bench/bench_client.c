@@ -0,0 +1,456 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+
+/*
+ * This is a synthetic client for benchmarking the simbus server. It
+ * speaks one of the bus protocols as fast as it can, so that the time
+ * of a run is all in the protocol and the server, and not in any
+ * device model. The bench.sh script starts the server and a set of
+ * these clients, and collects the results.
+ *
+ * Command line flags:
+ *
+ *    -p <protocol>
+ *       The bus protocol: pci, axi4, pcie-tlp or p2p.
+ *
+ *    -r <role>
+ *       The role on the bus: host or device. The host drives the
+ *       traffic and ends the simulation, the devices respond.
+ *
+ *    -n <devices>
+ *       The number of devices on the bus (pci hosts only). The host
+ *       writes to each device in turn.
+ *
+ *    -i <index>
+ *       The index of this device on the bus (pci devices only). This
+ *       selects the address range that the device claims.
+ *
+ *    -t <seconds>
+ *       The host runs for this many wall clock seconds, then ends
+ *       the simulation. The default is 2.
+ *
+ *    -w <width>
+ *       The data width. This is 32 or 64 for pci and axi4, the
+ *       payload words per TLP for pcie-tlp, and the WIDTH_I/WIDTH_O
+ *       bits for p2p.
+ *
+ *    -s <server>
+ *       Server string for connecting with the simbus server.
+ *
+ *    -d <name>
+ *       The device name to send to the server.
+ *
+ * When the client finishes, it prints a line with its name, the
+ * number of operations it drove (writes for hosts, clocks for p2p
+ * devices and bus steps for pcie-tlp endpoints), and its CPU time.
+ */
+
+# include  <simbus_pci.h>
+# include  <simbus_axi4.h>
+# include  <simbus_axi4s.h>
+# include  <simbus_pcie_tlp.h>
+# include  <simbus_p2p.h>
+# include  "simbus_priv.h"
+# include  <stdint.h>
+# include  <stdio.h>
+# include  <stdlib.h>
+# include  <unistd.h>
+# include  <string.h>
+# include  <time.h>
+# include  <sys/resource.h>
+# include  <assert.h>
+
+# define PCI_BASE 0x80000000UL
+
+static double run_seconds = 2.0;
+static unsigned data_width = 32;
+static struct timespec run_start;
+
+/*
+ * Return true if the host has run out of time.
+ */
+static int run_done(void)
+{
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      double secs = (now.tv_sec - run_start.tv_sec)
+	    + (now.tv_nsec - run_start.tv_nsec) / 1e9;
+      return secs >= run_seconds;
+}
+
+static void report_ops(const char*name, uint64_t ops)
+{
+      struct rusage ru;
+      getrusage(RUSAGE_SELF, &ru);
+      uint64_t cpu_ns = (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL
+	    + (uint64_t)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+
+      printf("bench_client %s ops=%" PRIu64 " cpu_ns=%" PRIu64 "\n", name, ops, cpu_ns);
+      fflush(stdout);
+}
+
+/* PCI */
+
+static uint32_t pci_need32(simbus_pci_t bus, uint64_t addr, int BEn)
+{
+      return (uint32_t)addr;
+}
+
+static void pci_recv32(simbus_pci_t bus, uint64_t addr, uint32_t val, int BEn)
+{
+}
+
+static uint64_t pci_need64(simbus_pci_t bus, uint64_t addr, int BEn)
+{
+      return addr;
+}
+
+static void pci_recv64(simbus_pci_t bus, uint64_t addr, uint64_t val, int BEn)
+{
+}
+
+static int pci_host(const char*server, const char*name, unsigned ndev)
+{
+      simbus_pci_t bus = simbus_pci_connect(server, name);
+      if (bus == 0)
+	    return -1;
+
+      simbus_pci_wait(bus, 4, 0);
+      simbus_pci_reset(bus, 8, 8);
+
+      uint64_t ops = 0;
+      clock_gettime(CLOCK_MONOTONIC, &run_start);
+      while (! run_done()) {
+	    unsigned idx;
+	    for (idx = 0 ; idx < ndev ; idx += 1) {
+		  uint64_t addr = PCI_BASE + (idx << 20) + 8*(ops&0xff);
+		  if (data_width == 64)
+			simbus_pci_write64(bus, addr, ops, 0);
+		  else
+			simbus_pci_write32(bus, addr, ops, 0);
+		  ops += 1;
+	    }
+      }
+
+      report_ops(name, ops);
+      simbus_pci_end_simulation(bus);
+      return 0;
+}
+
+static int pci_device(const char*server, const char*name, unsigned index)
+{
+      simbus_pci_t bus = simbus_pci_connect(server, name);
+      if (bus == 0)
+	    return -1;
+
+      struct simbus_translation xlate;
+      memset(&xlate, 0, sizeof xlate);
+      xlate.flags = data_width == 64? SIMBUS_XLATE_FLAG64 : 0;
+      xlate.base = PCI_BASE + (index << 20);
+      xlate.mask = 0xfff00000;
+      xlate.need32 = pci_need32;
+      xlate.recv32 = pci_recv32;
+      xlate.need64 = pci_need64;
+      xlate.recv64 = pci_recv64;
+      simbus_pci_mem_xlate(bus, 0, &xlate);
+
+      for (;;) {
+	    int rc = simbus_pci_wait(bus, 0xffffffff, 0);
+	    if (rc == SIMBUS_PCI_FINISHED || rc == SIMBUS_PCI_ERROR)
+		  break;
+      }
+
+      report_ops(name, 0);
+      simbus_pci_disconnect(bus);
+      return 0;
+}
+
+/* AXI4 */
+
+static simbus_axi4_resp_t axi4_write64(simbus_axi4_t bus, uint64_t addr, int prot, uint64_t data)
+{ return SIMBUS_AXI4_RESP_OKAY; }
+static simbus_axi4_resp_t axi4_write32(simbus_axi4_t bus, uint64_t addr, int prot, uint32_t data)
+{ return SIMBUS_AXI4_RESP_OKAY; }
+static simbus_axi4_resp_t axi4_write16(simbus_axi4_t bus, uint64_t addr, int prot, uint16_t data)
+{ return SIMBUS_AXI4_RESP_OKAY; }
+static simbus_axi4_resp_t axi4_write8(simbus_axi4_t bus, uint64_t addr, int prot, uint8_t data)
+{ return SIMBUS_AXI4_RESP_OKAY; }
+
+static simbus_axi4_resp_t axi4_read64(simbus_axi4_t bus, uint64_t addr, int prot, uint64_t*data)
+{ *data = addr; return SIMBUS_AXI4_RESP_OKAY; }
+static simbus_axi4_resp_t axi4_read32(simbus_axi4_t bus, uint64_t addr, int prot, uint32_t*data)
+{ *data = addr; return SIMBUS_AXI4_RESP_OKAY; }
+static simbus_axi4_resp_t axi4_read16(simbus_axi4_t bus, uint64_t addr, int prot, uint16_t*data)
+{ *data = addr; return SIMBUS_AXI4_RESP_OKAY; }
+static simbus_axi4_resp_t axi4_read8(simbus_axi4_t bus, uint64_t addr, int prot, uint8_t*data)
+{ *data = addr; return SIMBUS_AXI4_RESP_OKAY; }
+
+static const struct simbus_axi4s_slave_s axi4_slave_dev = {
+      axi4_write64, axi4_write32, axi4_write16, axi4_write8,
+      axi4_read64,  axi4_read32,  axi4_read16,  axi4_read8
+};
+
+static int axi4_host(const char*server, const char*name)
+{
+      simbus_axi4_t bus = simbus_axi4_connect(server, name, data_width, 32, 4, 4, 0);
+      if (bus == 0)
+	    return -1;
+
+      simbus_axi4_wait(bus, 4, 0);
+      simbus_axi4_reset(bus, 8, 8);
+
+      uint64_t ops = 0;
+      clock_gettime(CLOCK_MONOTONIC, &run_start);
+      while (! run_done()) {
+	    uint64_t addr = 8*(ops&0xff);
+	    if (data_width == 64)
+		  simbus_axi4_write64(bus, addr, 0, ops);
+	    else
+		  simbus_axi4_write32(bus, addr, 0, ops);
+	    ops += 1;
+      }
+
+      report_ops(name, ops);
+      simbus_axi4_end_simulation(bus);
+      return 0;
+}
+
+static int axi4_device(const char*server, const char*name)
+{
+      simbus_axi4_t bus = simbus_axi4_connect(server, name, data_width, 32, 4, 4, 0);
+      if (bus == 0)
+	    return -1;
+
+      simbus_axi4_slave(bus, &axi4_slave_dev);
+      report_ops(name, 0);
+      simbus_axi4_disconnect(bus);
+      return 0;
+}
+
+/* PCIe TLP */
+
+static int pcie_host(const char*server, const char*name)
+{
+      simbus_pcie_tlp_t bus = simbus_pcie_tlp_connect(server, name);
+      if (bus == 0)
+	    return -1;
+
+      simbus_pcie_tlp_wait(bus, 4, 0);
+      simbus_pcie_tlp_reset(bus, 1, 8);
+      simbus_pcie_tlp_wait(bus, 4, 0);
+
+      uint32_t*data = calloc(data_width, sizeof(uint32_t));
+      assert(data);
+
+      uint64_t ops = 0;
+      clock_gettime(CLOCK_MONOTONIC, &run_start);
+      while (! run_done()) {
+	    data[0] = ops;
+	    simbus_pcie_tlp_write(bus, 0x10000000 + 4*data_width*(ops&0xff),
+				  data, data_width, 0, 4*data_width);
+	    ops += 1;
+      }
+
+      free(data);
+      report_ops(name, ops);
+      simbus_pcie_tlp_end_simulation(bus);
+      return 0;
+}
+
+/*
+ * The libsimbus pcie-tlp API is the root side only, so the endpoint
+ * here speaks the protocol directly. It is always ready to receive,
+ * and never sends anything, which is all a stream of posted writes
+ * needs.
+ */
+static int pcie_device(const char*server, const char*name)
+{
+      int fd = __simbus_server_socket(server);
+      if (fd < 0)
+	    return -1;
+
+      unsigned ident = 0;
+      if (__simbus_server_hello(fd, name, &ident, 0, 0) < 0)
+	    return -1;
+
+      bus_bitval_t bit0 = BIT_0;
+      bus_bitval_t bit1 = BIT_1;
+      bus_bitval_t zero[64];
+      unsigned idx;
+      for (idx = 0 ; idx < 64 ; idx += 1)
+	    zero[idx] = BIT_0;
+
+      char signals[512];
+      char*cp = signals;
+      cp += __ready_signal(cp, "m_axis_rx_tready", &bit1, 1);
+      cp += __ready_signal(cp, "s_axis_tx_tdata",  zero, 64);
+      cp += __ready_signal(cp, "s_axis_tx_tkeep",  zero, 8);
+      cp += __ready_signal(cp, "s_axis_tx_tlast",  &bit0, 1);
+      cp += __ready_signal(cp, "s_axis_tx_tvalid", &bit0, 1);
+      cp += __ready_signal(cp, "s_axis_tx_tuser",  zero, 4);
+      *cp = 0;
+
+      char time_buf[64];
+      strcpy(time_buf, "0e0");
+
+      uint64_t ops = 0;
+      for (;;) {
+	    char buf[4096];
+	    snprintf(buf, sizeof buf, "READY %s%s\n", time_buf, signals);
+
+	    char*argv[2048];
+	    int argc = __simbus_server_send_recv(fd, buf, sizeof buf, 2048, argv, 0);
+	    if (argc <= 0)
+		  break;
+	    if (strcmp(argv[0],"UNTIL") != 0)
+		  break;
+
+	    assert(argc >= 2);
+	    strncpy(time_buf, argv[1], sizeof time_buf - 1);
+	    time_buf[sizeof time_buf - 1] = 0;
+	    ops += 1;
+      }
+
+      report_ops(name, ops);
+      close(fd);
+      return 0;
+}
+
+/* Point-to-point */
+
+static int p2p_run(const char*server, const char*name)
+{
+      simbus_p2p_t bus = simbus_p2p_connect(server, name, data_width, data_width);
+      if (bus == 0)
+	    return -1;
+
+      uint32_t*data = calloc((data_width+31)/32, sizeof(uint32_t));
+      assert(data);
+
+      int host = simbus_p2p_is_host(bus);
+      uint64_t ops = 0;
+      clock_gettime(CLOCK_MONOTONIC, &run_start);
+      for (;;) {
+	    data[0] = ops;
+	    if (host)
+		  simbus_p2p_out(bus, data);
+	    else
+		  simbus_p2p_in_poke(bus, data);
+
+	    if (simbus_p2p_clock_posedge(bus, 1) < 0)
+		  break;
+
+	    ops += 1;
+	    if (host && run_done())
+		  break;
+      }
+
+      free(data);
+      report_ops(name, ops);
+      if (host)
+	    simbus_p2p_end_simulation(bus);
+      else
+	    simbus_p2p_disconnect(bus);
+      return 0;
+}
+
+int main(int argc, char*argv[])
+{
+      const char*server = 0;
+      const char*protocol = "pci";
+      const char*name = 0;
+      int host_flag = 0;
+      unsigned ndev = 1;
+      unsigned index = 0;
+
+      int arg;
+      while ( (arg = getopt(argc, argv, "d:i:n:p:r:s:t:w:")) != -1 ) {
+
+	    switch (arg) {
+
+		case 'd': /* -d <name> */
+		  name = optarg;
+		  break;
+
+		case 'i': /* -i <index> */
+		  index = strtoul(optarg, 0, 0);
+		  break;
+
+		case 'n': /* -n <devices> */
+		  ndev = strtoul(optarg, 0, 0);
+		  break;
+
+		case 'p': /* -p <protocol> */
+		  protocol = optarg;
+		  break;
+
+		case 'r': /* -r <role> */
+		  host_flag = strcmp(optarg, "host") == 0;
+		  break;
+
+		case 's': /* -s <server> */
+		  server = optarg;
+		  break;
+
+		case 't': /* -t <seconds> */
+		  run_seconds = strtod(optarg, 0);
+		  break;
+
+		case 'w': /* -w <width> */
+		  data_width = strtoul(optarg, 0, 0);
+		  break;
+
+		default:
+		  return -1;
+	    }
+      }
+
+      if (server == 0 || name == 0) {
+	    fprintf(stderr, "usage: bench_client -p <protocol> -r host|device"
+		    " [-n <devices>] [-i <index>] [-t <seconds>] [-w <width>]"
+		    " -s <server> -d <name>\n");
+	    return -1;
+      }
+
+      int rc;
+      if (strcmp(protocol, "pci") == 0) {
+	    rc = host_flag? pci_host(server, name, ndev) : pci_device(server, name, index);
+
+      } else if (strcmp(protocol, "axi4") == 0) {
+	    rc = host_flag? axi4_host(server, name) : axi4_device(server, name);
+
+      } else if (strcmp(protocol, "pcie-tlp") == 0) {
+	    rc = host_flag? pcie_host(server, name) : pcie_device(server, name);
+
+      } else if (strcmp(protocol, "p2p") == 0) {
+	    rc = p2p_run(server, name);
+
+      } else {
+	    fprintf(stderr, "Unknown protocol %s\n", protocol);
+	    return -1;
+      }
+
+      if (rc < 0) {
+	    fprintf(stderr, "%s: Unable to connect to server %s\n", name, server);
+	    return -1;
+      }
+
+      return 0;
+}
@@ -0,0 +1,47 @@
+#!/bin/sh
+
+# This script runs the micro-benchmarks of the message functions, and
+# compares the results with the baseline in micro_baseline.txt. The
+# results are written to micro_results.txt. To make the results the
+# new baseline, copy them over the baseline file (make micro-baseline)
+# and commit it with the change that made the difference.
+#
+# These environment variables control the run:
+#
+#   MICRO_SECONDS   Seconds per benchmark (default 1)
+#   MICRO_FILTER    Run only the benchmarks whose name contains this
+#
+# The times are only comparable on the same machine with the same
+# compiler flags, so the results start with a description of both.
+
+seconds=${MICRO_SECONDS:-1}
+results=micro_results.txt
+baseline=micro_baseline.txt
+
+flags="-t $seconds"
+[ -n "$MICRO_FILTER" ] && flags="$flags -f $MICRO_FILTER"
+
+{
+    echo "# host: `uname -m` `grep -m1 'model name' /proc/cpuinfo 2>/dev/null | sed 's/.*: //'`"
+    echo "# CFLAGS: $CFLAGS"
+    echo "# CXXFLAGS: $CXXFLAGS"
+    ./micro_simbus $flags
+    ./micro_server $flags
+} > $results
+
+if [ ! -f $baseline ]; then
+    cat $results
+    exit 0
+fi
+
+grep '^#' $baseline | sed 's/^#/# baseline/'
+grep '^#' $results
+awk '
+    /^#/ { next }
+    FNR == NR { base[$1] = $2; next }
+    {
+	if ($1 in base && base[$1] > 0)
+	    printf "%-32s %12.1f %12.1f ns/op %+7.1f%%\n", $1, base[$1], $2, 100 * ($2 - base[$1]) / base[$1]
+	else
+	    printf "%-32s %12s %12.1f ns/op\n", $1, "-", $2
+    }' $baseline $results
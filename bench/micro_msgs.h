@@ -0,0 +1,110 @@
+#ifndef __micro_msgs_H
+#define __micro_msgs_H
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+/*
+ * These are the messages that the micro-benchmarks encode and
+ * decode. They are copied from a protocol log (-D protocol=<path>) of
+ * the bench_client programs, in the middle of a write, so the data
+ * signals have values and not just z. There is a READY and an UNTIL
+ * for each side of each protocol, and the HELLO arguments that the
+ * libsimbus client sends.
+ */
+
+struct micro_msg_s {
+	/* Protocol name, as in the .bus file, and the role. */
+      const char*protocol;
+      const char*role;
+      int host_flag;
+	/* Arguments of the HELLO message. */
+      const char*hello;
+      const char*ready;
+      const char*until;
+};
+
+static const struct micro_msg_s micro_msgs[] = {
+      { "pci", "pci-host", 1, "",
+	"READY 660000e-12 RESET#=1 REQ#=1 REQ64#=1 FRAME#=0 IRDY#=1 TRDY#=z"
+	" STOP#=z DEVSEL#=z ACK64#=z C/BE#=zzzz0111"
+	" AD=zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz10000000000000000000000000000000 PAR=z PAR64=z",
+	"UNTIL 673000e-12 ACK64#=z AD=zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz10000000000000000000000000000000"
+	" C/BE#=zzzz0111 DEVSEL#=z FRAME#=0 GNT#=0 IDSEL=z"
+	" INTA#=1111111111111111 INTB#=1111111111111111"
+	" INTC#=1111111111111111 INTD#=1111111111111111 IRDY#=1 PAR=z"
+	" PAR64=z PCIXCAP=0 PCI_CLK=1 REQ64#=1 STOP#=z TRDY#=z"
+      },
+      { "pci", "pci-device", 0, "",
+	"READY 690000e-12 RESET#=1 REQ#=1 REQ64#=z FRAME#=z IRDY#=z TRDY#=0"
+	" STOP#=1 DEVSEL#=0 ACK64#=1 C/BE#=zzzzzzzz"
+	" AD=zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz PAR=z PAR64=z",
+	"UNTIL 673000e-12 ACK64#=z AD=zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz10000000000000000000000000000000"
+	" C/BE#=zzzz0111 DEVSEL#=z FRAME#=0 GNT#=1 IDSEL=0 IRDY#=1 PAR=z"
+	" PAR64=z PCIXCAP=0 PCI_CLK=1 REQ64#=1 RESET#=1 STOP#=z TRDY#=z"
+      },
+      { "AXI4", "axi4-master", 1,
+	" data_width=32 addr_width=32 wid_width=4 rid_width=4 irq_width=0",
+	"READY 200000e-12 ARESETn=1 AWVALID=1 AWADDR=00000000000000000000000000000000"
+	" AWLEN=00000000 AWSIZE=010 AWBURST=01 AWLOCK=00 AWCACHE=0000"
+	" AWPROT=000 AWQOS=0000 AWID=0000 WVALID=1"
+	" WDATA=00000000000000000000000000000000 WSTRB=1111 BREADY=1"
+	" ARVALID=0 ARADDR=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx ARLEN=xxxxxxxx"
+	" ARSIZE=xxx ARBURST=xx ARLOCK=xx ARCACHE=xxxx ARPROT=xxx ARQOS=xxxx"
+	" ARID=zzzz RREADY=0",
+	"UNTIL 224000e-12 ACLK=1 ARREADY=1 AWREADY=0 BID=0000 BRESP=00 BVALID=1"
+	" IRQ= RDATA=00000000000000000000000000000000 RID=0000 RRESP=00"
+	" RVALID=0 WREADY=0"
+      },
+      { "AXI4", "axi4-slave", 0,
+	" data_width=32 addr_width=32 wid_width=4 rid_width=4 irq_width=0",
+	"READY 220000e-12 AWREADY=0 WREADY=0 BVALID=1 BRESP=00 BID=0000"
+	" ARREADY=1 RVALID=0 RDATA=00000000000000000000000000000000 RRESP=00 RID=0000",
+	"UNTIL 204000e-12 ACLK=1 ARADDR=xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx ARBURST=xx"
+	" ARCACHE=xxxx ARESETn=1 ARID=zzzz ARLEN=xxxxxxxx ARLOCK=xx ARPROT=xxx"
+	" ARQOS=xxxx ARSIZE=xxx ARVALID=0 AWADDR=00000000000000000000000000000000"
+	" AWBURST=01 AWCACHE=0000 AWID=0000 AWLEN=00000000 AWLOCK=00 AWPROT=000"
+	" AWQOS=0000 AWSIZE=010 AWVALID=1 BREADY=1 RREADY=0"
+	" WDATA=00000000000000000000000000000000 WSTRB=1111 WVALID=1"
+      },
+      { "pcie-tlp", "pcie-root", 1, "",
+	"READY 1878000e-12 user_reset=0 user_lnk_up=1 tx_buf_av=010000"
+	" m_axis_rx_tdata=0000000111111000000000001111111101000000000000000000000000100000"
+	" m_axis_rx_tkeep=11111111 m_axis_rx_tlast=0 m_axis_rx_tvalid=1"
+	" s_axis_tx_tready=1",
+	"UNTIL 1882000e-12 m_axis_rx_tready=1"
+	" s_axis_tx_tdata=0000000000000000000000000000000000000000000000000000000000000000"
+	" s_axis_tx_tkeep=00000000 s_axis_tx_tlast=0 s_axis_tx_tuser=0000"
+	" s_axis_tx_tvalid=0 s_axis_tx_user=xxxxxxxxxxxxxxxxxxxxxx user_clk=1"
+      },
+      { "pcie-tlp", "pcie-endpoint", 0, "",
+	"READY 1878000e-12 m_axis_rx_tready=1"
+	" s_axis_tx_tdata=0000000000000000000000000000000000000000000000000000000000000000"
+	" s_axis_tx_tkeep=00000000 s_axis_tx_tlast=0 s_axis_tx_tvalid=0"
+	" s_axis_tx_tuser=0000",
+	"UNTIL 1882000e-12"
+	" m_axis_rx_tdata=0000000111111000000000001111111101000000000000000000000000100000"
+	" m_axis_rx_tkeep=11111111 m_axis_rx_tlast=0 m_axis_rx_tvalid=1"
+	" s_axis_tx_tready=1 tx_buf_av=010000 user_clk=1 user_lnk_up=1"
+	" user_reset=0"
+      }
+};
+
+# define MICRO_MSGS (sizeof micro_msgs / sizeof micro_msgs[0])
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+
+/*
+ * Micro-benchmarks of the server message handling. This links the
+ * server objects and drives a bus of each protocol through socket
+ * pairs, with the messages in micro_msgs.h:
+ *
+ *    client_ready/<role>  read and process a READY from the client
+ *                         (client_state_t::read_from_socket, which
+ *                         calls process_client_ready_)
+ *    bus_ready/<protocol> one step of the bus, with all the clients
+ *                         ready: run the protocol and write an UNTIL
+ *                         to each client (protocol_t::bus_ready). The
+ *                         time includes reading the UNTILs back.
+ *
+ * Command line flags:
+ *
+ *    -t <seconds>
+ *       Run each benchmark for about this long. The default is 1.
+ *
+ *    -f <string>
+ *       Only run the benchmarks whose name contains the string.
+ */
+
+# include  "priv.h"
+# include  "client.h"
+# include  "protocol.h"
+# include  "micro_timer.h"
+# include  "micro_msgs.h"
+# include  <sys/socket.h>
+# include  <iostream>
+# include  <vector>
+# include  <stdlib.h>
+# include  <unistd.h>
+# include  <string.h>
+# include  <assert.h>
+
+using namespace std;
+
+/*
+ * A client of the benchmark bus. The server_fd is the end that the
+ * server reads, and the client_fd is the end that the benchmark
+ * writes the READY to and reads the UNTIL from.
+ */
+struct micro_client_s {
+      const struct micro_msg_s*msg;
+      int server_fd;
+      int client_fd;
+      string ready;
+};
+
+struct micro_bus_s {
+      bus_state*bus;
+      vector<micro_client_s> clients;
+};
+
+static void read_line(int fd)
+{
+      char buf[8192];
+      size_t fill = 0;
+      while (fill == 0 || buf[fill-1] != '\n') {
+	    ssize_t rc = read(fd, buf+fill, sizeof buf - fill);
+	    assert(rc > 0);
+	    fill += rc;
+      }
+}
+
+static void send_ready(micro_client_s&cli)
+{
+      ssize_t rc = write(cli.client_fd, cli.ready.data(), cli.ready.size());
+      assert(rc == (ssize_t)cli.ready.size());
+      client_state_t::client_map[cli.server_fd].read_from_socket(cli.server_fd);
+}
+
+/*
+ * Make a bus of the protocol with a host and a device, from a config
+ * file like the bench.sh script makes, and connect the clients.
+ */
+static void make_bus(micro_bus_s&mbus, const char*protocol)
+{
+      const struct micro_msg_s*host = 0;
+      const struct micro_msg_s*dev = 0;
+      for (size_t idx = 0 ; idx < MICRO_MSGS ; idx += 1) {
+	    if (strcmp(micro_msgs[idx].protocol, protocol) != 0)
+		  continue;
+	    if (micro_msgs[idx].host_flag)
+		  host = micro_msgs + idx;
+	    else
+		  dev = micro_msgs + idx;
+      }
+      assert(host && dev);
+
+      bool pci = strcmp(protocol, "pci") == 0;
+
+      FILE*cfg = tmpfile();
+      assert(cfg);
+      fprintf(cfg, "bus {\n");
+      fprintf(cfg, "  protocol = \"%s\";\n", protocol);
+      fprintf(cfg, "  name = \"%s\";\n", protocol);
+      fprintf(cfg, "  pipe = \"micro-%s\";\n", protocol);
+      if (! pci) {
+	    fprintf(cfg, "  CLOCK_high = 5000;\n");
+	    fprintf(cfg, "  CLOCK_low  = 5000;\n");
+	    fprintf(cfg, "  CLOCK_hold = 1000;\n");
+	    fprintf(cfg, "  CLOCK_setup = 1000;\n");
+      }
+      fprintf(cfg, "  host %d \"%s\";\n", pci? 15 : 0, host->role);
+      fprintf(cfg, "  device %d \"%s\";\n", pci? 0 : 1, dev->role);
+      fprintf(cfg, "}\n");
+      rewind(cfg);
+      int rc = config_file(cfg);
+      assert(rc == 0);
+      fclose(cfg);
+
+      string key = string("pipe:micro-") + protocol;
+      mbus.bus = bus_map[key];
+      assert(mbus.bus);
+
+      const struct micro_msg_s*msgs[2] = { host, dev };
+      for (int idx = 0 ; idx < 2 ; idx += 1) {
+	    int fds[2];
+	    rc = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+	    assert(rc == 0);
+
+	    micro_client_s cli;
+	    cli.msg = msgs[idx];
+	    cli.server_fd = fds[0];
+	    cli.client_fd = fds[1];
+	    cli.ready = string(msgs[idx]->ready) + "\n";
+
+	    client_state_t::client_map[cli.server_fd].set_bus(key);
+
+	    string hello = string("HELLO ") + msgs[idx]->role + msgs[idx]->hello + "\n";
+	    rc = write(cli.client_fd, hello.data(), hello.size());
+	    assert(rc == (int)hello.size());
+	    client_state_t::client_map[cli.server_fd].read_from_socket(cli.server_fd);
+	    read_line(cli.client_fd);
+
+	    mbus.clients.push_back(cli);
+      }
+
+      mbus.bus->assembly_complete();
+
+	// Send the first READY from each client, so that the bus has
+	// all the signals from the clients.
+      for (size_t idx = 0 ; idx < mbus.clients.size() ; idx += 1)
+	    send_ready(mbus.clients[idx]);
+}
+
+static void bench_client_ready(void*arg, unsigned long count)
+{
+      micro_client_s*cli = (micro_client_s*)arg;
+
+      while (count-- > 0)
+	    send_ready(*cli);
+}
+
+static void bench_bus_ready(void*arg, unsigned long count)
+{
+      micro_bus_s*mbus = (micro_bus_s*)arg;
+      bus_device_map_t&devs = mbus->bus->device_map;
+
+      while (count-- > 0) {
+	    for (bus_device_map_t::iterator dev = devs.begin()
+		       ; dev != devs.end() ; dev ++)
+		  dev->second->ready_flag = true;
+
+	    mbus->bus->proto->bus_ready();
+
+	    for (size_t idx = 0 ; idx < mbus->clients.size() ; idx += 1)
+		  read_line(mbus->clients[idx].client_fd);
+      }
+}
+
+int main(int argc, char*argv[])
+{
+      int arg;
+      while ( (arg = getopt(argc, argv, "f:t:")) != -1 ) {
+
+	    switch (arg) {
+
+		case 'f': /* -f <string> */
+		  micro_filter = optarg;
+		  break;
+
+		case 't': /* -t <seconds> */
+		  micro_seconds = strtod(optarg, 0);
+		  break;
+
+		default:
+		  return -1;
+	    }
+      }
+
+      static const char*protocols[3] = { "pci", "AXI4", "pcie-tlp" };
+      micro_bus_s mbus[3];
+
+	// The server is chatty while the busses are set up, so send
+	// that to nowhere.
+      streambuf*cout_buf = cout.rdbuf(0);
+      streambuf*cerr_buf = cerr.rdbuf(0);
+      for (int idx = 0 ; idx < 3 ; idx += 1)
+	    make_bus(mbus[idx], protocols[idx]);
+      cout.rdbuf(cout_buf);
+      cerr.rdbuf(cerr_buf);
+      cout.clear();
+      cerr.clear();
+
+      char name[64];
+      for (int idx = 0 ; idx < 3 ; idx += 1) {
+	    for (size_t cdx = 0 ; cdx < mbus[idx].clients.size() ; cdx += 1) {
+		  micro_client_s&cli = mbus[idx].clients[cdx];
+		  snprintf(name, sizeof name, "client_ready/%s", cli.msg->role);
+		  micro_run(name, bench_client_ready, &cli);
+	    }
+      }
+
+      for (int idx = 0 ; idx < 3 ; idx += 1) {
+	    snprintf(name, sizeof name, "bus_ready/%s", protocols[idx]);
+	    micro_run(name, bench_bus_ready, &mbus[idx]);
+      }
+
+      return 0;
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+
+/*
+ * Micro-benchmarks of the libsimbus message functions. Each
+ * benchmark runs one of the functions that a client calls for every
+ * bus step on the messages in micro_msgs.h:
+ *
+ *    ready_signal/<role>   __ready_signal for all the signals of a READY
+ *    until_signal/<role>   __until_signal for all the values of an UNTIL
+ *    parse_time_token      __parse_time_token of an UNTIL time
+ *    send_recv/<role>      __simbus_server_send_recv of a READY, with a
+ *                          thread on the other end of a socketpair
+ *                          that answers with the UNTIL
+ *    socketpair/<role>     write and read of the READY on a socketpair,
+ *                          for reference
+ *
+ * Command line flags:
+ *
+ *    -t <seconds>
+ *       Run each benchmark for about this long. The default is 1.
+ *
+ *    -f <string>
+ *       Only run the benchmarks whose name contains the string.
+ */
+
+# include  "simbus_priv.h"
+# include  "micro_timer.h"
+# include  "micro_msgs.h"
+# include  <sys/socket.h>
+# include  <pthread.h>
+# include  <stdlib.h>
+# include  <unistd.h>
+# include  <string.h>
+# include  <assert.h>
+
+# define MAX_SIGNALS 64
+
+/*
+ * A message split into its signals. The names and values point into
+ * the text, and the bits are the values decoded.
+ */
+struct micro_split_s {
+      char*text;
+      unsigned count;
+      const char*name[MAX_SIGNALS];
+      const char*value[MAX_SIGNALS];
+      size_t width[MAX_SIGNALS];
+      bus_bitval_t*bits[MAX_SIGNALS];
+};
+
+static void split_message(struct micro_split_s*msg, const char*line)
+{
+      msg->text = strdup(line);
+      msg->count = 0;
+
+	/* Skip the command and the time. */
+      char*cp = strchr(msg->text, ' ');
+      cp = strchr(cp+1, ' ');
+
+      while (cp) {
+	    *cp++ = 0;
+	    char*eq = strchr(cp, '=');
+	    assert(eq);
+	    *eq++ = 0;
+
+	    unsigned idx = msg->count++;
+	    assert(idx < MAX_SIGNALS);
+	    msg->name[idx] = cp;
+	    msg->value[idx] = eq;
+	    cp = strchr(eq, ' ');
+	    if (cp) *cp = 0;
+	    msg->width[idx] = strlen(eq);
+	    msg->bits[idx] = calloc(msg->width[idx] + 1, sizeof(bus_bitval_t));
+	    __until_signal(eq, msg->bits[idx], msg->width[idx]);
+	    if (cp) *cp = ' ';
+      }
+}
+
+static void bench_ready_signal(void*arg, unsigned long count)
+{
+      struct micro_split_s*msg = arg;
+      char buf[4096];
+
+      while (count-- > 0) {
+	    char*cp = buf;
+	    unsigned idx;
+	    for (idx = 0 ; idx < msg->count ; idx += 1)
+		  cp += __ready_signal(cp, msg->name[idx], msg->bits[idx], msg->width[idx]);
+      }
+}
+
+static void bench_until_signal(void*arg, unsigned long count)
+{
+      struct micro_split_s*msg = arg;
+
+      while (count-- > 0) {
+	    unsigned idx;
+	    for (idx = 0 ; idx < msg->count ; idx += 1)
+		  __until_signal(msg->value[idx], msg->bits[idx], msg->width[idx]);
+      }
+}
+
+static void bench_parse_time_token(void*arg, unsigned long count)
+{
+      static const char*tokens[4] = { "673000000e-15", "1882000e-12", "5e-9", "0e0" };
+      struct simbus_time_s time;
+
+      while (count-- > 0)
+	    __parse_time_token(tokens[count%4], &time);
+}
+
+/*
+ * The server end of the send_recv benchmark. Read each READY and
+ * answer with the UNTIL, until the socket is closed.
+ */
+struct micro_peer_s {
+      int fd;
+      const char*until;
+};
+
+static void* peer_thread(void*arg)
+{
+      struct micro_peer_s*peer = arg;
+      size_t until_len = strlen(peer->until);
+      char buf[4096];
+
+      for (;;) {
+	    size_t fill = 0;
+	    while (fill == 0 || buf[fill-1] != '\n') {
+		  ssize_t rc = read(peer->fd, buf+fill, sizeof buf - fill);
+		  if (rc <= 0)
+			return 0;
+		  fill += rc;
+	    }
+
+	    ssize_t rc = write(peer->fd, peer->until, until_len);
+	    assert(rc == (ssize_t)until_len);
+      }
+}
+
+struct micro_link_s {
+      int fd;
+	/* The other end, for the socketpair benchmark. */
+      int peer_fd;
+      char*ready;
+      size_t ready_len;
+};
+
+static void bench_send_recv(void*arg, unsigned long count)
+{
+      struct micro_link_s*link = arg;
+      char buf[4096];
+      char*argv[2048];
+
+      while (count-- > 0) {
+	    memcpy(buf, link->ready, link->ready_len+1);
+	    int argc = __simbus_server_send_recv(link->fd, buf, sizeof buf, 2048, argv, 0);
+	    assert(argc > 1);
+      }
+}
+
+static void bench_socketpair(void*arg, unsigned long count)
+{
+      struct micro_link_s*link = arg;
+      char buf[4096];
+
+      while (count-- > 0) {
+	    ssize_t rc = write(link->fd, link->ready, link->ready_len);
+	    assert(rc == (ssize_t)link->ready_len);
+	    size_t fill = 0;
+	    while (fill < link->ready_len) {
+		  rc = read(link->peer_fd, buf+fill, sizeof buf - fill);
+		  assert(rc > 0);
+		  fill += rc;
+	    }
+      }
+}
+
+static char* with_newline(const char*line)
+{
+      size_t len = strlen(line);
+      char*tmp = malloc(len + 2);
+      memcpy(tmp, line, len);
+      tmp[len+0] = '\n';
+      tmp[len+1] = 0;
+      return tmp;
+}
+
+int main(int argc, char*argv[])
+{
+      int arg;
+      while ( (arg = getopt(argc, argv, "f:t:")) != -1 ) {
+
+	    switch (arg) {
+
+		case 'f': /* -f <string> */
+		  micro_filter = optarg;
+		  break;
+
+		case 't': /* -t <seconds> */
+		  micro_seconds = strtod(optarg, 0);
+		  break;
+
+		default:
+		  return -1;
+	    }
+      }
+
+      char name[64];
+      unsigned idx;
+
+      for (idx = 0 ; idx < MICRO_MSGS ; idx += 1) {
+	    struct micro_split_s ready;
+	    split_message(&ready, micro_msgs[idx].ready);
+	    snprintf(name, sizeof name, "ready_signal/%s", micro_msgs[idx].role);
+	    micro_run(name, bench_ready_signal, &ready);
+      }
+
+      for (idx = 0 ; idx < MICRO_MSGS ; idx += 1) {
+	    struct micro_split_s until;
+	    split_message(&until, micro_msgs[idx].until);
+	    snprintf(name, sizeof name, "until_signal/%s", micro_msgs[idx].role);
+	    micro_run(name, bench_until_signal, &until);
+      }
+
+      micro_run("parse_time_token", bench_parse_time_token, 0);
+
+      for (idx = 0 ; idx < MICRO_MSGS ; idx += 1) {
+	    int fds[2];
+	    int rc = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+	    assert(rc == 0);
+
+	    struct micro_peer_s peer;
+	    peer.fd = fds[1];
+	    peer.until = with_newline(micro_msgs[idx].until);
+
+	    pthread_t thread;
+	    pthread_create(&thread, 0, peer_thread, &peer);
+
+	    struct micro_link_s link;
+	    link.fd = fds[0];
+	    link.peer_fd = -1;
+	    link.ready = with_newline(micro_msgs[idx].ready);
+	    link.ready_len = strlen(link.ready);
+
+	    snprintf(name, sizeof name, "send_recv/%s", micro_msgs[idx].role);
+	    micro_run(name, bench_send_recv, &link);
+
+	    shutdown(fds[0], SHUT_RDWR);
+	    pthread_join(thread, 0);
+	    close(fds[0]);
+	    close(fds[1]);
+      }
+
+      for (idx = 0 ; idx < MICRO_MSGS ; idx += 1) {
+	    int fds[2];
+	    int rc = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+	    assert(rc == 0);
+
+	    struct micro_link_s link;
+	    link.fd = fds[0];
+	    link.peer_fd = fds[1];
+	    link.ready = with_newline(micro_msgs[idx].ready);
+	    link.ready_len = strlen(link.ready);
+
+	    snprintf(name, sizeof name, "socketpair/%s", micro_msgs[idx].role);
+	    micro_run(name, bench_socketpair, &link);
+
+	    close(fds[0]);
+	    close(fds[1]);
+      }
+
+      return 0;
+}
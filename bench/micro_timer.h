@@ -0,0 +1,81 @@
+#ifndef __micro_timer_H
+#define __micro_timer_H
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+/*
+ * This is the timing loop for the micro-benchmarks. A benchmark is a
+ * function that runs its operation "count" times. The micro_run
+ * function finds a count that takes about 10ms, then runs the
+ * benchmark for micro_seconds in 5 trials and prints the fastest
+ * trial in ns per operation. The fastest trial is the one least
+ * disturbed by the rest of the system.
+ */
+# include  <stdio.h>
+# include  <stdint.h>
+# include  <string.h>
+# include  <time.h>
+
+typedef void (*micro_fun_t)(void*arg, unsigned long count);
+
+static double micro_seconds = 1.0;
+static const char*micro_filter = 0;
+
+static inline uint64_t micro_now_ns(void)
+{
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void micro_run(const char*name, micro_fun_t fun, void*arg)
+{
+      if (micro_filter && strstr(name, micro_filter) == 0)
+	    return;
+
+      unsigned long count = 1;
+      uint64_t elapsed;
+      for (;;) {
+	    uint64_t start = micro_now_ns();
+	    fun(arg, count);
+	    elapsed = micro_now_ns() - start;
+	    if (elapsed >= 10000000)
+		  break;
+	    count *= 2;
+      }
+
+      unsigned long trial_count = count * (micro_seconds / 5 / (elapsed / 1e9));
+      if (trial_count < 1)
+	    trial_count = 1;
+
+      double best = 0.0;
+      int trial;
+      for (trial = 0 ; trial < 5 ; trial += 1) {
+	    uint64_t start = micro_now_ns();
+	    fun(arg, trial_count);
+	    double ns = (double)(micro_now_ns() - start) / trial_count;
+	    if (trial == 0 || ns < best)
+		  best = ns;
+      }
+
+      printf("%-32s %12.1f ns/op\n", name, best);
+      fflush(stdout);
+}
+
+#endif
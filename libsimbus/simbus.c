@@ -188,14 +188,21 @@ int __simbus_server_hello(int server_fd, const char*name, unsigned*ident,
       return 0;
 }
 
-int __simbus_server_finish(int server_fd)
+int __simbus_server_finish(int server_fd, int status)
 {
+      char cmd[32];
       int rc;
 
-	/* Send the FINISH command */
-      rc = write(server_fd, "FINISH\n", 7);
+	/* Send the FINISH command, with the status if it is not 0. */
+      if (status == 0)
+	    snprintf(cmd, sizeof cmd, "FINISH\n");
+      else
+	    snprintf(cmd, sizeof cmd, "FINISH %d\n", status);
+
+      size_t len = strlen(cmd);
+      rc = write(server_fd, cmd, len);
       assert(rc >= 0);
-      assert(rc == 7);
+      assert((size_t)rc == len);
 
 	/* Now read the response, which should be a FINISH command */
       char buf[128];
@@ -259,30 +266,40 @@ int __simbus_server_send_recv(int server_fd, char*buf, size_t buf_size,
       return cur_argc;
 }
 
+static const uint64_t time_pow10[20] = {
+      1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+      10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+      100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+      100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+      100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
 void __parse_time_token(const char*token, struct simbus_time_s*timp)
 {
       char*cp;
-
-      if (sizeof(uint64_t) <= sizeof(unsigned long)) {
-	    timp->time_mant = strtoul(token, &cp, 10);
-      } else if (sizeof(uint64_t) <= sizeof(unsigned long long)) {
-	    timp->time_mant = strtoull(token, &cp, 10);
-      } else {
-	    timp->time_mant = strtoull(token, &cp, 10);
-#if defined(ULLONG_MAX)
-	    assert(timp->time_mant < ULLONG_MAX);
-#endif
-      }
+      uint64_t mant = strtoull(token, &cp, 10);
 
       assert(*cp == 'e');
       cp += 1;
-      timp->time_exp = strtol(cp, 0, 10);
+      int shift = strtol(cp, 0, 10) - SIMBUS_TIME_EXP;
+
+	/* The server sends femtoseconds, so this is normally just the
+	   mantissa. Other scales take a multiply or a rounded divide. */
+      if (shift >= 0) {
+	    assert(shift < 20);
+	    assert(mant <= UINT64_MAX / time_pow10[shift]);
+	    timp->time_fs = mant * time_pow10[shift];
+      } else {
+	    assert(shift > -20);
+	    uint64_t div = time_pow10[-shift];
+	    timp->time_fs = mant / div + (mant % div >= (div+1)/2);
+      }
 }
 
 double __time_as_double(const struct simbus_time_s*timp, int scale)
 {
-      double res = timp->time_mant;
-      return res * pow(10.0, timp->time_exp - scale);
+      double res = timp->time_fs;
+      return res * pow(10.0, SIMBUS_TIME_EXP - scale);
 }
 
 size_t __ready_signal(char*dst, const char*name, const bus_bitval_t*val, size_t nval)
@@ -125,7 +125,7 @@ int __axi4_ready_command(struct simbus_axi4_s*bus)
 {
       int idx;
       char buf[4096];
-      snprintf(buf, sizeof(buf), "READY %" PRIu64 "e%d", bus->bus_time.time_mant, bus->bus_time.time_exp);
+      snprintf(buf, sizeof(buf), "READY %" PRIu64 "e%d", bus->bus_time.time_fs, SIMBUS_TIME_EXP);
 
       char*cp = buf + strlen(buf);
 
@@ -414,6 +414,7 @@ simbus_axi4_t simbus_axi4_connect(const char*server, const char*name,
       bus->name = strdup(name);
       bus->fd = server_fd;
       bus->ident = ident;
+      bus->timeline = __simbus_timeline_track(name);
       bus->data_width = data_width;
       bus->addr_width = addr_width;
       bus->wid_width  = wid_width;
@@ -454,7 +455,7 @@ static uint32_t __axi4_test_interrupts(simbus_axi4_t bus, const uint32_t*irq_mas
       return rc;
 }
 
-int simbus_axi4_wait(simbus_axi4_t bus, unsigned clks, uint32_t*irq_mask)
+static int wait_clocks(simbus_axi4_t bus, unsigned clks, uint32_t*irq_mask)
 {
       uint32_t irq_test;
       if ( (irq_test = __axi4_test_interrupts(bus, irq_mask)) ) {
@@ -481,6 +482,16 @@ int simbus_axi4_wait(simbus_axi4_t bus, unsigned clks, uint32_t*irq_mask)
       return 0;
 }
 
+int simbus_axi4_wait(simbus_axi4_t bus, unsigned clks, uint32_t*irq_mask)
+{
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+      int rc = wait_clocks(bus, clks, irq_mask);
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_axi4_wait",
+			    &bus->bus_time, clks);
+      return rc;
+}
+
 void simbus_axi4_reset(simbus_axi4_t bus, unsigned width, unsigned settle)
 {
       assert(width > 0);
@@ -494,9 +505,14 @@ void simbus_axi4_reset(simbus_axi4_t bus, unsigned width, unsigned settle)
 }
 
 void simbus_axi4_end_simulation(simbus_axi4_t bus)
+{
+      simbus_axi4_end_simulation_status(bus, 0);
+}
+
+void simbus_axi4_end_simulation_status(simbus_axi4_t bus, int status)
 {
 	/* Send the FINISH command */
-      __simbus_server_finish(bus->fd);
+      __simbus_server_finish(bus->fd, status);
 	/* Clean up connection. */
       simbus_axi4_disconnect(bus);
 }
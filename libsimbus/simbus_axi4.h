@@ -121,8 +121,13 @@ EXTERN simbus_axi4_resp_t simbus_axi4_read8(simbus_axi4_t bus,
  * simbus_axi4_end_simulation function. Other devices should call the
  * simbus_axi4_disconnect function, which skips the end-of-simulation
  * message.
+ *
+ * The simbus_axi4_end_simulation_status function also sends a status
+ * to the server. A non-zero status tells the server that the test
+ * failed.
  */
 EXTERN void simbus_axi4_end_simulation(simbus_axi4_t bus);
+EXTERN void simbus_axi4_end_simulation_status(simbus_axi4_t bus, int status);
 
 #undef EXTERN
 #endif
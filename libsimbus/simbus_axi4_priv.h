@@ -81,6 +81,10 @@ struct simbus_axi4_s {
 	/* Current simulation time. */
       struct simbus_time_s bus_time;
 
+	/* Timeline track of this connection, or <0 if the timeline
+	   is off. */
+      int timeline;
+
 	/* Values that I writes to the server */
       bus_bitval_t areset_n;
 	/* .. write address channel */
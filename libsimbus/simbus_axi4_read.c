@@ -126,6 +126,9 @@ simbus_axi4_resp_t simbus_axi4_read64(simbus_axi4_t bus,
 	/* For now, assume address is aligned. */
       assert(addr%8 == 0);
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+
 	/* Drive the read address to the read address channel. */
       raddr_setup(bus, addr, 3, prot);
 
@@ -156,6 +159,8 @@ simbus_axi4_resp_t simbus_axi4_read64(simbus_axi4_t bus,
 	    }
       }
 
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_axi4_read64",
+			    &bus->bus_time, addr);
       return resp_code;
 }
 
@@ -172,6 +177,9 @@ simbus_axi4_resp_t simbus_axi4_read32(simbus_axi4_t bus,
 	/* For now, assume address is aligned. */
       assert(addr%4 == 0);
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+
 	/* Drive the read address to the read address channel. */
       raddr_setup(bus, addr, 2, prot);
 
@@ -202,6 +210,8 @@ simbus_axi4_resp_t simbus_axi4_read32(simbus_axi4_t bus,
 	    }
       }
 
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_axi4_read32",
+			    &bus->bus_time, addr);
       return resp_code;
 }
 
@@ -218,6 +228,9 @@ simbus_axi4_resp_t simbus_axi4_read16(simbus_axi4_t bus,
 	/* For now, assume address is aligned. */
       assert(addr%2 == 0);
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+
 	/* Drive the read address to the read address channel. */
       raddr_setup(bus, addr, 1, prot);
 
@@ -248,6 +261,8 @@ simbus_axi4_resp_t simbus_axi4_read16(simbus_axi4_t bus,
 	    }
       }
 
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_axi4_read16",
+			    &bus->bus_time, addr);
       return resp_code;
 }
 
@@ -262,6 +277,9 @@ simbus_axi4_resp_t simbus_axi4_read8(simbus_axi4_t bus,
 	/* Offset into the word of the target byte */
       int data_pref = addr % (bus->data_width / 8);
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+
 	/* Drive the read address to the read address channel. */
       raddr_setup(bus, addr, 0, prot);
 
@@ -292,5 +310,7 @@ simbus_axi4_resp_t simbus_axi4_read8(simbus_axi4_t bus,
 	    }
       }
 
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_axi4_read8",
+			    &bus->bus_time, addr);
       return resp_code;
 }
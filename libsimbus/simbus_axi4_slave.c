@@ -31,7 +31,7 @@ static int __axi4s_ready_command(simbus_axi4_t bus)
 {
       int idx;
       char buf[4096];
-      snprintf(buf, sizeof(buf), "READY %" PRIu64 "e%d", bus->bus_time.time_mant, bus->bus_time.time_exp);
+      snprintf(buf, sizeof(buf), "READY %" PRIu64 "e%d", bus->bus_time.time_fs, SIMBUS_TIME_EXP);
 
       char*cp = buf + strlen(buf);
 
@@ -505,9 +505,12 @@ int simbus_axi4_slave(simbus_axi4_t bus, const struct simbus_axi4s_slave_s*dev)
       bus->device = dev;
 
       for (;;) {
+	    int rc;
 	      /* Wait for the clock to fall... */
 	    while (bus->aclk != BIT_0) { /* ACLK==1/X/Z */
-		  __axi4s_ready_command(bus);
+		  rc = __axi4s_ready_command(bus);
+		  if (rc < 0)
+			return rc;
 	    }
 
 	    if (bus->areset_n == BIT_0)
@@ -515,7 +518,9 @@ int simbus_axi4_slave(simbus_axi4_t bus, const struct simbus_axi4s_slave_s*dev)
 
 	      /* and wait for it to go high again. */
 	    while (bus->aclk != BIT_1) { /* ACLK==0/X/Z */
-		  __axi4s_ready_command(bus);
+		  rc = __axi4s_ready_command(bus);
+		  if (rc < 0)
+			return rc;
 	    }
 
 	    if (bus->areset_n == BIT_0) {
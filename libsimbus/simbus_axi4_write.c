@@ -163,6 +163,9 @@ simbus_axi4_resp_t simbus_axi4_write64(simbus_axi4_t bus,
 
       int data_pref = addr % (bus->data_width/8);
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+
 	/* Drive the write address to the write address channel */
       waddr_setup(bus, addr, 3, prot);
       bus->awvalid = BIT_1;
@@ -188,7 +191,10 @@ simbus_axi4_resp_t simbus_axi4_write64(simbus_axi4_t bus,
       bus->bready = BIT_1;
 
 	/* Wait for the write transaction to complete. */
-      return wait_for_resp(bus);
+      simbus_axi4_resp_t resp_code = wait_for_resp(bus);
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_axi4_write64",
+			    &bus->bus_time, addr);
+      return resp_code;
 }
 
 
@@ -207,6 +213,9 @@ simbus_axi4_resp_t simbus_axi4_write32(simbus_axi4_t bus,
 
       int data_pref = addr % (bus->data_width/8);
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+
 	/* Drive the write address to the write address channel. */
       waddr_setup(bus, addr, 2, prot);
       bus->awvalid = BIT_1;
@@ -232,7 +241,10 @@ simbus_axi4_resp_t simbus_axi4_write32(simbus_axi4_t bus,
       bus->bready = BIT_1;
 
 	/* Wait for the write transaction to complete. */
-      return wait_for_resp(bus);
+      simbus_axi4_resp_t resp_code = wait_for_resp(bus);
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_axi4_write32",
+			    &bus->bus_time, addr);
+      return resp_code;
 }
 
 /*
@@ -255,6 +267,9 @@ simbus_axi4_resp_t simbus_axi4_write16(simbus_axi4_t bus,
 	/* Offset into the word of the target */
       int data_pref = addr % (bus->data_width/8);
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+
 	/* Setup the write address to the write address channel */
       waddr_setup(bus, addr, 1, prot);
       bus->awvalid = BIT_1;
@@ -280,7 +295,10 @@ simbus_axi4_resp_t simbus_axi4_write16(simbus_axi4_t bus,
       bus->bready = BIT_1;
 
 	/* Wait for the write transaction to complete */
-      return wait_for_resp(bus);
+      simbus_axi4_resp_t resp_code = wait_for_resp(bus);
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_axi4_write16",
+			    &bus->bus_time, addr);
+      return resp_code;
 }
 
 /*
@@ -298,6 +316,9 @@ simbus_axi4_resp_t simbus_axi4_write8(simbus_axi4_t bus,
 	/* Offset into the word of the target byte. */
       int data_pref = addr % (bus->data_width / 8);
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+
 	/* Setup the write address to the write address channel. */
       waddr_setup(bus, addr, 0, prot);
       bus->awvalid = BIT_1;
@@ -319,5 +340,8 @@ simbus_axi4_resp_t simbus_axi4_write8(simbus_axi4_t bus,
       bus->bready = BIT_1;
 
 	/* Wait for the write transaction to complete. */
-      return wait_for_resp(bus);
+      simbus_axi4_resp_t resp_code = wait_for_resp(bus);
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_axi4_write8",
+			    &bus->bus_time, addr);
+      return resp_code;
 }
@@ -1,5 +1,5 @@
-#ifndef __simbus_axi4_H
-#define __simbus_axi4_H
+#ifndef __simbus_axi4s_H
+#define __simbus_axi4s_H
 /*
  * Copyright (c) 2014 Stephen Williams (steve@icarus.com)
  *
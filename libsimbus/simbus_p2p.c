@@ -44,6 +44,7 @@ simbus_p2p_t simbus_p2p_connect(const char*server, const char*name,
       bus->name = strdup(name);
       bus->fd = server_fd;
       bus->ident = ident;
+      bus->timeline = __simbus_timeline_track(name);
 
       init_simbus_time(&bus->bus_time);
 
@@ -79,9 +80,14 @@ int simbus_p2p_is_host(simbus_p2p_t bus)
 }
 
 void simbus_p2p_end_simulation(simbus_p2p_t bus)
+{
+      simbus_p2p_end_simulation_status(bus, 0);
+}
+
+void simbus_p2p_end_simulation_status(simbus_p2p_t bus, int status)
 {
 	/* Send the FINISH command */
-      __simbus_server_finish(bus->fd);
+      __simbus_server_finish(bus->fd, status);
 	/* Clean up connection. */
       simbus_p2p_disconnect(bus);
 }
@@ -194,7 +200,7 @@ static int send_ready_p2p(simbus_p2p_t bus)
 {
       char buf[4096];
 
-      snprintf(buf, sizeof(buf), "READY %" PRIu64 "e%d", bus->bus_time.time_mant, bus->bus_time.time_exp);
+      snprintf(buf, sizeof(buf), "READY %" PRIu64 "e%d", bus->bus_time.time_fs, SIMBUS_TIME_EXP);
 
       char*cp = buf + strlen(buf);
 
@@ -300,6 +306,10 @@ static int send_ready_p2p(simbus_p2p_t bus)
 int simbus_p2p_clock_posedge(simbus_p2p_t bus, unsigned cycles)
 {
       int rc = 0;
+      unsigned count = cycles;
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+
       while (cycles > 0 && rc >= 0) {
 	      /* Look for low CLOCK */
 	    while (bus->clock != BIT_0 && rc >= 0)
@@ -312,12 +322,18 @@ int simbus_p2p_clock_posedge(simbus_p2p_t bus, unsigned cycles)
 	    cycles -= 1;
       }
 
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_p2p_clock_posedge",
+			    &bus->bus_time, count);
       return rc;
 }
 
 int simbus_p2p_clock_negedge(simbus_p2p_t bus, unsigned cycles)
 {
       int rc = 0;
+      unsigned count = cycles;
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+
       while (cycles > 0 && rc >= 0) {
 	      /* Look for high CLOCK */
 	    while (bus->clock != BIT_1 && rc >= 0)
@@ -330,5 +346,7 @@ int simbus_p2p_clock_negedge(simbus_p2p_t bus, unsigned cycles)
 	    cycles -= 1;
       }
 
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_p2p_clock_negedge",
+			    &bus->bus_time, count);
       return rc;
 }
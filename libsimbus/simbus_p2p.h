@@ -106,8 +106,13 @@ EXTERN int simbus_p2p_clock_negedge(simbus_p2p_t bus, unsigned cycles);
  * and close the bus object. Only HOST devices should call the
  * simbus_p2p_end_simulation function. Other devices should call the
  * simbus_p2p_disconnect function instead.
+ *
+ * The simbus_p2p_end_simulation_status function also sends a status
+ * to the server. A non-zero status tells the server that the test
+ * failed.
  */
 EXTERN void simbus_p2p_end_simulation(simbus_p2p_t bus);
+EXTERN void simbus_p2p_end_simulation_status(simbus_p2p_t bus, int status);
 EXTERN void simbus_p2p_disconnect(simbus_p2p_t bus);
 
 # undef EXTERN
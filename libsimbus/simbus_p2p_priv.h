@@ -33,6 +33,10 @@ struct simbus_p2p_s {
 	/* Current simulation time. */
       struct simbus_time_s bus_time;
 
+	/* Timeline track of this connection, or <0 if the timeline
+	   is off. */
+      int timeline;
+
       bus_bitval_t clock;
       bus_bitval_t clock_mode[2];
 
@@ -62,11 +62,14 @@ static void init_simbus_pci(struct simbus_pci_s*pci)
       pci->config_need32 = 0;
       pci->config_recv32 = 0;
 
-      for (idx = 0 ; idx < TARGET_MEM_REGIONS ; idx += 1) {
-	    memset(&pci->mem_target[idx], 0, sizeof(pci->mem_target[idx]));
-      }
+      pci->mem_target = 0;
+      pci->mem_target_count = 0;
+      memset(&pci->mem_decode, 0, sizeof pci->mem_decode);
+      memset(&pci->io_decode, 0, sizeof pci->io_decode);
 
       pci->target_state = TARG_IDLE;
+      pci->wait_clks = 0;
+      pci->idle_clks = 0;
 }
 
 void simbus_pci_config_need32(simbus_pci_t pci, need32_fun_t fun)
@@ -88,7 +91,7 @@ static int send_ready_command(struct simbus_pci_s*pci)
 {
       int rc;
       char buf[4096];
-      snprintf(buf, sizeof(buf), "READY %" PRIu64 "e%d", pci->bus_time.time_mant, pci->bus_time.time_exp);
+      snprintf(buf, sizeof(buf), "READY %" PRIu64 "e%d", pci->bus_time.time_fs, SIMBUS_TIME_EXP);
 
       char*cp = buf + strlen(buf);
 
@@ -146,6 +149,9 @@ static int send_ready_command(struct simbus_pci_s*pci)
       cp += strlen(cp);
       *cp++ = __bitval_to_char(pci->out_par64);
 
+      if (pci->wait_clks > 1)
+	    cp += sprintf(cp, " WAIT=%u", pci->wait_clks);
+
       if (pci->debug) {
 	    *cp = 0;
 	    fprintf(pci->debug, "SEND %s\n", buf);
@@ -267,6 +273,9 @@ static int send_ready_command(struct simbus_pci_s*pci)
 	    } else if (strcmp(argv[idx],"PAR64") == 0) {
 		  pci->pci_par64 = __char_to_bitval(*cp);
 
+	    } else if (strcmp(argv[idx],"IDLE") == 0) {
+		  pci->idle_clks = strtoul(cp, 0, 10);
+
 	    } else {
 		    /* Skip signals not of interest to me. */
 	    }
@@ -292,6 +301,7 @@ simbus_pci_t simbus_pci_connect(const char*server, const char*name)
       pci->name = strdup(name);
       pci->fd = server_fd;
       pci->ident = ident;
+      pci->timeline = __simbus_timeline_track(name);
 
       return pci;
 }
@@ -402,7 +412,7 @@ static uint64_t intr_active(simbus_pci_t pci)
       return mask;
 }
 
-int simbus_pci_wait(simbus_pci_t pci, unsigned clks, uint64_t*irq)
+static int wait_clocks(simbus_pci_t pci, unsigned clks, uint64_t*irq)
 {
 	/* Special case: if the clks is 0, then we are not really here
 	   to wait, but just to test if there are any interrupts
@@ -420,8 +430,22 @@ int simbus_pci_wait(simbus_pci_t pci, unsigned clks, uint64_t*irq)
       uint64_t mask = UINT64_C(0);
       uint64_t use_irq = irq? *irq : 0;
       while (clks > 0 && ! (mask & use_irq)) {
+	      /* Tell the server how long I am idle, so that it can
+	         skip clocks while the whole bus is idle. I am not idle
+	         if my target is busy or an enabled interrupt is on. */
+	    if (pci->target_state == TARG_IDLE && ! (intr_active(pci) & use_irq))
+		  pci->wait_clks = clks;
+
 	    while (pci->pci_clk != BIT_0 && rc >= 0)
 		  rc = send_ready_command(pci);
+	    pci->wait_clks = 0;
+
+	      /* If the server skipped idle clocks, count them. It
+	         stops before the posedge that ends the wait, so the
+	         clks is still >0. */
+	    assert(pci->idle_clks < clks);
+	    clks -= pci->idle_clks;
+	    pci->idle_clks = 0;
 
 	    while (pci->pci_clk != BIT_1 && rc >= 0)
 		  rc = send_ready_command(pci);
@@ -446,6 +470,16 @@ int simbus_pci_wait(simbus_pci_t pci, unsigned clks, uint64_t*irq)
       return mask == 0? 0 : 1;
 }
 
+int simbus_pci_wait(simbus_pci_t pci, unsigned clks, uint64_t*irq)
+{
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(pci->timeline, &mark, &pci->bus_time);
+      int rc = wait_clocks(pci, clks, irq);
+      __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_wait",
+			    &pci->bus_time, clks);
+      return rc;
+}
+
 int simbus_pci_wait_break(simbus_pci_t pci)
 {
       pci->break_flag = 1;
@@ -749,6 +783,147 @@ int __generic_pci_read32(simbus_pci_t pci, uint64_t addr, int cmd,
       return 0;
 }
 
+/*
+ * Get the byte enables for the data phase "phase" of a burst. If the
+ * burst is 64bit words but the target did not ACK64#, then each word
+ * takes 2 data phases and the word byte enables are split.
+ */
+static int burst_phase_ben(int phase, int words, int BEFn, int BELn,
+			   int flag64, int wide)
+{
+      int word = (flag64 && !wide)? phase/2 : phase;
+      int BEn;
+      if (word+1 == words)
+	    BEn = BELn;
+      else if (word == 0)
+	    BEn = BEFn;
+      else
+	    BEn = 0;
+
+      if (flag64 && !wide)
+	    BEn >>= 4 * (phase%2);
+      if (!wide)
+	    BEn &= 0x0f;
+
+      return BEn;
+}
+
+static void drive_c_be(simbus_pci_t pci, int BEn, int wide)
+{
+      int idx;
+      for (idx = 0 ; idx < 4 ; idx += 1)
+	    pci->out_c_be[idx] = (BEn & (1<<idx))? BIT_1 : BIT_0;
+      for (idx = 4 ; idx < 8 ; idx += 1) {
+	    if (wide)
+		  pci->out_c_be[idx] = (BEn & (1<<idx))? BIT_1 : BIT_0;
+	    else
+		  pci->out_c_be[idx] = BIT_Z;
+      }
+}
+
+int __generic_pci_read_burst(simbus_pci_t pci, uint64_t addr, int cmd,
+			     int flag64, int words, int BEFn, int BELn,
+			     uint32_t*val32, uint64_t*val64)
+{
+      int idx;
+      int rc = 0;
+
+      assert(words > 0);
+
+      __pci_request_bus(pci);
+
+      pci->out_req_n = BIT_1;
+
+	/* A single 32bit word is not a burst, so let FRAME# go with
+	   the first IRDY#. A 64bit word is a burst if the target does
+	   not ACK64#, and __wait_for_devsel takes care of FRAME# if
+	   it does. */
+      __address_command(pci, addr, cmd, BEFn, flag64, words>1 || flag64);
+
+      drive_c_be(pci, burst_phase_ben(0, words, BEFn, BELn, flag64, flag64), flag64);
+      for (idx = 0 ; idx < 64 ; idx += 1)
+	    pci->out_ad[idx] = BIT_Z;
+
+	/* Clock the IRDY and BE#s (and PAR), and un-drive the AD bits. */
+      __pci_next_posedge(pci);
+
+      if (__wait_for_devsel(pci) < 0) {
+	    __undrive_bus(pci);
+	    __pci_next_posedge(pci);
+	    return GPCI_MASTER_ABORT;
+      }
+
+	/* Now that DEVSEL# is here, we know if the target accepted a
+	   64bit transfer, and therefore how many data phases there
+	   are. Keep FRAME# (and REQ64#) active until the last one. */
+      int wide = flag64 && pci->pci_ack64_n == BIT_0;
+      int phases = (flag64 && !wide)? 2*words : words;
+      pci->out_frame_n = phases > 1? BIT_0 : BIT_1;
+      if (flag64)
+	    pci->out_req64_n = pci->out_frame_n;
+      if (flag64 && !wide)
+	    drive_c_be(pci, burst_phase_ben(0, words, BEFn, BELn, flag64, 0), 0);
+
+      int phase = 0;
+      while (phase < phases) {
+	    uint64_t val, valx;
+	    rc = __wait_for_read(pci, &val, &valx);
+	    if (rc < 0)
+		  break;
+
+	    if (val32) {
+		  val32[phase] = valx? 0xffffffff : val;
+	    } else if (wide) {
+		  val64[phase] = val;
+	    } else if (phase%2 == 0) {
+		  val64[phase/2] = val & UINT64_C(0xffffffff);
+	    } else {
+		  val64[phase/2] |= val << 32;
+	    }
+
+	    phase += 1;
+	    if (phase == phases)
+		  break;
+
+	      /* STOP# with TRDY# means the target disconnected after
+		 taking this data phase. */
+	    if (pci->pci_stop_n == BIT_0)
+		  break;
+
+	      /* Stage the next data phase. If it is the last, then
+		 withdraw the FRAME#. */
+	    drive_c_be(pci, burst_phase_ben(phase, words, BEFn, BELn, flag64, wide), wide);
+	    if (phase+1 == phases) {
+		  pci->out_frame_n = BIT_1;
+		  if (flag64) pci->out_req64_n = BIT_1;
+	    }
+	    __pci_next_posedge(pci);
+      }
+
+	/* If the target stopped the burst while I still had FRAME#
+	   active, then complete the transaction by withdrawing
+	   FRAME# and IRDY#. */
+      if (phase < phases) {
+	    pci->out_frame_n = BIT_1;
+	    pci->out_irdy_n  = BIT_1;
+	    if (flag64) pci->out_req64_n = BIT_1;
+	    __pci_next_posedge(pci);
+      }
+
+	/* Release all the signals I've been driving. */
+      __undrive_bus(pci);
+      __pci_next_posedge(pci);
+
+	/* Only whole words count. If a 64bit word was split and the
+	   target disconnected in the middle, the caller must read
+	   that word again. */
+      int count = (flag64 && !wide)? phase/2 : phase;
+      if (count == 0 && rc < 0)
+	    return rc;
+
+      return count;
+}
+
 void __setup_for_write(simbus_pci_t pci, uint64_t val, int BEn, int flag64)
 {
       pci->out_c_be[0] = BEn&1 ? BIT_1 : BIT_0;
@@ -833,9 +1008,14 @@ int __generic_pci_write32(simbus_pci_t pci, uint64_t addr, int cmd,
 }
 
 void simbus_pci_end_simulation(simbus_pci_t pci)
+{
+      simbus_pci_end_simulation_status(pci, 0);
+}
+
+void simbus_pci_end_simulation_status(simbus_pci_t pci, int status)
 {
 	/* Send the FINISH command */
-      __simbus_server_finish(pci->fd);
+      __simbus_server_finish(pci->fd, status);
 	/* Clean up connection. */
       simbus_pci_disconnect(pci);
 }
@@ -843,6 +1023,9 @@ void simbus_pci_end_simulation(simbus_pci_t pci)
 void simbus_pci_disconnect(simbus_pci_t pci)
 {
       close(pci->fd);
+      free(pci->mem_target);
+      free(pci->mem_decode.win);
+      free(pci->io_decode.win);
       free(pci->name);
       free(pci);
 }
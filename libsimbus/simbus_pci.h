@@ -169,15 +169,39 @@ EXTERN int simbus_pci_write64b(simbus_pci_t bus, uint64_t addr,
  * The read32_xz and read64_xz variant is similar, but returns
  * information about X/Z bits that were found. The valx bit mask is
  * set true for every bit that is X or Z.
+ *
+ * The read32b and read64b functions read words in a burst, using the
+ * Memory Read Line or Memory Read Multiple command. The "words"
+ * argument is the number of words to read into the val array, and
+ * the BEFn and BELn are the byte enables for the first and last
+ * words, as with the write32b/write64b functions. If the target
+ * retries or disconnects, the burst is resumed at the next word, so
+ * the return value is the number of words read, or SIMBUS_PCI_ERROR
+ * if the target does not respond at all.
  */
 EXTERN uint32_t simbus_pci_read32(simbus_pci_t bus, uint64_t addr, int BEn);
 EXTERN uint64_t simbus_pci_read64(simbus_pci_t bus, uint64_t addr, int BEn);
 
+EXTERN int simbus_pci_read32b(simbus_pci_t bus, uint64_t addr,
+			      uint32_t*val, int words,
+			      int BEFn, int BELn);
+EXTERN int simbus_pci_read64b(simbus_pci_t bus, uint64_t addr,
+			      uint64_t*val, int words,
+			      int BEFn, int BELn);
+
 EXTERN int simbus_pci_read32_xz(simbus_pci_t bus, uint64_t addr, int BEn,
 				uint32_t*val, uint32_t*valx);
 EXTERN int simbus_pci_read64_xz(simbus_pci_t bus, uint64_t addr, int BEn,
 				uint64_t*val, uint64_t*valx);
 
+/*
+ * Read/write 32bit values in I/O space. These are single word
+ * transactions using the I/O Read and I/O Write commands. The
+ * io_read32 function returns 0xffffffff if there is no response.
+ */
+EXTERN uint32_t simbus_pci_io_read32(simbus_pci_t bus, uint64_t addr, int BEn);
+EXTERN void simbus_pci_io_write32(simbus_pci_t bus, uint64_t addr, uint32_t val, int BEn);
+
 /*
  * Set handlers for target cycles. These handlers are invoked when
  * the device represented by the simbus_pci_t object is a target to a
@@ -192,24 +216,53 @@ typedef void (*recv32_fun_t) (simbus_pci_t bus, uint64_t addr, uint32_t val, int
 typedef uint64_t (*need64_fun_t) (simbus_pci_t bus, uint64_t addr, int BEn);
 typedef void (*recv64_fun_t) (simbus_pci_t bus, uint64_t addr, uint64_t val, int BEn);
 
+/*
+ * The burst handlers move a whole run of 32bit words at once. The
+ * needb_fun_t function fills the val array with "words" words
+ * starting at addr. Reads through a burst handler are prefetched, so
+ * the library may ask for more words then the master actually
+ * reads. The recvb_fun_t function receives "words" words that were
+ * written starting at addr. The BEFn and BELn are the byte enables
+ * for the first and last word. Intermediate words have all bytes
+ * enabled.
+ */
+typedef void (*needb_fun_t) (simbus_pci_t bus, uint64_t addr, uint32_t*val, size_t words);
+typedef void (*recvb_fun_t) (simbus_pci_t bus, uint64_t addr, const uint32_t*val,
+			     size_t words, int BEFn, int BELn);
+
 EXTERN void simbus_pci_config_need32(simbus_pci_t bus, need32_fun_t fun);
 EXTERN void simbus_pci_config_recv32(simbus_pci_t bus, recv32_fun_t fun);
 
 /*
  * Memory regions are claimed by the target device by calling the
  * simbus_pci_mem_xlate function with the region number and a pointer
- * to the translation descriptor. The target API supports up to 8
- * translation regions, each with their own base address and mask. An
- * address matches the region if (addr&mask) == (base&mask).
+ * to the translation descriptor. The region number is any small
+ * integer, and there is no fixed limit to the number of regions,
+ * each with their own base address and mask. An address matches the
+ * region if (addr&mask) == (base&mask). If the SIMBUS_XLATE_IO flag
+ * is set, then the region is in I/O space and is matched by I/O
+ * Read/Write commands instead of memory commands.
+ *
+ * Regions may be replaced at any time, including from within a
+ * handler. A transaction that is already in progress continues to
+ * use the region as it was when the transaction started.
+ *
+ * The need64/recv64 handlers are used for 64bit data phases if they
+ * are present, otherwise 64bit data phases are split into two calls
+ * to the need32/recv32 handlers. If the SIMBUS_XLATE_BURST flag is
+ * set, then the needb/recvb handlers are used in place of all the
+ * others.
  */
 struct simbus_translation {
       int flags;
       uint64_t base;
       uint64_t mask;
       need32_fun_t need32;
-      need64_fun_t reserved1;
+      need64_fun_t need64;
       recv32_fun_t recv32;
-      recv64_fun_t reserved2;
+      recv64_fun_t recv64;
+      needb_fun_t needb;
+      recvb_fun_t recvb;
 };
 
   /* Enable 64bit bus data cycles. (64bit addresses are always supported.) */
@@ -220,6 +273,10 @@ struct simbus_translation {
 # define SIMBUS_XLATE_RANDOM_RETRY_WRITE 0x0004
   /* Enable random target retries */
 # define SIMBUS_XLATE_RANDOM_RETRY_READ 0x0008
+  /* Use the needb/recvb burst handlers. */
+# define SIMBUS_XLATE_BURST 0x0010
+  /* The region is in I/O space. */
+# define SIMBUS_XLATE_IO 0x0020
 
 EXTERN void simbus_pci_mem_xlate(simbus_pci_t bus, unsigned idx,
 				 const struct simbus_translation*drv);
@@ -229,8 +286,13 @@ EXTERN void simbus_pci_mem_xlate(simbus_pci_t bus, unsigned idx,
  * and close the bus object. Only HOST devices should call the
  * pci_end_simulation function. Other devices should call the
  * simbus_pci_disconnect function instead.
+ *
+ * The simbus_pci_end_simulation_status function also sends a status
+ * to the server. A non-zero status tells the server that the test
+ * failed.
  */
 EXTERN void simbus_pci_end_simulation(simbus_pci_t bus);
+EXTERN void simbus_pci_end_simulation_status(simbus_pci_t bus, int status);
 EXTERN void simbus_pci_disconnect(simbus_pci_t bus);
 
 #undef EXTERN
@@ -40,7 +40,11 @@ uint32_t simbus_pci_config_read(simbus_pci_t pci, uint8_t dfn, uint16_t dw_addr)
       uint64_t addr = make_type0_addr(dfn, dw_addr);
 
       uint32_t val = 0xffffffff, valx = 0;
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(pci->timeline, &mark, &pci->bus_time);
       int rc = __generic_pci_read32(pci, addr, 0xfa, 0xf0, &val, &valx);
+      __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_config_read",
+			    &pci->bus_time, addr);
       if (rc < 0) {
 	    fprintf(stderr, "simbus_pci_config_read: "
 		    "No response to addr=0x%" PRIx64 ", rc=%d\n", addr, rc);
@@ -56,7 +60,11 @@ void simbus_pci_config_write(simbus_pci_t pci, uint8_t dfn, uint16_t dw_addr, ui
       int rc;
       uint64_t addr = make_type0_addr(dfn, dw_addr);
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(pci->timeline, &mark, &pci->bus_time);
       rc = __generic_pci_write32(pci, addr, 0xfb, val, BEn);
+      __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_config_write",
+			    &pci->bus_time, addr);
       if (rc < 0) {
 	    fprintf(stderr, "simbus_pci_config_write: "
 		    "No response to addr=0x%" PRIx64 "\n", addr);
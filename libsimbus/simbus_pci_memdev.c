@@ -27,6 +27,8 @@
 # define COMPARE_CMD 0x0001
 # define LOAD_CMD    0x0002
 # define SAVE_CMD    0x0003
+# define SNAPSHOT_CMD 0x0004
+# define RESTORE_CMD 0x0005
 
 struct simbus_pci_memdev_s {
       simbus_pci_t bus;
@@ -181,3 +183,15 @@ int simbus_pci_memdev_save(simbus_pci_memdev_t xsp,
       rc = m1readl(xsp, 0);
       return rc;
 }
+
+int simbus_pci_memdev_snapshot(simbus_pci_memdev_t xsp)
+{
+      m1writel(xsp, 0, SNAPSHOT_CMD);
+      return (int)m1readl(xsp, 0);
+}
+
+int simbus_pci_memdev_restore(simbus_pci_memdev_t xsp)
+{
+      m1writel(xsp, 0, RESTORE_CMD);
+      return (int)m1readl(xsp, 0);
+}
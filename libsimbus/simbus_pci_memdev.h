@@ -91,4 +91,16 @@ EXTERN int simbus_pci_memdev_save(simbus_pci_memdev_t xsp,
 				  uint64_t offset, unsigned count,
 				  const char*path);
 
+/*
+ * The snapshot command marks the current contents of the memory as
+ * the state that a later restore returns to. The restore is cheap,
+ * it only costs in proportion to the memory written since the
+ * snapshot, so it is a quick way to reset a large memory between
+ * tests. Both return 0 on success, or <0 for an error, such as a
+ * restore without a snapshot.
+ */
+EXTERN int simbus_pci_memdev_snapshot(simbus_pci_memdev_t xsp);
+
+EXTERN int simbus_pci_memdev_restore(simbus_pci_memdev_t xsp);
+
 #endif
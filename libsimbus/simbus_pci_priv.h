@@ -23,7 +23,30 @@
 # include  "mt_priv.h"
 # include  <stdlib.h>
 
-# define TARGET_MEM_REGIONS 8
+/*
+ * A decode window is the address range [lo, hi] claimed by the
+ * target region mem_target[idx]. The decode tables keep the windows
+ * of all the memory (or I/O) regions sorted by address so that a
+ * region can be found with a binary search. If any regions overlap,
+ * or a region mask does not describe a contiguous window, then the
+ * table is marked linear and the regions are scanned in order.
+ */
+struct simbus_pci_window_s {
+      uint64_t lo, hi;
+      unsigned idx;
+};
+
+struct simbus_pci_decode_s {
+      struct simbus_pci_window_s*win;
+      unsigned count;
+      int linear;
+};
+
+/*
+ * Maximum number of 32bit words that a target burst handler is asked
+ * to prefetch or receive at once.
+ */
+# define TARGET_BURST_WORDS 64
 
 struct simbus_pci_s {
 	/* The name given in the simbus_pci_connect function. This is
@@ -45,6 +68,10 @@ struct simbus_pci_s {
 	/* Current simulation time. */
       struct simbus_time_s bus_time;
 
+	/* Timeline track of this connection, or <0 if the timeline
+	   is off. */
+      int timeline;
+
 	/* Values that I write to the server */
       bus_bitval_t out_reset_n;
       bus_bitval_t out_req_n;
@@ -84,14 +111,27 @@ struct simbus_pci_s {
       need32_fun_t config_need32;
       recv32_fun_t config_recv32;
 
-	/* Description of target memory regions */
-      struct simbus_translation mem_target[TARGET_MEM_REGIONS];
+	/* Description of target memory and I/O regions, indexed by
+	   the region number given to simbus_pci_mem_xlate. The table
+	   grows as needed. */
+      struct simbus_translation*mem_target;
+      unsigned mem_target_count;
+
+	/* Decode tables built from the mem_target regions. */
+      struct simbus_pci_decode_s mem_decode;
+      struct simbus_pci_decode_s io_decode;
 
 	/* Low bits of a 64bit DAC cycle */
       uint64_t dac_addr_lo;
 
       int break_flag;
 
+	/* While in simbus_pci_wait, the clocks that are left to wait
+	   for, sent to the server in a WAIT token. The server may then
+	   skip idle clocks, and say how many in an IDLE token. */
+      unsigned wait_clks;
+      unsigned idle_clks;
+
       enum target_machine_e {
 	    TARG_IDLE = 0,
 	    TARG_DAC,
@@ -159,6 +199,36 @@ extern int __generic_pci_read32(simbus_pci_t pci, uint64_t addr, int cmd,
 # define GPCI_MASTER_ABORT (-1)
 # define GPCI_TARGET_RETRY (-2)
 
+/*
+ * The __generic_pci_read_burst function performs a single burst read
+ * transaction of up to "words" words. If flag64 is set, then the
+ * words are 64bits and REQ64# is asserted, and the results go into
+ * val64. Otherwise, the words are 32bits and the results go into
+ * val32. The BEFn and BELn are the byte enables for the first and
+ * last words, as for the write32b/write64b functions.
+ *
+ * The transaction ends when the count is met or the target
+ * disconnects. The return value is the number of complete words
+ * read (which may be less then the words count) or a GPCI error code
+ * if no words at all were read.
+ */
+extern int __generic_pci_read_burst(simbus_pci_t pci, uint64_t addr, int cmd,
+				    int flag64, int words, int BEFn, int BELn,
+				    uint32_t*val32, uint64_t*val64);
+
+/*
+ * Bursts that fit in a single cache line use Memory Read Line, and
+ * longer bursts use Memory Read Multiple.
+ */
+# define PCI_CACHE_LINE_BYTES 64
+static inline int __pci_burst_read_command(uint64_t addr, size_t bytes)
+{
+      if (addr%PCI_CACHE_LINE_BYTES + bytes > PCI_CACHE_LINE_BYTES)
+	    return 0x0c;
+      else
+	    return 0x0e;
+}
+
 extern int __generic_pci_write32(simbus_pci_t pci, uint64_t addr, int cmd,
 				 uint32_t val, int BEn);
 
@@ -25,6 +25,9 @@
 int simbus_pci_read32_xz(simbus_pci_t pci, uint64_t addr, int BEn,
 			 uint32_t*val, uint32_t*valx)
 {
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(pci->timeline, &mark, &pci->bus_time);
+
       *val  = 0xffffffff;
       *valx = 0xffffffff;
       int retry = 1;
@@ -45,10 +48,14 @@ int simbus_pci_read32_xz(simbus_pci_t pci, uint64_t addr, int BEn,
 	    if (rc < 0) {
 		  fprintf(stderr, "simbus_pci_read32: "
 			  "No response from addr=0x%" PRIx64 ", rc=%d\n", addr, rc);
+		  __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_read32",
+					&pci->bus_time, addr);
 		  return SIMBUS_PCI_ERROR;
 	    }
       }
 
+      __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_read32",
+			    &pci->bus_time, addr);
       return 0;
 }
 
@@ -60,11 +67,76 @@ uint32_t simbus_pci_read32(simbus_pci_t pci, uint64_t addr, int BEn)
       return val;
 }
 
+int simbus_pci_read32b(simbus_pci_t pci, uint64_t addr,
+		       uint32_t*val, int words,
+		       int BEFn, int BELn)
+{
+      assert(words > 0);
+      assert(words > 1 || BEFn==BELn);
+
+	/* Special case: If there is exactly 1 word to transfer, then
+	   use the single-word cycle. */
+      if (words == 1) {
+	    val[0] = simbus_pci_read32(pci, addr, BEFn);
+	    return 1;
+      }
+
+	/* PCI-X bursts are sized by the byte count in the attribute
+	   phase, which the master code does not generate, so read
+	   the words one at a time. */
+      if (pcix_mode(pci)) {
+	    int idx;
+	    for (idx = 0 ; idx < words ; idx += 1) {
+		  int use_BEn = 0;
+		  if (idx == 0) use_BEn = BEFn;
+		  else if (idx+1 == words) use_BEn = BELn;
+		  val[idx] = simbus_pci_read32(pci, addr + 4*idx, use_BEn);
+	    }
+	    return words;
+      }
+
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(pci->timeline, &mark, &pci->bus_time);
+
+      int count = 0;
+      while (count < words) {
+	    uint64_t use_addr = addr + 4*count;
+	    int remain = words - count;
+	    int cmd = __pci_burst_read_command(use_addr, 4*remain);
+	    int rc = __generic_pci_read_burst(pci, use_addr, cmd, 0, remain,
+					      count==0? BEFn : 0, BELn,
+					      val+count, 0);
+
+	      /* On a retry or a disconnect, resume the burst where
+		 the target left off. */
+	    if (rc == GPCI_TARGET_RETRY)
+		  continue;
+
+	    if (rc < 0) {
+		  fprintf(stderr, "simbus_pci_read32b: "
+			  "No response from addr=0x%" PRIx64 ", rc=%d\n", use_addr, rc);
+		  __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_read32b",
+					&pci->bus_time, addr);
+		  return count>0? count : SIMBUS_PCI_ERROR;
+	    }
+
+	    count += rc;
+      }
+
+      __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_read32b",
+			    &pci->bus_time, addr);
+      return count;
+}
+
 void simbus_pci_write32(simbus_pci_t pci, uint64_t addr, uint32_t val, int BEn)
 {
       int rc;
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(pci->timeline, &mark, &pci->bus_time);
       rc = __generic_pci_write32(pci, addr, 0xf7, val, BEn);
+      __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_write32",
+			    &pci->bus_time, addr);
       if (rc < 0) {
 	    fprintf(stderr, "simbus_pci_write32: "
 		    "No response to addr=0x%" PRIx64 "\n", addr);
@@ -86,6 +158,9 @@ int simbus_pci_write32b(simbus_pci_t pci, uint64_t addr,
 	    return 1;
       }
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(pci->timeline, &mark, &pci->bus_time);
+
       __pci_request_bus(pci);
       pci->out_req_n = BIT_1;
 
@@ -95,8 +170,11 @@ int simbus_pci_write32b(simbus_pci_t pci, uint64_t addr,
 
 	/* The first word involves waiting for the devsel. */
       int rc;
-      if ( (rc = __wait_for_devsel(pci)) < 0)
+      if ( (rc = __wait_for_devsel(pci)) < 0) {
+	    __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_write32b",
+				  &pci->bus_time, addr);
 	    return rc;
+      }
 
       while (pci->pci_trdy_n != BIT_0)
 	    __pci_next_posedge(pci);
@@ -133,5 +211,46 @@ int simbus_pci_write32b(simbus_pci_t pci, uint64_t addr,
       __undrive_bus(pci);
       __pci_next_posedge(pci);
 
+      __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_write32b",
+			    &pci->bus_time, addr);
       return words - remain;
 }
+
+uint32_t simbus_pci_io_read32(simbus_pci_t pci, uint64_t addr, int BEn)
+{
+      uint32_t val = 0xffffffff, valx = 0;
+      int rc;
+
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(pci->timeline, &mark, &pci->bus_time);
+      do {
+	    rc = __generic_pci_read32(pci, addr, 0x02, BEn, &val, &valx);
+      } while (rc == GPCI_TARGET_RETRY);
+      __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_io_read32",
+			    &pci->bus_time, addr);
+
+      if (rc < 0) {
+	    fprintf(stderr, "simbus_pci_io_read32: "
+		    "No response from addr=0x%" PRIx64 ", rc=%d\n", addr, rc);
+	    return 0xffffffff;
+      }
+
+      if (valx) val = 0xffffffff;
+      return val;
+}
+
+void simbus_pci_io_write32(simbus_pci_t pci, uint64_t addr, uint32_t val, int BEn)
+{
+      int rc;
+
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(pci->timeline, &mark, &pci->bus_time);
+      rc = __generic_pci_write32(pci, addr, 0x03, val, BEn);
+      __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_io_write32",
+			    &pci->bus_time, addr);
+      if (rc < 0) {
+	    fprintf(stderr, "simbus_pci_io_write32: "
+		    "No response to addr=0x%" PRIx64 "\n", addr);
+	    return ;
+      }
+}
@@ -31,6 +31,9 @@ uint64_t simbus_pci_read64(simbus_pci_t pci, uint64_t addr, int BEn)
       int idx;
       int rc;
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(pci->timeline, &mark, &pci->bus_time);
+
       while (retry) {
 	    __pci_request_bus(pci);
 
@@ -54,6 +57,8 @@ uint64_t simbus_pci_read64(simbus_pci_t pci, uint64_t addr, int BEn)
 
 	    if (__wait_for_devsel(pci) < 0) {
 		    /* Master abort */
+		  __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_read64",
+					&pci->bus_time, addr);
 		  return UINT64_C(0xffffffffffff);
 	    }
 
@@ -94,13 +99,79 @@ uint64_t simbus_pci_read64(simbus_pci_t pci, uint64_t addr, int BEn)
       __undrive_bus(pci);
       __pci_next_posedge(pci);
 
+      __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_read64",
+			    &pci->bus_time, addr);
       return val;
 }
 
+int simbus_pci_read64b(simbus_pci_t pci, uint64_t addr,
+		       uint64_t*val, int words,
+		       int BEFn, int BELn)
+{
+      assert(words > 0);
+      assert(words > 1 || BEFn==BELn);
+
+	/* Special case: If there is exactly 1 word to transfer, then
+	   use the single-word cycle. */
+      if (words == 1) {
+	    val[0] = simbus_pci_read64(pci, addr, BEFn);
+	    return 1;
+      }
+
+	/* PCI-X bursts are sized by the byte count in the attribute
+	   phase, which the master code does not generate, so read
+	   the words one at a time. */
+      if (pcix_mode(pci)) {
+	    int idx;
+	    for (idx = 0 ; idx < words ; idx += 1) {
+		  int use_BEn = 0;
+		  if (idx == 0) use_BEn = BEFn;
+		  else if (idx+1 == words) use_BEn = BELn;
+		  val[idx] = simbus_pci_read64(pci, addr + 8*idx, use_BEn);
+	    }
+	    return words;
+      }
+
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(pci->timeline, &mark, &pci->bus_time);
+
+      int count = 0;
+      while (count < words) {
+	    uint64_t use_addr = addr + 8*count;
+	    int remain = words - count;
+	    int cmd = __pci_burst_read_command(use_addr, 8*remain);
+	    int rc = __generic_pci_read_burst(pci, use_addr, cmd, 1, remain,
+					      count==0? BEFn : 0, BELn,
+					      0, val+count);
+
+	      /* On a retry or a disconnect, resume the burst where
+		 the target left off. */
+	    if (rc == GPCI_TARGET_RETRY)
+		  continue;
+
+	    if (rc < 0) {
+		  fprintf(stderr, "simbus_pci_read64b: "
+			  "No response from addr=0x%" PRIx64 ", rc=%d\n", use_addr, rc);
+		  __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_read64b",
+					&pci->bus_time, addr);
+		  return count>0? count : SIMBUS_PCI_ERROR;
+	    }
+
+	    count += rc;
+      }
+
+      __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_read64b",
+			    &pci->bus_time, addr);
+      return count;
+}
+
 void simbus_pci_write64(simbus_pci_t pci, uint64_t addr, uint64_t val, int BEn)
 {
       int rc;
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(pci->timeline, &mark, &pci->bus_time);
+
       __pci_request_bus(pci);
 
       pci->out_req_n = BIT_1;
@@ -109,8 +180,11 @@ void simbus_pci_write64(simbus_pci_t pci, uint64_t addr, uint64_t val, int BEn)
 
       __setup_for_write(pci, val, BEn, 1);
 
-      if ( (rc = __wait_for_devsel(pci)) < 0)
+      if ( (rc = __wait_for_devsel(pci)) < 0) {
+	    __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_write64",
+				  &pci->bus_time, addr);
 	    return;
+      }
 
 	/* Wait for the target to TRDY# in order to clock the data out. */
       while (pci->pci_trdy_n != BIT_0) {
@@ -125,6 +199,8 @@ void simbus_pci_write64(simbus_pci_t pci, uint64_t addr, uint64_t val, int BEn)
 	      /* Release the bus and settle. */
 	    __undrive_bus(pci);
 	    __pci_next_posedge(pci);
+	    __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_write64",
+				  &pci->bus_time, addr);
 	    return;
       }
 
@@ -142,6 +218,8 @@ void simbus_pci_write64(simbus_pci_t pci, uint64_t addr, uint64_t val, int BEn)
 	/* Release the bus and settle. */
       __undrive_bus(pci);
       __pci_next_posedge(pci);
+      __simbus_timeline_end(pci->timeline, &mark, "simbus_pci_write64",
+			    &pci->bus_time, addr);
 }
 
 int simbus_pci_write64b(simbus_pci_t pci, uint64_t addr,
@@ -152,7 +230,7 @@ int simbus_pci_write64b(simbus_pci_t pci, uint64_t addr,
       assert(words > 1 || BEFn==BELn);
 
       int idx;
-      for (idx = 0 ; idx < words ; idx += 1, addr += 4) {
+      for (idx = 0 ; idx < words ; idx += 1, addr += 8) {
 	    int use_BEn = 0;
 	    if (idx == 0) use_BEn = BEFn;
 	    else if (idx+1 == words) use_BEn = BELn;
@@ -149,21 +149,109 @@ static int get_c_be(simbus_pci_t pci, int bytes)
       return rc;
 }
 
-static const struct simbus_translation*match_mem_target(simbus_pci_t pci)
+static int region_is_io(const struct simbus_translation*cur)
+{
+      return (cur->flags & SIMBUS_XLATE_IO) != 0;
+}
+
+/*
+ * Find the region that claims the address of the current address
+ * phase. Search the I/O or memory regions, depending on the command,
+ * and copy the matching region into the caller's buffer. The copy
+ * is what the transaction uses, so that if a handler replaces the
+ * region in the middle of the transaction, the transaction is not
+ * disturbed.
+ */
+static const struct simbus_translation*match_target(simbus_pci_t pci, int io,
+						    struct simbus_translation*buf)
 {
-      int idx;
       uint64_t addr = get_addr(pci);
+      const struct simbus_pci_decode_s*dec = io? &pci->io_decode : &pci->mem_decode;
+      const struct simbus_translation*hit = 0;
+
+      if (dec->linear) {
+	    unsigned idx;
+	    for (idx = 0 ; idx < pci->mem_target_count ; idx += 1) {
+		  const struct simbus_translation*cur = pci->mem_target+idx;
+		  if (cur->mask == 0)
+			continue;
+		  if (region_is_io(cur) != io)
+			continue;
+		  if ((cur->mask & cur->base) == (cur->mask & addr)) {
+			hit = cur;
+			break;
+		  }
+	    }
+
+      } else {
+	      /* Binary search for the last window with lo <= addr. */
+	    unsigned lo = 0, hi = dec->count;
+	    while (lo < hi) {
+		  unsigned mid = lo + (hi-lo)/2;
+		  if (dec->win[mid].lo <= addr)
+			lo = mid + 1;
+		  else
+			hi = mid;
+	    }
+	    if (lo > 0 && addr <= dec->win[lo-1].hi)
+		  hit = pci->mem_target + dec->win[lo-1].idx;
+      }
+
+      if (hit == 0)
+	    return 0;
 
-      for (idx = 0 ; idx < TARGET_MEM_REGIONS ; idx += 1) {
+      *buf = *hit;
+      return buf;
+}
+
+static int compare_windows(const void*a, const void*b)
+{
+      const struct simbus_pci_window_s*wa = a;
+      const struct simbus_pci_window_s*wb = b;
+      if (wa->lo < wb->lo) return -1;
+      if (wa->lo > wb->lo) return  1;
+      return 0;
+}
+
+/*
+ * Rebuild the decode table for the memory or I/O regions. This is
+ * called whenever a region changes, which is rare compared to the
+ * address phases that use the table.
+ */
+static void rebuild_decode(simbus_pci_t pci, int io)
+{
+      struct simbus_pci_decode_s*dec = io? &pci->io_decode : &pci->mem_decode;
+      unsigned idx;
+
+      dec->win = realloc(dec->win, pci->mem_target_count * sizeof(dec->win[0]));
+      dec->count = 0;
+      dec->linear = 0;
+
+      for (idx = 0 ; idx < pci->mem_target_count ; idx += 1) {
 	    const struct simbus_translation*cur = pci->mem_target+idx;
 	    if (cur->mask == 0)
 		  continue;
+	    if (region_is_io(cur) != io)
+		  continue;
+
+	      /* The mask describes a contiguous window only if the
+		 bits it leaves out are all at the bottom. */
+	    uint64_t span = ~cur->mask;
+	    if (span & (span+1))
+		  dec->linear = 1;
 
-	    if ((cur->mask & cur->base) == (cur->mask & addr))
-		  return cur;
+	    dec->win[dec->count].lo = cur->base & cur->mask;
+	    dec->win[dec->count].hi = (cur->base & cur->mask) | span;
+	    dec->win[dec->count].idx = idx;
+	    dec->count += 1;
       }
 
-      return 0;
+      qsort(dec->win, dec->count, sizeof(dec->win[0]), compare_windows);
+
+      for (idx = 1 ; idx < dec->count ; idx += 1) {
+	    if (dec->win[idx].lo <= dec->win[idx-1].hi)
+		  dec->linear = 1;
+      }
 }
 
 /*
@@ -267,6 +355,147 @@ static void do_target_config_write(simbus_pci_t pci)
       pci->target_state = TARG_IDLE;
 }
 
+/*
+ * Reads from a BAR with a burst handler are served from this
+ * prefetch buffer, which holds "count" words starting at "addr". The
+ * command of the transaction determines how far ahead to fetch. If
+ * the end of the transaction is known (PCI-X byte counts) then "end"
+ * is the address after the last byte, otherwise it is 0.
+ */
+struct target_prefetch_s {
+      int command;
+      uint64_t end;
+      uint64_t addr;
+      size_t count;
+      uint32_t val[TARGET_BURST_WORDS];
+};
+
+static void init_target_prefetch(struct target_prefetch_s*pf, int command, uint64_t end)
+{
+      pf->command = command;
+      pf->end = end;
+      pf->addr = 0;
+      pf->count = 0;
+}
+
+static size_t prefetch_count(const struct simbus_translation*bar,
+			     const struct target_prefetch_s*pf, uint64_t addr)
+{
+      size_t words;
+
+      if (pf->end > addr) {
+	    words = (pf->end - addr + 3) / 4;
+      } else switch (pf->command) {
+	  case 0x0c: /* Memory Read Multiple */
+	    words = TARGET_BURST_WORDS;
+	    break;
+	  case 0x0e: /* Memory Read Line */
+	    words = (PCI_CACHE_LINE_BYTES - addr%PCI_CACHE_LINE_BYTES) / 4;
+	    break;
+	  case 0x02: /* I/O Read; never prefetch. */
+	    words = 1;
+	    break;
+	  default:   /* Memory Read; fetch a single 64bit data phase. */
+	    words = 2 - (addr%8)/4;
+	    break;
+      }
+
+      if (words > TARGET_BURST_WORDS)
+	    words = TARGET_BURST_WORDS;
+
+	/* Do not prefetch past the end of the BAR window. */
+      uint64_t last = addr | ~bar->mask;
+      if (words > (last - addr)/4 + 1)
+	    words = (last - addr)/4 + 1;
+
+      if (words == 0)
+	    words = 1;
+
+      return words;
+}
+
+/*
+ * Get a 32bit word from the target, either through the prefetch
+ * buffer of a burst handler or from the need32 handler.
+ */
+static uint32_t target_need32(simbus_pci_t pci, const struct simbus_translation*bar,
+			      struct target_prefetch_s*pf, uint64_t addr, int BEn)
+{
+      addr &= ~(uint64_t)3;
+
+      if (bar->flags & SIMBUS_XLATE_BURST) {
+	    if (bar->needb == 0)
+		  return 0xffffffff;
+
+	    if (addr < pf->addr || addr >= pf->addr + 4*pf->count) {
+		  pf->addr = addr;
+		  pf->count = prefetch_count(bar, pf, addr);
+		  bar->needb(pci, addr, pf->val, pf->count);
+	    }
+
+	    return pf->val[(addr - pf->addr) / 4];
+      }
+
+      if (bar->need32)
+	    return bar->need32(pci, addr, BEn);
+
+      return 0xffffffff;
+}
+
+/*
+ * Writes to a BAR with a burst handler are collected into this
+ * buffer and delivered when the run of words ends. A word extends
+ * the run only if it follows on, and if the current last word can
+ * become an intermediate word with all bytes enabled.
+ */
+struct target_wbuf_s {
+      uint64_t addr;
+      size_t count;
+      int BEFn, BELn;
+      uint32_t val[TARGET_BURST_WORDS];
+};
+
+static void target_flush_words(simbus_pci_t pci, const struct simbus_translation*bar,
+			       struct target_wbuf_s*wb)
+{
+      if (wb->count == 0)
+	    return;
+
+      bar->recvb(pci, wb->addr, wb->val, wb->count, wb->BEFn, wb->BELn);
+      wb->count = 0;
+}
+
+static void target_recv32(simbus_pci_t pci, const struct simbus_translation*bar,
+			  struct target_wbuf_s*wb, uint64_t addr, uint32_t val, int BEn)
+{
+      addr &= ~(uint64_t)3;
+
+      if ((bar->flags & SIMBUS_XLATE_BURST) == 0) {
+	    if (bar->recv32)
+		  bar->recv32(pci, addr, val, BEn);
+	    return;
+      }
+
+      if (bar->recvb == 0)
+	    return;
+
+      if (wb->count > 0) {
+	    int joins = addr == wb->addr + 4*wb->count
+		  && wb->count < TARGET_BURST_WORDS
+		  && (wb->count == 1 || wb->BELn == 0);
+	    if (!joins)
+		  target_flush_words(pci, bar, wb);
+      }
+
+      if (wb->count == 0) {
+	    wb->addr = addr;
+	    wb->BEFn = BEn;
+      }
+
+      wb->val[wb->count++] = val;
+      wb->BELn = BEn;
+}
+
 static void do_target_memory_read_split(simbus_pci_t pci, const struct simbus_translation*bar, uint64_t addr, uint32_t attr, int byte_count)
 {
       int idx;
@@ -392,13 +621,15 @@ static void do_target_memory_read_split(simbus_pci_t pci, const struct simbus_tr
       int word_count = (addr%word_size + byte_count + word_size-1) / word_size;
       int words_counted = 0;
       uint64_t use_addr = addr & ~(word_size-1);
+
+      struct target_prefetch_s pf;
+      init_target_prefetch(&pf, 0, addr + byte_count);
+
       while (word_count > 0) {
 	    uint32_t val;
 	    pci->out_irdy_n = BIT_0;
 
-	    if (bar->need32) {
-		  val = bar->need32(pci, use_addr, 0);
-	    }
+	    val = target_need32(pci, bar, &pf, use_addr, 0);
 
 	    for (idx = 0 ; idx < 32 ; idx += 1) {
 		  pci->out_ad[idx] = (val&1)? BIT_1 : BIT_0;
@@ -429,7 +660,8 @@ static void do_target_memory_read_split(simbus_pci_t pci, const struct simbus_tr
       __pci_next_posedge(pci);
 }
 
-static void do_target_memory_read(simbus_pci_t pci, const struct simbus_translation*bar)
+static void do_target_memory_read(simbus_pci_t pci, const struct simbus_translation*bar,
+				  int command)
 {
       int idx;
       uint64_t addr = get_addr(pci);
@@ -439,6 +671,7 @@ static void do_target_memory_read(simbus_pci_t pci, const struct simbus_translat
       int word_count = 0;
       int burst_len = 0;
       int word_size = 4;
+      struct target_prefetch_s pf;
 
       if (choose_to_retry_r(pci, bar)) {
 	    do_target_memory_rw_retry(pci, bar);
@@ -472,6 +705,16 @@ static void do_target_memory_read(simbus_pci_t pci, const struct simbus_translat
 		  word_size = 4;
 		  word_count = (addr%4 + byte_count + 3) / 4;
 	    }
+
+	    init_target_prefetch(&pf, command, addr + byte_count);
+
+      } else {
+	      /* Conventional PCI: Accept a 64bit transfer if the
+		 master requests it and it starts on a 64bit word. */
+	    if (pci64_mode(pci, bar) && addr%8 == 0)
+		  word_size = 8;
+
+	    init_target_prefetch(&pf, command, 0);
       }
 
 	/* Emit DEVSEL# but drive TRDY# high to insert a turnaround
@@ -487,12 +730,20 @@ static void do_target_memory_read(simbus_pci_t pci, const struct simbus_translat
       do {
 	      /* The C/BE# contains byte enables only if this is NOT
 		 PCI-X mode. */
-	    int BEnL = pcix_mode(pci) ? 0 : get_c_be(pci, 4);
-	    int BEnH = 0;
-	    if (bar->need32) {
-		  valL = bar->need32(pci, addr&~3, BEnL);
-		  if (word_size==8)
-			valH = bar->need32(pci, (addr+4)&~3, BEnH);
+	    int BEn = pcix_mode(pci) ? 0 : get_c_be(pci, word_size);
+
+	    if (word_size==8 && bar->need64
+		&& (bar->flags & SIMBUS_XLATE_BURST) == 0) {
+		  uint64_t val = bar->need64(pci, addr&~7, BEn);
+		  valL = val & 0xffffffff;
+		  valH = val >> 32;
+
+	    } else if (word_size==8) {
+		  valL = target_need32(pci, bar, &pf, (addr&~7)+0, (BEn>>0)&15);
+		  valH = target_need32(pci, bar, &pf, (addr&~7)+4, (BEn>>4)&15);
+
+	    } else {
+		  valL = target_need32(pci, bar, &pf, addr, BEn);
 	    }
 
 	      /* Drive TRDY# and the AD. */
@@ -740,16 +991,25 @@ static void do_target_memory_write(simbus_pci_t pci, const struct simbus_transla
 		  val -= 1;
 	    }
 
+      } else if (pci64_mode(pci, bar) && addr%8 == 0) {
+	      /* Conventional PCI: Accept a 64bit transfer if the
+		 master requests it and it starts on a 64bit word. */
+	    word_size = 8;
+
       } else {
 	    word_size = 4;
       }
 
+      struct target_wbuf_s wb;
+      wb.count = 0;
 
-	/* Emit DEVSEL# and TRDY# */
+	/* Emit DEVSEL# and TRDY#. If this is a 64bit transfer, then
+	   hold off TRDY# for a clock so that the master sees the
+	   ACK64# before the first data phase completes. */
       pci->out_devsel_n = BIT_0;
       pci->out_ack64_n = word_size==8? BIT_0 : BIT_1;
       pci->out_stop_n = BIT_1;
-      if (pcix_mode(pci)) __pci_next_posedge(pci);
+      if (pcix_mode(pci) || word_size==8) __pci_next_posedge(pci);
       pci->out_trdy_n = BIT_0;
 
       do {
@@ -758,29 +1018,31 @@ static void do_target_memory_write(simbus_pci_t pci, const struct simbus_transla
 		  __pci_next_posedge(pci);
 	    } while (pci->pci_irdy_n == BIT_1);
 
-	    if (bar->recv32) {
-		  int pcix_ben;
-		  if (burst_len == 0)
-			pcix_ben = first_ben;
-		  else if (burst_len+1 == word_count)
-			pcix_ben = last_ben;
-		  else
-			pcix_ben = 0;
-		  int BEn = pcix_mode(pci)? pcix_ben : get_c_be(pci, word_size);
-		  if (word_size==4) {
-			uint32_t val = get_addr32(pci);
-			bar->recv32(pci, addr&~3, val, BEn);
-		  } else {
-			assert(word_size==8);
-			uint64_t val = get_data64(pci);
-			uint32_t val1 = val & 0xffffffff;
-			val >>= 32;
-			uint32_t val2 = val & 0xffffffff;
-			int BEn1 = (BEn>>0)&15;
-			int BEn2 = (BEn>>4)&15;
-			bar->recv32(pci, (addr&~7)+0, val1, BEn1);
-			bar->recv32(pci, (addr&~7)+4, val2, BEn2);
-		  }
+	    int pcix_ben;
+	    if (burst_len == 0)
+		  pcix_ben = first_ben;
+	    else if (burst_len+1 == word_count)
+		  pcix_ben = last_ben;
+	    else
+		  pcix_ben = 0;
+	    int BEn = pcix_mode(pci)? pcix_ben : get_c_be(pci, word_size);
+	    if (word_size==4) {
+		  uint32_t val = get_addr32(pci);
+		  target_recv32(pci, bar, &wb, addr, val, BEn);
+
+	    } else if (bar->recv64 && (bar->flags & SIMBUS_XLATE_BURST) == 0) {
+		  bar->recv64(pci, addr&~7, get_data64(pci), BEn);
+
+	    } else {
+		  assert(word_size==8);
+		  uint64_t val = get_data64(pci);
+		  uint32_t val1 = val & 0xffffffff;
+		  val >>= 32;
+		  uint32_t val2 = val & 0xffffffff;
+		  int BEn1 = (BEn>>0)&15;
+		  int BEn2 = (BEn>>4)&15;
+		  target_recv32(pci, bar, &wb, (addr&~7)+0, val1, BEn1);
+		  target_recv32(pci, bar, &wb, (addr&~7)+4, val2, BEn2);
 	    }
 
 	    addr += word_size;
@@ -808,6 +1070,10 @@ static void do_target_memory_write(simbus_pci_t pci, const struct simbus_transla
 	    fprintf(stderr, "simbus_pci ERROR: Expected to write %d words, but wrote %d.\n", word_count, burst_len);
       }
 
+	/* Deliver the remains of a collected burst. */
+      if (wb.count > 0)
+	    target_flush_words(pci, bar, &wb);
+
 	/* Release the bus and settle. */
       pci->out_devsel_n = BIT_Z;
       pci->out_ack64_n = BIT_Z;
@@ -822,12 +1088,12 @@ static void do_target_memory_write(simbus_pci_t pci, const struct simbus_transla
 
 static void do_target_memory_read_multiple(simbus_pci_t pci, const struct simbus_translation*bar)
 {
-      do_target_memory_read(pci, bar);
+      do_target_memory_read(pci, bar, 0x0c);
 }
 
 static void do_target_memory_read_line(simbus_pci_t pci, const struct simbus_translation*bar)
 {
-      do_target_memory_read(pci, bar);
+      do_target_memory_read(pci, bar, 0x0e);
 }
 
 /*
@@ -842,18 +1108,27 @@ void __pci_target_state_machine(simbus_pci_t pci)
 	    if (pci->pci_frame_n == BIT_0) {
 		  int command = get_command(pci);
 		  int idsel = get_idsel(pci);
-		  const struct simbus_translation*bar = match_mem_target(pci);
+		  struct simbus_translation bar_buf;
+		  const struct simbus_translation*bar = match_target(pci, command==0x02 || command==0x03, &bar_buf);
 #if 0
 		  printf("XXXX __pci_target_state_machine: "
 			 "TARG_IDLE: Got command=%x, idsel=%d, bar=0x%016" PRIx64 "\n",
 			 command, idsel, bar? bar->base : 0);
 #endif
 		  if (bar && command == 0x06) {
-			do_target_memory_read(pci, bar);
+			do_target_memory_read(pci, bar, command);
 
 		  } else if (bar && command == 0x07) {
 			do_target_memory_write(pci, bar);
 
+		  } else if (bar && command == 0x02) {
+			  /* I/O Read */
+			do_target_memory_read(pci, bar, command);
+
+		  } else if (bar && command == 0x03) {
+			  /* I/O Write */
+			do_target_memory_write(pci, bar);
+
 		  } else if (idsel && command == 0x0a) {
 			do_target_config_read(pci);
 
@@ -887,14 +1162,15 @@ void __pci_target_state_machine(simbus_pci_t pci)
 		 DAC cycle, so do a reduced check. */
 	    if (pci->pci_frame_n == BIT_0) {
 		  int command = get_command(pci);
-		  const struct simbus_translation*bar = match_mem_target(pci);
+		  struct simbus_translation bar_buf;
+		  const struct simbus_translation*bar = match_target(pci, 0, &bar_buf);
 #if 0
 		  printf("XXXX __pci_target_state_machine: "
 			 "TARG_DAC: Got command=%x, bar=0x%016" PRIx64 "\n",
 			 command, bar? bar->base : 0);
 #endif
 		  if (bar && command == 0x06) {
-			do_target_memory_read(pci, bar);
+			do_target_memory_read(pci, bar, command);
 
 		  } else if (bar && command == 0x07) {
 			do_target_memory_write(pci, bar);
@@ -937,14 +1213,37 @@ void simbus_pci_mem_xlate(simbus_pci_t pci, unsigned idx,
 {
       struct simbus_translation*cur;
 
-      if (idx >= TARGET_MEM_REGIONS)
-	    return;
+      if (idx >= pci->mem_target_count) {
+	    if (drv == 0)
+		  return;
+
+	    unsigned count = pci->mem_target_count? pci->mem_target_count : 8;
+	    while (count <= idx)
+		  count *= 2;
+
+	    pci->mem_target = realloc(pci->mem_target, count * sizeof(pci->mem_target[0]));
+	    assert(pci->mem_target);
+	    memset(pci->mem_target + pci->mem_target_count, 0,
+		   (count - pci->mem_target_count) * sizeof(pci->mem_target[0]));
+	    pci->mem_target_count = count;
+      }
 
       cur = &pci->mem_target[idx];
+      int was_io = cur->mask != 0 && region_is_io(cur);
+      int was_mem = cur->mask != 0 && !region_is_io(cur);
+
       if (drv == 0) {
 	    memset(cur, 0, sizeof(*cur));
-	    return;
+      } else {
+	    memcpy(cur, drv, sizeof(*cur));
       }
 
-      memcpy(cur, drv, sizeof(*cur));
+	/* Only rebuild the decode tables that are affected. */
+      int is_io = cur->mask != 0 && region_is_io(cur);
+      int is_mem = cur->mask != 0 && !region_is_io(cur);
+
+      if (was_io || is_io || pci->io_decode.win == 0)
+	    rebuild_decode(pci, 1);
+      if (was_mem || is_mem || pci->mem_decode.win == 0)
+	    rebuild_decode(pci, 0);
 }
@@ -84,6 +84,7 @@ simbus_pcie_tlp_t simbus_pcie_tlp_connect(const char*server, const char*name)
       bus->name = strdup(name);
       bus->fd = server_fd;
       bus->ident = ident;
+      bus->timeline = __simbus_timeline_track(name);
 
       bus->s_tlp_cnt = 0;
       bus->tlp_next_tag = 0;
@@ -112,9 +113,14 @@ void simbus_pcie_tlp_disconnect(simbus_pcie_tlp_t bus)
 }
 
 void simbus_pcie_tlp_end_simulation(simbus_pcie_tlp_t bus)
+{
+      simbus_pcie_tlp_end_simulation_status(bus, 0);
+}
+
+void simbus_pcie_tlp_end_simulation_status(simbus_pcie_tlp_t bus, int status)
 {
 	/* Send the FINISH command */
-      __simbus_server_finish(bus->fd);
+      __simbus_server_finish(bus->fd, status);
 	/* Clean up connection. */
       simbus_pcie_tlp_disconnect(bus);
 }
@@ -128,7 +134,7 @@ static int send_ready_command(simbus_pcie_tlp_t bus)
 {
       int rc;
       char buf[4096];
-      snprintf(buf, sizeof(buf), "READY %" PRIu64 "e%d", bus->bus_time.time_mant, bus->bus_time.time_exp);
+      snprintf(buf, sizeof(buf), "READY %" PRIu64 "e%d", bus->bus_time.time_fs, SIMBUS_TIME_EXP);
 
       char*cp = buf + strlen(buf);
 
@@ -230,7 +236,7 @@ void __pcie_tlp_next_posedge(simbus_pcie_tlp_t bus)
       __pcie_tlp_recv_tlp(bus);
 }
 
-int simbus_pcie_tlp_wait(simbus_pcie_tlp_t bus, unsigned clks, int*irq_mask)
+static int wait_clocks(simbus_pcie_tlp_t bus, unsigned clks, int*irq_mask)
 {
       int return_mask = 0;
       int enable_mask = irq_mask? *irq_mask : 0;
@@ -251,6 +257,16 @@ int simbus_pcie_tlp_wait(simbus_pcie_tlp_t bus, unsigned clks, int*irq_mask)
       return clks;
 }
 
+int simbus_pcie_tlp_wait(simbus_pcie_tlp_t bus, unsigned clks, int*irq_mask)
+{
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+      int rc = wait_clocks(bus, clks, irq_mask);
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_pcie_tlp_wait",
+			    &bus->bus_time, clks);
+      return rc;
+}
+
 uint8_t __pcie_tlp_choose_tag(simbus_pcie_tlp_t bus)
 {
       uint8_t res = bus->tlp_next_tag;
@@ -161,7 +161,12 @@ EXTERN void simbus_pcie_tlp_read_handle(simbus_pcie_tlp_t bus,
  * Send an end-of-simulation message to the simulator, then dosconnect
  * and close the bus object. Only HOST devices should call the
  * simbus_pcie_tlp_end_simulation function.
+ *
+ * The simbus_pcie_tlp_end_simulation_status function also sends a
+ * status to the server. A non-zero status tells the server that the
+ * test failed.
  */
 EXTERN void simbus_pcie_tlp_end_simulation(simbus_pcie_tlp_t bus);
+EXTERN void simbus_pcie_tlp_end_simulation_status(simbus_pcie_tlp_t bus, int status);
 
 #endif
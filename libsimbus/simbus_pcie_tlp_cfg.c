@@ -59,12 +59,16 @@ void simbus_pcie_tlp_cfg_write32(simbus_pcie_tlp_t bus,
 
       bus->tlp_next_tag = (bus->tlp_next_tag + 1) % 32;
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
       __pcie_tlp_send_tlp(bus, tlp, 4);
 
 	/* Wait for the completion to come back. */
       while (bus->completions[use_tag] == 0) {
 	    __pcie_tlp_next_posedge(bus);
       }
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_pcie_tlp_cfg_write32",
+			    &bus->bus_time, (bus_devfn << 16) | addr);
 
       if (bus->debug) {
 	    fprintf(bus->debug, "Write32 completion:\n");
@@ -89,11 +93,15 @@ void simbus_pcie_tlp_cfg_write16(simbus_pcie_tlp_t bus,
 
       bus->tlp_next_tag = (bus->tlp_next_tag + 1) % 32;
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
       __pcie_tlp_send_tlp(bus, tlp, 4);
 
       while (bus->completions[use_tag] == 0) {
 	    __pcie_tlp_next_posedge(bus);
       }
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_pcie_tlp_cfg_write16",
+			    &bus->bus_time, (bus_devfn << 16) | addr);
 
       free(bus->completions[use_tag]);
       bus->completions[use_tag] = 0;
@@ -115,11 +123,15 @@ void simbus_pcie_tlp_cfg_write8(simbus_pcie_tlp_t bus,
 
       bus->tlp_next_tag = (bus->tlp_next_tag + 1) % 32;
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
       __pcie_tlp_send_tlp(bus, tlp, 4);
 
       while (bus->completions[use_tag] == 0) {
 	    __pcie_tlp_next_posedge(bus);
       }
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_pcie_tlp_cfg_write8",
+			    &bus->bus_time, (bus_devfn << 16) | addr);
 
       free(bus->completions[use_tag]);
       bus->completions[use_tag] = 0;
@@ -151,11 +163,15 @@ void simbus_pcie_tlp_cfg_read32(simbus_pcie_tlp_t bus,
       tlp[1] = 0x00000000 | (use_tag << 8) | 0xf | (bus->request_id << 16);
       tlp[2] = (bus_devfn << 16) | (addr & 0x0ffc);
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
       __pcie_tlp_send_tlp(bus, tlp, 3);
 
       while (bus->completions[use_tag] == 0) {
 	    __pcie_tlp_next_posedge(bus);
       }
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_pcie_tlp_cfg_read32",
+			    &bus->bus_time, (bus_devfn << 16) | addr);
 
       uint32_t*ctlp = bus->completions[use_tag];
       bus->completions[use_tag] = 0;
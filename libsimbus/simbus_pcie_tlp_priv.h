@@ -72,6 +72,10 @@ struct simbus_pcie_tlp_s {
 	/* Current simulation time. */
       struct simbus_time_s bus_time;
 
+	/* Timeline track of this connection, or <0 if the timeline
+	   is off. */
+      int timeline;
+
       struct tlp_cell*tlp_out_list;
 
 	/* Common Interface signals -- out, except for the clk. */
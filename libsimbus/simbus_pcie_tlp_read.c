@@ -93,6 +93,9 @@ void simbus_pcie_tlp_read(simbus_pcie_tlp_t bus, uint64_t addr,
 	    tlp[ntlp++] = addr_h;
       tlp[ntlp++] = addr_l;
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+
 	/* Send it! */
       __pcie_tlp_send_tlp(bus, tlp, ntlp);
 
@@ -100,6 +103,8 @@ void simbus_pcie_tlp_read(simbus_pcie_tlp_t bus, uint64_t addr,
       while (bus->completions[use_tag] == 0) {
 	    __pcie_tlp_next_posedge(bus);
       }
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_pcie_tlp_read",
+			    &bus->bus_time, addr);
 
       uint32_t*ctlp = bus->completions[use_tag];
       bus->completions[use_tag] = 0;
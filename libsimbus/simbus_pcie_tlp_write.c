@@ -123,8 +123,13 @@ void simbus_pcie_tlp_write(simbus_pcie_tlp_t bus, uint64_t addr,
 	    tlp[ntlp++] = tmp;
       }
 
+      struct simbus_timeline_mark_s mark;
+      __simbus_timeline_begin(bus->timeline, &mark, &bus->bus_time);
+
 	/* Send it! */
       __pcie_tlp_send_tlp(bus, tlp, ntlp);
+      __simbus_timeline_end(bus->timeline, &mark, "simbus_pcie_tlp_write",
+			    &bus->bus_time, addr);
 
       free(tlp);
 }
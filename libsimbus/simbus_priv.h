@@ -50,8 +50,9 @@ extern int __simbus_server_hello(int server_fd, const char*name, unsigned*ident,
 
 /*
  * Set to the server a FINISH record and wait for the FINISH response.
+ * A non-zero status is sent with the FINISH to mark a failed test.
  */
-extern int __simbus_server_finish(int server_fd);
+extern int __simbus_server_finish(int server_fd, int status);
 
 /*
  * Send a preformatted command to the server, then receive the
@@ -71,22 +72,47 @@ extern int __simbus_server_send_recv(int server_fd, char*buf, size_t buf_size,
 
 
 /*
- * Simbus times as understood by the server are (mant * (10**(texp))) seconds.
+ * Simbus times are kept as an integer count of femtoseconds, the same
+ * as the server. The messages carry times as <mant>e<exp> seconds, so
+ * __parse_time_token scales the time from the message (and asserts
+ * that it fits) and the READY messages send <time_fs>e-15.
  */
+# define SIMBUS_TIME_EXP (-15)
+
 struct simbus_time_s {
-      uint64_t time_mant;
-      int      time_exp;
+      uint64_t time_fs;
 };
 
 static inline void init_simbus_time(struct simbus_time_s*timp)
 {
-      timp->time_mant = 0;
-      timp->time_exp = 0;
+      timp->time_fs = 0;
 }
 
 extern void __parse_time_token(const char*token, struct simbus_time_s*timp);
 extern double __time_as_double(const struct simbus_time_s*timp, int scale);
 
+/*
+ * Timeline of the bus operations (see simbus_timeline.h). If the
+ * SIMBUS_TIMELINE environment variable names a directory, the
+ * process writes a timeline file there. Each connection gets a track
+ * with __simbus_timeline_track, which returns <0 if the timeline is
+ * off. An operation is a span from __simbus_timeline_begin to
+ * __simbus_timeline_end. Both do nothing if the track is <0. The
+ * name must be a constant string, since it is matched by address.
+ */
+struct simbus_timeline_mark_s {
+      uint64_t wall_ns;
+      struct simbus_time_s sim;
+};
+
+extern int __simbus_timeline_track(const char*name);
+extern uint64_t __simbus_timeline_now(void);
+extern void __simbus_timeline_begin(int track, struct simbus_timeline_mark_s*mark,
+				    const struct simbus_time_s*now);
+extern void __simbus_timeline_end(int track, const struct simbus_timeline_mark_s*mark,
+				  const char*name, const struct simbus_time_s*now,
+				  uint64_t arg);
+
 /*
  * Draw out the signal values in the format for the "READY..."
  * message. Include a leading SP so that this effectively appends the
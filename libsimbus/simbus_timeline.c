@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  "simbus_priv.h"
+# include  "simbus_timeline.h"
+# include  <unistd.h>
+# include  <fcntl.h>
+# include  <stdlib.h>
+# include  <string.h>
+# include  <time.h>
+# include  <stdio.h>
+# include  <assert.h>
+
+/*
+ * The timeline records are collected in a buffer that is written to
+ * the file when it fills, and at exit. The file is opened by the
+ * first connection that asks for a track, if the SIMBUS_TIMELINE
+ * environment variable is set.
+ */
+# define TIMELINE_BUF_SIZE (256*1024)
+
+static int timeline_fd = -1;
+static int timeline_tried = 0;
+static char*timeline_buf = 0;
+static size_t timeline_fill = 0;
+
+static unsigned timeline_tracks = 0;
+
+/* Span names, by the address of the (constant) name string. */
+static const char**timeline_names = 0;
+static unsigned timeline_name_count = 0;
+
+static void timeline_flush(void)
+{
+      size_t off = 0;
+      while (off < timeline_fill) {
+	    ssize_t rc = write(timeline_fd, timeline_buf+off, timeline_fill-off);
+	    if (rc <= 0) {
+		  perror("SIMBUS_TIMELINE");
+		  break;
+	    }
+	    off += rc;
+      }
+      timeline_fill = 0;
+}
+
+static void timeline_exit(void)
+{
+      if (timeline_fd < 0)
+	    return;
+
+      timeline_flush();
+      close(timeline_fd);
+      timeline_fd = -1;
+}
+
+static void timeline_put(struct simbus_timeline_rec_s*rec, const char*text)
+{
+      rec->len = text? strlen(text) : 0;
+      if (timeline_fill + sizeof(*rec) + rec->len > TIMELINE_BUF_SIZE)
+	    timeline_flush();
+
+      memcpy(timeline_buf+timeline_fill, rec, sizeof(*rec));
+      timeline_fill += sizeof(*rec);
+      if (rec->len > 0) {
+	    memcpy(timeline_buf+timeline_fill, text, rec->len);
+	    timeline_fill += rec->len;
+      }
+}
+
+/*
+ * Open <dir>/<name>-<pid>.sbtl, where the dir is the value of the
+ * SIMBUS_TIMELINE variable and the name is the first device that
+ * connects.
+ */
+static void timeline_open(const char*name)
+{
+      timeline_tried = 1;
+
+      const char*dir = getenv("SIMBUS_TIMELINE");
+      if (dir == 0 || dir[0] == 0)
+	    return;
+
+      size_t path_len = strlen(dir) + strlen(name) + 32;
+      char*path = malloc(path_len);
+      snprintf(path, path_len, "%s/%s-%ld.sbtl", dir, name, (long)getpid());
+
+      timeline_fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+      if (timeline_fd < 0) {
+	    perror(path);
+	    free(path);
+	    return;
+      }
+      free(path);
+
+      timeline_buf = malloc(TIMELINE_BUF_SIZE);
+      assert(timeline_buf);
+      memcpy(timeline_buf, SIMBUS_TIMELINE_MAGIC, 8);
+      timeline_fill = 8;
+
+      struct simbus_timeline_rec_s rec;
+      memset(&rec, 0, sizeof rec);
+      rec.kind = TL_PROCESS;
+      rec.arg = getpid();
+      timeline_put(&rec, name);
+
+      atexit(timeline_exit);
+}
+
+uint64_t __simbus_timeline_now(void)
+{
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+int __simbus_timeline_track(const char*name)
+{
+      if (! timeline_tried)
+	    timeline_open(name);
+      if (timeline_fd < 0)
+	    return -1;
+
+      struct simbus_timeline_rec_s rec;
+      memset(&rec, 0, sizeof rec);
+      rec.kind = TL_TRACK;
+      rec.track = timeline_tracks++;
+      timeline_put(&rec, name);
+      return rec.track;
+}
+
+void __simbus_timeline_begin(int track, struct simbus_timeline_mark_s*mark,
+			     const struct simbus_time_s*now)
+{
+      if (track < 0)
+	    return;
+
+      mark->wall_ns = __simbus_timeline_now();
+      mark->sim = *now;
+}
+
+void __simbus_timeline_end(int track, const struct simbus_timeline_mark_s*mark,
+			   const char*name, const struct simbus_time_s*now,
+			   uint64_t arg)
+{
+      if (track < 0 || timeline_fd < 0)
+	    return;
+
+      struct simbus_timeline_rec_s rec;
+      memset(&rec, 0, sizeof rec);
+
+	/* Give the name an id the first time it is used. */
+      unsigned id;
+      for (id = 0 ; id < timeline_name_count ; id += 1) {
+	    if (timeline_names[id] == name)
+		  break;
+      }
+      if (id == timeline_name_count) {
+	    timeline_names = realloc(timeline_names, (id+1) * sizeof(const char*));
+	    timeline_names[id] = name;
+	    timeline_name_count += 1;
+
+	    rec.kind = TL_NAME;
+	    rec.name = id;
+	    timeline_put(&rec, name);
+      }
+
+      rec.kind = TL_SPAN;
+      rec.name = id;
+      rec.track = track;
+      rec.start_ns = mark->wall_ns;
+      rec.dur_ns = __simbus_timeline_now() - mark->wall_ns;
+      rec.sim_begin = __time_as_double(&mark->sim, 0);
+      rec.sim_end = __time_as_double(now, 0);
+      rec.arg = arg;
+      timeline_put(&rec, 0);
+}
@@ -0,0 +1,72 @@
+#ifndef __simbus_timeline_H
+#define __simbus_timeline_H
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+/*
+ * Timeline file format. The server and the libsimbus clients each
+ * write a timeline file of the spans of time they spend in bus
+ * operations, and the simbus-timeline program merges the files into
+ * a single Chrome trace (JSON) that shows all the processes side by
+ * side. This header is shared by the server and libsimbus, so keep
+ * the two copies the same.
+ *
+ * The file starts with the 8 byte magic. After that is a sequence of
+ * records, each a simbus_timeline_rec_s followed by len bytes of
+ * payload. All values are in host byte order.
+ *
+ * TL_PROCESS names the process that wrote the file. The arg is the
+ *   pid and the payload is the name.
+ *
+ * TL_NAME defines the span name with the given id. The payload is
+ *   the name.
+ *
+ * TL_TRACK defines the track with the given number. A track is a row
+ *   of the timeline (a bus or a device). The payload is the name.
+ *
+ * TL_SPAN is a span of time on a track. The start is CLOCK_MONOTONIC
+ *   time, which is the same for all the processes on a host, and the
+ *   sim_begin/sim_end are the simulation times in seconds. The arg is
+ *   a value for the span, usually the address.
+ */
+# include  <stdint.h>
+
+# define SIMBUS_TIMELINE_MAGIC "SBTLIN01"
+
+enum simbus_timeline_kind_t {
+      TL_PROCESS = 0,
+      TL_NAME    = 1,
+      TL_TRACK   = 2,
+      TL_SPAN    = 3
+};
+
+struct simbus_timeline_rec_s {
+      uint64_t start_ns;
+      uint64_t dur_ns;
+      double   sim_begin;
+      double   sim_end;
+      uint64_t arg;
+      uint32_t len;
+      uint16_t name;
+      uint16_t track;
+      uint8_t  kind;
+      uint8_t  pad[7];
+};
+
+#endif
@@ -61,6 +61,7 @@
 # include  <inttypes.h>
 # include  <stdio.h>
 # include  <stdlib.h>
+# include  <string.h>
 # include  <assert.h>
 
 const char*name = "ramdev";
@@ -79,6 +80,9 @@ static uint32_t*memory_space = 0;
 static size_t memory_size = 0; // Size of memory in BYTES
 
 const int BAR2_WORDS = 0x2000/4;
+
+  // Maximum number of words to read in a single DMA burst.
+const int DMA_BURST_WORDS = 64;
 static uint32_t bar2_mem[BAR2_WORDS] = { 0 };
 
 static uint32_t config_read32(simbus_pci_t, uint64_t, int);
@@ -225,6 +229,51 @@ static void bar0_recv32(simbus_pci_t bus, uint64_t addr, uint32_t val, int BEn)
       memory_space[use_addr] = (val&be_mask) | (memory_space[use_addr]&~be_mask);
 }
 
+static uint32_t be_to_mask(int BEn)
+{
+      uint32_t be_mask = 0xffffffff;
+      if (BEn & 1) be_mask &= 0xffffff00;
+      if (BEn & 2) be_mask &= 0xffff00ff;
+      if (BEn & 4) be_mask &= 0xff00ffff;
+      if (BEn & 8) be_mask &= 0x00ffffff;
+      return be_mask;
+}
+
+/*
+ * The bar0_needb/recvb functions handle whole bursts to/from BAR0 in
+ * one go. Only the first and last words can have disabled bytes.
+ */
+static void bar0_needb(simbus_pci_t bus, uint64_t addr, uint32_t*val, size_t words)
+{
+      uint32_t use_addr = addr;
+      use_addr &= ~bar0_mask;
+      assert(use_addr + 4*words <= memory_size);
+      use_addr /= 4;
+
+      memcpy(val, memory_space+use_addr, 4*words);
+}
+
+static void bar0_recvb(simbus_pci_t bus, uint64_t addr, const uint32_t*val,
+		       size_t words, int BEFn, int BELn)
+{
+      uint32_t use_addr = addr;
+      use_addr &= ~bar0_mask;
+      assert(use_addr + 4*words <= memory_size);
+      use_addr /= 4;
+
+      uint32_t*dst = memory_space + use_addr;
+      uint32_t first = dst[0];
+      uint32_t last  = dst[words-1];
+      memcpy(dst, val, 4*words);
+
+      uint32_t be_mask = be_to_mask(BEFn);
+      dst[0] = (val[0]&be_mask) | (first&~be_mask);
+      if (words > 1) {
+	    be_mask = be_to_mask(BELn);
+	    dst[words-1] = (val[words-1]&be_mask) | (last&~be_mask);
+      }
+}
+
 /*
  * Reading BAR2 is idempotent.
  */
@@ -337,8 +386,11 @@ static void config_recv32(simbus_pci_t bus, uint64_t addr, uint32_t val, int BEn
       }
 
       if (config_mem[1] & 0x0002) {
+	    bar0_map.flags = SIMBUS_XLATE_FLAG64 | SIMBUS_XLATE_BURST;
 	    bar0_map.need32 = &bar0_need32;
 	    bar0_map.recv32 = &bar0_recv32;
+	    bar0_map.needb = &bar0_needb;
+	    bar0_map.recvb = &bar0_recvb;
 	    bar0_map.base = config_mem[5];
 	    bar0_map.base <<= 32;
 	    bar0_map.base |= config_mem[4];
@@ -372,11 +424,11 @@ static void do_bus_master_operations(simbus_pci_t bus)
 		  addr |= bar2_mem[0x1008/4];
 		  uint32_t off = bar2_mem[0x1010/4];
 
-		  bar2_mem[0x1010/4] += 4;
-		  bar2_mem[0x1008/4] += 4;
-		  bar2_mem[0x1004/4] -= 4;
-
 		  if (bar2_mem[0x1000/4] & 0x10) { // DMA Write
+			bar2_mem[0x1010/4] += 4;
+			bar2_mem[0x1008/4] += 4;
+			bar2_mem[0x1004/4] -= 4;
+
 			uint32_t val = 0xffffffff;
 			if (off < memory_size) {
 			      off /= 4;
@@ -384,15 +436,29 @@ static void do_bus_master_operations(simbus_pci_t bus)
 			}
 			simbus_pci_write32(bus, addr, val, 0);
 		  } else { // DMA Read
-			uint32_t val = simbus_pci_read32(bus, addr, 0);
-			if (off < memory_size) {
-			      off /= 4;
-#if 0
-			      printf("Write 0x%08lx to off=0x%x remain=%lu\n",
-				     val, off, bar2_mem[0x1004/4]);
-#endif
-			      memory_space[off] = val;
+			  // Read a burst of words at a time, and spread
+			  // them into the memory space.
+			uint32_t count = bar2_mem[0x1004/4];
+			int words = (count + 3) / 4;
+			if (words > DMA_BURST_WORDS) words = DMA_BURST_WORDS;
+
+			uint32_t val[DMA_BURST_WORDS];
+			int rc = simbus_pci_read32b(bus, addr, val, words, 0, 0);
+			if (rc <= 0) {
+			      printf("DMA read from 0x%" PRIx64 " failed, rc=%d\n", addr, rc);
+			      break;
+			}
+
+			for (int idx = 0 ; idx < rc ; idx += 1, off += 4) {
+			      if (off < memory_size)
+				    memory_space[off/4] = val[idx];
 			}
+
+			uint32_t bytes = 4*rc;
+			if (bytes > count) bytes = count;
+			bar2_mem[0x1010/4] += bytes;
+			bar2_mem[0x1008/4] += bytes;
+			bar2_mem[0x1004/4] -= bytes;
 		  }
 	    }
 
@@ -42,8 +42,20 @@
  * BAR2 is a command register set. It is 4K long, and used to carry
  * commands that the memory device itself can perform. Word-0 is the
  * command register, and writes to that address execute the specified
- * command. The next 4095 words are the arguments or results of the
+ * command. The next 1023 words are the arguments or results of the
  * command.
+ *
+ * The <base>, <size> and <base2> arguments below are the low 32 bits
+ * of 64bit values. The high 32 bits are in the last words of the
+ * page, so that commands can reach all of a memory that is larger
+ * than 4G:
+ *
+ *    0x0ff4 : <base> (and <base1>) high 32 bits
+ *    0x0ff8 : <size> (and <size1>) high 32 bits
+ *    0x0ffc : <base2> high 32 bits
+ *
+ * These registers keep their values, and are 0 until written, so
+ * software that never writes them gets 32bit arguments.
  * 
  * The BAR2 commands are as follows:
  * 
@@ -66,16 +78,36 @@
  * 
  *    The LOAD command reads host file contents into the address at
  *    <base> and for <size> bytes. The actual number of bytes loaded
- *    is returned in the command word. If there is an error reading
- *    the file, a -1 (0xffffffff) is returned instead.
+ *    is returned in the command word, with its high 32 bits in the
+ *    <size> high word. If there is an error reading the file, a -1
+ *    (0xffffffff) is returned instead.
  * 
- *    The file name is a null terminated string of bytes. The name
- *    is interpreted by the host system.
+ *    The file name is a null terminated string of bytes, starting at
+ *    word 3 and ending before the high words at 0x0ff4. The name is
+ *    interpreted by the host system.
  *
  * SAVE: 0x00000003 <base> <size> <file name...>
  * 
  *    The SAVE command writes a host file with the contents of memory
- *    at offset <base> and for <size> bytes.
+ *    at offset <base> and for <size> bytes. The count is returned as
+ *    for LOAD.
+ *
+ * SNAPSHOT: 0x00000004
+ *
+ *    The SNAPSHOT command saves the current contents of the memory
+ *    as the state that RESTORE returns to. The image file keeps the
+ *    snapshot, and later writes are kept in private copies of the
+ *    pages. A later SNAPSHOT writes only the pages written since the
+ *    last one to the file. At the end of the simulation, the written
+ *    pages are also saved, so the file still holds the final contents
+ *    of the memory. The result (0 or -1) replaces the command word.
+ *
+ * RESTORE: 0x00000005
+ *
+ *    The RESTORE command returns the memory to the contents at the
+ *    last SNAPSHOT. Only the pages written since the snapshot are
+ *    touched, so this is fast even for large memories. The result
+ *    is -1 if there is no snapshot.
  *
  * After the command region, The BAR2 region has registers of a DMA
  * controller. The DMA controller supports a single linear read.
@@ -413,11 +445,35 @@ module pci64_memory (CLK, RESET, AD, C_BE, PAR,
    integer retry_tmp;
    reg [31:0] read_tmp;
    reg 	   parity_bit;
+
+   // Target reads fetch the memory image a block at a time with
+   // $simbus_mem_read_block instead of a $simbus_mem_peek for every
+   // data phase. The block is refilled at the current address when
+   // it runs out, and is discarded at the end of the transaction.
+   localparam READ_BLOCK = 16;
+   reg [31:0] read_block[0:READ_BLOCK-1];
+   integer    read_block_idx;
+
+   task read_next_word;
+      input bar_flag;
+      input [31:0] address;
+      output [31:0] value;
+      begin
+	 if (read_block_idx >= READ_BLOCK) begin
+	    $simbus_mem_read_block(memory_fd, address, read_block, READ_BLOCK, bar_flag);
+	    read_block_idx = 0;
+	 end
+	 value = read_block[read_block_idx];
+	 read_block_idx = read_block_idx + 1;
+      end
+   endtask // read_next_word
+
    task do_memory_read;
       input bar_flag;
       reg [31:0] masked_address;
       begin
 	 masked_address = use_address[31:0] & ~bar0_mask;
+	 read_block_idx = READ_BLOCK;
 
 	 // Fast timing, respond immediately
 	 DEVSEL_reg <= 0;
@@ -450,7 +506,7 @@ module pci64_memory (CLK, RESET, AD, C_BE, PAR,
 	 AD_en  <= 1;
 
 	 // Read the addressed value,
-	 read_tmp = $simbus_mem_peek(memory_fd, masked_address, bar_flag);
+	 read_next_word(bar_flag, masked_address, read_tmp);
 	 AD_reg  <= read_tmp;
 	 parity_bit <= ^{read_tmp, C_BE};
 
@@ -469,7 +525,7 @@ module pci64_memory (CLK, RESET, AD, C_BE, PAR,
 	      PAR_reg <= parity_bit;
 	      PAR_en  <= 1;
 	      // Read the next value
-	      read_tmp = $simbus_mem_peek(memory_fd, masked_address, bar_flag);
+	      read_next_word(bar_flag, masked_address, read_tmp);
 	      AD_reg  <= read_tmp;
 	      parity_bit <= ^{read_tmp, C_BE};
 	      // Linear addressing.
@@ -670,6 +726,38 @@ module pci64_memory (CLK, RESET, AD, C_BE, PAR,
      if (REQ == 1 && FRAME_reg == 1 && IRDY_reg==1 && dma_count && dma_go)
        REQ <= 0;
 
+   // DMA data is collected here and written to the memory image
+   // with $simbus_mem_write_block, instead of a $simbus_mem_poke
+   // for every data phase. The dma_block_addr is the image address
+   // of the first word in the block.
+   localparam DMA_BLOCK = 64;
+   reg [31:0] dma_block[0:DMA_BLOCK-1];
+   integer    dma_block_cnt = 0;
+   reg [31:0] dma_block_addr;
+
+   task dma_block_flush;
+      begin
+	 if (dma_block_cnt > 0)
+	   $simbus_mem_write_block(memory_fd, dma_block_addr, dma_block, dma_block_cnt, 0);
+	 dma_block_cnt = 0;
+      end
+   endtask // dma_block_flush
+
+   task dma_block_store;
+      input [31:0] address;
+      input [31:0] value;
+      begin
+	 if (dma_block_cnt > 0 && address != dma_block_addr + 4*dma_block_cnt)
+	   dma_block_flush;
+	 if (dma_block_cnt == 0)
+	   dma_block_addr = address;
+	 dma_block[dma_block_cnt] = value;
+	 dma_block_cnt = dma_block_cnt + 1;
+	 if (dma_block_cnt == DMA_BLOCK)
+	   dma_block_flush;
+      end
+   endtask // dma_block_store
+
    // This implements a DMA bus mastering read from an external
    // address to local memory.
    task do_master_read;	//write to memory while acting as PCI Master
@@ -727,7 +815,7 @@ module pci64_memory (CLK, RESET, AD, C_BE, PAR,
 	 if ((IRDY == 0) && (TRDY == 0)) begin
 	    write_val = AD;	//data to write to memory
 	    // Store the next value
-	    $simbus_mem_poke(memory_fd, dma_memory, write_val, 0);
+	    dma_block_store(dma_memory, write_val);
 	    // Linear addressing of memory
 	    dma_memory <= dma_memory + 4;
 	    dma_count <= dma_count - 4;
@@ -743,13 +831,16 @@ module pci64_memory (CLK, RESET, AD, C_BE, PAR,
               if ((IRDY == 0) && (TRDY == 0)) begin
 		 write_val = AD;
 		 // Store the next value
-		 $simbus_mem_poke(memory_fd, dma_memory, write_val, 0);
+		 dma_block_store(dma_memory, write_val);
 		 // Linear addressing.
 		 dma_memory <= dma_memory + 4;
 		 dma_count <= dma_count - 4;
 	      end
             end
 
+	 // Write out whatever is left of the DMA data.
+	 dma_block_flush;
+
 	 // Transaction done. Turn off drivers.
 	 @(posedge CLK) begin
 	    IRDY_reg <= 1;
@@ -34,6 +34,9 @@ AXI4Protocol::AXI4Protocol(struct bus_state*b)
       rid_width_ = 0;
       irq_width_ = 0;
 
+      for (int idx = 0 ; idx < TR_COUNT ; idx += 1)
+	    trace_[idx] = -1;
+
       string clock_high_str  = b->options["CLOCK_high"];
       string clock_low_str   = b->options["CLOCK_low"];
       string clock_hold_str  = b->options["CLOCK_hold"];
@@ -87,51 +90,51 @@ bool AXI4Protocol::wrap_up_configuration()
 void AXI4Protocol::trace_init()
 {
 	// global signals
-      make_trace_("ACLK",    PT_BITS);
-      make_trace_("ARESETn", PT_BITS);
+      trace_[TR_ACLK]    = make_trace_("ACLK",    PT_BITS);
+      trace_[TR_ARESETn] = make_trace_("ARESETn", PT_BITS);
 	// write address channel
-      make_trace_("AWVALID", PT_BITS);
-      make_trace_("AWREADY", PT_BITS);
-      make_trace_("AWADDR",  PT_BITS, addr_width_);
-      make_trace_("AWLEN",   PT_BITS, 8);
-      make_trace_("AWSIZE",  PT_BITS, 3);
-      make_trace_("AWBURST", PT_BITS, 2);
-      make_trace_("AWLOCK",  PT_BITS, 2);
-      make_trace_("AWCACHE", PT_BITS, 4);
-      make_trace_("AWPROT",  PT_BITS, 3);
-      make_trace_("AWQOS",   PT_BITS, 4);
-      make_trace_("AWID",    PT_BITS, wid_width_);
+      trace_[TR_AWVALID] = make_trace_("AWVALID", PT_BITS);
+      trace_[TR_AWREADY] = make_trace_("AWREADY", PT_BITS);
+      trace_[TR_AWADDR]  = make_trace_("AWADDR",  PT_BITS, addr_width_);
+      trace_[TR_AWLEN]   = make_trace_("AWLEN",   PT_BITS, 8);
+      trace_[TR_AWSIZE]  = make_trace_("AWSIZE",  PT_BITS, 3);
+      trace_[TR_AWBURST] = make_trace_("AWBURST", PT_BITS, 2);
+      trace_[TR_AWLOCK]  = make_trace_("AWLOCK",  PT_BITS, 2);
+      trace_[TR_AWCACHE] = make_trace_("AWCACHE", PT_BITS, 4);
+      trace_[TR_AWPROT]  = make_trace_("AWPROT",  PT_BITS, 3);
+      trace_[TR_AWQOS]   = make_trace_("AWQOS",   PT_BITS, 4);
+      trace_[TR_AWID]    = make_trace_("AWID",    PT_BITS, wid_width_);
 	// write data channel
-      make_trace_("WVALID",  PT_BITS);
-      make_trace_("WREADY",  PT_BITS);
-      make_trace_("WDATA",   PT_BITS, data_width_);
-      make_trace_("WSTRB",   PT_BITS, data_width_/8);
+      trace_[TR_WVALID]  = make_trace_("WVALID",  PT_BITS);
+      trace_[TR_WREADY]  = make_trace_("WREADY",  PT_BITS);
+      trace_[TR_WDATA]   = make_trace_("WDATA",   PT_BITS, data_width_);
+      trace_[TR_WSTRB]   = make_trace_("WSTRB",   PT_BITS, data_width_/8);
 	// write response channel
-      make_trace_("BVALID",  PT_BITS);
-      make_trace_("BREADY",  PT_BITS);
-      make_trace_("BRESP",   PT_BITS, 2);
-      make_trace_("BID",     PT_BITS, wid_width_);
+      trace_[TR_BVALID]  = make_trace_("BVALID",  PT_BITS);
+      trace_[TR_BREADY]  = make_trace_("BREADY",  PT_BITS);
+      trace_[TR_BRESP]   = make_trace_("BRESP",   PT_BITS, 2);
+      trace_[TR_BID]     = make_trace_("BID",     PT_BITS, wid_width_);
 	// read address channel
-      make_trace_("ARVALID", PT_BITS);
-      make_trace_("ARREADY", PT_BITS);
-      make_trace_("ARADDR",  PT_BITS, addr_width_);
-      make_trace_("ARLEN",   PT_BITS, 8);
-      make_trace_("ARSIZE",  PT_BITS, 3);
-      make_trace_("ARBURST", PT_BITS, 2);
-      make_trace_("ARLOCK",  PT_BITS, 2);
-      make_trace_("ARCACHE", PT_BITS, 4);
-      make_trace_("ARPROT",  PT_BITS, 3);
-      make_trace_("ARQOS",   PT_BITS, 4);
-      make_trace_("ARID",    PT_BITS, rid_width_);
+      trace_[TR_ARVALID] = make_trace_("ARVALID", PT_BITS);
+      trace_[TR_ARREADY] = make_trace_("ARREADY", PT_BITS);
+      trace_[TR_ARADDR]  = make_trace_("ARADDR",  PT_BITS, addr_width_);
+      trace_[TR_ARLEN]   = make_trace_("ARLEN",   PT_BITS, 8);
+      trace_[TR_ARSIZE]  = make_trace_("ARSIZE",  PT_BITS, 3);
+      trace_[TR_ARBURST] = make_trace_("ARBURST", PT_BITS, 2);
+      trace_[TR_ARLOCK]  = make_trace_("ARLOCK",  PT_BITS, 2);
+      trace_[TR_ARCACHE] = make_trace_("ARCACHE", PT_BITS, 4);
+      trace_[TR_ARPROT]  = make_trace_("ARPROT",  PT_BITS, 3);
+      trace_[TR_ARQOS]   = make_trace_("ARQOS",   PT_BITS, 4);
+      trace_[TR_ARID]    = make_trace_("ARID",    PT_BITS, rid_width_);
 	// read data channel
-      make_trace_("RVALID",  PT_BITS);
-      make_trace_("RREADY",  PT_BITS);
-      make_trace_("RDATA",   PT_BITS, data_width_);
-      make_trace_("RRESP",   PT_BITS, 2);
-      make_trace_("RID",     PT_BITS, rid_width_);
+      trace_[TR_RVALID]  = make_trace_("RVALID",  PT_BITS);
+      trace_[TR_RREADY]  = make_trace_("RREADY",  PT_BITS);
+      trace_[TR_RDATA]   = make_trace_("RDATA",   PT_BITS, data_width_);
+      trace_[TR_RRESP]   = make_trace_("RRESP",   PT_BITS, 2);
+      trace_[TR_RID]     = make_trace_("RID",     PT_BITS, rid_width_);
       if (irq_width_ > 0) {
 	      // Interrupts
-	    make_trace_("IRQ",     PT_BITS, irq_width_);
+	    trace_[TR_IRQ] = make_trace_("IRQ", PT_BITS, irq_width_);
       }
 }
 
@@ -214,8 +217,8 @@ void AXI4Protocol::run_init()
       slave_ ->second->send_signals["ACLK"]    = tmp_1;
       slave_ ->second->send_signals["ARESETn"] = tmp_1;
 
-      set_trace_("ACLK",    BIT_1);
-      set_trace_("ARESETn", BIT_1);
+      set_trace_(trace_[TR_ACLK],    BIT_1);
+      set_trace_(trace_[TR_ARESETn], BIT_1);
 
 	// write address channel
       slave_ ->second->send_signals["AWVALID"] = tmp_z;
@@ -230,17 +233,17 @@ void AXI4Protocol::run_init()
       slave_ ->second->send_signals["AWQOS"  ] = tmp_qos;
       slave_ ->second->send_signals["AWID"   ] = tmp_wid;
 
-      set_trace_("AWVALID", BIT_Z);
-      set_trace_("AWREADY", BIT_Z);
-      set_trace_("AWADDR",  tmp_addr);
-      set_trace_("AWLEN",   tmp_len);
-      set_trace_("AWSIZE",  tmp_prot);
-      set_trace_("AWBURST", tmp_resp);
-      set_trace_("AWLOCK",  tmp_lock);
-      set_trace_("AWCACHE", tmp_cache);
-      set_trace_("AWPROT",  tmp_prot);
-      set_trace_("AWQOS",   tmp_qos);
-      set_trace_("AWID",    tmp_wid);
+      set_trace_(trace_[TR_AWVALID], BIT_Z);
+      set_trace_(trace_[TR_AWREADY], BIT_Z);
+      set_trace_(trace_[TR_AWADDR],  tmp_addr);
+      set_trace_(trace_[TR_AWLEN],   tmp_len);
+      set_trace_(trace_[TR_AWSIZE],  tmp_prot);
+      set_trace_(trace_[TR_AWBURST], tmp_resp);
+      set_trace_(trace_[TR_AWLOCK],  tmp_lock);
+      set_trace_(trace_[TR_AWCACHE], tmp_cache);
+      set_trace_(trace_[TR_AWPROT],  tmp_prot);
+      set_trace_(trace_[TR_AWQOS],   tmp_qos);
+      set_trace_(trace_[TR_AWID],    tmp_wid);
 
 	// write data channel
       slave_ ->second->send_signals["WVALID"] = tmp_z;
@@ -248,10 +251,10 @@ void AXI4Protocol::run_init()
       slave_ ->second->send_signals["WDATA" ] = tmp_data;
       slave_ ->second->send_signals["WSTRB" ] = tmp_strb;
 
-      set_trace_("WVALID", BIT_Z);
-      set_trace_("WREADY", BIT_Z);
-      set_trace_("WDATA",  tmp_data);
-      set_trace_("WSTRB",  tmp_strb);
+      set_trace_(trace_[TR_WVALID], BIT_Z);
+      set_trace_(trace_[TR_WREADY], BIT_Z);
+      set_trace_(trace_[TR_WDATA],  tmp_data);
+      set_trace_(trace_[TR_WSTRB],  tmp_strb);
 
 	// write response channel
       master_->second->send_signals["BVALID"] = tmp_z;
@@ -259,9 +262,9 @@ void AXI4Protocol::run_init()
       master_->second->send_signals["BRESP" ] = tmp_resp;
       master_->second->send_signals["BID"   ] = tmp_wid;
 
-      set_trace_("BVALID", BIT_Z);
-      set_trace_("BREADY", BIT_Z);
-      set_trace_("BRESP",  tmp_resp);
+      set_trace_(trace_[TR_BVALID], BIT_Z);
+      set_trace_(trace_[TR_BREADY], BIT_Z);
+      set_trace_(trace_[TR_BRESP],  tmp_resp);
 
 	// read address channel
       slave_ ->second->send_signals["ARVALID"] = tmp_z;
@@ -276,17 +279,17 @@ void AXI4Protocol::run_init()
       slave_ ->second->send_signals["ARQOS"  ] = tmp_qos;
       slave_ ->second->send_signals["ARID"   ] = tmp_rid;
 
-      set_trace_("ARVALID", BIT_Z);
-      set_trace_("ARREADY", BIT_Z);
-      set_trace_("ARADDR",  tmp_addr);
-      set_trace_("ARLEN",   tmp_len);
-      set_trace_("ARSIZE",  tmp_prot);
-      set_trace_("ARBURST", tmp_resp);
-      set_trace_("ARLOCK",  tmp_lock);
-      set_trace_("ARCACHE", tmp_cache);
-      set_trace_("ARPROT",  tmp_prot);
-      set_trace_("ARQOS",   tmp_qos);
-      set_trace_("ARID",    tmp_rid);
+      set_trace_(trace_[TR_ARVALID], BIT_Z);
+      set_trace_(trace_[TR_ARREADY], BIT_Z);
+      set_trace_(trace_[TR_ARADDR],  tmp_addr);
+      set_trace_(trace_[TR_ARLEN],   tmp_len);
+      set_trace_(trace_[TR_ARSIZE],  tmp_prot);
+      set_trace_(trace_[TR_ARBURST], tmp_resp);
+      set_trace_(trace_[TR_ARLOCK],  tmp_lock);
+      set_trace_(trace_[TR_ARCACHE], tmp_cache);
+      set_trace_(trace_[TR_ARPROT],  tmp_prot);
+      set_trace_(trace_[TR_ARQOS],   tmp_qos);
+      set_trace_(trace_[TR_ARID],    tmp_rid);
 
 	// read data channel
       master_->second->send_signals["RVALID"] = tmp_z;
@@ -296,15 +299,15 @@ void AXI4Protocol::run_init()
       master_->second->send_signals["RID"   ] = tmp_rid;
       master_->second->send_signals["IRQ"   ] = tmp_irq;
 
-      set_trace_("RVALID", BIT_Z);
-      set_trace_("RREADY", BIT_Z);
-      set_trace_("RDATA",  tmp_data);
-      set_trace_("RRESP",  tmp_resp);
-      set_trace_("RID",    tmp_rid);
-      set_trace_("IRQ",    tmp_irq);
+      set_trace_(trace_[TR_RVALID], BIT_Z);
+      set_trace_(trace_[TR_RREADY], BIT_Z);
+      set_trace_(trace_[TR_RDATA],  tmp_data);
+      set_trace_(trace_[TR_RRESP],  tmp_resp);
+      set_trace_(trace_[TR_RID],    tmp_rid);
+      set_trace_(trace_[TR_IRQ],    tmp_irq);
 }
 
-void AXI4Protocol::run_master_to_slave_(const char*name, size_t bits)
+void AXI4Protocol::run_master_to_slave_(const char*name, size_t bits, trace_signal_t trace)
 {
       valarray<bit_state_t>tmp;
 
@@ -313,13 +316,15 @@ void AXI4Protocol::run_master_to_slave_(const char*name, size_t bits)
 
       slave_->second->send_signals[name] = tmp;
 
+      if (trace_[trace] < 0)
+	    return;
       if (tmp.size()==1)
-	    set_trace_(name, tmp[0]);
+	    set_trace_(trace_[trace], tmp[0]);
       else
-	    set_trace_(name, tmp);
+	    set_trace_(trace_[trace], tmp);
 }
 
-void AXI4Protocol::run_slave_to_master_(const char*name, size_t bits)
+void AXI4Protocol::run_slave_to_master_(const char*name, size_t bits, trace_signal_t trace)
 {
       valarray<bit_state_t>tmp;
 
@@ -333,10 +338,12 @@ void AXI4Protocol::run_slave_to_master_(const char*name, size_t bits)
 
       master_->second->send_signals[name] = tmp;
 
+      if (trace_[trace] < 0)
+	    return;
       if (tmp.size()==1)
-	    set_trace_(name, tmp[0]);
+	    set_trace_(trace_[trace], tmp[0]);
       else
-	    set_trace_(name, tmp);
+	    set_trace_(trace_[trace], tmp);
 }
 
 void AXI4Protocol::run_run()
@@ -350,69 +357,72 @@ void AXI4Protocol::run_run()
 	// The ACLK is driven by the protocol server.
       master_->second->send_signals["ACLK"][0] = bus_clk;
       slave_ ->second->send_signals["ACLK"][0] = bus_clk;
-      set_trace_("ACLK", bus_clk);
+      set_trace_(trace_[TR_ACLK], bus_clk);
 
 	// Global signals...
-      run_master_to_slave_("ARESETn", 1);
+      run_master_to_slave_("ARESETn", 1, TR_ARESETn);
 
 	// write address channel
-      run_master_to_slave_("AWVALID", 1);
-      run_slave_to_master_("AWREADY", 1);
-      run_master_to_slave_("AWADDR",  addr_width_);
-      run_master_to_slave_("AWLEN",   8);
-      run_master_to_slave_("AWSIZE",  3);
-      run_master_to_slave_("AWBURST", 2);
-      run_master_to_slave_("AWLOCK",  2);
-      run_master_to_slave_("AWCACHE", 4);
-      run_master_to_slave_("AWPROT",  3);
-      run_master_to_slave_("AWQOS",   4);
-      run_master_to_slave_("AWID",    wid_width_);
+      run_master_to_slave_("AWVALID", 1, TR_AWVALID);
+      run_slave_to_master_("AWREADY", 1, TR_AWREADY);
+      run_master_to_slave_("AWADDR",  addr_width_, TR_AWADDR);
+      run_master_to_slave_("AWLEN",   8, TR_AWLEN);
+      run_master_to_slave_("AWSIZE",  3, TR_AWSIZE);
+      run_master_to_slave_("AWBURST", 2, TR_AWBURST);
+      run_master_to_slave_("AWLOCK",  2, TR_AWLOCK);
+      run_master_to_slave_("AWCACHE", 4, TR_AWCACHE);
+      run_master_to_slave_("AWPROT",  3, TR_AWPROT);
+      run_master_to_slave_("AWQOS",   4, TR_AWQOS);
+      run_master_to_slave_("AWID",    wid_width_, TR_AWID);
 
 	// write data channel
-      run_master_to_slave_("WVALID",  1);
-      run_slave_to_master_("WREADY",  1);
-      run_master_to_slave_("WDATA",   data_width_);
-      run_master_to_slave_("WSTRB",   data_width_/8);
+      run_master_to_slave_("WVALID",  1, TR_WVALID);
+      run_slave_to_master_("WREADY",  1, TR_WREADY);
+      run_master_to_slave_("WDATA",   data_width_, TR_WDATA);
+      run_master_to_slave_("WSTRB",   data_width_/8, TR_WSTRB);
 
 	// write response channel
-      run_slave_to_master_("BVALID",  1);
-      run_master_to_slave_("BREADY",  1);
-      run_slave_to_master_("BRESP",   2);
-      run_slave_to_master_("BID",     wid_width_);
+      run_slave_to_master_("BVALID",  1, TR_BVALID);
+      run_master_to_slave_("BREADY",  1, TR_BREADY);
+      run_slave_to_master_("BRESP",   2, TR_BRESP);
+      run_slave_to_master_("BID",     wid_width_, TR_BID);
 
 	// read address channel
-      run_master_to_slave_("ARVALID", 1);
-      run_slave_to_master_("ARREADY", 1);
-      run_master_to_slave_("ARADDR",  addr_width_);
-      run_master_to_slave_("ARLEN",   8);
-      run_master_to_slave_("ARSIZE",  3);
-      run_master_to_slave_("ARBURST", 2);
-      run_master_to_slave_("ARLOCK",  2);
-      run_master_to_slave_("ARCACHE", 4);
-      run_master_to_slave_("ARPROT",  3);
-      run_master_to_slave_("ARQOS",   4);
-      run_master_to_slave_("ARID",    wid_width_);
+      run_master_to_slave_("ARVALID", 1, TR_ARVALID);
+      run_slave_to_master_("ARREADY", 1, TR_ARREADY);
+      run_master_to_slave_("ARADDR",  addr_width_, TR_ARADDR);
+      run_master_to_slave_("ARLEN",   8, TR_ARLEN);
+      run_master_to_slave_("ARSIZE",  3, TR_ARSIZE);
+      run_master_to_slave_("ARBURST", 2, TR_ARBURST);
+      run_master_to_slave_("ARLOCK",  2, TR_ARLOCK);
+      run_master_to_slave_("ARCACHE", 4, TR_ARCACHE);
+      run_master_to_slave_("ARPROT",  3, TR_ARPROT);
+      run_master_to_slave_("ARQOS",   4, TR_ARQOS);
+      run_master_to_slave_("ARID",    wid_width_, TR_ARID);
 
 	// read data channel
-      run_slave_to_master_("RVALID",  1);
-      run_master_to_slave_("RREADY",  1);
-      run_slave_to_master_("RDATA",   data_width_);
-      run_slave_to_master_("RRESP",   2);
-      run_slave_to_master_("RID",     rid_width_);
+      run_slave_to_master_("RVALID",  1, TR_RVALID);
+      run_master_to_slave_("RREADY",  1, TR_RREADY);
+      run_slave_to_master_("RDATA",   data_width_, TR_RDATA);
+      run_slave_to_master_("RRESP",   2, TR_RRESP);
+      run_slave_to_master_("RID",     rid_width_, TR_RID);
 
       if (irq_width_ > 0) {
 	      // Interrupts
-	    run_slave_to_master_("IRQ",irq_width_);
+	    run_slave_to_master_("IRQ",irq_width_, TR_IRQ);
       }
 }
 
 void AXI4Protocol::advance_bus_clock_(void)
 {
-	// Advance the phase pointer
-      phase_ = (phase_ + 1) % 4;
-
-	// Advance time for the next phase. (Note that the table times
-	// are in pico-seconds.
-      advance_time_(clock_phase_map_[phase_], -12);
+	// Advance the phase pointer, and advance time by the length
+	// of the phases stepped over. (Note that the table times are
+	// in pico-seconds.)
+      uint64_t duration = 0;
+      for (int idx = 0 ; idx < clock_phase_step_() ; idx += 1) {
+	    phase_ = (phase_ + 1) % 4;
+	    duration += clock_phase_map_[phase_];
+      }
+      advance_time_(duration, -12);
 }
 
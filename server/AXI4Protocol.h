@@ -40,8 +40,23 @@ class AXI4Protocol  : public protocol_t {
     private:
       void advance_bus_clock_(void);
 
-      void run_master_to_slave_(const char*trace, size_t bits);
-      void run_slave_to_master_(const char*trace, size_t bits);
+	// The traced signals. The run_* methods take the signal for
+	// its trace symbol.
+      enum trace_signal_t { TR_ACLK, TR_ARESETn, TR_AWVALID,
+			    TR_AWREADY, TR_AWADDR, TR_AWLEN,
+			    TR_AWSIZE, TR_AWBURST, TR_AWLOCK,
+			    TR_AWCACHE, TR_AWPROT, TR_AWQOS, TR_AWID,
+			    TR_WVALID, TR_WREADY, TR_WDATA, TR_WSTRB,
+			    TR_BVALID, TR_BREADY, TR_BRESP, TR_BID,
+			    TR_ARVALID, TR_ARREADY, TR_ARADDR,
+			    TR_ARLEN, TR_ARSIZE, TR_ARBURST,
+			    TR_ARLOCK, TR_ARCACHE, TR_ARPROT,
+			    TR_ARQOS, TR_ARID, TR_RVALID, TR_RREADY,
+			    TR_RDATA, TR_RRESP, TR_RID, TR_IRQ,
+			    TR_COUNT };
+
+      void run_master_to_slave_(const char*name, size_t bits, trace_signal_t trace);
+      void run_slave_to_master_(const char*name, size_t bits, trace_signal_t trace);
 
     private:
       unsigned data_width_;
@@ -60,6 +75,10 @@ class AXI4Protocol  : public protocol_t {
       int phase_;
 	// Timings for the phases, in ps.
       uint64_t clock_phase_map_[4];
+
+	// The trace symbols, from trace_init, or -1 for the signals
+	// that are not traced.
+      int trace_[TR_COUNT];
 };
 
 #endif
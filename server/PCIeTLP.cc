@@ -41,6 +41,8 @@ PCIeTLP::PCIeTLP(struct bus_state*b)
 : protocol_t(b)
 {
       phase_ = 0;
+      for (int idx = 0 ; idx < TR_COUNT ; idx += 1)
+	    trace_[idx] = -1;
 
       string clock_high_str  = b->options["CLOCK_high"];
       string clock_low_str   = b->options["CLOCK_low"];
@@ -67,24 +69,24 @@ PCIeTLP::~PCIeTLP()
 
 void PCIeTLP::trace_init()
 {
-      make_trace_("user_clk",    PT_BITS);
-      make_trace_("user_reset",  PT_BITS);
-      make_trace_("user_lnk_up", PT_BITS);
-
-      make_trace_("m_axis_rx_tdata", PT_BITS, 64);
-      make_trace_("m_axis_rx_tkeep", PT_BITS,  8);
-      make_trace_("m_axis_rx_tlast", PT_BITS);
-      make_trace_("m_axis_rx_tready",PT_BITS);
-      make_trace_("m_axis_rx_tvalid",PT_BITS);
-
-      make_trace_("s_axis_tx_tdata", PT_BITS, 64);
-      make_trace_("s_axis_tx_tkeep", PT_BITS,  8);
-      make_trace_("s_axis_tx_tlast", PT_BITS);
-      make_trace_("s_axis_tx_tready",PT_BITS);
-      make_trace_("s_axis_tx_tvalid",PT_BITS);
-      make_trace_("s_axis_tx_tuser", PT_BITS,  4);
-
-      make_trace_("tx_buf_av",       PT_BITS,  6);
+      trace_[TR_USER_CLK]         = make_trace_("user_clk",         PT_BITS);
+      trace_[TR_USER_RESET]       = make_trace_("user_reset",       PT_BITS);
+      trace_[TR_USER_LNK_UP]      = make_trace_("user_lnk_up",      PT_BITS);
+
+      trace_[TR_M_AXIS_RX_TDATA]  = make_trace_("m_axis_rx_tdata",  PT_BITS, 64);
+      trace_[TR_M_AXIS_RX_TKEEP]  = make_trace_("m_axis_rx_tkeep",  PT_BITS,  8);
+      trace_[TR_M_AXIS_RX_TLAST]  = make_trace_("m_axis_rx_tlast",  PT_BITS);
+      trace_[TR_M_AXIS_RX_TREADY] = make_trace_("m_axis_rx_tready", PT_BITS);
+      trace_[TR_M_AXIS_RX_TVALID] = make_trace_("m_axis_rx_tvalid", PT_BITS);
+
+      trace_[TR_S_AXIS_TX_TDATA]  = make_trace_("s_axis_tx_tdata",  PT_BITS, 64);
+      trace_[TR_S_AXIS_TX_TKEEP]  = make_trace_("s_axis_tx_tkeep",  PT_BITS,  8);
+      trace_[TR_S_AXIS_TX_TLAST]  = make_trace_("s_axis_tx_tlast",  PT_BITS);
+      trace_[TR_S_AXIS_TX_TREADY] = make_trace_("s_axis_tx_tready", PT_BITS);
+      trace_[TR_S_AXIS_TX_TVALID] = make_trace_("s_axis_tx_tvalid", PT_BITS);
+      trace_[TR_S_AXIS_TX_TUSER]  = make_trace_("s_axis_tx_tuser",  PT_BITS,  4);
+
+      trace_[TR_TX_BUF_AV]        = make_trace_("tx_buf_av",        PT_BITS,  6);
 }
 
 void PCIeTLP::run_init()
@@ -114,17 +116,17 @@ void PCIeTLP::run_init()
       slave_->second->send_signals["user_clk"].resize(1);
       slave_->second->send_signals["user_clk"][0] = BIT_1;
 
-      set_trace_("user_clk_out", BIT_1);
+      set_trace_(trace_[TR_USER_CLK], BIT_1);
 
       slave_->second->send_signals["user_reset"].resize(1);
       slave_->second->send_signals["user_reset"][0] = BIT_1;
 
-      set_trace_("user_reset", BIT_1);
+      set_trace_(trace_[TR_USER_RESET], BIT_1);
 
       slave_->second->send_signals["user_lnk_up"].resize(1);
       slave_->second->send_signals["user_lnk_up"][0] = BIT_1;
 
-      set_trace_("user_lnk_up", BIT_1);
+      set_trace_(trace_[TR_USER_LNK_UP], BIT_1);
 
       slave_->second->send_signals["tx_buf_av"].resize(6);
       for (size_t idx = 0 ; idx < 6 ; idx += 1)
@@ -144,7 +146,7 @@ void PCIeTLP::run_init()
 
       master_->second->send_signals["m_axis_rx_tready"].resize(1);
       master_->second->send_signals["m_axis_rx_tready"][0] = BIT_X;
-      set_trace_("m_axis_rx_tready", BIT_X);
+      set_trace_(trace_[TR_M_AXIS_RX_TREADY], BIT_X);
 
       slave_->second->send_signals["m_axis_rx_tvalid"].resize(1);
       slave_->second->send_signals["m_axis_rx_tvalid"][0] = BIT_X;
@@ -183,76 +185,80 @@ void PCIeTLP::run_run()
 
       master_->second->send_signals["user_clk"][0] = bus_clk;
       slave_ ->second->send_signals["user_clk"][0] = bus_clk;
-      set_trace_("user_clk",   bus_clk);
+      set_trace_(trace_[TR_USER_CLK],   bus_clk);
 
       valarray<bit_state_t>tmp;
 
       tmp = master_->second->client_signals["user_reset"];
       slave_->second->send_signals["user_reset"] = tmp;
-      set_trace_("user_reset", tmp);
+      set_trace_(trace_[TR_USER_RESET], tmp);
 
       tmp = master_->second->client_signals["user_lnk_up"];
       slave_->second->send_signals["user_lnk_up"] = tmp;
-      set_trace_("user_lnk_up", tmp);
+      set_trace_(trace_[TR_USER_LNK_UP], tmp);
 
       tmp = master_->second->client_signals["tx_buf_av"];
       slave_->second->send_signals["tx_buf_av"] = tmp;
-      set_trace_("tx_buf_av", tmp);
+      set_trace_(trace_[TR_TX_BUF_AV], tmp);
 
 	/* Receive channel AXI4 Stream */
       tmp = master_->second->client_signals["m_axis_rx_tdata"];
       slave_->second->send_signals["m_axis_rx_tdata"] = tmp;
-      set_trace_("m_axis_rx_tdata", tmp);
+      set_trace_(trace_[TR_M_AXIS_RX_TDATA], tmp);
 
       tmp = master_->second->client_signals["m_axis_rx_tkeep"];
       slave_->second->send_signals["m_axis_rx_tkeep"] = tmp;
-      set_trace_("m_axis_rx_tkeep", tmp);
+      set_trace_(trace_[TR_M_AXIS_RX_TKEEP], tmp);
 
       tmp = master_->second->client_signals["m_axis_rx_tlast"];
       slave_->second->send_signals["m_axis_rx_tlast"] = tmp;
-      set_trace_("m_axis_rx_tlast", tmp);
+      set_trace_(trace_[TR_M_AXIS_RX_TLAST], tmp);
 
       tmp = slave_->second->client_signals["m_axis_rx_tready"];
       master_->second->send_signals["m_axis_rx_tready"] = tmp;
-      set_trace_("m_axis_rx_tready", tmp);
+      set_trace_(trace_[TR_M_AXIS_RX_TREADY], tmp);
 
       tmp = master_->second->client_signals["m_axis_rx_tvalid"];
       slave_->second->send_signals["m_axis_rx_tvalid"] = tmp;
-      set_trace_("m_axis_rx_tvalid", tmp);
+      set_trace_(trace_[TR_M_AXIS_RX_TVALID], tmp);
 
 	/* Transmit channel AXI4 Stream */
       tmp = slave_->second->client_signals["s_axis_tx_tdata"];
       master_->second->send_signals["s_axis_tx_tdata"] = tmp;
-      set_trace_("s_axis_tx_tdata", tmp);
+      set_trace_(trace_[TR_S_AXIS_TX_TDATA], tmp);
 
       tmp = slave_->second->client_signals["s_axis_tx_tkeep"];
       master_->second->send_signals["s_axis_tx_tkeep"] = tmp;
-      set_trace_("s_axis_tx_tkeep", tmp);
+      set_trace_(trace_[TR_S_AXIS_TX_TKEEP], tmp);
 
       tmp = slave_->second->client_signals["s_axis_tx_tlast"];
       master_->second->send_signals["s_axis_tx_tlast"] = tmp;
-      set_trace_("s_axis_tx_tlast", tmp);
+      set_trace_(trace_[TR_S_AXIS_TX_TLAST], tmp);
 
       tmp = master_->second->client_signals["s_axis_tx_tready"];
       slave_->second->send_signals["s_axis_tx_tready"] = tmp;
-      set_trace_("s_axis_tx_tready", tmp);
+      set_trace_(trace_[TR_S_AXIS_TX_TREADY], tmp);
 
       tmp = slave_->second->client_signals["s_axis_tx_tvalid"];
       master_->second->send_signals["s_axis_tx_tvalid"] = tmp;
-      set_trace_("s_axis_tx_tvalid", tmp);
+      set_trace_(trace_[TR_S_AXIS_TX_TVALID], tmp);
 
       tmp = slave_->second->client_signals["s_axis_tx_tuser"];
       master_->second->send_signals["s_axis_tx_tuser"] = tmp;
-      set_trace_("s_axis_tx_user", tmp);
+      set_trace_(trace_[TR_S_AXIS_TX_TUSER], tmp);
 }
 
 void PCIeTLP::advance_bus_clock_(void)
 {
-	// Advance the phase pointer
-      phase_ = (phase_ + 1) % 4;
-
-	// Advance time for the next phase
-      advance_time_(clock_phase_map_[phase_], -12);
+	// Advance the phase pointer, and advance time by the length
+	// of the phases stepped over. (Note that the table times are
+	// in pico-seconds.)
+      uint64_t duration = 0;
+      for (int idx = 0 ; idx < clock_phase_step_() ; idx += 1) {
+	    phase_ = (phase_ + 1) % 4;
+	    duration += clock_phase_map_[phase_];
+      }
+      advance_time_(duration, -12);
 }
 
 
@@ -45,6 +45,18 @@ class PCIeTLP  : public protocol_t {
 	// we arbitrarily name master and slave.
       bus_device_map_t::iterator master_;
       bus_device_map_t::iterator slave_;
+
+	// The trace symbols, from trace_init, or -1 for the signals
+	// that are not traced.
+      enum trace_signal_t { TR_USER_CLK, TR_USER_RESET, TR_USER_LNK_UP,
+			    TR_M_AXIS_RX_TDATA, TR_M_AXIS_RX_TKEEP,
+			    TR_M_AXIS_RX_TLAST, TR_M_AXIS_RX_TREADY,
+			    TR_M_AXIS_RX_TVALID, TR_S_AXIS_TX_TDATA,
+			    TR_S_AXIS_TX_TKEEP, TR_S_AXIS_TX_TLAST,
+			    TR_S_AXIS_TX_TREADY, TR_S_AXIS_TX_TVALID,
+			    TR_S_AXIS_TX_TUSER, TR_TX_BUF_AV,
+			    TR_COUNT };
+      int trace_[TR_COUNT];
 };
 
 #endif
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  "PciAnalyzer.h"
+# include  <string.h>
+# include  <iostream>
+# include  <algorithm>
+# include  <cassert>
+
+using namespace std;
+
+static bool compare_index(const pcitxn_index_s&a, const pcitxn_index_s&b)
+{
+      if (a.key != b.key)
+	    return a.key < b.key;
+      return a.offset < b.offset;
+}
+
+/*
+ * Get the value of wid bits of the vector, starting at base. Set the
+ * x_flag if any of the bits is not 0 or 1.
+ */
+static uint32_t vector_value(const valarray<bit_state_t>&vec, int base, int wid, bool&x_flag)
+{
+      uint32_t val = 0;
+      for (int idx = 0 ; idx < wid ; idx += 1) {
+	    switch (vec[base+idx]) {
+		case BIT_0:
+		  break;
+		case BIT_1:
+		  val |= 1U << idx;
+		  break;
+		default:
+		  x_flag = true;
+		  break;
+	    }
+      }
+      return val;
+}
+
+static inline bool asserted(bit_state_t val)
+{
+      return val == BIT_0;
+}
+
+PciAnalyzer::PciAnalyzer(const std::string&path)
+: path_(path), offset_(0), state_(IDLE), clock_(0), last_frame_(false)
+{
+      fd_ = fopen(path.c_str(), "wb");
+      if (fd_ == 0) {
+	    perror(path.c_str());
+	    return;
+      }
+
+      setvbuf(fd_, 0, _IOFBF, 1024*1024);
+      fwrite(PCITXN_MAGIC, 1, 8, fd_);
+      offset_ = 8;
+}
+
+PciAnalyzer::~PciAnalyzer()
+{
+      close();
+}
+
+void PciAnalyzer::sample(const sample_s&smp)
+{
+      if (fd_ == 0)
+	    return;
+
+      clock_ += 1;
+
+      bool frame = asserted(smp.frame_n);
+      bool irdy  = asserted(smp.irdy_n);
+
+	// The transaction is over on the clock after the last data
+	// phase, or when the master lets go of FRAME# and IRDY#
+	// without the last data phase completing (master abort).
+      if (state_ == DATA && (final_done_ || (!frame && !irdy)))
+	    end_transaction_();
+
+      switch (state_) {
+	  case IDLE:
+	      // The address phase is the first clock of FRAME#.
+	    if (frame && !last_frame_)
+		  begin_transaction_(smp);
+	    break;
+
+	  case ADDR2: {
+		// The second address phase of a dual address cycle
+		// has the high address bits and the real command.
+		bool x_flag = false;
+		uint64_t hi = vector_value(*smp.ad, 0, 32, x_flag);
+		cur_.addr |= hi << 32;
+		cur_.command = vector_value(*smp.cbe, 0, 4, x_flag);
+		state_ = DATA;
+		break;
+	  }
+
+	  case DATA:
+	    data_phase_(smp);
+	    break;
+      }
+
+      last_frame_ = frame;
+}
+
+void PciAnalyzer::begin_transaction_(const sample_s&smp)
+{
+      bool x_flag = false;
+
+      memset(&cur_, 0, sizeof cur_);
+      cur_.start = smp.time_ps;
+      cur_.addr = vector_value(*smp.ad, 0, 32, x_flag);
+      cur_.command = vector_value(*smp.cbe, 0, 4, x_flag);
+      cur_.initiator = smp.frame_dev >= 0? smp.frame_dev : PCITXN_NO_DEVICE;
+      cur_.target = PCITXN_NO_DEVICE;
+
+      req64_ = asserted(smp.req64_n);
+      devsel_seen_ = false;
+      final_done_ = false;
+      addr_clock_ = clock_;
+      last_data_clock_ = clock_;
+      data_.clear();
+      cbe_.clear();
+
+      if (cur_.command == 0xd) {
+	    cur_.flags |= PCITXN_DAC;
+	    state_ = ADDR2;
+      } else {
+	    state_ = DATA;
+      }
+}
+
+void PciAnalyzer::data_phase_(const sample_s&smp)
+{
+      bool frame  = asserted(smp.frame_n);
+      bool irdy   = asserted(smp.irdy_n);
+      bool trdy   = asserted(smp.trdy_n);
+      bool stop   = asserted(smp.stop_n);
+      bool devsel = asserted(smp.devsel_n);
+
+      if (devsel && !devsel_seen_) {
+	    devsel_seen_ = true;
+	    cur_.target = smp.devsel_dev >= 0? smp.devsel_dev : PCITXN_NO_DEVICE;
+	    uint64_t clocks = clock_ - addr_clock_;
+	    cur_.devsel = clocks > 0xff? 0xff : clocks;
+	      // The target claims a 64bit transfer with ACK64# along
+	      // with DEVSEL#, before any data moves.
+	    if (req64_ && asserted(smp.ack64_n) && cur_.beats == 0)
+		  cur_.flags |= PCITXN_64BIT;
+      }
+
+      if (irdy)
+	    last_data_clock_ = clock_;
+
+      if (irdy && (trdy || stop)) {
+	      // This data phase completes.
+	    if (trdy && cur_.beats < PCITXN_MAX_BEATS) {
+		  bool x_flag = false;
+		  data_.push_back(vector_value(*smp.ad, 0, 32, x_flag));
+		  uint8_t cbe = vector_value(*smp.cbe, 0, 4, x_flag);
+		  if (cur_.flags & PCITXN_64BIT) {
+			data_.push_back(vector_value(*smp.ad, 32, 32, x_flag));
+			cbe |= vector_value(*smp.cbe, 4, 4, x_flag) << 4;
+		  }
+		  cbe_.push_back(cbe);
+		  cur_.beats += 1;
+		  if (x_flag)
+			cur_.flags |= PCITXN_DATA_X;
+
+	    } else if (trdy) {
+		  cur_.flags |= PCITXN_TRUNCATED;
+	    }
+
+	    const uint16_t stop_flags = PCITXN_RETRY|PCITXN_DISCONNECT|PCITXN_TARGET_ABORT;
+	    if (stop && (cur_.flags & stop_flags) == 0) {
+		  if (! devsel)
+			cur_.flags |= PCITXN_TARGET_ABORT;
+		  else if (cur_.beats == 0 && !trdy)
+			cur_.flags |= PCITXN_RETRY;
+		  else
+			cur_.flags |= PCITXN_DISCONNECT;
+	    }
+
+	      // FRAME# is already deasserted in the last data phase.
+	    if (! frame)
+		  final_done_ = true;
+
+      } else if (! irdy) {
+	    if (cur_.irdy_waits < 0xffff)
+		  cur_.irdy_waits += 1;
+
+      } else {
+	    if (cur_.trdy_waits < 0xffff)
+		  cur_.trdy_waits += 1;
+      }
+}
+
+void PciAnalyzer::end_transaction_(void)
+{
+      state_ = IDLE;
+
+      if (! devsel_seen_)
+	    cur_.flags |= PCITXN_MASTER_ABORT;
+
+      uint64_t latency = last_data_clock_ - addr_clock_;
+      cur_.latency = latency > 0xffffffff? 0xffffffff : latency;
+
+      pcitxn_index_s idx;
+      idx.offset = offset_;
+      if (addr_index_.size() % PCITXN_TIME_STRIDE == 0) {
+	    idx.key = cur_.start;
+	    time_index_.push_back(idx);
+      }
+      idx.key = cur_.addr;
+      addr_index_.push_back(idx);
+
+      fwrite(&cur_, sizeof cur_, 1, fd_);
+      if (! data_.empty())
+	    fwrite(&data_[0], sizeof data_[0], data_.size(), fd_);
+      if (! cbe_.empty())
+	    fwrite(&cbe_[0], 1, cbe_.size(), fd_);
+
+      uint64_t size = pcitxn_rec_size(cur_);
+      uint64_t used = sizeof cur_ + data_.size()*sizeof data_[0] + cbe_.size();
+      static const char pad[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+      fwrite(pad, 1, size - used, fd_);
+
+      offset_ += size;
+}
+
+void PciAnalyzer::close()
+{
+      if (fd_ == 0)
+	    return;
+
+      if (state_ == DATA)
+	    end_transaction_();
+
+      pcitxn_footer_s foot;
+      memcpy(foot.magic, PCITXN_INDEX_MAGIC, sizeof foot.magic);
+      foot.count = addr_index_.size();
+
+      foot.time_index = offset_;
+      foot.time_count = time_index_.size();
+      if (! time_index_.empty())
+	    fwrite(&time_index_[0], sizeof time_index_[0], time_index_.size(), fd_);
+      offset_ += time_index_.size() * sizeof(pcitxn_index_s);
+
+      foot.addr_index = offset_;
+      sort(addr_index_.begin(), addr_index_.end(), compare_index);
+      if (! addr_index_.empty())
+	    fwrite(&addr_index_[0], sizeof addr_index_[0], addr_index_.size(), fd_);
+      offset_ += addr_index_.size() * sizeof(pcitxn_index_s);
+
+      fwrite(&foot, sizeof foot, 1, fd_);
+      fclose(fd_);
+      fd_ = 0;
+
+      cerr << path_ << ": Wrote " << foot.count << " PCI transactions." << endl;
+}
@@ -0,0 +1,95 @@
+#ifndef __PciAnalyzer_H
+#define __PciAnalyzer_H
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  "priv.h"
+# include  "pcitxn.h"
+# include  <stdio.h>
+# include  <string>
+# include  <vector>
+
+/*
+ * The PciAnalyzer watches the resolved PCI bus signals at each rising
+ * edge of the PCI clock, and decodes them into transactions. Each
+ * transaction is written as a record to the transaction log (see
+ * pcitxn.h for the file format).
+ */
+class PciAnalyzer {
+
+    public:
+      explicit PciAnalyzer(const std::string&path);
+      ~PciAnalyzer();
+
+      bool is_open() const { return fd_ != 0; }
+
+	// The signals of the bus at a rising edge of the clock. The
+	// frame_dev and devsel_dev are the device numbers of the
+	// devices driving FRAME# and DEVSEL# low, or -1.
+      struct sample_s {
+	    uint64_t time_ps;
+	    bit_state_t frame_n, irdy_n, trdy_n, stop_n;
+	    bit_state_t devsel_n, req64_n, ack64_n;
+	    const std::valarray<bit_state_t>*ad;
+	    const std::valarray<bit_state_t>*cbe;
+	    int frame_dev;
+	    int devsel_dev;
+      };
+      void sample(const sample_s&smp);
+
+	// Finish the current transaction, write the index and close
+	// the file.
+      void close();
+
+    private:
+      void begin_transaction_(const sample_s&smp);
+      void data_phase_(const sample_s&smp);
+      void end_transaction_(void);
+
+    private:
+      std::string path_;
+      FILE*fd_;
+      uint64_t offset_;
+
+      enum state_t { IDLE, ADDR2, DATA };
+      state_t state_;
+
+	// Count of rising edges.
+      uint64_t clock_;
+      bool last_frame_;
+
+	// The transaction in progress.
+      pcitxn_rec_s cur_;
+      bool req64_;
+      bool devsel_seen_;
+      bool final_done_;
+      uint64_t addr_clock_;
+      uint64_t last_data_clock_;
+      std::vector<uint32_t> data_;
+      std::vector<uint8_t> cbe_;
+
+      std::vector<pcitxn_index_s> time_index_;
+      std::vector<pcitxn_index_s> addr_index_;
+
+    private: // Not implemented
+      PciAnalyzer(const PciAnalyzer&);
+      PciAnalyzer& operator= (const PciAnalyzer&);
+};
+
+#endif
@@ -0,0 +1,461 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  "PciArbiter.h"
+extern "C" {
+# include  "mt_priv.h"
+}
+# include  <stdlib.h>
+# include  <inttypes.h>
+# include  <iostream>
+# include  <cassert>
+
+using namespace std;
+
+/*
+ * The random policy is the original arbiter: The grant stays with
+ * the granted device while it requests, and otherwise goes to the
+ * next requesting device after it, or after a random device if none
+ * is granted.
+ */
+class PciArbiterRandom : public PciArbiter {
+    public:
+      explicit PciArbiterRandom(struct context_s*rand)
+      : PciArbiter("random"), rand_(rand) { }
+
+      int arbitrate(unsigned req, int granted, int master);
+
+    private:
+      struct context_s*rand_;
+};
+
+int PciArbiterRandom::arbitrate(unsigned req, int granted, int)
+{
+      if (granted >= 0 && (req >> granted) & 1)
+	    return granted;
+
+      int last = granted >= 0? granted : (long)genrand(rand_) % 16;
+      return next_request_(req, last);
+}
+
+/*
+ * The round-robin policy passes the grant to the next requesting
+ * device after the last device granted, as soon as the granted
+ * device becomes master. Every requesting device gets the bus in
+ * turn.
+ */
+class PciArbiterRoundRobin : public PciArbiter {
+    public:
+      PciArbiterRoundRobin() : PciArbiter("round-robin"), last_(15) { }
+
+      int arbitrate(unsigned req, int granted, int master);
+
+    private:
+      int last_;
+};
+
+int PciArbiterRoundRobin::arbitrate(unsigned req, int granted, int master)
+{
+      if (grant_pending_(req, granted, master))
+	    return granted;
+
+      last_ = next_request_(req, granted >= 0? granted : last_);
+      return last_;
+}
+
+/*
+ * The priority policy grants the requesting device that is first in
+ * the arb_priority list. The devices that are not in the list follow,
+ * lowest number first.
+ */
+class PciArbiterPriority : public PciArbiter {
+    public:
+      explicit PciArbiterPriority(const int order[16])
+      : PciArbiter("priority")
+      { for (int idx = 0 ; idx < 16 ; idx += 1) order_[idx] = order[idx]; }
+
+      int arbitrate(unsigned req, int granted, int master);
+
+    private:
+      int order_[16];
+};
+
+int PciArbiterPriority::arbitrate(unsigned req, int granted, int master)
+{
+      if (grant_pending_(req, granted, master))
+	    return granted;
+
+      for (int idx = 0 ; idx < 16 ; idx += 1) {
+	    if ((req >> order_[idx]) & 1)
+		  return order_[idx];
+      }
+
+      assert(0);
+      return granted;
+}
+
+/*
+ * The weighted policy is a smooth weighted round-robin. Each
+ * arbitration, each requesting device earns its weight in credit, and
+ * the device with the most credit gets the grant and pays back the
+ * weights of all the requesting devices. Over time, the devices that
+ * keep requesting get grants in proportion to their weights.
+ */
+class PciArbiterWeighted : public PciArbiter {
+    public:
+      explicit PciArbiterWeighted(const unsigned weight[16])
+      : PciArbiter("weighted")
+      { for (int idx = 0 ; idx < 16 ; idx += 1) {
+		  weight_[idx] = weight[idx];
+		  credit_[idx] = 0;
+	    }
+      }
+
+      int arbitrate(unsigned req, int granted, int master);
+
+    private:
+      long weight_[16];
+      long credit_[16];
+};
+
+int PciArbiterWeighted::arbitrate(unsigned req, int granted, int master)
+{
+      if (grant_pending_(req, granted, master))
+	    return granted;
+
+      long total = 0;
+      int best = -1;
+      for (int idx = 0 ; idx < 16 ; idx += 1) {
+	    if (! ((req >> idx) & 1))
+		  continue;
+	    credit_[idx] += weight_[idx];
+	    total += weight_[idx];
+	    if (best < 0 || credit_[idx] > credit_[best])
+		  best = idx;
+      }
+
+      assert(best >= 0);
+      credit_[best] -= total;
+      return best;
+}
+
+/*
+ * The latency policy is round-robin, but lets the master keep the
+ * grant while it is using the bus, until it has had the bus for
+ * arb_latency clocks. This models an arbiter that is set up with the
+ * latency timers of the masters, so that a master is not made to
+ * give up the bus before it has had its share of burst time.
+ */
+class PciArbiterLatency : public PciArbiter {
+    public:
+      explicit PciArbiterLatency(unsigned long latency)
+      : PciArbiter("latency"), latency_(latency), last_(15),
+	tenure_(0), busy_(false) { }
+
+      int arbitrate(unsigned req, int granted, int master);
+
+    private:
+      void clock_(const sample_s&smp, unsigned count);
+
+    private:
+      uint64_t latency_;
+      int last_;
+	// Clocks that the granted device has been master.
+      uint64_t tenure_;
+      bool busy_;
+};
+
+void PciArbiterLatency::clock_(const sample_s&smp, unsigned count)
+{
+      if (smp.master >= 0 && smp.master == smp.granted)
+	    tenure_ += count;
+      else
+	    tenure_ = 0;
+
+      busy_ = smp.busy;
+}
+
+int PciArbiterLatency::arbitrate(unsigned req, int granted, int master)
+{
+      if (grant_pending_(req, granted, master))
+	    return granted;
+
+      if (granted >= 0 && master == granted && busy_ && tenure_ < latency_)
+	    return granted;
+
+      last_ = next_request_(req, granted >= 0? granted : last_);
+      return last_;
+}
+
+/*
+ * Parse a list of device numbers, separated by commas, into the
+ * order. The devices that are not listed are added after, in order.
+ */
+static bool parse_priority(const string&bus, const string&text, int order[16])
+{
+      bool listed[16];
+      for (int idx = 0 ; idx < 16 ; idx += 1)
+	    listed[idx] = false;
+
+      int fill = 0;
+      const char*cp = text.c_str();
+      while (*cp) {
+	    char*ep;
+	    unsigned long dev = strtoul(cp, &ep, 0);
+	    if (ep == cp || dev > 15 || listed[dev] || (*ep != ',' && *ep != 0)) {
+		  cerr << "Bus " << bus << ": arb_priority=" << text
+		       << " is not a list of device numbers. Using random." << endl;
+		  return false;
+	    }
+	    listed[dev] = true;
+	    order[fill++] = dev;
+	    cp = *ep? ep+1 : ep;
+      }
+
+      for (int idx = 0 ; idx < 16 ; idx += 1) {
+	    if (! listed[idx])
+		  order[fill++] = idx;
+      }
+
+      assert(fill == 16);
+      return true;
+}
+
+/*
+ * Parse a list of <device>:<weight> items, separated by commas. The
+ * devices that are not listed keep their weight.
+ */
+static bool parse_weights(const string&bus, const string&text, unsigned weight[16])
+{
+      const char*cp = text.c_str();
+      while (*cp) {
+	    char*ep;
+	    unsigned long dev = strtoul(cp, &ep, 0);
+	    if (ep == cp || dev > 15 || *ep != ':') {
+		  cerr << "Bus " << bus << ": arb_weights=" << text
+		       << " is not a list of <device>:<weight>. Using random." << endl;
+		  return false;
+	    }
+	    cp = ep+1;
+	    unsigned long val = strtoul(cp, &ep, 0);
+	    if (ep == cp || (*ep != ',' && *ep != 0)) {
+		  cerr << "Bus " << bus << ": arb_weights=" << text
+		       << " is not a list of <device>:<weight>. Using random." << endl;
+		  return false;
+	    }
+	    weight[dev] = val;
+	    cp = *ep? ep+1 : ep;
+      }
+
+      return true;
+}
+
+PciArbiter* PciArbiter::make(struct bus_state*bus, struct context_s*rand)
+{
+      string policy = bus->options["arbiter"];
+
+      if (policy == "" || policy == "random")
+	    return new PciArbiterRandom(rand);
+
+      if (policy == "round-robin")
+	    return new PciArbiterRoundRobin;
+
+      if (policy == "priority") {
+	    int order[16];
+	    if (! parse_priority(bus->name, bus->options["arb_priority"], order))
+		  return new PciArbiterRandom(rand);
+	    return new PciArbiterPriority(order);
+      }
+
+      if (policy == "weighted") {
+	    unsigned weight[16];
+	    for (int idx = 0 ; idx < 16 ; idx += 1)
+		  weight[idx] = 1;
+	    if (! parse_weights(bus->name, bus->options["arb_weights"], weight))
+		  return new PciArbiterRandom(rand);
+	    return new PciArbiterWeighted(weight);
+      }
+
+      if (policy == "latency") {
+	    unsigned long latency = 16;
+	    string arb_latency = bus->options["arb_latency"];
+	    if (arb_latency != "")
+		  latency = strtoul(arb_latency.c_str(), 0, 0);
+	    return new PciArbiterLatency(latency);
+      }
+
+      cerr << "Bus " << bus->name << ": arbiter=" << policy
+	   << " is not a known arbiter. Using random." << endl;
+      return new PciArbiterRandom(rand);
+}
+
+PciArbiter::PciArbiter(const char*policy)
+: policy_(policy), fd_(0), clocks_(0), idle_clocks_(0), last_retry_(false)
+{
+      for (int idx = 0 ; idx < 16 ; idx += 1) {
+	    master_stats_s&st = stats_[idx];
+	    st.grants = 0;
+	    st.req_clocks = 0;
+	    st.wait_total = 0;
+	    st.wait_max = 0;
+	    st.busy_clocks = 0;
+	    st.grant_idle = 0;
+	    st.retries = 0;
+	    st.waiting = false;
+	    st.wait_start = 0;
+	    st.counted = false;
+      }
+}
+
+PciArbiter::~PciArbiter()
+{
+      close();
+}
+
+int PciArbiter::next_request_(unsigned req, int last)
+{
+      assert(req != 0);
+      int idx = last;
+      do {
+	    idx = (idx+1) % 16;
+      } while (! ((req >> idx) & 1));
+
+      return idx;
+}
+
+bool PciArbiter::grant_pending_(unsigned req, int granted, int master)
+{
+      return granted >= 0 && ((req >> granted) & 1) && master != granted;
+}
+
+void PciArbiter::clock_(const sample_s&, unsigned)
+{
+}
+
+void PciArbiter::device_name(int ident, const string&name)
+{
+      assert(ident >= 0 && ident < 16);
+      stats_[ident].name = name;
+}
+
+/*
+ * The grant latency of a request is the number of clocks from the
+ * rising edge where the REQ# is first seen to the rising edge where
+ * the device sees its GNT#. A request that comes while the device has
+ * the GNT# already (it is parked there) is granted with no wait.
+ */
+void PciArbiter::sample(const sample_s&smp, unsigned count)
+{
+      clock_(smp, count);
+
+      clocks_ += count;
+      if (! smp.busy)
+	    idle_clocks_ += count;
+
+      for (int idx = 0 ; idx < 16 ; idx += 1) {
+	    master_stats_s&st = stats_[idx];
+	    bool req = (smp.req >> idx) & 1;
+
+	    if (idx != smp.granted) {
+		  st.counted = false;
+		  if (req && ! st.waiting) {
+			st.waiting = true;
+			st.wait_start = clocks_;
+		  }
+
+	    } else if (st.waiting) {
+		  uint64_t wait = clocks_ - st.wait_start;
+		  st.grants += 1;
+		  st.wait_total += wait;
+		  if (wait > st.wait_max)
+			st.wait_max = wait;
+		  st.waiting = false;
+		  st.counted = true;
+
+	    } else if (req && ! st.counted) {
+		  st.grants += 1;
+		  st.counted = true;
+	    }
+
+	    if (req)
+		  st.req_clocks += count;
+      }
+
+      if (smp.master >= 0 && smp.busy)
+	    stats_[smp.master].busy_clocks += count;
+      if (smp.granted >= 0 && ! smp.busy)
+	    stats_[smp.granted].grant_idle += count;
+
+      if (smp.retry && ! last_retry_ && smp.master >= 0)
+	    stats_[smp.master].retries += 1;
+      last_retry_ = smp.retry;
+}
+
+bool PciArbiter::open_log(const string&path, const string&bus_name)
+{
+      fd_ = fopen(path.c_str(), "w");
+      if (fd_ == 0) {
+	    perror(path.c_str());
+	    return false;
+      }
+
+      path_ = path;
+      bus_name_ = bus_name;
+      return true;
+}
+
+/*
+ * The log has a line for the bus and then a line for each device,
+ * with the values in key=value form like the profile report. A device
+ * that is still waiting for its grant has the wait so far included in
+ * its wait_max, and is marked waiting=1.
+ */
+void PciArbiter::close()
+{
+      if (fd_ == 0)
+	    return;
+
+      fprintf(fd_, "arbiter bus=%s policy=%s clocks=%" PRIu64
+	      " idle_clocks=%" PRIu64 " utilization=%.4f\n",
+	      bus_name_.c_str(), policy_, clocks_, idle_clocks_,
+	      clocks_? (double)(clocks_ - idle_clocks_) / clocks_ : 0.0);
+
+      for (int idx = 0 ; idx < 16 ; idx += 1) {
+	    master_stats_s&st = stats_[idx];
+	    if (st.name == "")
+		  continue;
+
+	    uint64_t wait_max = st.wait_max;
+	    if (st.waiting && clocks_ - st.wait_start > wait_max)
+		  wait_max = clocks_ - st.wait_start;
+
+	    fprintf(fd_, "master dev=%d name=%s grants=%" PRIu64
+		    " req_clocks=%" PRIu64 " wait_avg=%.2f wait_max=%" PRIu64
+		    " waiting=%d busy_clocks=%" PRIu64 " occupancy=%.4f"
+		    " grant_idle=%" PRIu64 " retries=%" PRIu64 "\n",
+		    idx, st.name.c_str(), st.grants, st.req_clocks,
+		    st.grants? (double)st.wait_total / st.grants : 0.0,
+		    wait_max, st.waiting? 1 : 0, st.busy_clocks,
+		    clocks_? (double)st.busy_clocks / clocks_ : 0.0,
+		    st.grant_idle, st.retries);
+      }
+
+      fclose(fd_);
+      fd_ = 0;
+}
@@ -0,0 +1,127 @@
+#ifndef __PciArbiter_H
+#define __PciArbiter_H
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  "priv.h"
+# include  <stdio.h>
+# include  <string>
+
+struct context_s;
+
+/*
+ * A PciArbiter chooses which of the requesting devices gets the GNT#
+ * of a PCI bus. The PciProtocol samples the REQ# inputs at the rising
+ * edge of the clock and asks the arbiter for the new grant, so the
+ * derived classes are the arbitration policies. The PciProtocol still
+ * handles parking and recalling the grant when there are no requests.
+ *
+ * The arbiter also keeps per-master statistics of the bus use, which
+ * are written to the arb_log file (if any) at exit.
+ */
+class PciArbiter {
+
+    public:
+	// Make the arbiter that the "arbiter" option of the bus
+	// selects. The rand is the random number state of the bus,
+	// for the random policy. If the options are not valid, print
+	// an error and make the random arbiter.
+      static PciArbiter* make(struct bus_state*bus, struct context_s*rand);
+
+      explicit PciArbiter(const char*policy);
+      virtual ~PciArbiter();
+
+	// Choose the device to grant. The req is the mask of the
+	// devices that are requesting (bit N for device N) and is not
+	// 0. The granted is the device that has the GNT# now, and the
+	// master the device that is master of the bus, or -1 for
+	// none. Return the device to grant, which may be granted.
+      virtual int arbitrate(unsigned req, int granted, int master) =0;
+
+	// The state of the bus at a rising edge of the clock, for the
+	// statistics. The busy flag is true if FRAME# or IRDY# is
+	// asserted, and the retry flag is true if the target is
+	// asserting STOP# without TRDY#.
+      struct sample_s {
+	    unsigned req;
+	    int granted;
+	    int master;
+	    bool busy;
+	    bool retry;
+      };
+	// Account for count clocks with this bus state.
+      void sample(const sample_s&smp, unsigned count);
+
+	// Give the name of the device, for the statistics.
+      void device_name(int ident, const std::string&name);
+
+	// Write the statistics to the file at the path at exit.
+      bool open_log(const std::string&path, const std::string&bus_name);
+
+	// Write the statistics and close the file.
+      void close();
+
+    protected:
+	// The derived class may override this to track the bus state
+	// at each rising edge. The sample method calls it.
+      virtual void clock_(const sample_s&smp, unsigned count);
+
+	// Return the first requesting device after the device last,
+	// in round-robin order. This is last if it is the only one.
+      static int next_request_(unsigned req, int last);
+
+	// Return true if the granted device is still requesting, but
+	// has not yet become master. Taking the grant away then could
+	// starve it, so the policies leave the grant alone.
+      static bool grant_pending_(unsigned req, int granted, int master);
+
+    private:
+      const char*policy_;
+
+      std::string path_;
+      std::string bus_name_;
+      FILE*fd_;
+
+      uint64_t clocks_;
+      uint64_t idle_clocks_;
+      bool last_retry_;
+
+      struct master_stats_s {
+	    std::string name;
+	    uint64_t grants;
+	    uint64_t req_clocks;
+	    uint64_t wait_total;
+	    uint64_t wait_max;
+	    uint64_t busy_clocks;
+	    uint64_t grant_idle;
+	    uint64_t retries;
+	      // The clock of a REQ# that is waiting for a GNT#.
+	    bool waiting;
+	    uint64_t wait_start;
+	      // True if the current GNT# is already counted.
+	    bool counted;
+      };
+      master_stats_s stats_[16];
+
+    private: // Not implemented
+      PciArbiter(const PciArbiter&);
+      PciArbiter& operator= (const PciArbiter&);
+};
+
+#endif
@@ -18,11 +18,30 @@
  */
 
 # include  "PciProtocol.h"
+# include  "PciAnalyzer.h"
+# include  "PciArbiter.h"
 # include  <iostream>
+# include  <list>
+# include  <climits>
 # include  <cassert>
 
 using namespace std;
 
+/*
+ * The protocols are never deleted, so the buses that have a txn_log
+ * or arb_log are listed here and their logs are closed at exit.
+ */
+static list<PciProtocol*> logging_buses;
+
+static void close_bus_logs(void)
+{
+      while (! logging_buses.empty()) {
+	    PciProtocol*cur = logging_buses.front();
+	    logging_buses.pop_front();
+	    cur->close_logs();
+      }
+}
+
 /*
  * The clock_phase_map describes the phases of the clock. The phase
  * states are chosen to give clients a chance to participate in the
@@ -53,8 +72,12 @@ const PciProtocol::clock_phase_map_t PciProtocol::clock_phase_map66[4] = {
 };
 
 PciProtocol::PciProtocol(struct bus_state*b)
-: protocol_t(b), phase_(0), req_n_(16)
+: protocol_t(b), phase_(0), req_n_(16), analyzer_(0), arbiter_(0)
 {
+      for (int idx = 0 ; idx < BI_COUNT ; idx += 1)
+	    bi_conflict_[idx] = 0;
+      for (int idx = 0 ; idx < TR_COUNT ; idx += 1)
+	    trace_[idx] = -1;
       granted_ = 0;
       clock_phase_map_ = clock_phase_map33;
       park_mode_ = GNT_PARK_NONE;
@@ -95,39 +118,81 @@ PciProtocol::PciProtocol(struct bus_state*b)
       } else {
 	    pcixcap_ = BIT_0;
       }
+
+      string idle_skip = b->options["idle_skip"];
+      idle_skip_ = false;
+      if (idle_skip == "yes") {
+	    idle_skip_ = true;
+      } else if (idle_skip != "" && idle_skip != "no") {
+	    cerr << "Bus " << b->name << ": idle_skip=" << idle_skip
+		 << " is not yes or no. Using no." << endl;
+      }
+
+      string txn_log = b->options["txn_log"];
+      if (txn_log != "") {
+	    analyzer_ = new PciAnalyzer(txn_log);
+	    if (! analyzer_->is_open()) {
+		  delete analyzer_;
+		  analyzer_ = 0;
+	    }
+      }
+
+      arbiter_ = PciArbiter::make(b, rand_context_());
+
+      string arb_log = b->options["arb_log"];
+      bool arb_log_flag = false;
+      if (arb_log != "")
+	    arb_log_flag = arbiter_->open_log(arb_log, b->name);
+
+      if (analyzer_ || arb_log_flag) {
+	    if (logging_buses.empty())
+		  atexit(&close_bus_logs);
+	    logging_buses.push_back(this);
+      }
 }
 
 PciProtocol::~PciProtocol()
 {
+      logging_buses.remove(this);
+      delete analyzer_;
+      delete arbiter_;
+}
+
+void PciProtocol::close_logs()
+{
+      if (analyzer_)
+	    analyzer_->close();
+      arbiter_->close();
 }
 
 void PciProtocol::trace_init()
 {
-      make_trace_("PCI_CLK", PT_BITS);
-      make_trace_("RESET#",  PT_BITS);
-      make_trace_("FRAME#",  PT_BITS);
-      make_trace_("REQ64#",  PT_BITS);
-      make_trace_("IRDY#",   PT_BITS);
-      make_trace_("TRDY#",   PT_BITS);
-      make_trace_("STOP#",   PT_BITS);
-      make_trace_("DEVSEL#", PT_BITS);
-      make_trace_("ACK64#",  PT_BITS);
-      make_trace_("PAR",     PT_BITS);
-      make_trace_("PAR64",   PT_BITS);
-      make_trace_("AD",      PT_BITS, 32);
-      make_trace_("AD64",    PT_BITS, 32);
-      make_trace_("C/BE#",   PT_BITS, 4);
-      make_trace_("C/BE64#", PT_BITS, 4);
-      make_trace_("INTA#",   PT_BITS, 16);
-      make_trace_("INTB#",   PT_BITS, 16);
-      make_trace_("INTC#",   PT_BITS, 16);
-      make_trace_("INTD#",   PT_BITS, 16);
-      make_trace_("REQ#",    PT_BITS, 16);
-      make_trace_("Bus grant",PT_STRING);
-      make_trace_("Bus master",PT_STRING);
-      make_trace_("PCIXCAP", PT_STRING);
-
-      set_trace_("PCIXCAP", pcixcap_==BIT_1? "yes" : "no");
+      trace_[TR_PCI_CLK] = make_trace_("PCI_CLK",   PT_BITS);
+      trace_[TR_RESET]   = make_trace_("RESET#",    PT_BITS);
+      trace_[TR_FRAME]   = make_trace_("FRAME#",    PT_BITS);
+      trace_[TR_REQ64]   = make_trace_("REQ64#",    PT_BITS);
+      trace_[TR_IRDY]    = make_trace_("IRDY#",     PT_BITS);
+      trace_[TR_TRDY]    = make_trace_("TRDY#",     PT_BITS);
+      trace_[TR_STOP]    = make_trace_("STOP#",     PT_BITS);
+      trace_[TR_DEVSEL]  = make_trace_("DEVSEL#",   PT_BITS);
+      trace_[TR_ACK64]   = make_trace_("ACK64#",    PT_BITS);
+      trace_[TR_PAR]     = make_trace_("PAR",       PT_BITS);
+      trace_[TR_PAR64]   = make_trace_("PAR64",     PT_BITS);
+      trace_[TR_AD]      = make_trace_("AD",        PT_BITS, 32);
+      trace_[TR_AD64]    = make_trace_("AD64",      PT_BITS, 32);
+      trace_[TR_CBE]     = make_trace_("C/BE#",     PT_BITS, 4);
+      trace_[TR_CBE64]   = make_trace_("C/BE64#",   PT_BITS, 4);
+      trace_[TR_INTA]    = make_trace_("INTA#",     PT_BITS, 16);
+      trace_[TR_INTB]    = make_trace_("INTB#",     PT_BITS, 16);
+      trace_[TR_INTC]    = make_trace_("INTC#",     PT_BITS, 16);
+      trace_[TR_INTD]    = make_trace_("INTD#",     PT_BITS, 16);
+      trace_[TR_REQ]     = make_trace_("REQ#",      PT_BITS, 16);
+      trace_[TR_GRANT]   = make_trace_("Bus grant", PT_STRING);
+      trace_[TR_MASTER]  = make_trace_("Bus master", PT_STRING);
+      trace_[TR_PCIXCAP] = make_trace_("PCIXCAP",   PT_STRING);
+
+      if (trace_[TR_PCIXCAP] >= 0)
+	    set_trace_(trace_[TR_PCIXCAP], pcixcap_==BIT_1? "yes" : "no");
 }
 
 void PciProtocol::run_init()
@@ -142,6 +207,8 @@ void PciProtocol::run_init()
 
 	    struct bus_device_plug&curdev = *(dev->second);
 
+	    arbiter_->device_name(curdev.ident, curdev.name);
+
 	    curdev.send_signals["PCIXCAP"].resize(1);
 	    curdev.send_signals["PCIXCAP"][0] = pcixcap_;
 
@@ -237,8 +304,9 @@ void PciProtocol::run_init()
 
 void PciProtocol::run_run()
 {
-	// Step the PCI clock.
-      advance_pci_clock_();
+	// Step the PCI clock, skipping idle clocks if possible.
+      unsigned skip = idle_clocks_();
+      advance_pci_clock_(skip);
 
 	// Calculate the RESET# signal.
       bit_state_t reset_n = calculate_reset_n_();
@@ -276,17 +344,83 @@ void PciProtocol::run_run()
 	    }
       }
 
-      set_trace_("PCI_CLK", pci_clk);
-      set_trace_("RESET#",  reset_n);
+      set_trace_(trace_[TR_PCI_CLK], pci_clk);
+      set_trace_(trace_[TR_RESET],  reset_n);
+
+	// The skipped clocks are idle, with the grant left where
+	// it is, so account for them all at once.
+      if (skip > 0) {
+	    PciArbiter::sample_s smp;
+	    smp.req = 0;
+	    smp.granted = granted_? granted_->ident : -1;
+	    smp.master = -1;
+	    smp.busy = false;
+	    smp.retry = false;
+	    arbiter_->sample(smp, skip);
+
+	    until_token_("IDLE", skip);
+      }
 }
 
-void PciProtocol::advance_pci_clock_(void)
+/*
+ * The bus is idle if nobody is requesting or holding the bus, so the
+ * arbiter has nothing to do and none of the shared signals are
+ * driven. If the bus is idle at the posedge and all the clients are
+ * waiting (they sent WAIT=<n> tokens), then nothing can change until
+ * the first client is done waiting. Return the number of whole clocks
+ * that can be skipped, or 0.
+ */
+unsigned PciProtocol::idle_clocks_()
 {
-	// Advance the phase pointer
-      phase_ = (phase_ + 1) % 4;
+      if (! idle_skip_ || phase_ != 0 || master_ != 0)
+	    return 0;
+
+      unsigned wait = UINT_MAX;
+      for (bus_device_map_t::iterator dev = device_map().begin()
+		 ; dev != device_map().end() ; dev ++) {
+
+	    struct bus_device_plug*curdev = dev->second;
+	    if (curdev->wait_clocks < wait)
+		  wait = curdev->wait_clocks;
+	    if (wait < 2)
+		  return 0;
+
+	    valarray<bit_state_t>&req_n = curdev->client_signals["REQ#"];
+	    if (req_n.size() > 0 && req_n[0] == BIT_0)
+		  return 0;
+	    valarray<bit_state_t>&frame_n = curdev->client_signals["FRAME#"];
+	    if (frame_n.size() > 0 && frame_n[0] == BIT_0)
+		  return 0;
+	    valarray<bit_state_t>&irdy_n = curdev->client_signals["IRDY#"];
+	    if (irdy_n.size() > 0 && irdy_n[0] == BIT_0)
+		  return 0;
+      }
 
-	// Advance time for the next phase
-      advance_time_(clock_phase_map_[phase_].duration_ps, -12);
+	// Stop before the posedge that ends the shortest wait.
+      return wait - 1;
+}
+
+void PciProtocol::advance_pci_clock_(unsigned skip)
+{
+	// Advance the phase pointer, and advance time by the length
+	// of the phases stepped over. If skipping idle clocks, go to
+	// the negedge of the last skipped clock. The clients see the
+	// next posedge as the end of their wait.
+      uint64_t duration = 0;
+      int steps = clock_phase_step_();
+      if (skip > 0) {
+	    assert(phase_ == 0);
+	    for (int idx = 0 ; idx < 4 ; idx += 1)
+		  duration += clock_phase_map_[idx].duration_ps;
+	    duration *= skip;
+	    steps = 2;
+      }
+
+      for (int idx = 0 ; idx < steps ; idx += 1) {
+	    phase_ = (phase_ + 1) % 4;
+	    duration += clock_phase_map_[phase_].duration_ps;
+      }
+      advance_time_(duration, -12);
 }
 
 bit_state_t PciProtocol::calculate_reset_n_()
@@ -346,10 +480,11 @@ void PciProtocol::track_req_n_()
 	    req_n_[curdev->ident] = tmp[0];
       }
 
-      set_trace_("REQ#", req_n_);
+      set_trace_(trace_[TR_REQ], req_n_);
 
       if (master_ == 0 && granted_ == 0) {
-	    set_trace_("Bus master", "<>");
+	    if (trace_[TR_MASTER] >= 0)
+		  set_trace_(trace_[TR_MASTER], "<>");
 
       } else if (master_ == 0) {
 	    assert(granted_);
@@ -359,7 +494,8 @@ void PciProtocol::track_req_n_()
 	    valarray<bit_state_t>&frame_g = granted_->client_signals["FRAME#"];
 	    if (frame_g[0] == BIT_0) {
 		  master_ = granted_;
-		  set_trace_("Bus master", master_->name);
+		  if (trace_[TR_MASTER] >= 0)
+			set_trace_(trace_[TR_MASTER], master_->name);
 	    }
 
       } else if (master_ == granted_) {
@@ -382,7 +518,8 @@ void PciProtocol::track_req_n_()
 	    } else  {
 		    // Give bus to grantee.
 		  master_ = granted_;
-		  set_trace_("Bus master", master_->name);
+		  if (trace_[TR_MASTER] >= 0)
+			set_trace_(trace_[TR_MASTER], master_->name);
 	    }
 
       } else {
@@ -397,7 +534,8 @@ void PciProtocol::track_req_n_()
 	      // active, then it no longer owns the bus.
 	    if (frame_m[0] != BIT_0 && irdy_m[0] != BIT_0) {
 		  master_ = 0;
-		  set_trace_("Bus master", "<>");
+		  if (trace_[TR_MASTER] >= 0)
+			set_trace_(trace_[TR_MASTER], "<>");
 	    }
       }
 }
@@ -405,13 +543,19 @@ void PciProtocol::track_req_n_()
 void PciProtocol::arbitrate_()
 {
 	// Only arbitrate on the rising edge of the clock. So
-	// arbitration results are sent out after the HOLD time.
-      if (phase_ != 1)
+	// arbitration results are sent out after the HOLD time. With
+	// only the 2 edge phases, they are sent out at the negedge.
+      if (phase_ != (clock_phase_step_() == 2? 2 : 1))
 	    return;
 
       int count_requests = 0;
-      for (int idx = 0 ; idx < 16 ; idx += 1)
-	    if (req_n_[idx] == BIT_0) count_requests += 1;
+      unsigned req = 0;
+      for (int idx = 0 ; idx < 16 ; idx += 1) {
+	    if (req_n_[idx] != BIT_0)
+		  continue;
+	    count_requests += 1;
+	    req |= 1U << idx;
+      }
 
 	// If there are no requests, then leave the GNT# signals as
 	// they are. This has the effect of parking the GNT# at the
@@ -425,22 +569,15 @@ void PciProtocol::arbitrate_()
 		    // the client's ability to handle that.
 		  granted_->send_signals["GNT#"][0] = BIT_1;
 		  granted_ = 0;
-		  set_trace_("Bus grant", "<>");
+		  if (trace_[TR_GRANT] >= 0)
+			set_trace_(trace_[TR_GRANT], "<>");
 	    }
 	    return;
       }
 
-	// If the current grantee is still requesting, then don't take
-	// the bus away from it.
-      if (granted_ && req_n_[granted_->ident] == BIT_0)
-	    return;
-
+	// The arbitration policy chooses among the requests.
       int old_grant = granted_? granted_->ident : -1;
-      int new_grant = granted_? granted_->ident : (lrand_()%16);
-
-      do {
-	    new_grant = (new_grant+1) % 16;
-      } while (req_n_[new_grant] != BIT_0);
+      int new_grant = arbiter_->arbitrate(req, old_grant, master_? master_->ident : -1);
 
       if (new_grant == old_grant)
 	    return;
@@ -475,7 +612,8 @@ void PciProtocol::arbitrate_()
 	// Indicate where the grant is being sent. Note that exactly
 	// one GNT# is ever active, so we can be clever and give the
 	// client name here.
-      set_trace_("Bus grant", granted_->name);
+      if (trace_[TR_GRANT] >= 0)
+	    set_trace_(trace_[TR_GRANT], granted_->name);
 }
 
 void PciProtocol::route_interrupts_()
@@ -565,140 +703,243 @@ void PciProtocol::route_interrupts_()
 		  curdev->send_signals["INTD#"][cur->first] = cur->second;
 	    }
 
-	    set_trace_("INTA#", curdev->send_signals["INTA#"]);
-	    set_trace_("INTB#", curdev->send_signals["INTB#"]);
-	    set_trace_("INTC#", curdev->send_signals["INTC#"]);
-	    set_trace_("INTD#", curdev->send_signals["INTD#"]);
+	    if (trace_[TR_INTA] >= 0)
+		  set_trace_(trace_[TR_INTA], curdev->send_signals["INTA#"]);
+	    if (trace_[TR_INTB] >= 0)
+		  set_trace_(trace_[TR_INTB], curdev->send_signals["INTB#"]);
+	    if (trace_[TR_INTC] >= 0)
+		  set_trace_(trace_[TR_INTC], curdev->send_signals["INTC#"]);
+	    if (trace_[TR_INTD] >= 0)
+		  set_trace_(trace_[TR_INTD], curdev->send_signals["INTD#"]);
       }
 }
 
-static bit_state_t blend_bits(bit_state_t a, bit_state_t b)
+/*
+ * The bi-directional signals are blended in packed form. Bit n of a
+ * signal is bit n of an aval and a bval word, with the same encoding
+ * as bit_state_t (and Verilog): 0=(0,0), 1=(1,0), z=(0,1), x=(1,1).
+ * Bits past the width of the signal are z.
+ *
+ * The clients still send and receive the signals as valarrays, so
+ * each phase packs every device's drive bit by bit on the way in, and
+ * unpacks the result bit by bit on the way out. Only the blending in
+ * between works on whole words, with bitwise operations:
+ *
+ *   one  - bits that some device drives to 1
+ *   zero - bits that some device drives to 0
+ *   xs   - bits that some device drives to x
+ *
+ * A bit is x if any device drives x or if one device drives 0 and
+ * another 1 (a conflict), z if no device drives it, and otherwise the
+ * driven value. This is the same as blending the drivers pairwise.
+ */
+static const struct bi_signal_s {
+      const char*name;
+      unsigned wid;
+} bi_signals[] = {
+      { "FRAME#",  1 },
+      { "REQ64#",  1 },
+      { "IRDY#",   1 },
+      { "TRDY#",   1 },
+      { "STOP#",   1 },
+      { "DEVSEL#", 1 },
+      { "ACK64#",  1 },
+      { "AD",     64 },
+      { "C/BE#",   8 },
+      { "PAR",     1 },
+      { "PAR64",   1 }
+};
+
+static inline bit_state_t packed_bit(uint64_t aval, uint64_t bval, unsigned idx)
 {
-      assert(a < 4);
-      assert(b < 4);
-
-      if (a == BIT_Z)
-	    return b;
-      if (b == BIT_Z)
-	    return a;
-      if (a == b)
-	    return a;
-      else
-	    return BIT_X;
+      return (bit_state_t) (((aval >> idx) & 1) | (((bval >> idx) & 1) << 1));
 }
 
-static bit_state_t subtract_feedback(bit_state_t sig, bit_state_t ref)
+static void pack_bits(uint64_t&aval, uint64_t&bval, const valarray<bit_state_t>&val, unsigned wid)
 {
-      if (ref == BIT_Z)
-	    return sig;
-      if (sig == ref)
-	    return BIT_Z;
-      return sig;
+      if (val.size() < wid)
+	    wid = val.size();
+
+      aval = 0;
+      bval = wid < 64? ~UINT64_C(0) << wid : 0;
+      for (unsigned idx = 0 ; idx < wid ; idx += 1) {
+	    uint64_t bit = val[idx];
+	    aval |= (bit & 1) << idx;
+	    bval |= (bit >> 1) << idx;
+      }
+}
+
+static void unpack_bits(valarray<bit_state_t>&val, uint64_t aval, uint64_t bval, unsigned wid)
+{
+      assert(val.size() == wid);
+      for (unsigned idx = 0 ; idx < wid ; idx += 1)
+	    val[idx] = packed_bit(aval, bval, idx);
 }
 
 void PciProtocol::blend_bi_signals_(void)
 {
-      bit_state_t frame_n = BIT_Z;
-      bit_state_t req64_n = BIT_Z;
-      bit_state_t devsel_n= BIT_Z;
-      bit_state_t ack64_n = BIT_Z;
-      bit_state_t irdy_n  = BIT_Z;
-      bit_state_t trdy_n  = BIT_Z;
-      bit_state_t stop_n  = BIT_Z;
-      valarray<bit_state_t> ad (64);
-      valarray<bit_state_t> cbe(8);
-      bit_state_t par = BIT_Z;
-      bit_state_t par64 = BIT_Z;
+      uint64_t one[BI_COUNT], zero[BI_COUNT], xs[BI_COUNT];
+      for (int sig = 0 ; sig < BI_COUNT ; sig += 1) {
+	    one[sig] = 0;
+	    zero[sig] = 0;
+	    xs[sig] = 0;
+      }
 
-      for (int idx = 0 ; idx < 64 ; idx += 1)
-	    ad[idx] = BIT_Z;
-      for (int idx = 0 ; idx < 8 ; idx += 1)
-	    cbe[idx] = BIT_Z;
+      int frame_dev = -1;
+      int devsel_dev = -1;
 
+	// Pack the drivers of all the devices, and collect them.
+      bi_drive_.resize(device_map().size() * BI_COUNT);
+      packed_bits_s*drv = &bi_drive_[0];
       for (bus_device_map_t::iterator dev = device_map().begin()
 		 ; dev != device_map().end() ; dev ++ ) {
 
 	    struct bus_device_plug&curdev = *(dev->second);
-	    bit_state_t tmp;
-
-	    tmp = curdev.client_signals["FRAME#"][0];
-	    frame_n = blend_bits(frame_n, tmp);
-
-	    tmp = curdev.client_signals["REQ64#"][0];
-	    req64_n = blend_bits(req64_n, tmp);
 
-	    tmp = curdev.client_signals["DEVSEL#"][0];
-	    devsel_n = blend_bits(devsel_n, tmp);
+	    for (int sig = 0 ; sig < BI_COUNT ; sig += 1) {
+		  uint64_t aval, bval;
+		  pack_bits(aval, bval, curdev.client_signals[bi_signals[sig].name],
+			    bi_signals[sig].wid);
+		  drv[sig].aval = aval;
+		  drv[sig].bval = bval;
 
-	    tmp = curdev.client_signals["ACK64#"][0];
-	    ack64_n = blend_bits(ack64_n, tmp);
-
-	    tmp = curdev.client_signals["IRDY#"][0];
-	    irdy_n = blend_bits(irdy_n, tmp);
+		  one[sig]  |=  aval & ~bval;
+		  zero[sig] |= ~aval & ~bval;
+		  xs[sig]   |=  aval &  bval;
+	    }
 
-	    tmp = curdev.client_signals["TRDY#"][0];
-	    trdy_n = blend_bits(trdy_n, tmp);
+	    if ((~drv[BI_FRAME].aval & ~drv[BI_FRAME].bval) & 1)
+		  frame_dev = curdev.ident;
+	    if ((~drv[BI_DEVSEL].aval & ~drv[BI_DEVSEL].bval) & 1)
+		  devsel_dev = curdev.ident;
 
-	    tmp = curdev.client_signals["STOP#"][0];
-	    stop_n = blend_bits(stop_n, tmp);
+	    drv += BI_COUNT;
+      }
 
-	    valarray<bit_state_t>&tmp_ad = curdev.client_signals["AD"];
-	    for (int idx = 0 ; idx < 64 ; idx += 1)
-		  ad[idx] = blend_bits(ad[idx], tmp_ad[idx]);
+	// Resolve all the signals, and report new conflicts.
+      packed_bits_s res[BI_COUNT];
+      for (int sig = 0 ; sig < BI_COUNT ; sig += 1) {
+	    uint64_t conflict = one[sig] & zero[sig];
+	    res[sig].aval = one[sig] | xs[sig];
+	    res[sig].bval = xs[sig] | conflict | ~(one[sig] | zero[sig]);
 
-	    valarray<bit_state_t>&tmp_cbe = curdev.client_signals["C/BE#"];
-	    for (int idx = 0 ; idx < 8 ; idx += 1)
-		  cbe[idx] = blend_bits(cbe[idx], tmp_cbe[idx]);
+	    if (conflict & ~bi_conflict_[sig])
+		  report_conflict_(sig, conflict);
+	    bi_conflict_[sig] = conflict;
+      }
 
-	    tmp = curdev.client_signals["PAR"][0];
-	    par = blend_bits(par, tmp);
+      valarray<bit_state_t> ad (64);
+      valarray<bit_state_t> cbe(8);
+      unpack_bits(ad,  res[BI_AD].aval,  res[BI_AD].bval,  64);
+      unpack_bits(cbe, res[BI_CBE].aval, res[BI_CBE].bval, 8);
+
+      bit_state_t frame_n = packed_bit(res[BI_FRAME].aval,  res[BI_FRAME].bval,  0);
+      bit_state_t req64_n = packed_bit(res[BI_REQ64].aval,  res[BI_REQ64].bval,  0);
+      bit_state_t irdy_n  = packed_bit(res[BI_IRDY].aval,   res[BI_IRDY].bval,   0);
+      bit_state_t trdy_n  = packed_bit(res[BI_TRDY].aval,   res[BI_TRDY].bval,   0);
+      bit_state_t stop_n  = packed_bit(res[BI_STOP].aval,   res[BI_STOP].bval,   0);
+      bit_state_t devsel_n= packed_bit(res[BI_DEVSEL].aval, res[BI_DEVSEL].bval, 0);
+      bit_state_t ack64_n = packed_bit(res[BI_ACK64].aval,  res[BI_ACK64].bval,  0);
+      bit_state_t par     = packed_bit(res[BI_PAR].aval,    res[BI_PAR].bval,    0);
+      bit_state_t par64   = packed_bit(res[BI_PAR64].aval,  res[BI_PAR64].bval,  0);
+
+	// The transaction decoder samples the bus at the rising edge
+	// of the clock, like the devices do.
+      if (analyzer_ && phase_ == 0) {
+	    PciAnalyzer::sample_s smp;
+	    smp.time_ps  = peek_time().units_value(-12);
+	    smp.frame_n  = frame_n;
+	    smp.irdy_n   = irdy_n;
+	    smp.trdy_n   = trdy_n;
+	    smp.stop_n   = stop_n;
+	    smp.devsel_n = devsel_n;
+	    smp.req64_n  = req64_n;
+	    smp.ack64_n  = ack64_n;
+	    smp.ad  = &ad;
+	    smp.cbe = &cbe;
+	    smp.frame_dev  = frame_dev;
+	    smp.devsel_dev = devsel_dev;
+	    analyzer_->sample(smp);
+      }
 
-	    tmp = curdev.client_signals["PAR64"][0];
-	    par64 = blend_bits(par64, tmp);
+	// The arbiter keeps its statistics from the same samples.
+      if (phase_ == 0) {
+	    PciArbiter::sample_s smp;
+	    smp.req = 0;
+	    for (int idx = 0 ; idx < 16 ; idx += 1)
+		  if (req_n_[idx] == BIT_0) smp.req |= 1U << idx;
+	    smp.granted = granted_? granted_->ident : -1;
+	    smp.master  = master_? master_->ident : -1;
+	    smp.busy  = frame_n == BIT_0 || irdy_n == BIT_0;
+	    smp.retry = stop_n == BIT_0 && trdy_n != BIT_0 && devsel_n == BIT_0;
+	    arbiter_->sample(smp, 1);
       }
 
+      set_trace_(trace_[TR_FRAME], frame_n);
+      set_trace_(trace_[TR_REQ64], req64_n);
+      set_trace_(trace_[TR_IRDY],  irdy_n);
+      set_trace_(trace_[TR_TRDY],  trdy_n);
+      set_trace_(trace_[TR_STOP],  stop_n);
+      set_trace_(trace_[TR_DEVSEL],devsel_n);
+      set_trace_(trace_[TR_ACK64], ack64_n);
+      if (trace_[TR_AD] >= 0)
+	    set_trace_(trace_[TR_AD],   ad[slice( 0,32,1)]);
+      if (trace_[TR_AD64] >= 0)
+	    set_trace_(trace_[TR_AD64], ad[slice(32,32,1)]);
+      if (trace_[TR_CBE] >= 0)
+	    set_trace_(trace_[TR_CBE],   cbe[slice(0,4,1)]);
+      if (trace_[TR_CBE64] >= 0)
+	    set_trace_(trace_[TR_CBE64], cbe[slice(4,4,1)]);
+      set_trace_(trace_[TR_PAR],    par);
+      set_trace_(trace_[TR_PAR64],  par64);
+
+	// Send each device the resolved signals, less its own
+	// drive. Bits that the device drives to the value that the
+	// bus has are sent as z.
+      drv = &bi_drive_[0];
       for (bus_device_map_t::iterator dev = device_map().begin()
 		 ; dev != device_map().end() ; dev ++ ) {
 
 	    struct bus_device_plug&curdev = *(dev->second);
 
-	    set_trace_("FRAME#", frame_n);
-	    set_trace_("REQ64#", req64_n);
-	    set_trace_("IRDY#",  irdy_n);
-	    set_trace_("TRDY#",  trdy_n);
-	    set_trace_("STOP#",  stop_n);
-	    set_trace_("DEVSEL#",devsel_n);
-	    set_trace_("ACK64#", ack64_n);
-
-	    curdev.send_signals["FRAME#"][0] = subtract_feedback(frame_n, curdev.client_signals["FRAME#"][0]);
-	    curdev.send_signals["REQ64#"][0] = subtract_feedback(req64_n, curdev.client_signals["REQ64#"][0]);
-	    curdev.send_signals["IRDY#"][0]  = subtract_feedback(irdy_n, curdev.client_signals["IRDY#"][0]);
-	    curdev.send_signals["TRDY#"][0]  = subtract_feedback(trdy_n, curdev.client_signals["TRDY#"][0]);
-	    curdev.send_signals["STOP#"][0]  = subtract_feedback(stop_n, curdev.client_signals["STOP#"][0]);
-	    curdev.send_signals["DEVSEL#"][0]= subtract_feedback(devsel_n, curdev.client_signals["DEVSEL#"][0]);
-	    curdev.send_signals["ACK64#"][0] = subtract_feedback(ack64_n, curdev.client_signals["ACK64#"][0]);
+	    for (int sig = 0 ; sig < BI_COUNT ; sig += 1) {
+		  uint64_t ref_z = ~drv[sig].aval & drv[sig].bval;
+		  uint64_t same  = ~(res[sig].aval ^ drv[sig].aval)
+			& ~(res[sig].bval ^ drv[sig].bval);
+		  uint64_t mask = same & ~ref_z;
+		  unpack_bits(curdev.send_signals[bi_signals[sig].name],
+			      res[sig].aval & ~mask, res[sig].bval | mask,
+			      bi_signals[sig].wid);
+	    }
 
 	    curdev.send_signals["IDSEL"][0]  = ad[curdev.ident+16];
 
-	    valarray<bit_state_t>&tmp_ad = curdev.send_signals["AD"];
-	    valarray<bit_state_t>&cli_ad = curdev.client_signals["AD"];
-	    for (int idx = 0 ; idx < 64 ; idx += 1)
-		  tmp_ad[idx] = subtract_feedback(ad[idx], cli_ad[idx]);
-
-	    valarray<bit_state_t>&tmp_cbe = curdev.send_signals["C/BE#"];
-	    valarray<bit_state_t>&cli_cbe = curdev.client_signals["C/BE#"];
-	    for (int idx = 0 ; idx < 8 ; idx += 1)
-		  tmp_cbe[idx] = subtract_feedback(cbe[idx], cli_cbe[idx]);
-
-	    set_trace_("AD",   ad[slice( 0,32,1)]);
-	    set_trace_("AD64", ad[slice(32,32,1)]);
-	    set_trace_("C/BE#",   cbe[slice(0,4,1)]);
-	    set_trace_("C/BE64#", cbe[slice(4,4,1)]);
-
-	    curdev.send_signals["PAR"][0]   = subtract_feedback(par, curdev.client_signals["PAR"][0]);
-	    curdev.send_signals["PAR64"][0] = subtract_feedback(par64, curdev.client_signals["PAR64"][0]);
+	    drv += BI_COUNT;
+      }
+}
 
-	    set_trace_("PAR",    par);
-	    set_trace_("PAR64",  par64);
+/*
+ * Two or more devices drive some bits of a signal to opposite
+ * values. Those bits are x on the bus. Report the bits and the
+ * devices that drive them.
+ */
+void PciProtocol::report_conflict_(int sig, uint64_t bits)
+{
+      cerr << "Bus " << bus_name() << ": drive conflict"
+	   << " signal=" << bi_signals[sig].name
+	   << " bits=0x" << hex << bits << dec
+	   << " time=" << peek_time().peek_mant() << "e" << peek_time().peek_exp()
+	   << " devices=";
+
+      const char*sep = "";
+      packed_bits_s*drv = &bi_drive_[0];
+      for (bus_device_map_t::iterator dev = device_map().begin()
+		 ; dev != device_map().end() ; dev ++ ) {
+	    if (~drv[sig].bval & bits) {
+		  cerr << sep << dev->first;
+		  sep = ",";
+	    }
+	    drv += BI_COUNT;
       }
+      cerr << endl;
 }
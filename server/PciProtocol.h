@@ -20,6 +20,10 @@
  */
 
 # include  "protocol.h"
+# include  <vector>
+
+class PciAnalyzer;
+class PciArbiter;
 
 class PciProtocol  : public protocol_t {
 
@@ -31,13 +35,18 @@ class PciProtocol  : public protocol_t {
       void run_init();
       void run_run();
 
+	// Write out the transaction and arbiter logs.
+      void close_logs();
+
     private:
-      void advance_pci_clock_(void);
+      unsigned idle_clocks_(void);
+      void advance_pci_clock_(unsigned skip);
       bit_state_t calculate_reset_n_(void);
       void track_req_n_(void);
       void arbitrate_(void);
       void route_interrupts_(void);
       void blend_bi_signals_(void);
+      void report_conflict_(int sig, uint64_t bits);
 
     private:
       typedef struct {
@@ -55,6 +64,10 @@ class PciProtocol  : public protocol_t {
       park_mode_t park_mode_;
       long gnt_linger_;
 
+	// If true, skip clocks while the bus is idle and all the
+	// clients are waiting.
+      bool idle_skip_;
+
 	// Current state of the PCI clock. (It toggles.)
       int phase_;
 	// Device that is currently granted, if any.
@@ -67,6 +80,36 @@ class PciProtocol  : public protocol_t {
 
 	// These are the sampled REQ# inputs.
       std::valarray<bit_state_t> req_n_;
+
+	// Transaction decoder, if the txn_log option is set.
+      PciAnalyzer*analyzer_;
+
+	// The arbitration policy, selected by the arbiter option.
+      PciArbiter*arbiter_;
+
+	// The bi-directional signals are resolved packed, each in an
+	// aval/bval pair of words (see blend_bi_signals_).
+      struct packed_bits_s {
+	    uint64_t aval, bval;
+      };
+      enum bi_signal_t { BI_FRAME, BI_REQ64, BI_IRDY, BI_TRDY, BI_STOP,
+			 BI_DEVSEL, BI_ACK64, BI_AD, BI_CBE, BI_PAR,
+			 BI_PAR64, BI_COUNT };
+	// The packed drivers of each device, BI_COUNT per device.
+      std::vector<packed_bits_s> bi_drive_;
+	// The bits of each signal that were in conflict at the last
+	// phase, so that a conflict is reported once when it starts.
+      uint64_t bi_conflict_[BI_COUNT];
+
+	// The trace symbols, from trace_init, or -1 for the signals
+	// that are not traced.
+      enum trace_signal_t { TR_PCI_CLK, TR_RESET, TR_FRAME, TR_REQ64,
+			    TR_IRDY, TR_TRDY, TR_STOP, TR_DEVSEL, TR_ACK64,
+			    TR_PAR, TR_PAR64, TR_AD, TR_AD64, TR_CBE,
+			    TR_CBE64, TR_INTA, TR_INTB, TR_INTC, TR_INTD,
+			    TR_REQ, TR_GRANT, TR_MASTER, TR_PCIXCAP,
+			    TR_COUNT };
+      int trace_[TR_COUNT];
 };
 
 #endif
@@ -28,6 +28,8 @@ PointToPoint::PointToPoint(struct bus_state*b)
 {
       phase_ = 0;
       master_clock_mode_ = CLOCK_RUN;
+      for (int idx = 0 ; idx < TR_COUNT ; idx += 1)
+	    trace_[idx] = -1;
 
       string opt_width = b->options["WIDTH"];
       if (! opt_width.empty()) {
@@ -89,12 +91,12 @@ string PointToPoint::clock_mode_string_(clock_mode_t mode)
 
 void PointToPoint::trace_init()
 {
-      make_trace_("CLOCK", PT_BITS);
-      make_trace_("CLOCK_MODE", PT_STRING);
+      trace_[TR_CLOCK] = make_trace_("CLOCK", PT_BITS);
+      trace_[TR_CLOCK_MODE] = make_trace_("CLOCK_MODE", PT_STRING);
       if (wid_i_ > 0)
-	    make_trace_("DATA_I", PT_BITS, wid_i_);
+	    trace_[TR_DATA_I] = make_trace_("DATA_I", PT_BITS, wid_i_);
       if (wid_o_ > 0)
-	    make_trace_("DATA_O", PT_BITS, wid_o_);
+	    trace_[TR_DATA_O] = make_trace_("DATA_O", PT_BITS, wid_o_);
 }
 
 void PointToPoint::run_init()
@@ -130,8 +132,9 @@ void PointToPoint::run_init()
       for (unsigned idx = 0 ; idx < wid_o_ ; idx += 1)
 	    slave_->second->send_signals["DATA_O"][idx] = BIT_Z;
 
-      set_trace_("CLOCK", BIT_1);
-      set_trace_("CLOCK_MODE", clock_mode_string_(master_clock_mode_));
+      set_trace_(trace_[TR_CLOCK], BIT_1);
+      if (trace_[TR_CLOCK_MODE] >= 0)
+	    set_trace_(trace_[TR_CLOCK_MODE], clock_mode_string_(master_clock_mode_));
 }
 
 void PointToPoint::run_run()
@@ -209,19 +212,23 @@ void PointToPoint::run_run()
       }
       master_->second->send_signals["DATA_I"] = data_i;
 
-      set_trace_("CLOCK", bus_clk);
-      set_trace_("CLOCK_MODE", clock_mode_string_(master_clock_mode_));
-      if (wid_o_) set_trace_("DATA_O", data_o);
-      if (wid_i_) set_trace_("DATA_I", data_i);
+      set_trace_(trace_[TR_CLOCK], bus_clk);
+      if (trace_[TR_CLOCK_MODE] >= 0)
+	    set_trace_(trace_[TR_CLOCK_MODE], clock_mode_string_(master_clock_mode_));
+      set_trace_(trace_[TR_DATA_O], data_o);
+      set_trace_(trace_[TR_DATA_I], data_i);
 }
 
 void PointToPoint::advance_bus_clock_(void)
 {
-	// Advance the phase pointer
-      phase_ = (phase_ + 1) % 4;
-
-	// Advance time for the next phase. (Note that the table times
-	// are in pico-seconds.
-      advance_time_(clock_phase_map_[phase_], -12);
+	// Advance the phase pointer, and advance time by the length
+	// of the phases stepped over. (Note that the table times are
+	// in pico-seconds.)
+      uint64_t duration = 0;
+      for (int idx = 0 ; idx < clock_phase_step_() ; idx += 1) {
+	    phase_ = (phase_ + 1) % 4;
+	    duration += clock_phase_map_[phase_];
+      }
+      advance_time_(duration, -12);
 }
 
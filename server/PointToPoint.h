@@ -54,6 +54,12 @@ class PointToPoint  : public protocol_t {
 	// we arbitrarily name master and slave.
       bus_device_map_t::iterator master_;
       bus_device_map_t::iterator slave_;
+
+	// The trace symbols, from trace_init, or -1 for the signals
+	// that are not traced.
+      enum trace_signal_t { TR_CLOCK, TR_CLOCK_MODE, TR_DATA_O, TR_DATA_I,
+			    TR_COUNT };
+      int trace_[TR_COUNT];
 };
 
 #endif
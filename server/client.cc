@@ -19,6 +19,11 @@
 
 # include  "client.h"
 # include  "priv.h"
+# include  "protocol.h"
+# include  "protolog.h"
+# include  "profile.h"
+# include  "timeline.h"
+# include  "trace.h"
 # include  <iostream>
 # include  <errno.h>
 # include  <cstdlib>
@@ -33,6 +38,7 @@ std::map<int, client_state_t> client_state_t::client_map;
 client_state_t::client_state_t()
 {
       bus_interface_ = 0;
+      buffer_.resize(4096);
       buffer_fill_ = 0;
 }
 
@@ -53,10 +59,12 @@ const char white_space[] = " \r";
 
 int client_state_t::read_from_socket(int fd)
 {
-      size_t trans = sizeof buffer_ - buffer_fill_ - 1;
-      assert(trans > 0);
+	// Make room for more data. Keep a byte for the nul.
+      if (buffer_fill_ + 1 >= buffer_.size())
+	    buffer_.resize(2 * buffer_.size());
 
-      int rc = read(fd, buffer_ + buffer_fill_, trans);
+      size_t trans = buffer_.size() - buffer_fill_ - 1;
+      int rc = read(fd, &buffer_[buffer_fill_], trans);
 	// Treat a connection reset as an EOF.
       if (rc < 0 && errno==ECONNRESET) {
 	    rc = 0;
@@ -74,6 +82,8 @@ int client_state_t::read_from_socket(int fd)
 		 << "." << endl;
 	    bus_interface_->ready_flag  = true;
 	    bus_interface_->exited_flag = true;
+	    trace_dump("client error");
+	    protolog_flush();
 	    return rc;
       }
 
@@ -91,39 +101,47 @@ int client_state_t::read_from_socket(int fd)
 		       << "." << endl;
 		  bus_interface_->ready_flag  = true;
 		  bus_interface_->exited_flag = true;
+		  trace_dump("client EOF");
+		  protolog_flush();
 	    } else {
 		  cerr << "EOF from client before HELLO." << endl;
+		  protolog_close();
 		  assert(0);
 	    }
 	    return rc;
       }
 
       buffer_fill_ += rc;
-      *(buffer_+buffer_fill_) = 0;
+      char*buf = &buffer_[0];
+      buf[buffer_fill_] = 0;
 
-      if (char*eol = strchr(buffer_, '\n')) {
+      if (char*eol = strchr(buf, '\n')) {
 	      // Remove the new-line.
 	    *eol++ = 0;
-	    int argc = 0;
-	    char*argv[2048];
+	    argv_.clear();
 
-	    char*cp = buffer_;
+	    char*cp = buf;
 	    while (*cp != 0) {
-		  argv[argc++] = cp;
+		  argv_.push_back(cp);
 		  cp += strcspn(cp, white_space);
 		  if (*cp) {
 			*cp++ = 0;
 			cp += strspn(cp, white_space);
 		  }
 	    }
-	    argv[argc] = 0;
+	    int argc = argv_.size();
+	    argv_.push_back(0);
 
 	      // Process the client command.
-	    process_client_command_(fd, argc, argv);
+	    process_client_command_(fd, argc, &argv_[0]);
+	    if (bus_interface_) {
+		  bus_interface_->msgs_in += 1;
+		  bus_interface_->bytes_in += eol - buf;
+	    }
 
 	      // Remove the command line from the input buffer
-	    buffer_fill_ -= eol - buffer_;
-	    memmove(buffer_, eol, buffer_fill_);
+	    buffer_fill_ -= eol - buf;
+	    memmove(buf, eol, buffer_fill_);
       }
 }
 
@@ -134,10 +152,10 @@ void client_state_t::process_client_command_(int fd, int argc, char*argv[])
 	    return;
       }
 
-      protocol_log << dev_name_ << ":RECV:" << argv[0];
-      for (int idx = 1 ; idx < argc ; idx += 1)
-	    protocol_log << " " << argv[idx];
-      protocol_log << endl;
+      if (protolog_active()) {
+	    bus_state*bus = bus_map[bus_];
+	    protolog_recv(bus_interface_->log_id, bus->proto->peek_time(), argc, argv);
+      }
 
       if (strcmp(argv[0],"HELLO") == 0) {
 	    cerr << "Spurious HELLO from " << dev_name_ << endl;
@@ -225,8 +243,16 @@ void client_state_t::process_client_hello_(int fd, int argc, char*argv[])
       int rc = write(fd, outbuf, strlen(outbuf));
       assert(rc == strlen(outbuf));
 
-      protocol_log << dev_name_ << ":SEND:YOU-ARE "
-		   << bus_interface_->ident << endl;
+      if (protolog_active()) {
+	    bus_interface_->log_id = protolog_device(bus->name, dev_name_);
+	    protolog_send(bus_interface_->log_id, bus->proto->peek_time(),
+			  outbuf, strlen(outbuf)-1);
+      }
+
+      if (profile_active())
+	    bus_interface_->prof_id = profile_device(bus->name, dev_name_);
+      if (timeline_active())
+	    bus_interface_->tl_id = timeline_device(bus->name, dev_name_);
 
       cerr << "Device " << use_name
 	   << " is attached to bus " << bus->name
@@ -247,7 +273,10 @@ void client_state_t::process_client_ready_(int fd, int argc, char*argv[])
       bus_interface_->ready_scale = strtol(ep, &ep, 10);
       assert(*ep == 0);
 
-	// The remaining arguments are <name>=<value> tokens.
+	// The remaining arguments are <name>=<value> tokens. The
+	// WAIT=<n> token is not a signal, but the number of clocks
+	// that the client is idle for.
+      bus_interface_->wait_clocks = 0;
       for (int idx = 2 ; idx < argc ; idx += 1) {
 
 	      // Parse the <name> from the token
@@ -255,6 +284,11 @@ void client_state_t::process_client_ready_(int fd, int argc, char*argv[])
 	    assert(ep && *ep=='=');
 	    *ep++ = 0;
 
+	    if (strcmp(argv[idx], "WAIT") == 0) {
+		  bus_interface_->wait_clocks = strtoul(ep, 0, 10);
+		  continue;
+	    }
+
 	      // Build the array of bit values from the <value>
 	    std::valarray<bit_state_t> tmp (strlen(ep));
 	    for (int bit = 0 ; ep[bit] != 0 ;  bit += 1) {
@@ -275,6 +309,7 @@ void client_state_t::process_client_ready_(int fd, int argc, char*argv[])
 			tmp[array_idx] = BIT_X;
 			break;
 		      default:
+			protolog_close();
 			assert(0);
 			tmp[array_idx] = BIT_X;
 			break;
@@ -287,6 +322,8 @@ void client_state_t::process_client_ready_(int fd, int argc, char*argv[])
 
 	// This client is now ready and waiting for the server.
       bus_interface_->ready_flag = true;
+      profile_ready(bus_interface_->prof_id);
+      timeline_ready(bus_interface_->tl_id);
 }
 
 void client_state_t::process_client_finish_(int fd, int argc, char*argv[])
@@ -296,11 +333,23 @@ void client_state_t::process_client_finish_(int fd, int argc, char*argv[])
       assert(bus_info != bus_map.end());
       struct bus_state*bus = bus_info->second;
 
+	// The client may send an exit status with the FINISH. A
+	// non-zero status means that the test failed.
+      long status = argc > 1? strtol(argv[1], 0, 0) : 0;
+
       cerr << "Device " << dev_name_
 	   << " detached from bus " << bus->name
 	   << " as " << (bus_interface_->host_flag? "host" : "device")
 	   << " " << bus_interface_->ident
-	   << " with FINISH command." << endl;
+	   << " with FINISH command";
+      if (status != 0)
+	    cerr << " (status " << status << ")";
+      cerr << "." << endl;
       bus_interface_->ready_flag  = true;
       bus_interface_->exited_flag = true;
+
+	// A FINISH with a non-zero status is a failure, so dump the
+	// flight recorder.
+      if (status != 0)
+	    trace_dump("FINISH with error");
 }
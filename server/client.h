@@ -20,6 +20,7 @@
  */
 
 # include  <string>
+# include  <vector>
 # include  <stddef.h>
 # include  "priv.h"
 
@@ -80,9 +81,12 @@ class client_state_t {
 	// State information
       struct bus_device_plug*bus_interface_;
 
-	// Keep an input buffer of data read from the connection.
-      char buffer_[4096];
+	// Keep an input buffer of data read from the connection. It
+	// grows to hold the longest message, so that wide busses fit.
+      std::vector<char> buffer_;
       size_t buffer_fill_;
+	// The tokens of the message being processed.
+      std::vector<char*> argv_;
 };
 
 #endif
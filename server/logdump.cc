@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+/*
+ * simbus-logdump [-t] <file>
+ *
+ * Print a binary protocol log (simbus_server -D protocol-bin=<file>)
+ * as text. The output is the same as the text log that -D
+ * protocol=<file> writes. With -t, each line starts with the bus time
+ * of the message.
+ */
+
+# include  "protolog.h"
+# include  <stdio.h>
+# include  <string.h>
+# include  <unistd.h>
+# include  <inttypes.h>
+# include  <iostream>
+# include  <vector>
+# include  <string>
+
+using namespace std;
+
+int main(int argc, char*argv[])
+{
+      bool time_flag = false;
+
+      int opt;
+      while ((opt = getopt(argc, argv, "t")) != -1) {
+	    switch (opt) {
+		case 't':
+		  time_flag = true;
+		  break;
+		default:
+		  cerr << "Usage: " << argv[0] << " [-t] <file>" << endl;
+		  return 1;
+	    }
+      }
+
+      if (optind+1 != argc) {
+	    cerr << "Usage: " << argv[0] << " [-t] <file>" << endl;
+	    return 1;
+      }
+
+      const char*path = argv[optind];
+      FILE*fd = fopen(path, "rb");
+      if (fd == 0) {
+	    perror(path);
+	    return 2;
+      }
+
+      char magic[8];
+      int32_t prec;
+      if (fread(magic, 1, sizeof magic, fd) != sizeof magic
+	  || memcmp(magic, PROTOLOG_MAGIC, sizeof magic) != 0
+	  || fread(&prec, sizeof prec, 1, fd) != 1) {
+	    cerr << path << ": Not a simbus protocol log." << endl;
+	    return 2;
+      }
+
+      vector<string> device_names;
+      vector<char> payload;
+
+      protolog_rec_s rec;
+      while (fread(&rec, sizeof rec, 1, fd) == 1) {
+	    payload.resize(rec.len + 1);
+	    if (fread(&payload[0], 1, rec.len, fd) != rec.len) {
+		  cerr << path << ": Truncated record." << endl;
+		  return 3;
+	    }
+	    payload[rec.len] = 0;
+
+	    if (rec.kind == PL_DEVICE) {
+		    // The payload is the bus name then the device name.
+		  const char*bus = &payload[0];
+		  const char*name = bus + strlen(bus) + 1;
+		  if (device_names.size() <= rec.dev)
+			device_names.resize(rec.dev+1);
+		  device_names[rec.dev] = name;
+		  continue;
+	    }
+
+	    if (rec.dev >= device_names.size()) {
+		  cerr << path << ": Unknown device " << rec.dev << endl;
+		  return 3;
+	    }
+
+	    if (time_flag)
+		  printf("%" PRIu64 "e%d ", rec.time, prec);
+
+	    printf("%s:%s:", device_names[rec.dev].c_str(),
+		   rec.kind == PL_RECV? "RECV" : "SEND");
+	    fwrite(&payload[0], 1, rec.len, stdout);
+	    fputc('\n', stdout);
+      }
+
+      fclose(fd);
+      return 0;
+}
@@ -675,7 +675,7 @@ if((lt)&&(lt->numfacs))
 
 		fflush(lt->handle);
 		lt->zfacname_size = lt->position;
-		lt->zhandle = gzdopen(dup(fileno(lt->handle)), "wb9");
+		lt->zhandle = gzdopen(dup(fileno(lt->handle)), lt->zmode);
 
 		lt->zpackcount = 0;
 		for(i=0;i<lt->numfacs;i++)
@@ -693,7 +693,7 @@ if((lt)&&(lt->numfacs))
 		lt->position=ftello(lt->handle);
 		lt->zfacname_size = lt->position - lt->zfacname_size;
 
-		lt->zhandle = gzdopen(dup(fileno(lt->handle)), "wb9");
+		lt->zhandle = gzdopen(dup(fileno(lt->handle)), lt->zmode);
 
 		lt->facgeometry_offset = lt->position;
 		for(i=0;i<lt->numfacs;i++)
@@ -26,10 +26,13 @@ using namespace std;
 # include  <string.h>
 # include  <unistd.h>
 # include  "priv.h"
+# include  "protolog.h"
+# include  "profile.h"
+# include  "metrics.h"
+# include  "timeline.h"
+# include  "trace.h"
 # include  <assert.h>
 
-std::ofstream protocol_log;
-
 void process_debug_flag(const char*arg)
 {
       const char* key = arg;
@@ -39,18 +42,39 @@ void process_debug_flag(const char*arg)
       } else {
 	    value += 1;
 	    if (strncmp(arg, "protocol=", value-key) == 0) {
-		  protocol_log.open(value, ios_base::out);
+		  protolog_open(value, false);
+	    } else if (strncmp(arg, "protocol-bin=", value-key) == 0) {
+		  protolog_open(value, true);
+	    } else if (strncmp(arg, "timeline=", value-key) == 0) {
+		  timeline_open(value);
 	    }
       }
 }
 
+/*
+ * Trace settings on the command line are -T <key>=<value>, with the
+ * same keys as the trace section of the config file.
+ */
+static bool process_trace_flag(const char*arg)
+{
+      const char*value = strchr(arg, '=');
+      if (value == 0)
+	    return false;
+
+      return trace_config(string(arg, value-arg), value+1);
+}
+
 int main(int argc, char*argv[])
 {
       list<const char*> config_paths;
       const char*trace_path = 0;
+      int trace_level = TRACE_DEFAULT_LEVEL;
+      const char*profile_path = 0;
+      unsigned profile_interval = 10;
+      const char*metrics_port = 0;
       int opt;
 
-      while ( (opt = getopt(argc, argv, "c:D:t:")) != -1 ) {
+      while ( (opt = getopt(argc, argv, "c:D:m:p:P:t:T:z:")) != -1 ) {
 	    switch (opt) {
 		case 'c':
 		  config_paths .push_back(optarg);
@@ -58,9 +82,31 @@ int main(int argc, char*argv[])
 		case 'D':
 		  process_debug_flag(optarg);
 		  break;
+		case 'm':
+		  metrics_port = optarg;
+		  break;
+		case 'p':
+		  profile_path = optarg;
+		  break;
+		case 'P':
+		  profile_interval = strtoul(optarg, 0, 10);
+		  break;
 		case 't':
 		  trace_path = optarg;
 		  break;
+		case 'T':
+		  if (! process_trace_flag(optarg)) {
+			cerr << "Invalid trace setting: " << optarg << endl;
+			return 1;
+		  }
+		  break;
+		case 'z':
+		  trace_level = strtol(optarg, 0, 10);
+		  if (trace_level < 0 || trace_level > 9) {
+			cerr << "Trace compression level must be 0-9." << endl;
+			return 1;
+		  }
+		  break;
 		default:
 		  assert(0);
 		  break;
@@ -75,7 +121,11 @@ int main(int argc, char*argv[])
       }
 
 	/* Initialize the server... */
-      service_init(trace_path);
+      service_init(trace_path, trace_level);
+      if (profile_path)
+	    profile_open(profile_path, profile_interval);
+      if (metrics_port && ! metrics_open(metrics_port))
+	    return 1;
 
 	/* Parse the config files... */
       for (list<const char*>::iterator idx = config_paths.begin()
@@ -96,11 +146,3 @@ int main(int argc, char*argv[])
 	/* Run the service. */
       return service_run();
 }
-
-ostream& operator<< (ostream&out, const std::valarray<bit_state_t>&vec)
-{
-      out << vec.size() << "'b";
-      for (int idx = 0 ; idx < vec.size() ; idx += 1)
-	    out << vec[vec.size()-idx-1];
-      return out;
-}
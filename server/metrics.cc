@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  "metrics.h"
+# include  "priv.h"
+# include  "protocol.h"
+# include  "protolog.h"
+# include  "trace.h"
+# include  <sys/types.h>
+# include  <sys/socket.h>
+# include  <sys/un.h>
+# include  <netinet/in.h>
+# include  <arpa/inet.h>
+# include  <fcntl.h>
+# include  <unistd.h>
+# include  <errno.h>
+# include  <string.h>
+# include  <stdlib.h>
+# include  <stdio.h>
+# include  <time.h>
+# include  <inttypes.h>
+# include  <string>
+# include  <list>
+
+using namespace std;
+
+/*
+ * A connection first reads the request, up to the blank line of an
+ * HTTP request or the EOF of a plain client. Then it writes the
+ * answer and closes. An HTTP request gets an HTTP answer, and
+ * anything else just the text.
+ */
+struct metrics_conn_s {
+      int fd;
+      bool writing;
+      std::string in;
+      std::string out;
+      size_t sent;
+};
+
+	// More connections than this are closed right away.
+# define METRICS_MAX_CONNS 16
+
+static int listen_fd = -1;
+static std::string unlink_path;
+static list<metrics_conn_s> conns;
+static uint64_t start_ns = 0;
+
+static uint64_t now_ns(void)
+{
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+bool metrics_open(const char*port)
+{
+      string astr = port;
+      if (astr.substr(0,4) == "tcp:")
+	    astr.erase(0,4);
+
+      int rc;
+      if (astr.substr(0,5) == "pipe:") {
+	    astr.erase(0,5);
+
+	    listen_fd = socket(PF_UNIX, SOCK_STREAM, 0);
+	    if (listen_fd < 0) {
+		  perror("socket(PF_UNIX, SOCK_STREAM)");
+		  return false;
+	    }
+
+	    struct sockaddr_un addr;
+	    memset(&addr, 0, sizeof addr);
+	    if (astr.size() >= sizeof addr.sun_path) {
+		  fprintf(stderr, "Metrics pipe path too long: %s\n", astr.c_str());
+		  close(listen_fd);
+		  listen_fd = -1;
+		  return false;
+	    }
+	    addr.sun_family = AF_UNIX;
+	    strcpy(addr.sun_path, astr.c_str());
+
+	      // A socket left over from an earlier run is in the way.
+	    unlink(astr.c_str());
+	    rc = bind(listen_fd, (const struct sockaddr*)&addr, sizeof addr);
+	    unlink_path = astr;
+
+      } else if (astr.size() > 0 && astr.find_first_not_of("0123456789") == string::npos) {
+	    listen_fd = socket(PF_INET, SOCK_STREAM, 0);
+	    if (listen_fd < 0) {
+		  perror("socket(PF_INET, SOCK_STREAM)");
+		  return false;
+	    }
+
+	    int one = 1;
+	    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+	    struct sockaddr_in addr;
+	    memset(&addr, 0, sizeof addr);
+	    addr.sin_family = AF_INET;
+	    addr.sin_port = htons(strtoul(astr.c_str(), 0, 10));
+	    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	    rc = bind(listen_fd, (const struct sockaddr*)&addr, sizeof addr);
+
+      } else {
+	    fprintf(stderr, "Invalid metrics port: %s\n", port);
+	    return false;
+      }
+
+      if (rc < 0 || listen(listen_fd, 4) < 0) {
+	    fprintf(stderr, "Unable to open metrics port %s (errno=%d)\n", port, errno);
+	    close(listen_fd);
+	    listen_fd = -1;
+	    return false;
+      }
+
+      fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+      start_ns = now_ns();
+      printf("Metrics on port %s\n", port);
+      return true;
+}
+
+bool metrics_active(void)
+{
+      return listen_fd >= 0;
+}
+
+void metrics_bus_begin(struct bus_state*bus)
+{
+      if (bus->until_ns == 0)
+	    return;
+
+      uint64_t ns = now_ns() - bus->until_ns;
+      bus->phase_ns += ns;
+
+	// Bucket k counts times up to 2^k us.
+      uint64_t us = (ns + 999) / 1000;
+      int idx = 0;
+      while (idx < BUS_PHASE_BUCKETS-1 && (1ULL << idx) < us)
+	    idx += 1;
+      bus->phase_hist[idx] += 1;
+}
+
+void metrics_bus_end(struct bus_state*bus)
+{
+      bus->until_ns = now_ns();
+}
+
+static string label(const string&text)
+{
+      string res;
+      for (size_t idx = 0 ; idx < text.size() ; idx += 1) {
+	    if (text[idx] == '\\' || text[idx] == '"')
+		  res += '\\';
+	    res += text[idx];
+      }
+      return res;
+}
+
+static void header(string&out, const char*name, const char*type, const char*help)
+{
+      out += "# HELP ";
+      out += name;
+      out += " ";
+      out += help;
+      out += "\n# TYPE ";
+      out += name;
+      out += " ";
+      out += type;
+      out += "\n";
+}
+
+static void value(string&out, const char*name, const string&labels, double val)
+{
+      char buf[64];
+      snprintf(buf, sizeof buf, "%.9g", val);
+      out += name;
+      if (labels.size() > 0) {
+	    out += "{";
+	    out += labels;
+	    out += "}";
+      }
+      out += " ";
+      out += buf;
+      out += "\n";
+}
+
+static void value(string&out, const char*name, const string&labels, uint64_t val)
+{
+      char buf[64];
+      snprintf(buf, sizeof buf, "%" PRIu64, val);
+      out += name;
+      if (labels.size() > 0) {
+	    out += "{";
+	    out += labels;
+	    out += "}";
+      }
+      out += " ";
+      out += buf;
+      out += "\n";
+}
+
+/*
+ * Format all the metrics as Prometheus text.
+ */
+static string format_metrics(void)
+{
+      string out;
+
+      header(out, "simbus_uptime_seconds", "gauge", "Seconds since the metrics port opened.");
+      value(out, "simbus_uptime_seconds", "", (now_ns() - start_ns) / 1e9);
+
+      header(out, "simbus_bus_phases_total", "counter", "Steps (UNTIL/READY rounds) of the bus.");
+      for (bus_map_idx_t cur = bus_map.begin() ; cur != bus_map.end() ; ++ cur) {
+	    string lab = "bus=\"" + label(cur->second->name) + "\"";
+	    value(out, "simbus_bus_phases_total", lab, cur->second->phases);
+      }
+
+      header(out, "simbus_bus_time_seconds", "gauge", "Simulation time of the bus.");
+      for (bus_map_idx_t cur = bus_map.begin() ; cur != bus_map.end() ; ++ cur) {
+	    if (cur->second->proto == 0)
+		  continue;
+	    string lab = "bus=\"" + label(cur->second->name) + "\"";
+	    uint64_t ps = cur->second->proto->peek_time().units_value(-12);
+	    value(out, "simbus_bus_time_seconds", lab, ps / 1e12);
+      }
+
+      header(out, "simbus_bus_phase_seconds", "histogram",
+	     "Wall clock time from UNTIL to the last READY.");
+      for (bus_map_idx_t cur = bus_map.begin() ; cur != bus_map.end() ; ++ cur) {
+	    bus_state*bus = cur->second;
+	    string lab = "bus=\"" + label(bus->name) + "\"";
+	    uint64_t count = 0;
+	    for (int idx = 0 ; idx < BUS_PHASE_BUCKETS ; idx += 1) {
+		  count += bus->phase_hist[idx];
+		  char le[64];
+		  if (idx == BUS_PHASE_BUCKETS-1)
+			strcpy(le, "+Inf");
+		  else
+			snprintf(le, sizeof le, "%g", (1ULL << idx) / 1e6);
+		  value(out, "simbus_bus_phase_seconds_bucket",
+			lab + ",le=\"" + le + "\"", count);
+	    }
+	    value(out, "simbus_bus_phase_seconds_sum", lab, bus->phase_ns / 1e9);
+	    value(out, "simbus_bus_phase_seconds_count", lab, count);
+      }
+
+      static const struct {
+	    const char*name;
+	    const char*help;
+	    uint64_t bus_device_plug::*field;
+      } client_counters[4] = {
+	    { "simbus_client_messages_in_total",  "Messages from the client.", &bus_device_plug::msgs_in },
+	    { "simbus_client_messages_out_total", "Messages to the client.",   &bus_device_plug::msgs_out },
+	    { "simbus_client_bytes_in_total",     "Bytes from the client.",    &bus_device_plug::bytes_in },
+	    { "simbus_client_bytes_out_total",    "Bytes to the client.",      &bus_device_plug::bytes_out }
+      };
+
+      for (int cnt = 0 ; cnt < 4 ; cnt += 1) {
+	    header(out, client_counters[cnt].name, "counter", client_counters[cnt].help);
+	    for (bus_map_idx_t cur = bus_map.begin() ; cur != bus_map.end() ; ++ cur) {
+		  bus_state*bus = cur->second;
+		  for (bus_device_map_t::iterator dev = bus->device_map.begin()
+			     ; dev != bus->device_map.end() ; ++ dev) {
+			string lab = "bus=\"" + label(bus->name)
+			      + "\",device=\"" + label(dev->first) + "\"";
+			value(out, client_counters[cnt].name, lab,
+			      dev->second->*client_counters[cnt].field);
+		  }
+	    }
+      }
+
+      trace_stats_s tstats;
+      trace_stats(tstats);
+      header(out, "simbus_trace_bytes_written_total", "counter", "Bytes written to the trace file.");
+      value(out, "simbus_trace_bytes_written_total", "", tstats.bytes_written);
+      header(out, "simbus_trace_queue_depth", "gauge", "Trace chunks waiting for the writer thread.");
+      value(out, "simbus_trace_queue_depth", "", (uint64_t)tstats.queue_depth);
+      header(out, "simbus_trace_queue_stalls_total", "counter", "Times the server waited for the trace writer.");
+      value(out, "simbus_trace_queue_stalls_total", "", (uint64_t)tstats.queue_stalls);
+      header(out, "simbus_trace_flight_bytes", "gauge", "Bytes held in the flight recorder rings.");
+      value(out, "simbus_trace_flight_bytes", "", (uint64_t)tstats.flight_bytes);
+
+      if (protolog_active()) {
+	    uint64_t bytes;
+	    size_t depth;
+	    protolog_stats(bytes, depth);
+	    header(out, "simbus_protolog_bytes_written_total", "counter", "Bytes written to the protocol log.");
+	    value(out, "simbus_protolog_bytes_written_total", "", bytes);
+	    header(out, "simbus_protolog_queue_depth", "gauge", "Protocol log buffers waiting for the writer thread.");
+	    value(out, "simbus_protolog_queue_depth", "", (uint64_t)depth);
+      }
+
+      return out;
+}
+
+/*
+ * The request is complete at the end of the HTTP header, or at EOF.
+ */
+static void start_answer(metrics_conn_s&conn)
+{
+      string body = format_metrics();
+      if (conn.in.compare(0, 4, "GET ") == 0) {
+	    char head[256];
+	    snprintf(head, sizeof head, "HTTP/1.0 200 OK\r\n"
+		     "Content-Type: text/plain; version=0.0.4\r\n"
+		     "Content-Length: %zu\r\n"
+		     "Connection: close\r\n\r\n", body.size());
+	    conn.out = head;
+	    conn.out += body;
+      } else {
+	    conn.out.swap(body);
+      }
+      conn.writing = true;
+      conn.sent = 0;
+}
+
+static void accept_conn(void)
+{
+      int fd = accept(listen_fd, 0, 0);
+      if (fd < 0)
+	    return;
+
+      if (conns.size() >= METRICS_MAX_CONNS) {
+	    close(fd);
+	    return;
+      }
+
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+      metrics_conn_s conn;
+      conn.fd = fd;
+      conn.writing = false;
+      conn.sent = 0;
+      conns.push_back(conn);
+}
+
+/*
+ * Read or write what the connection can without blocking. Return
+ * false when the connection is done.
+ */
+static bool service_conn(metrics_conn_s&conn, bool readable, bool writable)
+{
+      if (! conn.writing && readable) {
+	    char buf[1024];
+	    ssize_t rc = read(conn.fd, buf, sizeof buf);
+	    if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+		  return true;
+	    if (rc < 0)
+		  return false;
+	    conn.in.append(buf, rc);
+	    if (rc == 0
+		|| conn.in.find("\r\n\r\n") != string::npos
+		|| conn.in.find("\n\n") != string::npos)
+		  start_answer(conn);
+	    else if (conn.in.size() > 8192)
+		  return false;
+	      // Try the write right away; it usually all fits.
+	    writable = conn.writing;
+      }
+
+      if (conn.writing && writable) {
+	    ssize_t rc = send(conn.fd, conn.out.data() + conn.sent,
+			      conn.out.size() - conn.sent, MSG_NOSIGNAL);
+	    if (rc < 0 && (errno == EAGAIN || errno == EINTR))
+		  return true;
+	    if (rc < 0)
+		  return false;
+	    conn.sent += rc;
+	    if (conn.sent == conn.out.size())
+		  return false;
+      }
+
+      return true;
+}
+
+void metrics_fill_fds(fd_set*rfds, fd_set*wfds, int&nfds)
+{
+      if (listen_fd < 0)
+	    return;
+
+      FD_SET(listen_fd, rfds);
+      if (listen_fd >= nfds)
+	    nfds = listen_fd + 1;
+
+      for (list<metrics_conn_s>::iterator cur = conns.begin()
+		 ; cur != conns.end() ; ++ cur) {
+	    FD_SET(cur->fd, cur->writing? wfds : rfds);
+	    if (cur->fd >= nfds)
+		  nfds = cur->fd + 1;
+      }
+}
+
+void metrics_service(const fd_set*rfds, const fd_set*wfds)
+{
+      if (listen_fd < 0)
+	    return;
+
+      list<metrics_conn_s>::iterator cur = conns.begin();
+      while (cur != conns.end()) {
+	    bool readable = FD_ISSET(cur->fd, rfds);
+	    bool writable = FD_ISSET(cur->fd, wfds);
+	    if ((readable || writable) && ! service_conn(*cur, readable, writable)) {
+		  close(cur->fd);
+		  cur = conns.erase(cur);
+	    } else {
+		  ++ cur;
+	    }
+      }
+
+      if (FD_ISSET(listen_fd, rfds))
+	    accept_conn();
+}
+
+void metrics_close(void)
+{
+      if (listen_fd < 0)
+	    return;
+
+      while (! conns.empty()) {
+	    close(conns.front().fd);
+	    conns.pop_front();
+      }
+
+      close(listen_fd);
+      listen_fd = -1;
+      if (unlink_path.size() > 0)
+	    unlink(unlink_path.c_str());
+}
@@ -0,0 +1,63 @@
+#ifndef __metrics_H
+#define __metrics_H
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  <sys/select.h>
+
+struct bus_state;
+
+/*
+ * The metrics endpoint is a local socket where the server answers
+ * each connection with its counters in the Prometheus text format:
+ * the bus phases, bus time and phase time histograms, the messages
+ * and bytes to and from each client, and the state of the trace and
+ * protocol log writers. The connections are serviced by the select
+ * loop with non-blocking I/O, so a slow reader never stalls the
+ * simulation.
+ */
+
+/*
+ * Open the metrics socket. The port is tcp:<n> (or just <n>) for a
+ * TCP port on the loopback address, or pipe:<path> for a UNIX
+ * socket. Return false if the socket cannot be opened.
+ */
+extern bool metrics_open(const char*port);
+
+/* True if the metrics socket is open. */
+extern bool metrics_active(void);
+
+/*
+ * The protocol calls these at the start and end of a step of the bus,
+ * to measure the time from UNTIL to the last READY.
+ */
+extern void metrics_bus_begin(struct bus_state*bus);
+extern void metrics_bus_end(struct bus_state*bus);
+
+/*
+ * Add the metrics socket and connections to the select sets, and
+ * service the ones that select says are ready.
+ */
+extern void metrics_fill_fds(fd_set*rfds, fd_set*wfds, int&nfds);
+extern void metrics_service(const fd_set*rfds, const fd_set*wfds);
+
+/* Close the connections and the socket. */
+extern void metrics_close(void);
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef __pcitxn_H
+#define __pcitxn_H
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  <stdint.h>
+
+/*
+ * Format of the PCI transaction log (the txn_log option of a PCI
+ * bus). All values are in host byte order.
+ *
+ * The file starts with the 8 byte PCITXN_MAGIC. Then there is a
+ * pcitxn_rec_s for each transaction, in the order that the
+ * transactions end. Each record is followed by the data of the data
+ * beats: one 32bit word per beat, or two (low word first) if the
+ * PCITXN_64BIT flag is set. Then one byte of C/BE# per beat. The
+ * record plus data is padded to a multiple of 8 bytes.
+ *
+ * When the log is closed, the index is written after the last
+ * record. The time index has the start time and file offset of every
+ * PCITXN_TIME_STRIDE'th record. The address index has the address and
+ * file offset of every record, sorted by address. Last comes the
+ * pcitxn_footer_s. A file without the footer (the server did not exit
+ * cleanly) can still be read from the start.
+ */
+
+# define PCITXN_MAGIC "SBPCITX1"
+# define PCITXN_INDEX_MAGIC "SBPCIIX1"
+# define PCITXN_TIME_STRIDE 64
+
+	// Address and data went over the 64bit bus.
+# define PCITXN_64BIT        0x0001
+	// The address phase was a dual address cycle.
+# define PCITXN_DAC          0x0002
+	// The target terminated with retry (STOP# before any data).
+# define PCITXN_RETRY        0x0004
+	// The target terminated with disconnect (STOP# after data).
+# define PCITXN_DISCONNECT   0x0008
+	// STOP# without DEVSEL#
+# define PCITXN_TARGET_ABORT 0x0010
+	// No target claimed the transaction.
+# define PCITXN_MASTER_ABORT 0x0020
+	// Some data beat had x or z bits on AD.
+# define PCITXN_DATA_X       0x0040
+	// There were more beats than are kept in the record.
+# define PCITXN_TRUNCATED    0x0080
+
+	// The most data beats kept in a record.
+# define PCITXN_MAX_BEATS    4096
+
+	// Device number for "no device"
+# define PCITXN_NO_DEVICE    0xff
+
+struct pcitxn_rec_s {
+	// Time of the address phase, in ps.
+      uint64_t start;
+      uint64_t addr;
+	// Clocks from the address phase to the last data phase.
+      uint32_t latency;
+	// Number of data beats (kept in the record).
+      uint16_t beats;
+      uint16_t flags;
+	// Clocks with IRDY# or TRDY# (and STOP#) deasserted during
+	// the data phases.
+      uint16_t irdy_waits;
+      uint16_t trdy_waits;
+	// Device numbers of the master and target.
+      uint8_t initiator;
+      uint8_t target;
+	// The C/BE# of the address phase.
+      uint8_t command;
+	// Clocks from the address phase to DEVSEL#.
+      uint8_t devsel;
+};
+
+struct pcitxn_index_s {
+	// Start time for the time index, address for the address index.
+      uint64_t key;
+      uint64_t offset;
+};
+
+struct pcitxn_footer_s {
+      char magic[8];
+      uint64_t count;
+      uint64_t time_index;
+      uint64_t time_count;
+      uint64_t addr_index;
+};
+
+static inline uint64_t pcitxn_rec_size(const pcitxn_rec_s&rec)
+{
+      uint64_t words = (rec.flags & PCITXN_64BIT)? 2 : 1;
+      uint64_t size = sizeof rec + rec.beats*(4*words + 1);
+      return (size + 7) & ~(uint64_t)7;
+}
+
+#endif
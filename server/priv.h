@@ -33,7 +33,7 @@ class protocol_t;
 extern const char simbus_version[];
 
 /* Initial pre-configuration. */
-extern void service_init(const char*trace_path);
+extern void service_init(const char*trace_path, int trace_level);
 
 /* Parse the config file. */
 extern int config_file(FILE*cfg);
@@ -85,7 +85,8 @@ extern std::ostream& operator << (std::ostream&, const std::valarray<bit_state_t
  */
 
 struct bus_device_plug {
-      bus_device_plug() : host_flag(false), fd(-1), ready_flag(false), exited_flag(false) { }
+      bus_device_plug() : host_flag(false), fd(-1), ready_flag(false), exited_flag(false), log_id(-1), prof_id(-1), tl_id(-1),
+	    msgs_in(0), msgs_out(0), bytes_in(0), bytes_out(0), wait_clocks(0) { }
       std::string name;
 	// True if this device is a "host" connection.
       bool host_flag;
@@ -97,9 +98,22 @@ struct bus_device_plug {
 	// True when the device is ready for another step.
       bool ready_flag;
       bool exited_flag;
+	// Id of the device in the protocol log (see protolog.h).
+      int log_id;
+	// Id of the device in the profiler (see profile.h).
+      int prof_id;
+	// Id of the device in the timeline (see timeline.h).
+      int tl_id;
+	// Message counters for the metrics endpoint (see metrics.h).
+      uint64_t msgs_in, msgs_out;
+      uint64_t bytes_in, bytes_out;
 	// Time that the client last reported.
       uint64_t ready_time;
       int ready_scale;
+	// Clocks that the client is waiting for, from the WAIT token
+	// of its last READY, or 0. The protocol may use this to skip
+	// idle clocks (see pci_protocol.txt).
+      unsigned wait_clocks;
 	// Map of the signal values from the client.
       signal_state_map_t client_signals;
 	// Map of this signal values to send to the client.
@@ -107,6 +121,9 @@ struct bus_device_plug {
 };
 typedef std::map<std::string,struct bus_device_plug*> bus_device_map_t;
 
+/* Number of buckets in the phase time histogram of a bus. */
+# define BUS_PHASE_BUCKETS 24
+
 /*
  * The bus_state describes a bus. The fd is the posix file-descriptor
  * for the server port, and the name is the configured bus name.
@@ -134,6 +151,13 @@ struct bus_state {
 	// device, so that the client device can be located when it
 	// binds and calls in its name.
       bus_device_map_t device_map;
+	// Counters for the metrics endpoint. The phase_hist counts
+	// the wall clock time from UNTIL to the last READY, in
+	// buckets of powers of 2 microseconds.
+      uint64_t phases;
+      uint64_t until_ns;
+      uint64_t phase_ns;
+      uint64_t phase_hist[BUS_PHASE_BUCKETS];
 
       void assembly_complete();
 };
@@ -167,16 +191,10 @@ extern void process_add(const std::string&name,
 			const std::map<std::string,std::string>&use_env);
 
 /*
- * Hook for the server LXT dumper. It is up to the protocols to figure
- * out what to dump here.
+ * Time units of the server LXT dumper (see trace.h). It is up to the
+ * protocols to figure out what to dump.
  */
-extern struct lxt2_wr_trace*service_lxt;
 # define SERVICE_TIME_PRECISION (-10)
 
-/*
- * File for logging protocol interractions with the clients.
- */
-extern std::ofstream protocol_log;
-
 
 #endif
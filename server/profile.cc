@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  "profile.h"
+# include  <stdio.h>
+# include  <time.h>
+# include  <sys/resource.h>
+# include  <inttypes.h>
+# include  <map>
+# include  <vector>
+
+using namespace std;
+
+struct prof_bus_s {
+      std::string name;
+      uint64_t phases;
+	// Bus time of the first and latest phase.
+      uint64_t first_ps, last_ps;
+	// Wall time of the first phase, and of the latest UNTIL.
+      uint64_t first_ns, last_ns;
+	// Total time waiting for the devices, and in the server.
+      uint64_t wait_ns;
+      uint64_t server_ns;
+
+	// The current phase. sent_ns is 0 until the first UNTIL.
+      uint64_t begin_ns, sent_ns;
+      int last_dev;
+      uint64_t last_ready_ns, prev_ready_ns;
+
+	// Totals at the last periodic summary.
+      uint64_t sum_phases, sum_ps, sum_ns, sum_wait_ns, sum_server_ns;
+};
+
+struct prof_dev_s {
+      std::string name;
+      int bus;
+      uint64_t readies;
+	// UNTIL to READY times.
+      uint64_t turn_ns, turn_max_ns;
+	// Phases where this was the last device to answer, and the
+	// time by which it was last.
+      uint64_t slowest;
+      uint64_t slowest_lead_ns;
+	// slowest count at the last periodic summary.
+      uint64_t sum_slowest;
+	// Message and byte counts (see profile_traffic).
+      uint64_t msgs_in, bytes_in, msgs_out, bytes_out;
+};
+
+static bool profile_on = false;
+static std::string report_path;
+static uint64_t summary_interval_ns = 0;
+static uint64_t next_summary_ns = 0;
+
+static vector<prof_bus_s> buses;
+static vector<prof_dev_s> devices;
+static map<string,int> bus_ids;
+
+static uint64_t now_ns(void)
+{
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double percent(uint64_t part, uint64_t whole)
+{
+      return whole? 100.0 * part / whole : 0.0;
+}
+
+/*
+ * Print a line per bus with the rates since the last summary.
+ */
+static void print_summary(uint64_t now)
+{
+      for (size_t idx = 0 ; idx < buses.size() ; idx += 1) {
+	    prof_bus_s&bus = buses[idx];
+	    if (bus.phases == 0)
+		  continue;
+
+	    uint64_t wall = bus.last_ns - bus.sum_ns;
+	    uint64_t phases = bus.phases - bus.sum_phases;
+	    uint64_t sim = bus.last_ps - bus.sum_ps;
+	    double secs = wall / 1e9;
+
+	    int slow_dev = -1;
+	    uint64_t slow_cnt = 0;
+	    for (size_t dev = 0 ; dev < devices.size() ; dev += 1) {
+		  if (devices[dev].bus != (int)idx)
+			continue;
+		  uint64_t cnt = devices[dev].slowest - devices[dev].sum_slowest;
+		  if (slow_dev < 0 || cnt > slow_cnt) {
+			slow_dev = dev;
+			slow_cnt = cnt;
+		  }
+		  devices[dev].sum_slowest = devices[dev].slowest;
+	    }
+
+	    printf("profile: %s: %.0f phases/s, %.3f us sim/s, "
+		   "clients %.0f%%, server %.0f%%",
+		   bus.name.c_str(), secs > 0? phases / secs : 0.0,
+		   secs > 0? sim / secs / 1e6 : 0.0,
+		   percent(bus.wait_ns - bus.sum_wait_ns, wall),
+		   percent(bus.server_ns - bus.sum_server_ns, wall));
+	    if (slow_dev >= 0)
+		  printf(", slowest %s (%.0f%% of phases)",
+			 devices[slow_dev].name.c_str(), percent(slow_cnt, phases));
+	    printf("\n");
+
+	    bus.sum_phases = bus.phases;
+	    bus.sum_ps = bus.last_ps;
+	    bus.sum_ns = bus.last_ns;
+	    bus.sum_wait_ns = bus.wait_ns;
+	    bus.sum_server_ns = bus.server_ns;
+      }
+      fflush(stdout);
+      next_summary_ns = now + summary_interval_ns;
+}
+
+void profile_open(const char*path, unsigned interval)
+{
+      profile_on = true;
+      report_path = path;
+      summary_interval_ns = (uint64_t)interval * 1000000000ULL;
+}
+
+bool profile_active(void)
+{
+      return profile_on;
+}
+
+int profile_bus(const std::string&name)
+{
+      map<string,int>::iterator cur = bus_ids.find(name);
+      if (cur != bus_ids.end())
+	    return cur->second;
+
+      prof_bus_s bus;
+      bus.name = name;
+      bus.phases = 0;
+      bus.first_ps = bus.last_ps = 0;
+      bus.first_ns = bus.last_ns = 0;
+      bus.wait_ns = bus.server_ns = 0;
+      bus.begin_ns = bus.sent_ns = 0;
+      bus.last_dev = -1;
+      bus.last_ready_ns = bus.prev_ready_ns = 0;
+      bus.sum_phases = bus.sum_ps = bus.sum_ns = 0;
+      bus.sum_wait_ns = bus.sum_server_ns = 0;
+
+      int id = buses.size();
+      buses.push_back(bus);
+      bus_ids[name] = id;
+      return id;
+}
+
+int profile_device(const std::string&bus, const std::string&name)
+{
+      prof_dev_s dev;
+      dev.name = name;
+      dev.bus = profile_bus(bus);
+      dev.readies = 0;
+      dev.turn_ns = dev.turn_max_ns = 0;
+      dev.slowest = dev.slowest_lead_ns = 0;
+      dev.sum_slowest = 0;
+      dev.msgs_in = dev.bytes_in = dev.msgs_out = dev.bytes_out = 0;
+
+      devices.push_back(dev);
+      return devices.size() - 1;
+}
+
+void profile_ready(int id)
+{
+      if (id < 0)
+	    return;
+
+      prof_dev_s&dev = devices[id];
+      prof_bus_s&bus = buses[dev.bus];
+      if (bus.sent_ns == 0)
+	    return;
+
+      uint64_t now = now_ns();
+      uint64_t turn = now - bus.sent_ns;
+      dev.readies += 1;
+      dev.turn_ns += turn;
+      if (turn > dev.turn_max_ns)
+	    dev.turn_max_ns = turn;
+
+      bus.prev_ready_ns = bus.last_ready_ns;
+      bus.last_ready_ns = now;
+      bus.last_dev = id;
+}
+
+void profile_traffic(int id, uint64_t msgs_in, uint64_t bytes_in,
+		     uint64_t msgs_out, uint64_t bytes_out)
+{
+      if (id < 0)
+	    return;
+
+      prof_dev_s&dev = devices[id];
+      dev.msgs_in = msgs_in;
+      dev.bytes_in = bytes_in;
+      dev.msgs_out = msgs_out;
+      dev.bytes_out = bytes_out;
+}
+
+void profile_bus_begin(int id, uint64_t time_ps)
+{
+      prof_bus_s&bus = buses[id];
+      uint64_t now = now_ns();
+
+      if (bus.sent_ns != 0 && bus.last_dev >= 0) {
+	      // The phase ended with the last READY. The device that
+	      // sent it held up the bus for the time after the
+	      // READY before it (or after the UNTIL, if it was alone).
+	    bus.wait_ns += bus.last_ready_ns - bus.sent_ns;
+	    uint64_t prev = bus.prev_ready_ns > bus.sent_ns? bus.prev_ready_ns : bus.sent_ns;
+	    prof_dev_s&dev = devices[bus.last_dev];
+	    dev.slowest += 1;
+	    dev.slowest_lead_ns += bus.last_ready_ns - prev;
+      }
+
+      if (bus.phases == 0) {
+	    bus.first_ps = bus.sum_ps = time_ps;
+	    bus.first_ns = bus.sum_ns = now;
+	    if (next_summary_ns == 0)
+		  next_summary_ns = now + summary_interval_ns;
+      }
+
+      bus.phases += 1;
+      bus.last_ps = time_ps;
+      bus.begin_ns = now;
+      bus.last_dev = -1;
+      bus.last_ready_ns = bus.prev_ready_ns = 0;
+
+      if (summary_interval_ns && now >= next_summary_ns)
+	    print_summary(now);
+}
+
+void profile_bus_end(int id)
+{
+      prof_bus_s&bus = buses[id];
+      uint64_t now = now_ns();
+      bus.server_ns += now - bus.begin_ns;
+      bus.sent_ns = now;
+      bus.last_ns = now;
+}
+
+/*
+ * The report is text, with a line for the server, and a line per bus
+ * and per device. Each line is a keyword followed by <key>=<value>
+ * fields. Times are in ns, except bus times which are in ps.
+ */
+void profile_report(void)
+{
+      if (! profile_on)
+	    return;
+
+      FILE*fd = fopen(report_path.c_str(), "w");
+      if (fd == 0) {
+	    perror(report_path.c_str());
+	    return;
+      }
+
+      fprintf(fd, "# simbus profile report\n");
+
+      struct rusage ru;
+      getrusage(RUSAGE_SELF, &ru);
+      fprintf(fd, "server cpu_user_ns=%" PRIu64 " cpu_sys_ns=%" PRIu64 "\n",
+	      (uint64_t)(ru.ru_utime.tv_sec * 1000000000ULL + ru.ru_utime.tv_usec * 1000ULL),
+	      (uint64_t)(ru.ru_stime.tv_sec * 1000000000ULL + ru.ru_stime.tv_usec * 1000ULL));
+
+      for (size_t idx = 0 ; idx < buses.size() ; idx += 1) {
+	    const prof_bus_s&bus = buses[idx];
+	    uint64_t wall = bus.last_ns - bus.first_ns;
+	    uint64_t sim = bus.last_ps - bus.first_ps;
+	    double secs = wall / 1e9;
+	    fprintf(fd, "bus name=%s phases=%" PRIu64 " wall_ns=%" PRIu64
+		    " sim_ps=%" PRIu64 " wait_ns=%" PRIu64 " server_ns=%" PRIu64
+		    " phases_per_sec=%.1f sim_ps_per_sec=%.1f\n",
+		    bus.name.c_str(), bus.phases, wall, sim,
+		    bus.wait_ns, bus.server_ns,
+		    secs > 0? bus.phases / secs : 0.0,
+		    secs > 0? sim / secs : 0.0);
+      }
+
+      for (size_t idx = 0 ; idx < devices.size() ; idx += 1) {
+	    const prof_dev_s&dev = devices[idx];
+	    fprintf(fd, "device bus=%s name=%s ready=%" PRIu64
+		    " turnaround_ns=%" PRIu64 " turnaround_avg_ns=%" PRIu64
+		    " turnaround_max_ns=%" PRIu64 " slowest=%" PRIu64
+		    " slowest_lead_ns=%" PRIu64 " msgs_in=%" PRIu64
+		    " bytes_in=%" PRIu64 " msgs_out=%" PRIu64
+		    " bytes_out=%" PRIu64 "\n",
+		    buses[dev.bus].name.c_str(), dev.name.c_str(), dev.readies,
+		    dev.turn_ns, dev.readies? dev.turn_ns / dev.readies : 0,
+		    dev.turn_max_ns, dev.slowest, dev.slowest_lead_ns,
+		    dev.msgs_in, dev.bytes_in, dev.msgs_out, dev.bytes_out);
+      }
+
+      fclose(fd);
+}
+
+void profile_close(void)
+{
+      if (! profile_on)
+	    return;
+
+      profile_report();
+      if (summary_interval_ns)
+	    print_summary(now_ns());
+      profile_on = false;
+}
@@ -0,0 +1,74 @@
+#ifndef __profile_H
+#define __profile_H
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  <stdint.h>
+# include  <string>
+
+/*
+ * The synchronization profiler measures where the wall clock time of
+ * a simulation goes. A bus phase starts when the server sends the
+ * UNTIL messages, and ends when the last device has answered with
+ * READY. The profiler keeps, for each device, the time from UNTIL to
+ * its READY, and how often (and for how long) it was the last device
+ * the bus waited for. For each bus it keeps the time waiting for the
+ * devices, the time in the server, and the phases and simulated time
+ * per wall second.
+ */
+
+/*
+ * Turn on the profiler. The report is written to the path when a bus
+ * finishes and when the server exits. A summary is printed every
+ * interval seconds, or never if the interval is 0.
+ */
+extern void profile_open(const char*path, unsigned interval);
+
+/* True if the profiler is on. A bus gets its profile id on first use. */
+extern bool profile_active(void);
+
+/* Get the profile id of the bus or device, creating it if needed. */
+extern int profile_bus(const std::string&bus);
+extern int profile_device(const std::string&bus, const std::string&name);
+
+/* Note that the device sent READY. */
+extern void profile_ready(int dev);
+
+/*
+ * Set the message and byte counts of the device so far, for the
+ * report. The protocol calls this when a bus finishes.
+ */
+extern void profile_traffic(int dev, uint64_t msgs_in, uint64_t bytes_in,
+			    uint64_t msgs_out, uint64_t bytes_out);
+
+/*
+ * The server starts (begin) and finishes (end) processing a step of
+ * the bus. The time is the bus time in ps. The end is when all the
+ * UNTIL messages have been sent.
+ */
+extern void profile_bus_begin(int bus, uint64_t time_ps);
+extern void profile_bus_end(int bus);
+
+/* Write the report file. */
+extern void profile_report(void);
+
+/* Write the final report and turn off the profiler. */
+extern void profile_close(void);
+
+#endif
@@ -21,17 +21,41 @@
 # include  "protocol.h"
 # include  "client.h"
 # include  "priv.h"
-# include  "lxt2_write.h"
+# include  "protolog.h"
+# include  "profile.h"
+# include  "metrics.h"
+# include  "timeline.h"
+# include  "trace.h"
 # include  <inttypes.h>
+# include  <string.h>
+# include  <unistd.h>
 # include  <iostream>
 # include  <assert.h>
 
 using namespace std;
 
+const uint64_t simtime_pow10[20] = {
+      1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+      10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+      100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+      100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+      100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
 protocol_t::protocol_t(struct bus_state*b)
-: bus_(b)
+: bus_(b), clock_phase_step_val_(1), prof_id_(-1), tl_id_(-1)
 {
       sgenrand(&rand_state_, 1);
+
+      string clock_phases = b->options["CLOCK_phases"];
+      if (clock_phases == "" || clock_phases == "4") {
+	    clock_phase_step_val_ = 1;
+      } else if (clock_phases == "2") {
+	    clock_phase_step_val_ = 2;
+      } else {
+	    cerr << "Bus " << b->name << ": CLOCK_phases=" << clock_phases
+		 << " is not 2 or 4. Using 4." << endl;
+      }
 }
 
 protocol_t::~protocol_t()
@@ -43,60 +67,86 @@ bus_device_map_t& protocol_t::device_map()
       return bus_->device_map;
 }
 
-void protocol_t::make_trace_(const char*lab, trace_type_t lt_type, int wid)
+const string& protocol_t::bus_name() const
+{
+      return bus_->name;
+}
+
+int protocol_t::make_trace_(const char*lab, trace_type_t lt_type, int wid)
 {
-      int use_lt_type = 0;
-      switch (lt_type) {
-	  case PT_BITS:
-	    use_lt_type = LXT2_WR_SYM_F_BITS;
-	    break;
-	  case PT_STRING:
-	    use_lt_type = LXT2_WR_SYM_F_STRING;
-	    break;
-      }
       string tmp_name = bus_->name + "." + lab;
-      struct lxt2_wr_symbol*sym = lxt2_wr_symbol_add(service_lxt,
-						     tmp_name.c_str(),
-						     0, wid-1, 0, use_lt_type);
-      signal_trace_map[lab] = sym;
+      return trace_symbol_add(tmp_name, wid, lt_type == PT_STRING);
 }
 
-void protocol_t::set_trace_(const char*lab, bit_state_t bit)
+void protocol_t::set_trace_(int sym, bit_state_t bit)
 {
-      struct lxt2_wr_symbol*sym = signal_trace_map[lab];
-      char buf[2];
+      if (sym < 0)
+	    return;
+
+      char buf[1];
       assert(bit < 4);
       buf[0] = "01zx"[bit];
-      buf[1] = 0;
-      lxt2_wr_emit_value_bit_string(service_lxt, sym, 0, buf);
+      trace_emit_bits(sym, buf, 1);
 }
 
-void protocol_t::set_trace_(const char*lab, const valarray<bit_state_t>&bit)
+void protocol_t::set_trace_(int sym, const valarray<bit_state_t>&bit)
 {
-      struct lxt2_wr_symbol*sym = signal_trace_map[lab];
-      char buf[1025];
-      assert(bit.size() < sizeof buf);
+      if (sym < 0)
+	    return;
+
+      char buf[1024];
+      assert(bit.size() <= sizeof buf);
       for (int idx = 0 ; idx < bit.size() ; idx += 1)
 	    buf[idx] = "01zx"[bit[bit.size()-1-idx]];
 
-      buf[bit.size()] = 0;
-      lxt2_wr_emit_value_bit_string(service_lxt, sym, 0, buf);
+      trace_emit_bits(sym, buf, bit.size());
 }
 
-void protocol_t::set_trace_(const char*lab, const string&bit)
+void protocol_t::set_trace_(int sym, const string&bit)
 {
-      struct lxt2_wr_symbol*sym = signal_trace_map[lab];
-      lxt2_wr_emit_value_string(service_lxt, sym, 0,
-				const_cast<char*>(bit.c_str()));
+      if (sym < 0)
+	    return;
+
+      trace_emit_string(sym, bit);
 }
 
 void protocol_t::advance_time_(uint64_t use_mant, int use_exp)
 {
-      time_ += simtime_t(use_mant, use_exp);
+      if (time_.add(simtime_t(use_mant, use_exp)))
+	    return;
+
+	// The time can not go on, so finish the bus.
+      cerr << "Bus " << bus_->name << ": simulation time overflow after "
+	   << time_.peek_mant() << "e" << time_.peek_exp()
+	   << " seconds. Finishing the bus." << endl;
+      bus_->finished = true;
+}
+
+void protocol_t::until_token_(const string&key, unsigned long val)
+{
+      char buf[64];
+      snprintf(buf, sizeof buf, " %s=%lu", key.c_str(), val);
+      until_tokens_ += buf;
 }
 
 void protocol_t::bus_ready()
 {
+      if (profile_active()) {
+	    if (prof_id_ < 0)
+		  prof_id_ = profile_bus(bus_->name);
+	    profile_bus_begin(prof_id_, time_.units_value(-12));
+      }
+
+      if (timeline_active()) {
+	    if (tl_id_ < 0)
+		  tl_id_ = timeline_bus(bus_->name);
+	    timeline_bus_begin(tl_id_, time_);
+      }
+
+      bus_->phases += 1;
+      if (metrics_active())
+	    metrics_bus_begin(bus_);
+
 	// First, clear the ready flags for all the devices. This will
 	// force the expectation of a new READY message from all the
 	// devices.
@@ -118,15 +168,29 @@ void protocol_t::bus_ready()
 		  int rc = write(fd, "FINISH\n", 7);
 		  close(fd);
 		  dev->second->exited_flag = true;
+		  dev->second->msgs_out += 1;
+		  dev->second->bytes_out += 7;
 
-		  protocol_log << client_state_t::client_map[fd].dev_name()
-			       << ":SEND:FINISH" << endl;
+		  protolog_send(dev->second->log_id, time_, "FINISH", 6);
 	    }
 
 	      // Close the bus.
 	    close(bus_->fd);
 	    bus_->fd = -1;
 
+	    if (prof_id_ >= 0) {
+		  for (bus_device_map_t::iterator dev = bus_->device_map.begin()
+			     ; dev != bus_->device_map.end() ;  dev ++) {
+			bus_device_plug*plug = dev->second;
+			profile_traffic(plug->prof_id, plug->msgs_in, plug->bytes_in,
+					plug->msgs_out, plug->bytes_out);
+		  }
+		  profile_bus_end(prof_id_);
+		  profile_report();
+	    }
+	    if (tl_id_ >= 0)
+		  timeline_bus_end(tl_id_, time_);
+
 	    return;
       }
 
@@ -139,19 +203,31 @@ void protocol_t::bus_ready()
 	    int fd = dev->second->fd;
 	    signal_state_map_t&sigs = dev->second->send_signals;
 
-	    char buf[4097];
-	    snprintf(buf, sizeof buf, "UNTIL %" PRIu64 "e%d",
-		     time_.peek_mant(), time_.peek_exp());
+	    char head[64];
+	    int head_len = snprintf(head, sizeof head, "UNTIL %" PRIu64 "e%d",
+				    time_.peek_mant(), time_.peek_exp());
+
+	      // Make the buffer big enough for the whole message,
+	      // including the new-line.
+	    size_t need = head_len + until_tokens_.size() + 1;
+	    for (signal_state_map_t::iterator cur_sig = sigs.begin()
+		       ; cur_sig != sigs.end() ; cur_sig ++)
+		  need += cur_sig->first.size() + cur_sig->second.size() + 2;
+	    if (until_buf_.size() < need)
+		  until_buf_.resize(need);
+
+	    char*buf = &until_buf_[0];
+	    memcpy(buf, head, head_len);
 
-	    char*cp = buf + strlen(buf);
+	    char*cp = buf + head_len;
 	    for (signal_state_map_t::iterator cur_sig = sigs.begin()
 		       ; cur_sig != sigs.end() ; cur_sig ++) {
 
 		  int width = cur_sig->second.size();
 
 		  *cp++ = ' ';
-		  strcpy(cp, cur_sig->first.c_str());
-		  cp += strlen(cp);
+		  memcpy(cp, cur_sig->first.data(), cur_sig->first.size());
+		  cp += cur_sig->first.size();
 		  *cp++ = '=';
 		  for (int idx = 0 ; idx < width ; idx+=1) {
 			switch (cur_sig->second[width-idx-1]) {
@@ -179,14 +255,31 @@ void protocol_t::bus_ready()
 
 	    }
 
-	    *cp = 0;
-	    protocol_log << client_state_t::client_map[fd].dev_name()
-			 << ":SEND:" << buf << endl;
+	    if (! until_tokens_.empty()) {
+		  memcpy(cp, until_tokens_.data(), until_tokens_.size());
+		  cp += until_tokens_.size();
+	    }
+
+	    protolog_send(dev->second->log_id, time_, buf, cp-buf);
 
 	    *cp++ = '\n';
 	    int rc = write(fd, buf, cp-buf);
+	    if (rc != (cp-buf)) {
+		  trace_dump("client write error");
+		  protolog_close();
+	    }
 	    assert(rc == (cp-buf));
+	    dev->second->msgs_out += 1;
+	    dev->second->bytes_out += rc;
       }
+      until_tokens_.clear();
+
+      if (prof_id_ >= 0)
+	    profile_bus_end(prof_id_);
+      if (metrics_active())
+	    metrics_bus_end(bus_);
+      if (tl_id_ >= 0)
+	    timeline_bus_end(tl_id_, time_);
 }
 
 bool protocol_t::wrap_up_configuration()
@@ -206,3 +299,11 @@ void protocol_t::run_run()
 {
       assert(0);
 }
+
+ostream& operator<< (ostream&out, const std::valarray<bit_state_t>&vec)
+{
+      out << vec.size() << "'b";
+      for (int idx = 0 ; idx < vec.size() ; idx += 1)
+	    out << vec[vec.size()-idx-1];
+      return out;
+}
@@ -59,29 +59,48 @@ class protocol_t  {
 	// Access the devices of the bus. The derived class mostly is
 	// interested in the signals to and from the client.
       bus_device_map_t& device_map();
+      const std::string& bus_name() const;
 
       inline std::string get_option(const std::string&key)
       { return bus_->options[key]; }
 
 	// Functions to facilitate server-side tracing of the bus. The
-	// protocol creates the traces and sets their value with these
-	// functions.
+	// protocol creates the traces in trace_init and keeps the
+	// symbol ids that make_trace_ returns. The id is <0 if the
+	// signal is not traced, so the protocol tests it before it
+	// builds the value to pass to set_trace_.
       enum trace_type_t { PT_BITS, PT_STRING };
-      void make_trace_(const char*lab, trace_type_t lt_type, int wid=1);
-      void set_trace_(const char*lab, bit_state_t bit);
-      void set_trace_(const char*lab, const std::valarray<bit_state_t>&bit);
-      void set_trace_(const char*lab, const std::string&bit);
+      int make_trace_(const char*lab, trace_type_t lt_type, int wid=1);
+      void set_trace_(int sym, bit_state_t bit);
+      void set_trace_(int sym, const std::valarray<bit_state_t>&bit);
+      void set_trace_(int sym, const std::string&bit);
 
 	// The derived protocol knows when the next interesting event
 	// will be, and it uses this method to advance the clock to
 	// that time.
       void advance_time_(uint64_t mant, int exp);
 
+	// The clocked protocols have 4 phases per clock (see their
+	// clock_phase_map) and step through them one at a time. With
+	// the bus option CLOCK_phases=2, they step 2 phases at a time,
+	// so that there are only synchronization points at the clock
+	// edges. This is the number of phases to step.
+      int clock_phase_step_() const { return clock_phase_step_val_; }
+
+	// Add a <key>=<value> token to the end of all the UNTIL
+	// messages of this step. This is for values that are not
+	// signals, such as the count of skipped idle clocks.
+      void until_token_(const std::string&key, unsigned long val);
+
       inline long lrand_(void) {
 	    unsigned long tmp = genrand(&rand_state_);
 	    return tmp;
       }
 
+	// The random number state, for helpers that draw from the
+	// same sequence as lrand_.
+      struct context_s* rand_context_(void) { return &rand_state_; }
+
     private:
 	// The derived class implements this method to process its
 	// signals at the current synchronization point. The base
@@ -96,7 +115,18 @@ class protocol_t  {
 
       simtime_t time_;
 
-      std::map<std::string,struct lxt2_wr_symbol*>signal_trace_map;
+      int clock_phase_step_val_;
+
+	// Tokens for the UNTIL messages of this step (until_token_).
+      std::string until_tokens_;
+	// The UNTIL message being built. It is kept so that it only
+	// grows, and does not need to be allocated for every message.
+      std::string until_buf_;
+
+	// Id of the bus in the profiler, or -1.
+      int prof_id_;
+	// Id of the bus in the timeline, or -1.
+      int tl_id_;
 
     private: // Not implemented
       protocol_t(const protocol_t&);
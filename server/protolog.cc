@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  "protolog.h"
+# include  "priv.h"
+# include  "simtime.h"
+# include  <pthread.h>
+# include  <string.h>
+# include  <stdio.h>
+# include  <errno.h>
+# include  <fcntl.h>
+# include  <unistd.h>
+# include  <vector>
+# include  <deque>
+
+using namespace std;
+
+/*
+ * This works like the trace queue (see trace.cc). The service thread
+ * fills the current chunk, and full chunks go to the writer thread,
+ * which writes each with a single write. The chunks are large so that
+ * the file gets few, large writes. A record that does not fit in
+ * a chunk gets a chunk of its own with a larger buffer, which the
+ * writer thread shrinks again when it is done with it.
+ */
+# define PROTOLOG_CHUNK_SIZE   (256*1024)
+# define PROTOLOG_CHUNK_COUNT  16
+
+struct protolog_chunk_s {
+      size_t fill;
+      size_t size;
+      char*data;
+};
+
+static int log_fd = -1;
+static bool log_binary = false;
+
+static pthread_t writer_thread;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_free = PTHREAD_COND_INITIALIZER;
+static deque<protolog_chunk_s*> full_queue;
+static deque<protolog_chunk_s*> free_queue;
+static bool writer_stop = false;
+static bool writer_error = false;
+static uint64_t writer_bytes = 0;
+
+	// Service thread state.
+static protolog_chunk_s*cur_chunk = 0;
+static vector<string> device_names;
+
+static void write_chunk(protolog_chunk_s*chunk)
+{
+      size_t off = 0;
+      while (off < chunk->fill && !writer_error) {
+	    ssize_t rc = write(log_fd, chunk->data+off, chunk->fill-off);
+	    if (rc < 0 && errno == EINTR)
+		  continue;
+	    if (rc <= 0) {
+		  perror("protocol log");
+		  writer_error = true;
+		  break;
+	    }
+	    off += rc;
+      }
+}
+
+static void* writer_main(void*)
+{
+      pthread_mutex_lock(&queue_lock);
+      for (;;) {
+	    while (full_queue.empty() && !writer_stop)
+		  pthread_cond_wait(&queue_work, &queue_lock);
+
+	    if (full_queue.empty())
+		  break;
+
+	    protolog_chunk_s*chunk = full_queue.front();
+	    full_queue.pop_front();
+	    pthread_mutex_unlock(&queue_lock);
+
+	    write_chunk(chunk);
+	    size_t cnt = chunk->fill;
+	    chunk->fill = 0;
+	    if (chunk->size > PROTOLOG_CHUNK_SIZE) {
+		  delete[]chunk->data;
+		  chunk->data = new char[PROTOLOG_CHUNK_SIZE];
+		  chunk->size = PROTOLOG_CHUNK_SIZE;
+	    }
+
+	    pthread_mutex_lock(&queue_lock);
+	    writer_bytes += cnt;
+	    free_queue.push_back(chunk);
+	    pthread_cond_signal(&queue_free);
+      }
+      pthread_mutex_unlock(&queue_lock);
+      return 0;
+}
+
+static void submit_chunk(void)
+{
+      pthread_mutex_lock(&queue_lock);
+      if (cur_chunk->fill > 0) {
+	    full_queue.push_back(cur_chunk);
+	    pthread_cond_signal(&queue_work);
+
+	    while (free_queue.empty())
+		  pthread_cond_wait(&queue_free, &queue_lock);
+
+	    cur_chunk = free_queue.front();
+	    free_queue.pop_front();
+      }
+      pthread_mutex_unlock(&queue_lock);
+}
+
+/*
+ * Make room for cnt bytes in the current chunk and return a pointer
+ * to them. The caller fills them all in.
+ */
+static char* reserve(size_t cnt)
+{
+      if (cur_chunk->fill + cnt > cur_chunk->size)
+	    submit_chunk();
+
+	// The chunk is empty now, so it can take a new buffer.
+      if (cnt > cur_chunk->size) {
+	    delete[]cur_chunk->data;
+	    cur_chunk->data = new char[cnt];
+	    cur_chunk->size = cnt;
+      }
+
+      char*cp = cur_chunk->data + cur_chunk->fill;
+      cur_chunk->fill += cnt;
+      return cp;
+}
+
+/*
+ * Start a record. In binary mode this is the record header, and in
+ * text mode it is the "<device>:<dir>:" prefix of the line. Return a
+ * pointer to where the payload of len bytes goes.
+ */
+static char* begin_record(protolog_kind_t kind, int dev,
+			  const simtime_t&time, size_t len)
+{
+      if (log_binary) {
+	    protolog_rec_s rec;
+	    rec.time = time.units_value(SERVICE_TIME_PRECISION);
+	    rec.len = len;
+	    rec.dev = dev;
+	    rec.kind = kind;
+	    rec.pad = 0;
+	    char*cp = reserve(sizeof rec + len);
+	    memcpy(cp, &rec, sizeof rec);
+	    return cp + sizeof rec;
+      }
+
+      const string&name = device_names[dev];
+      const char*dir = kind == PL_RECV? ":RECV:" : ":SEND:";
+	// Text lines end with a newline that the payload does not have.
+      char*cp = reserve(name.size() + 6 + len + 1);
+      memcpy(cp, name.data(), name.size());
+      cp += name.size();
+      memcpy(cp, dir, 6);
+      cp[6 + len] = '\n';
+      return cp + 6;
+}
+
+bool protolog_open(const char*path, bool binary_flag)
+{
+	// A second -D protocol flag replaces the first.
+      protolog_close();
+
+      log_fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+      if (log_fd < 0) {
+	    perror(path);
+	    return false;
+      }
+
+      log_binary = binary_flag;
+
+      for (int idx = 0 ; idx < PROTOLOG_CHUNK_COUNT ; idx += 1) {
+	    protolog_chunk_s*chunk = new protolog_chunk_s;
+	    chunk->fill = 0;
+	    chunk->size = PROTOLOG_CHUNK_SIZE;
+	    chunk->data = new char[PROTOLOG_CHUNK_SIZE];
+	    free_queue.push_back(chunk);
+      }
+      cur_chunk = free_queue.front();
+      free_queue.pop_front();
+
+      if (log_binary) {
+	    int32_t prec = SERVICE_TIME_PRECISION;
+	    char*cp = reserve(8 + sizeof prec);
+	    memcpy(cp, PROTOLOG_MAGIC, 8);
+	    memcpy(cp+8, &prec, sizeof prec);
+      }
+
+      writer_stop = false;
+      pthread_create(&writer_thread, 0, &writer_main, 0);
+      return true;
+}
+
+bool protolog_active(void)
+{
+      return log_fd >= 0;
+}
+
+int protolog_device(const std::string&bus, const std::string&name)
+{
+      if (log_fd < 0)
+	    return -1;
+
+      int dev = device_names.size();
+      device_names.push_back(name);
+
+      if (log_binary) {
+	    simtime_t zero;
+	    size_t len = bus.size() + 1 + name.size() + 1;
+	    char*cp = begin_record(PL_DEVICE, dev, zero, len);
+	    memcpy(cp, bus.c_str(), bus.size()+1);
+	    memcpy(cp + bus.size()+1, name.c_str(), name.size()+1);
+      }
+
+      return dev;
+}
+
+void protolog_recv(int dev, const simtime_t&time, int argc, char*argv[])
+{
+      if (log_fd < 0 || dev < 0)
+	    return;
+
+	// The payload is the command line with single spaces, so the
+	// arguments can be copied straight into the chunk.
+      size_t len = argc > 0? argc-1 : 0;
+      for (int idx = 0 ; idx < argc ; idx += 1)
+	    len += strlen(argv[idx]);
+
+      char*cp = begin_record(PL_RECV, dev, time, len);
+      for (int idx = 0 ; idx < argc ; idx += 1) {
+	    if (idx > 0)
+		  *cp++ = ' ';
+	    size_t cnt = strlen(argv[idx]);
+	    memcpy(cp, argv[idx], cnt);
+	    cp += cnt;
+      }
+}
+
+void protolog_send(int dev, const simtime_t&time, const char*text, size_t len)
+{
+      if (log_fd < 0 || dev < 0)
+	    return;
+
+      char*cp = begin_record(PL_SEND, dev, time, len);
+      memcpy(cp, text, len);
+}
+
+void protolog_stats(uint64_t&bytes_written, size_t&queue_depth)
+{
+      pthread_mutex_lock(&queue_lock);
+      bytes_written = writer_bytes;
+      queue_depth = full_queue.size();
+      pthread_mutex_unlock(&queue_lock);
+}
+
+void protolog_flush(void)
+{
+      if (log_fd < 0)
+	    return;
+
+      submit_chunk();
+
+	// All the chunks but the current one are back in the
+	// free_queue when the writer thread is done with them.
+      pthread_mutex_lock(&queue_lock);
+      while (free_queue.size() + 1 < PROTOLOG_CHUNK_COUNT)
+	    pthread_cond_wait(&queue_free, &queue_lock);
+      pthread_mutex_unlock(&queue_lock);
+}
+
+void protolog_close(void)
+{
+      if (log_fd < 0)
+	    return;
+
+      pthread_mutex_lock(&queue_lock);
+      if (cur_chunk->fill > 0) {
+	    full_queue.push_back(cur_chunk);
+	    cur_chunk = 0;
+      }
+      writer_stop = true;
+      pthread_cond_signal(&queue_work);
+      pthread_mutex_unlock(&queue_lock);
+
+      pthread_join(writer_thread, 0);
+
+      if (cur_chunk)
+	    free_queue.push_back(cur_chunk);
+      cur_chunk = 0;
+      while (! free_queue.empty()) {
+	    delete[]free_queue.front()->data;
+	    delete free_queue.front();
+	    free_queue.pop_front();
+      }
+
+      close(log_fd);
+      log_fd = -1;
+}
@@ -0,0 +1,100 @@
+#ifndef __protolog_H
+#define __protolog_H
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  <stddef.h>
+# include  <stdint.h>
+# include  <string>
+
+class simtime_t;
+
+/*
+ * The protocol log records the messages between the server and the
+ * clients. The service thread formats each message into a buffer,
+ * and a background thread writes full buffers to the file, so logging
+ * does not cost a write (or a flush) per message.
+ *
+ * The log is either text, one line per message, or binary. The
+ * binary log is the raw message with a small header, and the
+ * simbus-logdump program turns it into the same text.
+ */
+
+/*
+ * Binary log format. The file starts with the 8 byte magic and the
+ * time precision (an int32_t exponent). After that is a sequence of
+ * records, each a protolog_rec_s followed by len bytes of payload.
+ * All values are in host byte order.
+ *
+ * A PL_DEVICE record introduces a device id. The payload is the bus
+ * name and the device name, each terminated by a nul. PL_RECV and
+ * PL_SEND records are messages from or to the device, without the
+ * trailing newline.
+ */
+# define PROTOLOG_MAGIC "SBPLOG01"
+
+enum protolog_kind_t { PL_DEVICE = 0, PL_RECV = 1, PL_SEND = 2 };
+
+struct protolog_rec_s {
+	// Bus time of the message, in precision units.
+      uint64_t time;
+      uint32_t len;
+      uint16_t dev;
+      uint8_t kind;
+      uint8_t pad;
+};
+
+/*
+ * Open the log file and start the writer thread. If binary_flag is
+ * false, the log is text.
+ */
+extern bool protolog_open(const char*path, bool binary_flag);
+
+/* True if the log is open. Devices register with protolog_device when it is. */
+extern bool protolog_active(void);
+
+/*
+ * Give a device a log id. The id is used for the messages to and
+ * from that device.
+ */
+extern int protolog_device(const std::string&bus, const std::string&name);
+
+/* Log a command received from the device. */
+extern void protolog_recv(int dev, const simtime_t&time, int argc, char*argv[]);
+
+/* Log a message sent to the device. The text has no newline. */
+extern void protolog_send(int dev, const simtime_t&time, const char*text, size_t len);
+
+/*
+ * Counters for the metrics endpoint: the bytes written to the file so
+ * far, and the number of full buffers waiting for the writer thread.
+ */
+extern void protolog_stats(uint64_t&bytes_written, size_t&queue_depth);
+
+/*
+ * Write what is buffered and wait for it to reach the file. The log
+ * stays open. This is for when a client goes away unexpectedly, in
+ * case the server does not get to exit cleanly.
+ */
+extern void protolog_flush(void);
+
+/* Write what is buffered, stop the writer thread and close the file. */
+extern void protolog_close(void);
+
+#endif
@@ -37,7 +37,11 @@
 # include  "PointToPoint.h"
 # include  "AXI4Protocol.h"
 # include  "PCIeTLP.h"
-# include  "lxt2_write.h"
+# include  "protolog.h"
+# include  "profile.h"
+# include  "timeline.h"
+# include  "metrics.h"
+# include  "trace.h"
 # include  <assert.h>
 
 using namespace std;
@@ -52,6 +56,16 @@ static void sigint_handler(int)
       interrupted_flag = true;
 }
 
+/*
+ * SIGUSR1 asks for a dump of the flight recorder. The service loop
+ * does the dump when it notices the flag.
+ */
+static bool dump_flag = false;
+static void sigusr1_handler(int)
+{
+      dump_flag = true;
+}
+
 /*
  * The bus_map is a collection of all the configured busses. The key
  * is the port id string, which is unique for every bus. Clients that
@@ -67,16 +81,13 @@ map <string, struct bus_state*> bus_map;
  */
 set <struct bus_state*> need_initialization;
 
-/*
- * If the server is supposed to write lxt output, this is the pointer
- * to the lxt writer.
- */
-struct lxt2_wr_trace*service_lxt = 0;
-
 static void service_uninit(void)
 {
-      if (service_lxt) lxt2_wr_close(service_lxt);
-      service_lxt = 0;
+      trace_close();
+      protolog_close();
+      profile_close();
+      metrics_close();
+      timeline_close();
 }
 
 /*
@@ -84,13 +95,11 @@ static void service_uninit(void)
  * do the initial setup of data structures. It is called before
  * anything else can happen with the service.
  */
-void service_init(const char*trace_path)
+void service_init(const char*trace_path, int trace_level)
 {
-      service_lxt = trace_path? lxt2_wr_init(trace_path) : 0;
-      if (service_lxt) {
+      if (trace_path) {
 	    printf("Dumping bus signals to %s\n", trace_path);
-	    lxt2_wr_set_timescale(service_lxt, SERVICE_TIME_PRECISION);
-	    lxt2_wr_set_time(service_lxt, 0);
+	    trace_open(trace_path, trace_level);
       }
       atexit(&service_uninit);
 }
@@ -118,6 +127,11 @@ void service_add_bus(const std::string&port, const std::string&name,
       tmp->finished = false;
       tmp->device_map = dev;
       tmp->options = options;
+      tmp->phases = 0;
+      tmp->until_ns = 0;
+      tmp->phase_ns = 0;
+      for (int idx = 0 ; idx < BUS_PHASE_BUCKETS ; idx += 1)
+	    tmp->phase_hist[idx] = 0;
 
       if (bus_protocol_name == "pci") {
 	    tmp->proto = new PciProtocol(tmp);
@@ -164,6 +178,11 @@ static int socket_from_string(string astr, struct bus_state*bus_obj)
 		  return fd;
 	    }
 
+	      // Allow the port to be bound again right away when the
+	      // server is restarted.
+	    int one = 1;
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
 	    struct sockaddr_in addr;
 	    memset(&addr, 0, sizeof addr);
 
@@ -315,6 +334,12 @@ int service_run(void)
       sigemptyset(&sigpipe_new.sa_mask);
       rc = sigaction(SIGPIPE, &sigpipe_new, &sigpipe_old);
 
+      struct sigaction sigusr1_new, sigusr1_old;
+      sigusr1_new.sa_handler = &sigusr1_handler;
+      sigusr1_new.sa_flags = 0;
+      sigemptyset(&sigusr1_new.sa_mask);
+      rc = sigaction(SIGUSR1, &sigusr1_new, &sigusr1_old);
+
       interrupted_flag = false;
 
       while (true) {
@@ -323,9 +348,15 @@ int service_run(void)
 		  break;
 	    }
 
+	    if (dump_flag) {
+		  dump_flag = false;
+		  trace_dump("SIGUSR1");
+	    }
+
 	    int nfds = 0;
-	    fd_set rfds;
+	    fd_set rfds, wfds;
 	    FD_ZERO(&rfds);
+	    FD_ZERO(&wfds);
 
 	      // Add the server ports to the fd list.
 	    for (bus_map_idx_t idx = bus_map.begin()
@@ -355,8 +386,12 @@ int service_run(void)
 		  break;
 	    }
 
+	      // The metrics connections do not keep the server running,
+	      // so add them after the check above.
+	    metrics_fill_fds(&rfds, &wfds, nfds);
+
 	      // Wait for bus or client ports.
-	    rc = select(nfds, &rfds, 0, 0, 0);
+	    rc = select(nfds, &rfds, &wfds, 0, 0);
 	    if (rc == 0)
 		  continue;
 
@@ -387,10 +422,14 @@ int service_run(void)
 		       ; idx != client_state_t::client_map.end() ; idx ++) {
 		  int fd = idx->first;
 		  assert(fd >= 0);
-		  if (FD_ISSET(fd, &rfds))
+		    // The fd of an exited client may be in use by a
+		    // metrics connection now.
+		  if (! idx->second.is_exited() && FD_ISSET(fd, &rfds))
 			client_ready(idx);
 	    }
 
+	    metrics_service(&rfds, &wfds);
+
 	      // Check to see if there are any busses that need
 	      // initialization, and are ready. If so, initialize
 	      // them.
@@ -457,18 +496,19 @@ int service_run(void)
 
 		    // If the lxt dumper is active, then advance the
 		    // LXT time to the bus time.
-		  if (service_lxt) {
-			unsigned long long use_time = cur->first.units_value(SERVICE_TIME_PRECISION);
-			lxt2_wr_set_time(service_lxt, use_time);
+		  if (trace_active()) {
+			uint64_t use_time = cur->first.units_value(SERVICE_TIME_PRECISION);
+			trace_set_time(use_time);
 		  }
 
 		  cur->second->proto->bus_ready();
 	    }
       }
 
-      if (service_lxt) lxt2_wr_flush(service_lxt);
+      trace_flush();
 
       rc = sigaction(SIGINT, &sigint_old, 0);
+      rc = sigaction(SIGUSR1, &sigusr1_old, 0);
       service_uninit();
 }
 
@@ -481,7 +521,7 @@ void bus_state::assembly_complete()
 	// Should do something useful with the config_flag results.
       assert(config_flag);
 
-      if (service_lxt) {
+      if (trace_active()) {
 	    cout << name << ": Initialize traces..." << endl;
 	    proto->trace_init();
       }
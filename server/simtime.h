@@ -20,14 +20,29 @@
  */
 
 # include  <stdint.h>
+# include  <assert.h>
+
+/*
+ * A simtime_t is a simulation time as an integer count of
+ * femtoseconds. With a fixed resolution, compare and add are single
+ * integer operations, and the time goes on the wire as <count>e-15
+ * without any scaling. A 64bit count covers a little over 5 hours of
+ * simulated time. An add that goes past that saturates the time and
+ * returns false, so the caller can report it.
+ */
+# define SIMTIME_EXP (-15)
 
 class simtime_t {
 
     public:
       simtime_t();
+	// Make a time of mant * 10**use_exp seconds. The use_exp must
+	// be within 19 of SIMTIME_EXP. Finer times are rounded.
       simtime_t(uint64_t mant, int use_exp);
 
-	// Add that time into this time
+	// Add that time into this time. Return false (and saturate)
+	// if the result overflows.
+      bool add(const simtime_t&that);
       simtime_t& operator += (const simtime_t&that);
 
       bool operator < (const simtime_t&that) const;
@@ -35,78 +50,66 @@ class simtime_t {
 	// Get time in given units
       unsigned long long units_value(int use_units) const;
 
-      uint64_t peek_mant() const { return mant_; }
-      int      peek_exp()  const { return exp_; }
+	// The time is peek_mant() * 10**peek_exp() seconds.
+      uint64_t peek_mant() const { return fs_; }
+      int      peek_exp()  const { return SIMTIME_EXP; }
 
     private:
-      uint64_t mant_;
-      int exp_;
+      uint64_t fs_;
 };
 
+/* Powers of 10 that fit in a uint64_t, for scaling times. */
+extern const uint64_t simtime_pow10[20];
+
 inline simtime_t::simtime_t()
 {
-      mant_ = 0;
-      exp_  = 0;
+      fs_ = 0;
 }
 
 inline simtime_t::simtime_t(uint64_t m, int e)
 {
-      mant_ = m;
-      exp_  = e;
+      int shift = e - SIMTIME_EXP;
+      if (shift >= 0) {
+	    assert(shift < 20);
+	    assert(m <= UINT64_MAX / simtime_pow10[shift]);
+	    fs_ = m * simtime_pow10[shift];
+      } else {
+	    assert(shift > -20);
+	    uint64_t div = simtime_pow10[-shift];
+	    fs_ = m / div + (m % div >= (div+1)/2);
+      }
 }
 
-inline simtime_t& simtime_t::operator += (const simtime_t&that)
+inline bool simtime_t::add(const simtime_t&that)
 {
-      int use_exp = that.exp_;
-      uint64_t use_mant = that.mant_;
-
-      while (use_exp < exp_) {
-	    mant_ *= 10;
-	    exp_ -= 1;
-      }
-      while (exp_ < use_exp) {
-	    use_mant *= 10;
-	    use_exp -= 1;
-      }
+      uint64_t sum = fs_ + that.fs_;
+      uint64_t ovf = -(uint64_t)(sum < fs_);
+      fs_ = sum | ovf;
+      return ovf == 0;
+}
 
-      mant_ += use_mant;
+inline simtime_t& simtime_t::operator += (const simtime_t&that)
+{
+      add(that);
+      return *this;
 }
 
 inline bool simtime_t::operator < (const simtime_t&r) const
 {
-      int l_exp = exp_;
-      int r_exp = r.exp_;
-
-      unsigned long long l_mant = mant_;
-      unsigned long long r_mant = r.mant_;
-
-      while (l_exp > r_exp) {
-	    l_exp -= 1;
-	    l_mant *= 10ULL;
-      }
-      while (r_exp > l_exp) {
-	    r_exp -= 1;
-	    r_mant *= 10ULL;
-      }
-      return l_mant < r_mant;
+      return fs_ < r.fs_;
 }
 
 inline unsigned long long simtime_t::units_value(int use_units) const
 {
-      unsigned long long use_time = mant_;
-      int use_exp = exp_;
-
-      while (use_exp < use_units) {
-	    use_time += 5ULL;
-	    use_time /= 10ULL;
-	    use_exp += 1;
-      }
-      while (use_exp > use_units) {
-	    use_time *= 10ULL;
-	    use_exp -= 1;
+      int shift = use_units - SIMTIME_EXP;
+      if (shift <= 0) {
+	    assert(shift > -20);
+	    return fs_ * simtime_pow10[-shift];
       }
 
-      return use_time;
+      assert(shift < 20);
+      uint64_t div = simtime_pow10[shift];
+      return fs_ / div + (fs_ % div >= (div+1)/2);
 }
 
 #endif
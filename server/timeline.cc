@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  "timeline.h"
+# include  "simbus_timeline.h"
+# include  "simtime.h"
+# include  <unistd.h>
+# include  <fcntl.h>
+# include  <string.h>
+# include  <stdio.h>
+# include  <time.h>
+# include  <math.h>
+# include  <map>
+# include  <vector>
+
+using namespace std;
+
+enum { NAME_BUS_READY = 0, NAME_WAIT = 1 };
+
+static const size_t BUF_SIZE = 256*1024;
+
+static int timeline_fd = -1;
+static char*buf = 0;
+static size_t buf_fill = 0;
+
+struct tl_bus_s {
+      int track;
+	// Start of the current step, and the latest UNTIL.
+      uint64_t begin_ns, sent_ns;
+      double begin_sim, sent_sim;
+};
+
+struct tl_dev_s {
+      int track;
+      int bus;
+};
+
+static vector<tl_bus_s> buses;
+static vector<tl_dev_s> devices;
+static map<string,int> bus_ids;
+static unsigned next_track = 0;
+
+static uint64_t now_ns(void)
+{
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double sim_seconds(const simtime_t&time)
+{
+      return time.peek_mant() * pow(10.0, time.peek_exp());
+}
+
+static void flush_buf(void)
+{
+      size_t off = 0;
+      while (off < buf_fill) {
+	    ssize_t rc = write(timeline_fd, buf+off, buf_fill-off);
+	    if (rc <= 0) {
+		  perror("timeline");
+		  break;
+	    }
+	    off += rc;
+      }
+      buf_fill = 0;
+}
+
+static void put_rec(simbus_timeline_rec_s&rec, const char*text)
+{
+      rec.len = text? strlen(text) : 0;
+      if (buf_fill + sizeof rec + rec.len > BUF_SIZE)
+	    flush_buf();
+
+      memcpy(buf+buf_fill, &rec, sizeof rec);
+      buf_fill += sizeof rec;
+      if (rec.len > 0) {
+	    memcpy(buf+buf_fill, text, rec.len);
+	    buf_fill += rec.len;
+      }
+}
+
+static void put_text(simbus_timeline_kind_t kind, int id, const char*text)
+{
+      simbus_timeline_rec_s rec;
+      memset(&rec, 0, sizeof rec);
+      rec.kind = kind;
+      if (kind == TL_TRACK)
+	    rec.track = id;
+      else
+	    rec.name = id;
+      put_rec(rec, text);
+}
+
+static void put_span(int track, int name, uint64_t start, uint64_t end,
+		     double sim_begin, double sim_end)
+{
+      simbus_timeline_rec_s rec;
+      memset(&rec, 0, sizeof rec);
+      rec.kind = TL_SPAN;
+      rec.name = name;
+      rec.track = track;
+      rec.start_ns = start;
+      rec.dur_ns = end - start;
+      rec.sim_begin = sim_begin;
+      rec.sim_end = sim_end;
+      put_rec(rec, 0);
+}
+
+bool timeline_open(const char*path)
+{
+      timeline_fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+      if (timeline_fd < 0) {
+	    perror(path);
+	    return false;
+      }
+
+      buf = new char[BUF_SIZE];
+      memcpy(buf, SIMBUS_TIMELINE_MAGIC, 8);
+      buf_fill = 8;
+
+      simbus_timeline_rec_s rec;
+      memset(&rec, 0, sizeof rec);
+      rec.kind = TL_PROCESS;
+      rec.arg = getpid();
+      put_rec(rec, "simbus_server");
+
+      put_text(TL_NAME, NAME_BUS_READY, "bus_ready");
+      put_text(TL_NAME, NAME_WAIT, "wait for client");
+      return true;
+}
+
+bool timeline_active(void)
+{
+      return timeline_fd >= 0;
+}
+
+int timeline_bus(const std::string&name)
+{
+      map<string,int>::iterator cur = bus_ids.find(name);
+      if (cur != bus_ids.end())
+	    return cur->second;
+
+      tl_bus_s bus;
+      bus.track = next_track++;
+      bus.begin_ns = bus.sent_ns = 0;
+      bus.begin_sim = bus.sent_sim = 0.0;
+      put_text(TL_TRACK, bus.track, name.c_str());
+
+      int id = buses.size();
+      buses.push_back(bus);
+      bus_ids[name] = id;
+      return id;
+}
+
+int timeline_device(const std::string&bus, const std::string&name)
+{
+      tl_dev_s dev;
+      dev.bus = timeline_bus(bus);
+      dev.track = next_track++;
+      put_text(TL_TRACK, dev.track, (bus + "." + name).c_str());
+
+      devices.push_back(dev);
+      return devices.size() - 1;
+}
+
+void timeline_ready(int id)
+{
+      if (id < 0)
+	    return;
+
+      const tl_dev_s&dev = devices[id];
+      const tl_bus_s&bus = buses[dev.bus];
+      if (bus.sent_ns == 0)
+	    return;
+
+      put_span(dev.track, NAME_WAIT, bus.sent_ns, now_ns(),
+	       bus.sent_sim, bus.sent_sim);
+}
+
+void timeline_bus_begin(int id, const simtime_t&time)
+{
+      tl_bus_s&bus = buses[id];
+      bus.begin_ns = now_ns();
+      bus.begin_sim = sim_seconds(time);
+}
+
+void timeline_bus_end(int id, const simtime_t&time)
+{
+      tl_bus_s&bus = buses[id];
+      bus.sent_ns = now_ns();
+      bus.sent_sim = sim_seconds(time);
+      put_span(bus.track, NAME_BUS_READY, bus.begin_ns, bus.sent_ns,
+	       bus.begin_sim, bus.sent_sim);
+}
+
+void timeline_close(void)
+{
+      if (timeline_fd < 0)
+	    return;
+
+      flush_buf();
+      close(timeline_fd);
+      timeline_fd = -1;
+      delete[]buf;
+      buf = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef __timeline_H
+#define __timeline_H
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  <string>
+
+class simtime_t;
+
+/*
+ * The server timeline records a span for each step of each bus (from
+ * the last READY to the UNTIL messages) and for each wait for a
+ * device (from the UNTIL to that device's READY). The records are
+ * binary (see simbus_timeline.h) and are buffered, so the cost per
+ * span is a clock read and a copy. The libsimbus clients write their
+ * own timeline files, and the simbus-timeline program merges them
+ * all into one Chrome trace.
+ */
+
+/* Open the timeline file. Return false if it cannot be opened. */
+extern bool timeline_open(const char*path);
+
+/* True if the timeline is open, so bus and device ids are wanted. */
+extern bool timeline_active(void);
+
+/* Get a track for the bus or device. */
+extern int timeline_bus(const std::string&bus);
+extern int timeline_device(const std::string&bus, const std::string&name);
+
+/* Note that the device sent READY. This ends its wait span. */
+extern void timeline_ready(int dev);
+
+/*
+ * The server starts (begin) and finishes (end) a step of the bus. The
+ * end is when all the UNTIL messages have been sent, and the time is
+ * the new bus time.
+ */
+extern void timeline_bus_begin(int bus, const simtime_t&time);
+extern void timeline_bus_end(int bus, const simtime_t&time);
+
+/* Write what is buffered and close the file. */
+extern void timeline_close(void);
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+/*
+ * simbus-timeline [-s] <file>...
+ *
+ * Merge timeline files from the server (simbus_server -D
+ * timeline=<file>) and from the libsimbus clients (SIMBUS_TIMELINE=<dir>)
+ * into a single Chrome trace, written to stdout as JSON. The trace can
+ * be loaded into chrome://tracing or the Perfetto UI. Each file is a
+ * process, and each bus or device is a thread of that process.
+ *
+ * The time axis is the wall clock time from the first span. With -s,
+ * the time axis is the simulation time instead. Both times are in the
+ * args of each span.
+ */
+
+# include  "simbus_timeline.h"
+# include  <stdio.h>
+# include  <string.h>
+# include  <unistd.h>
+# include  <inttypes.h>
+# include  <iostream>
+# include  <vector>
+# include  <string>
+
+using namespace std;
+
+static void print_string(const char*text)
+{
+      fputc('"', stdout);
+      for (const char*cp = text ; *cp ; cp += 1) {
+	    if (*cp == '"' || *cp == '\\')
+		  fputc('\\', stdout);
+	    if ((unsigned char)*cp < 0x20)
+		  continue;
+	    fputc(*cp, stdout);
+      }
+      fputc('"', stdout);
+}
+
+static FILE* open_timeline(const char*path)
+{
+      FILE*fd = fopen(path, "rb");
+      if (fd == 0) {
+	    perror(path);
+	    return 0;
+      }
+
+      char magic[8];
+      if (fread(magic, 1, sizeof magic, fd) != sizeof magic
+	  || memcmp(magic, SIMBUS_TIMELINE_MAGIC, sizeof magic) != 0) {
+	    cerr << path << ": Not a simbus timeline." << endl;
+	    fclose(fd);
+	    return 0;
+      }
+
+      return fd;
+}
+
+/*
+ * Read the next record and its payload. A truncated record at the end
+ * of the file (a process that did not exit cleanly) ends the file.
+ */
+static bool read_rec(FILE*fd, simbus_timeline_rec_s&rec, vector<char>&payload)
+{
+      if (fread(&rec, sizeof rec, 1, fd) != 1)
+	    return false;
+
+      payload.resize(rec.len + 1);
+      if (fread(&payload[0], 1, rec.len, fd) != rec.len)
+	    return false;
+      payload[rec.len] = 0;
+      return true;
+}
+
+int main(int argc, char*argv[])
+{
+      bool sim_flag = false;
+
+      int opt;
+      while ((opt = getopt(argc, argv, "s")) != -1) {
+	    switch (opt) {
+		case 's':
+		  sim_flag = true;
+		  break;
+		default:
+		  cerr << "Usage: " << argv[0] << " [-s] <file>..." << endl;
+		  return 1;
+	    }
+      }
+
+      if (optind >= argc) {
+	    cerr << "Usage: " << argv[0] << " [-s] <file>..." << endl;
+	    return 1;
+      }
+
+      simbus_timeline_rec_s rec;
+      vector<char> payload;
+
+	// First pass: find the earliest span, which is time 0 of the
+	// wall clock axis.
+      uint64_t base_ns = UINT64_MAX;
+      for (int idx = optind ; idx < argc ; idx += 1) {
+	    FILE*fd = open_timeline(argv[idx]);
+	    if (fd == 0)
+		  return 2;
+	    while (read_rec(fd, rec, payload)) {
+		  if (rec.kind == TL_SPAN && rec.start_ns < base_ns)
+			base_ns = rec.start_ns;
+	    }
+	    fclose(fd);
+      }
+
+      printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+      const char*sep = "";
+
+      for (int idx = optind ; idx < argc ; idx += 1) {
+	    FILE*fd = open_timeline(argv[idx]);
+	    if (fd == 0)
+		  return 2;
+
+	    uint64_t pid = 0;
+	    vector<string> names;
+
+	    while (read_rec(fd, rec, payload)) {
+		  switch (rec.kind) {
+		      case TL_PROCESS:
+			pid = rec.arg;
+			printf("%s{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%" PRIu64
+			       ",\"args\":{\"name\":", sep, pid);
+			print_string(&payload[0]);
+			printf("}}");
+			break;
+
+		      case TL_NAME:
+			if (names.size() <= rec.name)
+			      names.resize(rec.name+1);
+			names[rec.name] = &payload[0];
+			continue;
+
+		      case TL_TRACK:
+			printf("%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%" PRIu64
+			       ",\"tid\":%u,\"args\":{\"name\":", sep, pid, rec.track+1);
+			print_string(&payload[0]);
+			printf("}}");
+			break;
+
+		      case TL_SPAN: {
+			    double ts, dur;
+			    if (sim_flag) {
+				  ts = rec.sim_begin * 1e6;
+				  dur = (rec.sim_end - rec.sim_begin) * 1e6;
+			    } else {
+				  ts = (rec.start_ns - base_ns) / 1e3;
+				  dur = rec.dur_ns / 1e3;
+			    }
+			    printf("%s{\"ph\":\"X\",\"name\":", sep);
+			    print_string(rec.name < names.size()? names[rec.name].c_str() : "?");
+			    printf(",\"pid\":%" PRIu64 ",\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f"
+				   ",\"args\":{\"wall_ns\":%" PRIu64 ",\"wall_dur_ns\":%" PRIu64
+				   ",\"sim_begin\":%.12g,\"sim_end\":%.12g,\"arg\":\"0x%" PRIx64 "\"}}",
+				   pid, rec.track+1, ts, dur,
+				   rec.start_ns - base_ns, rec.dur_ns,
+				   rec.sim_begin, rec.sim_end, rec.arg);
+			    break;
+		      }
+
+		      default:
+			continue;
+		  }
+		  sep = ",\n";
+	    }
+
+	    fclose(fd);
+      }
+
+      printf("\n]}\n");
+      return 0;
+}
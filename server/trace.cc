@@ -0,0 +1,958 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  "trace.h"
+# include  "priv.h"
+# include  "lxt2_write.h"
+# include  <pthread.h>
+# include  <string.h>
+# include  <stdlib.h>
+# include  <fnmatch.h>
+# include  <ctype.h>
+# include  <iostream>
+# include  <vector>
+# include  <deque>
+# include  <list>
+# include  <algorithm>
+# include  <assert.h>
+
+using namespace std;
+
+/*
+ * The service thread writes trace records into the current chunk.
+ * When the chunk is full it goes onto the full queue and the writer
+ * thread takes it from there. The records in a chunk are only touched
+ * by one thread at a time, so only the queue handoff needs the
+ * lock. There is a fixed number of chunks, so if the writer thread
+ * falls behind by all of them, the service thread waits for a free
+ * one. That is the only time tracing blocks the service thread.
+ */
+# define TRACE_CHUNK_SIZE   (64*1024)
+# define TRACE_CHUNK_COUNT  64
+
+enum trace_op_t { REC_SYMBOL, REC_TIME, REC_BITS, REC_STRING, REC_FLUSH };
+
+struct trace_rec_s {
+      uint16_t op;
+	// For REC_SYMBOL, this is true for string symbols.
+      uint16_t flag;
+      uint32_t sym;
+	// Bytes of payload that follow, including the nul for
+	// strings. For REC_SYMBOL, the width is in arg.
+      uint32_t len;
+      uint32_t arg;
+};
+
+struct trace_chunk_s {
+      size_t fill;
+      char data[TRACE_CHUNK_SIZE];
+};
+
+static std::string trace_path;
+static int trace_level = TRACE_DEFAULT_LEVEL;
+static bool trace_started = false;
+static struct lxt2_wr_trace*trace_lxt = 0;
+
+static pthread_t writer_thread;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_free = PTHREAD_COND_INITIALIZER;
+static deque<trace_chunk_s*> full_queue;
+static deque<trace_chunk_s*> free_queue;
+static bool writer_stop = false;
+	// File position of the LXT2 writer, for trace_stats.
+static uint64_t writer_position = 0;
+
+	// Service thread state.
+static trace_chunk_s*cur_chunk = 0;
+static unsigned long queue_stalls = 0;
+
+/*
+ * The service thread keeps the last value of every symbol, even while
+ * the trace window is closed, so that the values can be dumped when
+ * the window opens.
+ */
+struct trace_sym_s {
+      std::string name;
+      std::string last_value;
+      bool last_valid;
+      bool string_flag;
+      int wid;
+	// Flight recorder ring for the bus of this signal, and the
+	// value of the signal at the start of that ring.
+      int ring;
+      std::string flight_base;
+      bool flight_base_valid;
+	// False if the symbol is only kept for a trigger.
+      bool traced;
+	// Index into the trigger list, or -1.
+      int trigger;
+};
+static vector<trace_sym_s> symbols;
+
+/*
+ * Trace selection. Signals are included if they match any of the
+ * include globs (or there are none) and none of the exclude
+ * globs. The trace window is open from the first time >= start at
+ * which all the triggers match, until the stop time.
+ */
+struct trace_trigger_s {
+      std::string name;
+      std::string value;
+      int sym;
+      bool match;
+};
+static list<string> include_globs;
+static list<string> exclude_globs;
+static vector<trace_trigger_s> triggers;
+static uint64_t window_start = 0;
+static uint64_t window_stop = UINT64_MAX;
+static bool window_open = false;
+static bool window_done = false;
+static uint64_t cur_time = 0;
+
+	// Writer thread state.
+static vector<struct lxt2_wr_symbol*> writer_syms;
+
+/*
+ * In flight recorder mode there is no writer thread. The value
+ * changes of each bus go into a ring of packed records instead, and
+ * are written out as an LXT2 file only when trace_dump is called. When
+ * the ring is full, the oldest records are retired into the
+ * flight_base values of the symbols, so that a dump can start with
+ * the values at the beginning of the ring.
+ *
+ * A ring record is a kind byte, then for FR_TIME an 8 byte time, or
+ * for FR_BITS/FR_STRING a 4 byte symbol index, a 2 byte length and
+ * the value. Bit values are packed 4 to a byte.
+ */
+enum flight_kind_t { FR_TIME, FR_BITS, FR_STRING };
+
+struct flight_ring_s {
+      std::string bus;
+      std::vector<unsigned char> buf;
+	// Offset of the oldest byte, and the number of bytes used.
+      size_t head, fill;
+	// Time of the oldest records, and of the newest.
+      uint64_t base_time;
+      uint64_t last_time;
+      bool time_valid;
+};
+
+static size_t flight_size = 0;
+static vector<flight_ring_s> flight_rings;
+static unsigned flight_dumps = 0;
+
+static inline size_t rec_size(size_t len)
+{
+      return (sizeof(trace_rec_s) + len + 7) & ~(size_t)7;
+}
+
+static void process_chunk(trace_chunk_s*chunk)
+{
+      size_t off = 0;
+      while (off < chunk->fill) {
+	    trace_rec_s*rec = reinterpret_cast<trace_rec_s*>(chunk->data + off);
+	    char*payload = chunk->data + off + sizeof(trace_rec_s);
+
+	    switch (rec->op) {
+		case REC_SYMBOL: {
+		      int flags = rec->flag? LXT2_WR_SYM_F_STRING : LXT2_WR_SYM_F_BITS;
+		      struct lxt2_wr_symbol*sym = lxt2_wr_symbol_add(trace_lxt, payload,
+								     0, rec->arg-1, 0, flags);
+		      if (writer_syms.size() <= rec->sym)
+			    writer_syms.resize(rec->sym+1, 0);
+		      writer_syms[rec->sym] = sym;
+		      break;
+		}
+		case REC_TIME: {
+		      uint64_t time;
+		      memcpy(&time, payload, sizeof time);
+		      lxt2_wr_set_time64(trace_lxt, time);
+		      break;
+		}
+		case REC_BITS:
+		  lxt2_wr_emit_value_bit_string(trace_lxt, writer_syms[rec->sym], 0, payload);
+		  break;
+		case REC_STRING:
+		  lxt2_wr_emit_value_string(trace_lxt, writer_syms[rec->sym], 0, payload);
+		  break;
+		case REC_FLUSH:
+		  lxt2_wr_flush(trace_lxt);
+		  break;
+		default:
+		  assert(0);
+		  break;
+	    }
+
+	    off += rec_size(rec->len);
+      }
+}
+
+static void* writer_main(void*)
+{
+      pthread_mutex_lock(&queue_lock);
+      for (;;) {
+	    while (full_queue.empty() && !writer_stop)
+		  pthread_cond_wait(&queue_work, &queue_lock);
+
+	    if (full_queue.empty())
+		  break;
+
+	    trace_chunk_s*chunk = full_queue.front();
+	    full_queue.pop_front();
+	    pthread_mutex_unlock(&queue_lock);
+
+	    process_chunk(chunk);
+	    chunk->fill = 0;
+
+	    pthread_mutex_lock(&queue_lock);
+	    writer_position = trace_lxt->position;
+	    free_queue.push_back(chunk);
+	    pthread_cond_signal(&queue_free);
+      }
+      pthread_mutex_unlock(&queue_lock);
+      return 0;
+}
+
+/*
+ * Pass the current chunk to the writer thread and get an empty one.
+ */
+static void submit_chunk(void)
+{
+      pthread_mutex_lock(&queue_lock);
+      if (cur_chunk->fill > 0) {
+	    full_queue.push_back(cur_chunk);
+	    pthread_cond_signal(&queue_work);
+
+	    if (free_queue.empty())
+		  queue_stalls += 1;
+	    while (free_queue.empty())
+		  pthread_cond_wait(&queue_free, &queue_lock);
+
+	    cur_chunk = free_queue.front();
+	    free_queue.pop_front();
+      }
+      pthread_mutex_unlock(&queue_lock);
+}
+
+/*
+ * Make room for a record in the current chunk, and fill in its
+ * header. Return a pointer to the payload.
+ */
+static char* add_record(trace_op_t op, unsigned sym, size_t len)
+{
+      assert(rec_size(len) <= TRACE_CHUNK_SIZE);
+      if (cur_chunk->fill + rec_size(len) > TRACE_CHUNK_SIZE)
+	    submit_chunk();
+
+      trace_rec_s*rec = reinterpret_cast<trace_rec_s*>(cur_chunk->data + cur_chunk->fill);
+      rec->op = op;
+      rec->flag = 0;
+      rec->sym = sym;
+      rec->len = len;
+      rec->arg = 0;
+      cur_chunk->fill += rec_size(len);
+      return reinterpret_cast<char*>(rec + 1);
+}
+
+/*
+ * Return true if the value is the same as the last value emitted for
+ * the symbol. If not, remember it for next time.
+ */
+static bool same_as_last(trace_sym_s&sym, const char*text, size_t len)
+{
+      string&last = sym.last_value;
+      if (sym.last_valid && last.size() == len && memcmp(last.data(), text, len) == 0)
+	    return true;
+
+      last.assign(text, len);
+      sym.last_valid = true;
+      return false;
+}
+
+static void ring_put(flight_ring_s&ring, const void*data, size_t cnt)
+{
+      const unsigned char*src = static_cast<const unsigned char*>(data);
+      size_t pos = (ring.head + ring.fill) % ring.buf.size();
+      for (size_t idx = 0 ; idx < cnt ; idx += 1) {
+	    ring.buf[pos] = src[idx];
+	    pos = pos+1 == ring.buf.size()? 0 : pos+1;
+      }
+      ring.fill += cnt;
+}
+
+static void ring_get(const flight_ring_s&ring, size_t off, void*data, size_t cnt)
+{
+      unsigned char*dst = static_cast<unsigned char*>(data);
+      size_t pos = (ring.head + off) % ring.buf.size();
+      for (size_t idx = 0 ; idx < cnt ; idx += 1) {
+	    dst[idx] = ring.buf[pos];
+	    pos = pos+1 == ring.buf.size()? 0 : pos+1;
+      }
+}
+
+static size_t packed_size(flight_kind_t kind, size_t len)
+{
+      return kind == FR_BITS? (len+3)/4 : len;
+}
+
+/*
+ * Decode the record at offset off of the ring. Return its size. For a
+ * time record, set time, otherwise set sym and value.
+ */
+static size_t ring_decode(const flight_ring_s&ring, size_t off,
+			  uint64_t&time, int&sym, string&value)
+{
+      unsigned char kind;
+      ring_get(ring, off, &kind, 1);
+      if (kind == FR_TIME) {
+	    ring_get(ring, off+1, &time, sizeof time);
+	    sym = -1;
+	    return 1 + sizeof time;
+      }
+
+      uint32_t idx;
+      uint16_t len;
+      ring_get(ring, off+1, &idx, sizeof idx);
+      ring_get(ring, off+5, &len, sizeof len);
+      size_t cnt = packed_size((flight_kind_t)kind, len);
+      vector<unsigned char> buf (cnt+1);
+      ring_get(ring, off+7, &buf[0], cnt);
+
+      sym = idx;
+      if (kind == FR_BITS) {
+	    value.resize(len);
+	    for (size_t bit = 0 ; bit < len ; bit += 1)
+		  value[bit] = "01zx"[(buf[bit/4] >> (2*(bit%4))) & 3];
+      } else {
+	    value.assign(reinterpret_cast<char*>(&buf[0]), len);
+      }
+      return 7 + cnt;
+}
+
+/*
+ * Retire the oldest record of the ring into the base values.
+ */
+static void ring_retire(flight_ring_s&ring)
+{
+      uint64_t time;
+      int sym;
+      string value;
+      size_t cnt = ring_decode(ring, 0, time, sym, value);
+      if (sym < 0) {
+	    ring.base_time = time;
+      } else {
+	    symbols[sym].flight_base = value;
+	    symbols[sym].flight_base_valid = true;
+      }
+      ring.head = (ring.head + cnt) % ring.buf.size();
+      ring.fill -= cnt;
+}
+
+static void ring_make_room(flight_ring_s&ring, size_t cnt)
+{
+      while (ring.fill + cnt > ring.buf.size())
+	    ring_retire(ring);
+}
+
+static void flight_value(int idx)
+{
+      trace_sym_s&sym = symbols[idx];
+      flight_ring_s&ring = flight_rings[sym.ring];
+
+      flight_kind_t kind = sym.string_flag? FR_STRING : FR_BITS;
+      size_t len = sym.last_value.size();
+      if (len > 0xffff)
+	    len = 0xffff;
+      size_t cnt = packed_size(kind, len);
+
+	// Values that do not fit in the ring at all are not recorded.
+      if (7 + cnt + 1 + sizeof(uint64_t) > ring.buf.size())
+	    return;
+
+      if (! ring.time_valid || ring.last_time != cur_time) {
+	    unsigned char tkind = FR_TIME;
+	    ring_make_room(ring, 1 + sizeof cur_time);
+	    ring_put(ring, &tkind, 1);
+	    ring_put(ring, &cur_time, sizeof cur_time);
+	    ring.last_time = cur_time;
+	    ring.time_valid = true;
+      }
+
+      static vector<unsigned char> pack_buf;
+      if (pack_buf.size() < 7 + cnt)
+	    pack_buf.resize(7 + cnt);
+      unsigned char*buf = &pack_buf[0];
+      uint32_t sym_idx = idx;
+      uint16_t len16 = len;
+      buf[0] = kind;
+      memcpy(buf+1, &sym_idx, sizeof sym_idx);
+      memcpy(buf+5, &len16, sizeof len16);
+      if (kind == FR_BITS) {
+	    memset(buf+7, 0, cnt);
+	    for (size_t bit = 0 ; bit < len ; bit += 1) {
+		  unsigned code;
+		  switch (sym.last_value[bit]) {
+		      case '0': code = 0; break;
+		      case '1': code = 1; break;
+		      case 'z': code = 2; break;
+		      default:  code = 3; break;
+		  }
+		  buf[7 + bit/4] |= code << (2*(bit%4));
+	    }
+      } else {
+	    memcpy(buf+7, sym.last_value.data(), len);
+      }
+
+      ring_make_room(ring, 7 + cnt);
+      ring_put(ring, buf, 7 + cnt);
+}
+
+static int flight_ring_for(const string&name)
+{
+      string bus = name.substr(0, name.find('.'));
+      for (size_t idx = 0 ; idx < flight_rings.size() ; idx += 1) {
+	    if (flight_rings[idx].bus == bus)
+		  return idx;
+      }
+
+      flight_rings.push_back(flight_ring_s());
+      flight_ring_s&ring = flight_rings.back();
+      ring.bus = bus;
+      ring.buf.resize(flight_size);
+      ring.head = 0;
+      ring.fill = 0;
+      ring.base_time = 0;
+      ring.last_time = 0;
+      ring.time_valid = false;
+      return flight_rings.size()-1;
+}
+
+static void queue_symbol(int idx)
+{
+      trace_sym_s&sym = symbols[idx];
+      if (flight_size > 0) {
+	    sym.ring = flight_ring_for(sym.name);
+	    return;
+      }
+
+      char*payload = add_record(REC_SYMBOL, idx, sym.name.size()+1);
+      trace_rec_s*rec = reinterpret_cast<trace_rec_s*>(payload) - 1;
+      rec->flag = sym.string_flag? 1 : 0;
+      rec->arg = sym.wid;
+      memcpy(payload, sym.name.c_str(), sym.name.size()+1);
+}
+
+static void queue_value(int idx)
+{
+      if (flight_size > 0) {
+	    flight_value(idx);
+	    return;
+      }
+
+      trace_sym_s&sym = symbols[idx];
+      size_t len = sym.last_value.size();
+      char*payload = add_record(sym.string_flag? REC_STRING : REC_BITS, idx, len+1);
+      memcpy(payload, sym.last_value.data(), len);
+      payload[len] = 0;
+}
+
+static void queue_time(void)
+{
+	// The flight recorder puts the time into each ring as needed.
+      if (flight_size > 0)
+	    return;
+
+      char*payload = add_record(REC_TIME, 0, sizeof cur_time);
+      memcpy(payload, &cur_time, sizeof cur_time);
+}
+
+/*
+ * Open the trace window if the time and triggers allow it. The
+ * current values of all the traced signals are written at the start
+ * of the window, so that the trace does not start out as all x.
+ */
+static void check_window(void)
+{
+      if (window_open) {
+	    if (cur_time >= window_stop) {
+		  window_open = false;
+		  window_done = true;
+	    }
+	    return;
+      }
+
+      if (window_done || cur_time < window_start)
+	    return;
+      if (cur_time >= window_stop) {
+	    window_done = true;
+	    return;
+      }
+
+      for (size_t idx = 0 ; idx < triggers.size() ; idx += 1) {
+	    if (! triggers[idx].match)
+		  return;
+      }
+
+      window_open = true;
+      queue_time();
+      for (size_t idx = 0 ; idx < symbols.size() ; idx += 1) {
+	    if (symbols[idx].traced && symbols[idx].last_valid)
+		  queue_value(idx);
+      }
+}
+
+/*
+ * Record a new value for a symbol, and queue it if the window is
+ * open.
+ */
+static void emit_value(int idx, const char*text, size_t len)
+{
+      trace_sym_s&sym = symbols[idx];
+      if (same_as_last(sym, text, len))
+	    return;
+
+      if (sym.trigger >= 0) {
+	    trace_trigger_s&trig = triggers[sym.trigger];
+	    trig.match = trig.value == sym.last_value;
+      }
+
+      if (! window_open) {
+	    if (window_done)
+		  return;
+	      // Opening the window writes this value with the rest.
+	    check_window();
+	    return;
+      }
+
+      if (sym.traced)
+	    queue_value(idx);
+}
+
+static bool match_any(const list<string>&globs, const string&name)
+{
+      for (list<string>::const_iterator cur = globs.begin()
+		 ; cur != globs.end() ; ++ cur) {
+	    if (fnmatch(cur->c_str(), name.c_str(), 0) == 0)
+		  return true;
+      }
+      return false;
+}
+
+/*
+ * Parse a time like "10us" or "1.5e-3" (seconds) into
+ * SERVICE_TIME_PRECISION units.
+ */
+static bool parse_time(const string&text, uint64_t&val)
+{
+      char*end;
+      double num = strtod(text.c_str(), &end);
+      if (end == text.c_str() || num < 0)
+	    return false;
+
+      double scale;
+      string unit (end);
+      if (unit == "" || unit == "s")
+	    scale = 1.0;
+      else if (unit == "ms")
+	    scale = 1e-3;
+      else if (unit == "us")
+	    scale = 1e-6;
+      else if (unit == "ns")
+	    scale = 1e-9;
+      else if (unit == "ps")
+	    scale = 1e-12;
+      else
+	    return false;
+
+      for (int idx = SERVICE_TIME_PRECISION ; idx < 0 ; idx += 1)
+	    scale *= 10.0;
+
+      val = (uint64_t)(num * scale + 0.5);
+      return true;
+}
+
+/*
+ * Convert a trigger value to the bit string of the given width, MSB
+ * first. The value is either "0x<hex digits>" or a string of 0, 1, x
+ * and z bits. Return an empty string if the value is invalid.
+ */
+static string trigger_bits(const string&value, int wid)
+{
+      string bits;
+      if (value.compare(0, 2, "0x") == 0 || value.compare(0, 2, "0X") == 0) {
+	    for (size_t idx = 2 ; idx < value.size() ; idx += 1) {
+		  char ch = value[idx];
+		  int nib;
+		  if (ch >= '0' && ch <= '9') nib = ch - '0';
+		  else if (ch >= 'a' && ch <= 'f') nib = ch - 'a' + 10;
+		  else if (ch >= 'A' && ch <= 'F') nib = ch - 'A' + 10;
+		  else return string();
+		  for (int bit = 3 ; bit >= 0 ; bit -= 1)
+			bits += (nib >> bit) & 1? '1' : '0';
+	    }
+      } else {
+	    for (size_t idx = 0 ; idx < value.size() ; idx += 1) {
+		  char ch = tolower(value[idx]);
+		  if (ch != '0' && ch != '1' && ch != 'x' && ch != 'z')
+			return string();
+		  bits += ch;
+	    }
+      }
+
+      if (bits.size() == 0)
+	    return bits;
+      if ((int)bits.size() > wid)
+	    return bits.substr(bits.size() - wid);
+      return string(wid - bits.size(), '0') + bits;
+}
+
+/*
+ * Parse a size like "4096", "64K" or "16M".
+ */
+static bool parse_size(const string&text, size_t&val)
+{
+      char*end;
+      unsigned long num = strtoul(text.c_str(), &end, 0);
+      if (end == text.c_str())
+	    return false;
+
+      string unit (end);
+      if (unit == "")
+	    val = num;
+      else if (unit == "K" || unit == "k")
+	    val = num * 1024;
+      else if (unit == "M" || unit == "m")
+	    val = num * 1024 * 1024;
+      else if (unit == "G" || unit == "g")
+	    val = num * 1024 * 1024 * 1024;
+      else
+	    return false;
+
+      return true;
+}
+
+bool trace_config(const string&key, const string&value)
+{
+	// The mode cannot change after the trace has started.
+      if (key == "flight" && trace_started)
+	    return false;
+
+      if (key == "include") {
+	    include_globs.push_back(value);
+
+      } else if (key == "exclude") {
+	    exclude_globs.push_back(value);
+
+      } else if (key == "start") {
+	    if (! parse_time(value, window_start))
+		  return false;
+
+      } else if (key == "stop") {
+	    if (! parse_time(value, window_stop))
+		  return false;
+
+      } else if (key == "flight") {
+	    if (! parse_size(value, flight_size) || flight_size < 4096)
+		  return false;
+
+      } else if (key == "trigger") {
+	    size_t eq = value.rfind('=');
+	    if (eq == string::npos || eq == 0 || eq+1 == value.size())
+		  return false;
+	    trace_trigger_s tmp;
+	    tmp.name = value.substr(0, eq);
+	    tmp.value = value.substr(eq+1);
+	    tmp.sym = -1;
+	    tmp.match = false;
+	    triggers.push_back(tmp);
+
+      } else {
+	    return false;
+      }
+
+      return true;
+}
+
+void trace_open(const char*path, int level)
+{
+      assert(trace_path.size() == 0);
+      trace_path = path;
+      trace_level = level;
+}
+
+/*
+ * The trace really starts when the first symbol is added. By then the
+ * config files have been read, so all the trace settings are known.
+ */
+static void start_trace(void)
+{
+      if (trace_started)
+	    return;
+      trace_started = true;
+
+      if (flight_size > 0) {
+	    cout << "Flight recorder keeps " << flight_size
+		 << " bytes per bus for " << trace_path << endl;
+	    return;
+      }
+
+      trace_lxt = lxt2_wr_init(trace_path.c_str());
+      if (trace_lxt == 0) {
+	    cerr << "Unable to open trace file " << trace_path << endl;
+	    trace_path = "";
+	    return;
+      }
+
+      lxt2_wr_set_compression_depth(trace_lxt, trace_level);
+      lxt2_wr_set_timescale(trace_lxt, SERVICE_TIME_PRECISION);
+      lxt2_wr_set_time(trace_lxt, 0);
+
+      for (int idx = 0 ; idx < TRACE_CHUNK_COUNT ; idx += 1) {
+	    trace_chunk_s*chunk = new trace_chunk_s;
+	    chunk->fill = 0;
+	    free_queue.push_back(chunk);
+      }
+      cur_chunk = free_queue.front();
+      free_queue.pop_front();
+
+      writer_stop = false;
+      int rc = pthread_create(&writer_thread, 0, &writer_main, 0);
+      assert(rc == 0);
+}
+
+bool trace_active(void)
+{
+      return trace_path.size() > 0;
+}
+
+int trace_symbol_add(const string&name, int wid, bool string_flag)
+{
+      bool traced = include_globs.empty() || match_any(include_globs, name);
+      if (match_any(exclude_globs, name))
+	    traced = false;
+
+      int trigger = -1;
+      for (size_t idx = 0 ; idx < triggers.size() ; idx += 1) {
+	    if (triggers[idx].name != name || triggers[idx].sym >= 0)
+		  continue;
+
+	    string bits = string_flag? triggers[idx].value
+		  : trigger_bits(triggers[idx].value, wid);
+	    if (bits.size() == 0) {
+		  cerr << "Invalid trigger value for " << name
+		       << ": " << triggers[idx].value << endl;
+		  continue;
+	    }
+	    triggers[idx].value = bits;
+	    triggers[idx].sym = symbols.size();
+	    trigger = idx;
+	    break;
+      }
+
+	// Untraced signals do not get a symbol at all, so setting
+	// them costs nothing.
+      if (! traced && trigger < 0)
+	    return -1;
+
+      start_trace();
+      if (! trace_active())
+	    return -1;
+
+      int sym = symbols.size();
+      symbols.push_back(trace_sym_s());
+      symbols[sym].name = name;
+      symbols[sym].last_valid = false;
+      symbols[sym].string_flag = string_flag;
+      symbols[sym].wid = wid;
+      symbols[sym].ring = -1;
+      symbols[sym].flight_base_valid = false;
+      symbols[sym].traced = traced;
+      symbols[sym].trigger = trigger;
+
+      if (traced)
+	    queue_symbol(sym);
+      return sym;
+}
+
+void trace_set_time(uint64_t time)
+{
+      cur_time = time;
+      if (window_done)
+	    return;
+
+      bool was_open = window_open;
+      check_window();
+      if (was_open && window_open)
+	    queue_time();
+}
+
+void trace_emit_bits(int sym, const char*bits, size_t nbits)
+{
+      assert(sym >= 0 && (unsigned)sym < symbols.size());
+      emit_value(sym, bits, nbits);
+}
+
+void trace_emit_string(int sym, const string&text)
+{
+      assert(sym >= 0 && (unsigned)sym < symbols.size());
+      emit_value(sym, text.data(), text.size());
+}
+
+/*
+ * Write the contents of the flight recorder rings to an LXT2 file. The
+ * first dump goes to the trace path, and later dumps to <path>.<n>.
+ */
+struct flight_event_s {
+      uint64_t time;
+      int sym;
+      std::string value;
+};
+
+static bool flight_event_less(const flight_event_s&a, const flight_event_s&b)
+{
+      return a.time < b.time;
+}
+
+void trace_dump(const char*reason)
+{
+      if (flight_size == 0 || ! trace_started || ! trace_active())
+	    return;
+
+      vector<flight_event_s> events;
+      for (size_t idx = 0 ; idx < flight_rings.size() ; idx += 1) {
+	    const flight_ring_s&ring = flight_rings[idx];
+	    flight_event_s event;
+
+	      // The values at the start of the ring.
+	    event.time = ring.base_time;
+	    for (size_t sym = 0 ; sym < symbols.size() ; sym += 1) {
+		  if (symbols[sym].ring != (int)idx || ! symbols[sym].flight_base_valid)
+			continue;
+		  event.sym = sym;
+		  event.value = symbols[sym].flight_base;
+		  events.push_back(event);
+	    }
+
+	    size_t off = 0;
+	    uint64_t time = ring.base_time;
+	    while (off < ring.fill) {
+		  off += ring_decode(ring, off, time, event.sym, event.value);
+		  if (event.sym < 0)
+			continue;
+		  event.time = time;
+		  events.push_back(event);
+	    }
+      }
+      stable_sort(events.begin(), events.end(), flight_event_less);
+
+      string path = trace_path;
+      if (flight_dumps > 0) {
+	    char buf[32];
+	    snprintf(buf, sizeof buf, ".%u", flight_dumps);
+	    path += buf;
+      }
+      flight_dumps += 1;
+
+      struct lxt2_wr_trace*lt = lxt2_wr_init(path.c_str());
+      if (lt == 0) {
+	    cerr << "Unable to open trace file " << path << endl;
+	    return;
+      }
+      lxt2_wr_set_compression_depth(lt, trace_level);
+      lxt2_wr_set_timescale(lt, SERVICE_TIME_PRECISION);
+
+      vector<struct lxt2_wr_symbol*> lxt_syms (symbols.size());
+      for (size_t sym = 0 ; sym < symbols.size() ; sym += 1) {
+	    if (! symbols[sym].traced)
+		  continue;
+	    int flags = symbols[sym].string_flag? LXT2_WR_SYM_F_STRING : LXT2_WR_SYM_F_BITS;
+	    lxt_syms[sym] = lxt2_wr_symbol_add(lt, symbols[sym].name.c_str(),
+					       0, symbols[sym].wid-1, 0, flags);
+      }
+
+      for (size_t idx = 0 ; idx < events.size() ; idx += 1) {
+	    flight_event_s&event = events[idx];
+	    lxt2_wr_set_time64(lt, event.time);
+	    char*value = const_cast<char*>(event.value.c_str());
+	    if (symbols[event.sym].string_flag)
+		  lxt2_wr_emit_value_string(lt, lxt_syms[event.sym], 0, value);
+	    else
+		  lxt2_wr_emit_value_bit_string(lt, lxt_syms[event.sym], 0, value);
+      }
+      lxt2_wr_close(lt);
+
+      cerr << "Flight recorder (" << reason << "): wrote " << events.size()
+	   << " value changes to " << path << endl;
+}
+
+void trace_stats(trace_stats_s&stats)
+{
+      pthread_mutex_lock(&queue_lock);
+      stats.bytes_written = writer_position;
+      stats.queue_depth = full_queue.size();
+      pthread_mutex_unlock(&queue_lock);
+
+      stats.queue_stalls = queue_stalls;
+      stats.flight_bytes = 0;
+      for (size_t idx = 0 ; idx < flight_rings.size() ; idx += 1)
+	    stats.flight_bytes += flight_rings[idx].fill;
+}
+
+void trace_flush(void)
+{
+      if (trace_lxt == 0)
+	    return;
+
+      add_record(REC_FLUSH, 0, 0);
+      submit_chunk();
+}
+
+void trace_close(void)
+{
+	// If nothing was traced, still leave an (empty) trace file.
+      if (trace_active() && flight_size == 0)
+	    start_trace();
+
+      if (trace_lxt == 0)
+	    return;
+
+      submit_chunk();
+
+      pthread_mutex_lock(&queue_lock);
+      writer_stop = true;
+      pthread_cond_signal(&queue_work);
+      pthread_mutex_unlock(&queue_lock);
+      pthread_join(writer_thread, 0);
+
+      lxt2_wr_close(trace_lxt);
+      trace_lxt = 0;
+
+      if (queue_stalls > 0)
+	    cerr << "Trace writer fell behind " << queue_stalls
+		 << " times." << endl;
+
+      delete cur_chunk;
+      cur_chunk = 0;
+      while (! free_queue.empty()) {
+	    delete free_queue.front();
+	    free_queue.pop_front();
+      }
+}
@@ -0,0 +1,116 @@
+#ifndef __trace_H
+#define __trace_H
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+# include  <stddef.h>
+# include  <stdint.h>
+# include  <string>
+
+/*
+ * The server trace writer. The service loop and the protocols put
+ * trace events into a queue, and a background thread takes them out
+ * and writes them to the LXT2 file. The LXT2 writer does the sorting
+ * and compressing, so all that work is off the service thread.
+ *
+ * Symbols are identified by the index that trace_symbol_add
+ * returns. All the functions here are called from the service thread
+ * only.
+ */
+
+/* The default zlib compression level for the LXT2 output. */
+# define TRACE_DEFAULT_LEVEL 4
+
+/*
+ * Open the trace file and start the writer thread. The level is the
+ * zlib compression level, 0-9.
+ */
+extern void trace_open(const char*path, int level);
+
+/*
+ * Add a trace selection setting from the config file or the command
+ * line. The keys are:
+ *
+ *    include = <glob>      trace only signals whose <bus>.<signal>
+ *                          name matches one of the include globs
+ *    exclude = <glob>      do not trace signals that match
+ *    start = <time>        open the trace window at this time
+ *    stop = <time>         close the trace window at this time
+ *    trigger = <bus>.<signal>=<value>
+ *                          open the trace window only when the signal
+ *                          has this value (all triggers must match)
+ *    flight = <size>       keep only the last <size> bytes of value
+ *                          changes per bus in memory, and write them
+ *                          to the trace file only on trace_dump
+ *
+ * Times are in seconds, with an optional s, ms, us, ns or ps
+ * suffix. Sizes are bytes with an optional K, M or G suffix. Trigger
+ * values are bits (01xz) or 0x<hex>. Return false if the key or
+ * value is invalid.
+ */
+extern bool trace_config(const std::string&key, const std::string&value);
+
+/* True if trace_open has been called and the trace is not closed. */
+extern bool trace_active(void);
+
+/*
+ * Create a trace symbol. The name is the full (dotted) name of the
+ * signal. If string_flag is true, the trace carries strings instead of
+ * bit vectors of the given width.
+ */
+extern int trace_symbol_add(const std::string&name, int wid, bool string_flag);
+
+/* Advance the trace time, in SERVICE_TIME_PRECISION units. */
+extern void trace_set_time(uint64_t time);
+
+/*
+ * Set the value of a symbol. The bits are '0', '1', 'x' or 'z'
+ * characters, MSB first. Values that are the same as the last value
+ * for the symbol are dropped here, before they reach the queue.
+ */
+extern void trace_emit_bits(int sym, const char*bits, size_t nbits);
+extern void trace_emit_string(int sym, const std::string&text);
+
+/*
+ * In flight recorder mode (the "flight" setting), write the recent
+ * history kept in memory to the trace file. The reason is printed
+ * with the message. Otherwise, this does nothing.
+ */
+extern void trace_dump(const char*reason);
+
+/*
+ * Counters for the metrics endpoint. The bytes_written is the size of
+ * the trace file so far, and the queue_depth the number of chunks
+ * waiting for the writer thread.
+ */
+struct trace_stats_s {
+      uint64_t bytes_written;
+      size_t queue_depth;
+      unsigned long queue_stalls;
+      size_t flight_bytes;
+};
+extern void trace_stats(trace_stats_s&stats);
+
+/* Ask the writer thread to flush what it has to the file. */
+extern void trace_flush(void);
+
+/* Drain the queue, stop the writer thread and close the file. */
+extern void trace_close(void);
+
+#endif
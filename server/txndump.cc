@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2010 Stephen Williams (steve@icarus.com)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+/*
+ * simbus-txndump [-d] [-t <from>:<to>] [-a <low>:<high>] <file>
+ *
+ * Print the PCI transaction log that the txn_log option of a PCI bus
+ * writes. The -t flag selects transactions that start in the time
+ * range (in ps), and -a selects transactions with the address in the
+ * range. Either end of a range may be left out. The -d flag prints
+ * the data beats as well. When the log has an index, the selections
+ * use it instead of reading the whole file.
+ */
+
+# include  "pcitxn.h"
+# include  <stdio.h>
+# include  <stdlib.h>
+# include  <string.h>
+# include  <unistd.h>
+# include  <inttypes.h>
+# include  <iostream>
+# include  <vector>
+# include  <algorithm>
+
+using namespace std;
+
+static const char*command_names[16] = {
+      "INTACK", "SPECIAL", "IOREAD", "IOWRITE",
+      "RSVD4", "RSVD5", "MEMREAD", "MEMWRITE",
+      "RSVD8", "RSVD9", "CFGREAD", "CFGWRITE",
+      "MEMREADMULT", "DAC", "MEMREADLINE", "MEMWRITEINV"
+};
+
+static bool data_flag = false;
+
+static bool parse_range(const char*arg, uint64_t&low, uint64_t&high)
+{
+      const char*cp = strchr(arg, ':');
+      if (cp == 0)
+	    return false;
+
+      char*ep;
+      if (cp != arg) {
+	    low = strtoull(arg, &ep, 0);
+	    if (ep != cp)
+		  return false;
+      }
+      if (cp[1] != 0) {
+	    high = strtoull(cp+1, &ep, 0);
+	    if (*ep != 0)
+		  return false;
+      }
+      return true;
+}
+
+static void print_device(uint8_t dev)
+{
+      if (dev == PCITXN_NO_DEVICE)
+	    printf("-");
+      else
+	    printf("%u", dev);
+}
+
+/*
+ * Read the record at the current position of the file and print
+ * it. Return false at the end of the file.
+ */
+static bool read_record(FILE*fd, pcitxn_rec_s&rec, vector<uint32_t>&data,
+			vector<uint8_t>&cbe)
+{
+      if (fread(&rec, sizeof rec, 1, fd) != 1)
+	    return false;
+
+      unsigned words = (rec.flags & PCITXN_64BIT)? 2 : 1;
+      data.resize(rec.beats * words);
+      cbe.resize(rec.beats);
+      if (rec.beats > 0) {
+	    if (fread(&data[0], sizeof data[0], data.size(), fd) != data.size())
+		  return false;
+	    if (fread(&cbe[0], 1, cbe.size(), fd) != cbe.size())
+		  return false;
+      }
+
+      uint64_t used = sizeof rec + data.size()*sizeof data[0] + cbe.size();
+      fseeko(fd, pcitxn_rec_size(rec) - used, SEEK_CUR);
+      return true;
+}
+
+static void print_record(const pcitxn_rec_s&rec, const vector<uint32_t>&data,
+			 const vector<uint8_t>&cbe)
+{
+      printf("%" PRIu64 "ps %s ", rec.start, command_names[rec.command & 0xf]);
+      print_device(rec.initiator);
+      printf("->");
+      print_device(rec.target);
+      printf(" addr=0x%" PRIx64 " beats=%u waits=%u/%u devsel=%u latency=%u",
+	     rec.addr, rec.beats, rec.irdy_waits, rec.trdy_waits,
+	     rec.devsel, rec.latency);
+
+      if (rec.flags & PCITXN_64BIT)        printf(" 64BIT");
+      if (rec.flags & PCITXN_DAC)          printf(" DAC");
+      if (rec.flags & PCITXN_RETRY)        printf(" RETRY");
+      if (rec.flags & PCITXN_DISCONNECT)   printf(" DISCONNECT");
+      if (rec.flags & PCITXN_TARGET_ABORT) printf(" TARGET-ABORT");
+      if (rec.flags & PCITXN_MASTER_ABORT) printf(" MASTER-ABORT");
+      if (rec.flags & PCITXN_DATA_X)       printf(" DATA-X");
+      if (rec.flags & PCITXN_TRUNCATED)    printf(" TRUNCATED");
+      printf("\n");
+
+      if (! data_flag)
+	    return;
+
+      unsigned words = (rec.flags & PCITXN_64BIT)? 2 : 1;
+      for (unsigned idx = 0 ; idx < rec.beats ; idx += 1) {
+	    if (words == 2)
+		  printf("    %08x%08x", data[2*idx+1], data[2*idx]);
+	    else
+		  printf("    %08x", data[idx]);
+	    printf(" C/BE#=%x\n", cbe[idx]);
+      }
+}
+
+int main(int argc, char*argv[])
+{
+      uint64_t time_low = 0, time_high = UINT64_MAX;
+      uint64_t addr_low = 0, addr_high = UINT64_MAX;
+      bool time_flag = false;
+      bool addr_flag = false;
+
+      int opt;
+      while ((opt = getopt(argc, argv, "a:dt:")) != -1) {
+	    switch (opt) {
+		case 'a':
+		  addr_flag = parse_range(optarg, addr_low, addr_high);
+		  if (! addr_flag) {
+			cerr << "Invalid address range: " << optarg << endl;
+			return 1;
+		  }
+		  break;
+		case 'd':
+		  data_flag = true;
+		  break;
+		case 't':
+		  time_flag = parse_range(optarg, time_low, time_high);
+		  if (! time_flag) {
+			cerr << "Invalid time range: " << optarg << endl;
+			return 1;
+		  }
+		  break;
+		default:
+		  optind = argc;
+		  break;
+	    }
+      }
+
+      if (optind+1 != argc) {
+	    cerr << "Usage: " << argv[0]
+		 << " [-d] [-t <from>:<to>] [-a <low>:<high>] <file>" << endl;
+	    return 1;
+      }
+
+      const char*path = argv[optind];
+      FILE*fd = fopen(path, "rb");
+      if (fd == 0) {
+	    perror(path);
+	    return 2;
+      }
+
+      char magic[8];
+      if (fread(magic, 1, sizeof magic, fd) != sizeof magic
+	  || memcmp(magic, PCITXN_MAGIC, sizeof magic) != 0) {
+	    cerr << path << ": Not a PCI transaction log." << endl;
+	    return 2;
+      }
+
+	// Look for the index at the end of the file.
+      pcitxn_footer_s foot;
+      bool index_flag = false;
+      uint64_t records_end = UINT64_MAX;
+      if (fseeko(fd, -(off_t)sizeof foot, SEEK_END) == 0
+	  && fread(&foot, sizeof foot, 1, fd) == 1
+	  && memcmp(foot.magic, PCITXN_INDEX_MAGIC, sizeof foot.magic) == 0) {
+	    index_flag = true;
+	    records_end = foot.time_index;
+      }
+
+      pcitxn_rec_s rec;
+      vector<uint32_t> data;
+      vector<uint8_t> cbe;
+
+      if (index_flag && addr_flag) {
+	      // Find the address range in the address index, then
+	      // print the selected records in file (time) order.
+	    vector<pcitxn_index_s> index (foot.count);
+	    fseeko(fd, foot.addr_index, SEEK_SET);
+	    if (foot.count > 0 && fread(&index[0], sizeof index[0], index.size(), fd) != index.size()) {
+		  cerr << path << ": Truncated address index." << endl;
+		  return 3;
+	    }
+
+	    vector<uint64_t> offsets;
+	    for (size_t idx = 0 ; idx < index.size() ; idx += 1) {
+		  if (index[idx].key < addr_low)
+			continue;
+		  if (index[idx].key > addr_high)
+			break;
+		  offsets.push_back(index[idx].offset);
+	    }
+	    sort(offsets.begin(), offsets.end());
+
+	    for (size_t idx = 0 ; idx < offsets.size() ; idx += 1) {
+		  fseeko(fd, offsets[idx], SEEK_SET);
+		  if (! read_record(fd, rec, data, cbe))
+			break;
+		  if (rec.start < time_low || rec.start > time_high)
+			continue;
+		  print_record(rec, data, cbe);
+	    }
+
+	    fclose(fd);
+	    return 0;
+      }
+
+      uint64_t offset = sizeof magic;
+      if (index_flag && time_flag) {
+	      // Start at the last indexed record before the range.
+	    vector<pcitxn_index_s> index (foot.time_count);
+	    fseeko(fd, foot.time_index, SEEK_SET);
+	    if (foot.time_count > 0 && fread(&index[0], sizeof index[0], index.size(), fd) != index.size()) {
+		  cerr << path << ": Truncated time index." << endl;
+		  return 3;
+	    }
+	    for (size_t idx = 0 ; idx < index.size() ; idx += 1) {
+		  if (index[idx].key > time_low)
+			break;
+		  offset = index[idx].offset;
+	    }
+      }
+
+      fseeko(fd, offset, SEEK_SET);
+      while ((uint64_t)ftello(fd) < records_end && read_record(fd, rec, data, cbe)) {
+	    if (rec.start > time_high)
+		  break;
+	    if (rec.start < time_low)
+		  continue;
+	    if (rec.addr < addr_low || rec.addr > addr_high)
+		  continue;
+	    print_record(rec, data, cbe);
+      }
+
+      fclose(fd);
+      return 0;
+}
@@ -19,12 +19,13 @@
 
 # include  <vpi_user.h>
 # include  <sys/types.h>
-# include  <sys/select.h>
 # include  <sys/socket.h>
 # include  <sys/un.h>
 # include  <ctype.h>
 # include  <errno.h>
+# include  <fcntl.h>
 # include  <netdb.h>
+# include  <poll.h>
 # include  <unistd.h>
 # include  <stdlib.h>
 # include  <string.h>
@@ -43,10 +44,6 @@
  * $simbus_until
  */
 
-# define MAX_INSTANCES 32
-/* Largest message length, including the newline. */
-# define MAX_MESSAGE 4096
-
 /*
  * Debug capabilities can be turned on by setting bits in this
  * bitmask. The -simbus-debug-mask=<N> command line will set the debug mask.
@@ -63,7 +60,8 @@ struct port_instance {
 	   to the server. */
       char*name;
 
-	/* This fd is the socket that is connected to the bus server. */
+	/* This fd is the socket that is connected to the bus server.
+	   Once the connection is made, the fd is non-blocking. */
       int fd;
 
 	/* this is the identifier that I get back from the bus when I
@@ -71,135 +69,314 @@ struct port_instance {
 	   non-shared bus signals. */
       unsigned ident;
 
-	/* Use these buffers to manage data received from the server. */
-      char   read_buf[MAX_MESSAGE+1];
+	/* Use these buffers to manage data received from the
+	   server. The buffer grows as needed to hold a complete
+	   message. The read_msg is the size of the message most
+	   recently returned by read_message, which stays in place
+	   until the next read. The read_scan is how far the buffer
+	   is known to be free of newlines. */
+      char*  read_buf;
+      size_t read_siz;
       size_t read_fil;
+      size_t read_msg;
+      size_t read_scan;
+	/* Set when the server closes the connection. */
+      int    read_eof;
+
+	/* Scratch space for building $simbus_ready messages and for
+	   splitting $simbus_until messages into tokens. These are
+	   kept with the instance and grown as needed. */
+      char*  write_buf;
+      size_t write_siz;
+      char** msg_argv;
+      size_t msg_argv_siz;
 
 	/* When poll-waiting for a message from the server, this
 	   member is set to the vpiHandle of the trigger register that
 	   is to receive a prod when data is ready. */
       vpiHandle trig;
+};
+
+static struct port_instance*instance_table = 0;
+static unsigned instance_count = 0;
+static unsigned instance_alloc = 0;
 
-} instance_table[MAX_INSTANCES];
+/* Scratch for poll_for_simbus_bus, one entry per instance. */
+static struct pollfd*poll_fds = 0;
 
 /*
- * This function tests if the next message for the bus can be read
- * without blocking. If the message is complete in the buffer, return
- * true. Otherwise, return false.
+ * This is true while a poll_for_simbus_bus callback is registered. A
+ * single callback services all the waiting triggers, no matter how
+ * many $simbus_poll calls are waiting.
  */
-static int check_readable(int idx)
+static int poll_callback_pending = 0;
+static PLI_INT32 poll_for_simbus_bus(struct t_cb_data*cb);
+
+static struct port_instance* get_instance(int idx)
 {
-      assert(idx < MAX_INSTANCES);
+      assert(idx >= 0 && (unsigned)idx < instance_count);
       struct port_instance*inst = instance_table + idx;
       assert(inst->name != 0);
+      return inst;
+}
+
+static struct port_instance* new_instance(int*idx)
+{
+      if (instance_count >= instance_alloc) {
+	    instance_alloc = instance_alloc? 2*instance_alloc : 8;
+	    instance_table = realloc(instance_table,
+				     instance_alloc*sizeof(struct port_instance));
+	    poll_fds = realloc(poll_fds, instance_alloc*sizeof(struct pollfd));
+      }
 
-      return (strchr(inst->read_buf, '\n') != 0);
+      *idx = instance_count;
+      struct port_instance*inst = instance_table + instance_count;
+      instance_count += 1;
+
+      memset(inst, 0, sizeof *inst);
+      inst->fd = -1;
+      inst->read_siz = 4096;
+      inst->read_buf = malloc(inst->read_siz);
+      inst->read_buf[0] = 0;
+      inst->msg_argv_siz = 64;
+      inst->msg_argv = malloc(inst->msg_argv_siz*sizeof(char*));
+      return inst;
 }
 
-static void consume_readable_data(int idx)
+/*
+ * Drop the message that the last read_message returned, now that the
+ * caller is done with it.
+ */
+static void release_message(struct port_instance*inst)
 {
-      assert(idx < MAX_INSTANCES);
-      struct port_instance*inst = instance_table + idx;
-      assert(inst->name != 0);
+      if (inst->read_msg == 0)
+	    return;
 
-      size_t trans = sizeof inst->read_buf - inst->read_fil - 1;
-      int rc = read(inst->fd, inst->read_buf+inst->read_fil, trans);
-      if (rc <= 0) return;
+      assert(inst->read_msg <= inst->read_fil);
+      inst->read_fil -= inst->read_msg;
+      if (inst->read_fil > 0)
+	    memmove(inst->read_buf, inst->read_buf+inst->read_msg, inst->read_fil);
 
-      assert(rc > 0);
-      inst->read_fil += rc;
       inst->read_buf[inst->read_fil] = 0;
+      inst->read_msg = 0;
+      inst->read_scan = 0;
 }
 
-static PLI_INT32 poll_for_simbus_bus(struct t_cb_data*cb)
+/*
+ * Return a pointer to the newline that ends the next message in the
+ * buffer, or nil if the message is not complete yet.
+ */
+static char* find_message_end(struct port_instance*inst)
 {
-      int nfds = 0;
-      int idx;
-      int rc;
-      fd_set read_set;
-      FD_ZERO(&read_set);
+      release_message(inst);
 
-      for (idx = 0 ; idx < MAX_INSTANCES ; idx += 1) {
-	    if (instance_table[idx].trig == 0)
-		  continue;
+      char*cp = memchr(inst->read_buf + inst->read_scan, '\n',
+		       inst->read_fil - inst->read_scan);
+      if (cp == 0)
+	    inst->read_scan = inst->read_fil;
 
-	    if (instance_table[idx].fd > nfds)
-		  nfds = instance_table[idx].fd;
+      return cp;
+}
 
-	    FD_SET(instance_table[idx].fd, &read_set);
-      }
+/*
+ * This function tests if the next message for the bus can be read
+ * without blocking. If the message is complete in the buffer, return
+ * true. Otherwise, return false.
+ */
+static int check_readable(int idx)
+{
+      struct port_instance*inst = get_instance(idx);
 
-      if (nfds == 0)
-	    return 0;
+      return find_message_end(inst) != 0;
+}
 
-      rc = select(nfds+1, &read_set, 0, 0, 0);
-      assert(rc != 0);
-      if (rc < 0) {
-	    vpi_printf("ERROR:poll_for_simbus_bus:%s\n", sys_errlist[errno]);
-	    vpi_control(vpiFinish, 1);
-	    return 0;
-      }
-      assert(rc > 0);
+/*
+ * Read whatever data is available from the server without
+ * blocking. Return the number of bytes added to the read buffer.
+ */
+static size_t consume_readable_data(int idx)
+{
+      struct port_instance*inst = get_instance(idx);
 
-      for (idx = 0 ; idx < MAX_INSTANCES ; idx += 1) {
-	    s_vpi_value value;
+      release_message(inst);
 
-	    if (instance_table[idx].trig == 0)
-		  continue;
+      size_t count = 0;
+      for (;;) {
+	    if (inst->read_fil + 1 >= inst->read_siz) {
+		  inst->read_siz *= 2;
+		  inst->read_buf = realloc(inst->read_buf, inst->read_siz);
+	    }
 
-	    if (! FD_ISSET(instance_table[idx].fd, &read_set))
+	    size_t trans = inst->read_siz - inst->read_fil - 1;
+	    ssize_t rc = read(inst->fd, inst->read_buf+inst->read_fil, trans);
+	    if (rc < 0 && errno == EINTR)
 		  continue;
+	    if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		  break;
+	    if (rc <= 0) {
+		  inst->read_eof = 1;
+		  break;
+	    }
+
+	    inst->read_fil += rc;
+	    count += rc;
+      }
+
+      inst->read_buf[inst->read_fil] = 0;
+      return count;
+}
+
+/*
+ * Check for a complete message, reading from the socket only if the
+ * buffer does not already have one. A connection that the server
+ * closed counts as readable, so that $simbus_until can report it.
+ */
+static int poll_readable(int idx)
+{
+      struct port_instance*inst = get_instance(idx);
 
-	      /* This fd is readable, so try to read some data, and
-		 check if a command is complete. If not, then continue
-		 waiting. Otherwise, let this one be completed. */
+      if (check_readable(idx))
+	    return 1;
+
+      if (inst->read_eof == 0)
 	    consume_readable_data(idx);
-	    if (!check_readable(idx))
-		  continue;
 
-	    value.format = vpiScalarVal;
-	    value.value.scalar = vpi1;
-	    vpi_put_value(instance_table[idx].trig, &value, 0, vpiNoDelay);
-	    instance_table[idx].trig = 0;
-      }
+      return inst->read_eof || check_readable(idx);
+}
 
-	/* Check and see if there are still triggers waiting. If so
-	   then reschedule this callback. */
-      nfds += 1;
-      for (idx = 0 ; idx < MAX_INSTANCES ; idx += 1) {
-	    if (instance_table[idx].trig == 0)
-		  continue;
+/*
+ * Block until the fd for the instance has data. This is only used
+ * when the simulation cannot proceed without it.
+ */
+static void wait_for_data(int idx)
+{
+      struct pollfd pfd;
+      pfd.fd = get_instance(idx)->fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+	    ;
+}
 
-	    nfds += 1;
-      }
+/*
+ * Write the whole message to the server. The socket is non-blocking,
+ * so a long message may go out in pieces, and if the socket buffer is
+ * full, wait for it to drain. Return -1 if the write fails.
+ */
+static int write_message(int idx, const char*buf, size_t len)
+{
+      int fd = get_instance(idx)->fd;
+
+      while (len > 0) {
+	    ssize_t rc = write(fd, buf, len);
+	    if (rc < 0 && errno == EINTR)
+		  continue;
+	    if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		  struct pollfd pfd;
+		  pfd.fd = fd;
+		  pfd.events = POLLOUT;
+		  pfd.revents = 0;
+		  while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+			;
+		  continue;
+	    }
+	    if (rc <= 0)
+		  return -1;
 
-      if (nfds > 0) {
-	    struct t_cb_data cb_data;
-	    struct t_vpi_time cb_time;
-	    cb_time.type = vpiSuppressTime;
-	    cb_data.reason = cbReadWriteSynch;
-	    cb_data.cb_rtn = poll_for_simbus_bus;
-	    cb_data.obj = 0;
-	    cb_data.time   = &cb_time;
-	    cb_data.value = 0;
-	    cb_data.index = 0;
-	    cb_data.user_data = 0;
-	    vpi_register_cb(&cb_data);
+	    buf += rc;
+	    len -= rc;
       }
 
       return 0;
 }
 
+static void schedule_poll_callback(void)
+{
+      struct t_cb_data cb_data;
+      struct t_vpi_time cb_time;
+
+      if (poll_callback_pending)
+	    return;
+
+      cb_time.type = vpiSuppressTime;
+      cb_data.reason = cbReadWriteSynch;
+      cb_data.cb_rtn = poll_for_simbus_bus;
+      cb_data.obj = 0;
+      cb_data.time   = &cb_time;
+      cb_data.value = 0;
+      cb_data.index = 0;
+      cb_data.user_data = 0;
+      vpi_register_cb(&cb_data);
+      poll_callback_pending = 1;
+}
+
+/*
+ * This callback runs at the end of a time step while any $simbus_poll
+ * triggers are waiting. Deliver every message that has arrived. Only
+ * if none of the waiting buses are ready does it block, because then
+ * the simulation cannot advance until a server answers. If some but
+ * not all triggers were delivered, the callback reschedules itself so
+ * that the logic released by the triggers runs before checking again.
+ */
+static PLI_INT32 poll_for_simbus_bus(struct t_cb_data*cb)
+{
+      unsigned idx;
+
+      poll_callback_pending = 0;
+
+      for (;;) {
+	    int delivered = 0;
+	    int nfds = 0;
+
+	    for (idx = 0 ; idx < instance_count ; idx += 1) {
+		  s_vpi_value value;
+
+		  if (instance_table[idx].trig == 0)
+			continue;
+
+		  if (! poll_readable(idx)) {
+			poll_fds[nfds].fd = instance_table[idx].fd;
+			poll_fds[nfds].events = POLLIN;
+			poll_fds[nfds].revents = 0;
+			nfds += 1;
+			continue;
+		  }
+
+		  value.format = vpiScalarVal;
+		  value.value.scalar = vpi1;
+		  vpi_put_value(instance_table[idx].trig, &value, 0, vpiNoDelay);
+		  instance_table[idx].trig = 0;
+		  delivered += 1;
+	    }
+
+	    if (nfds == 0)
+		  return 0;
+
+	    if (delivered > 0) {
+		  schedule_poll_callback();
+		  return 0;
+	    }
+
+	    int rc = poll(poll_fds, nfds, -1);
+	    if (rc < 0 && errno != EINTR) {
+		  vpi_printf("ERROR:poll_for_simbus_bus:%s\n", strerror(errno));
+		  vpi_control(vpiFinish, 1);
+		  return 0;
+	    }
+      }
+}
+
 /*
  * Read the next network message from the specified server
  * connection. This function will manage the read buffer to get text
- * until the message is complete.
+ * until the message is complete. The message is returned in place
+ * through *msg, without the newline, and stays valid until the next
+ * read from this instance. Return -1 if the server closed the
+ * connection first.
  */
-static int read_message(int idx, char*buf, size_t nbuf)
+static int read_message(int idx, char**msg)
 {
-      assert(idx < MAX_INSTANCES);
-      struct port_instance*inst = instance_table + idx;
-      assert(inst->name != 0);
+      struct port_instance*inst = get_instance(idx);
 
 	/* This function is certain to read data, so make sure the
 	   trig is cleared. */
@@ -207,25 +384,22 @@ static int read_message(int idx, char*buf, size_t nbuf)
 
       for (;;) {
 	    char*cp;
-	      /* If there is a line in the buffer now, then pull that
-		 line out of the read buffer and give it to the
-		 caller. */
-	    if ( (cp = strchr(inst->read_buf, '\n')) != 0 ) {
+	      /* If there is a line in the buffer now, then give that
+		 line to the caller. It is released by the next
+		 read. */
+	    if ( (cp = find_message_end(inst)) != 0 ) {
 		  size_t len = cp - inst->read_buf;
-		  assert(len < nbuf);
-
-		  *cp++ = 0;
-		  strcpy(buf, inst->read_buf);
-		  assert(len < inst->read_fil);
-		  inst->read_fil -= len+1;
-		  if (inst->read_fil > 0)
-			memmove(inst->read_buf, cp, inst->read_fil);
-
-		  inst->read_buf[inst->read_fil] = 0;
+		  *cp = 0;
+		  inst->read_msg = len + 1;
+		  *msg = inst->read_buf;
 		  return len;
 	    }
 
-	    consume_readable_data(idx);
+	    if (inst->read_eof)
+		  return -1;
+
+	    if (consume_readable_data(idx) == 0 && inst->read_eof == 0)
+		  wait_for_data(idx);
       }
 }
 
@@ -542,17 +716,15 @@ static PLI_INT32 simbus_connect_calltf(char*my_name)
       }
 
 	/* Create an instance for this connection. */
-      idx = 0;
-      while (instance_table[idx].name && idx < MAX_INSTANCES) {
-	    idx += 1;
-      }
+      struct port_instance*inst = new_instance(&idx);
+      inst->name = dev_name;
+      inst->fd = server_fd;
+      inst->ident = ident;
 
-      assert(idx < MAX_INSTANCES);
-      instance_table[idx].name = dev_name;
-      instance_table[idx].fd = server_fd;
-	/* Empty the read buffer. */
-      instance_table[idx].read_buf[0] = 0;
-      instance_table[idx].read_fil = 0;
+	/* From here on, reads from the server are done only when
+	   data is known to be available, or after draining what is
+	   there, so the socket can be non-blocking. */
+      fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL) | O_NONBLOCK);
 
       vpi_printf("%s:%d: %s(%s) Bus server %s ready.\n",
 		 vpi_get_str(vpiFile, sys), (int)vpi_get(vpiLineNo, sys),
@@ -565,13 +737,380 @@ static PLI_INT32 simbus_connect_calltf(char*my_name)
       return 0;
 }
 
+/*
+ * The server keeps time as an integer count of femtoseconds, and the
+ * messages carry times as <mant>e<exp> seconds. The READY sends the
+ * simulation time as femtoseconds, and the UNTIL time is scaled to
+ * the units of the scope, each with a table lookup instead of a loop
+ * over the decades.
+ */
+# define SIMBUS_TIME_EXP (-15)
+
+static const uint64_t time_pow10[20] = {
+      1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+      10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+      100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+      100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+      100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/* Return mant * 10**shift, rounded if the shift is negative. */
+static uint64_t scale_time(uint64_t mant, int shift)
+{
+      if (shift >= 0) {
+	    assert(shift < 20);
+	    assert(mant <= UINT64_MAX / time_pow10[shift]);
+	    return mant * time_pow10[shift];
+      }
+
+      assert(shift > -20);
+      uint64_t div = time_pow10[-shift];
+      return mant / div + (mant % div >= (div+1)/2);
+}
+
+/*
+ * Signal values travel to and from the server as strings of 01xz
+ * characters, most significant bit first. These tables convert
+ * between those strings and s_vpi_vecval words a nibble (or a
+ * character) at a time, without testing each bit.
+ *
+ * vec_chars[a<<4 | b] is the 4 character string for the aval nibble
+ * a and bval nibble b. char_bits[c] holds the aval bit of character c
+ * in bit 0 and the bval bit in bit 1. Characters other than 01xz map
+ * to 0, as they always have.
+ */
+static char vec_chars[256][4];
+static unsigned char char_bits[256];
+
+static void init_vector_tables(void)
+{
+      static const char bit_char[4] = { '0', '1', 'z', 'x' };
+      unsigned idx, bit;
+
+      for (idx = 0 ; idx < 256 ; idx += 1) {
+	    unsigned a = idx >> 4;
+	    unsigned b = idx & 0x0f;
+	    for (bit = 0 ; bit < 4 ; bit += 1) {
+		  unsigned code = ((a >> bit) & 1) | (((b >> bit) & 1) << 1);
+		  vec_chars[idx][3-bit] = bit_char[code];
+	    }
+      }
+
+      memset(char_bits, 0, sizeof char_bits);
+      char_bits['1'] = 1;
+      char_bits['z'] = 2;
+      char_bits['x'] = 3;
+}
+
+/*
+ * Write the width characters of the vector value to dst, most
+ * significant bit first.
+ */
+static void vector_to_chars(char*dst, const s_vpi_vecval*vec, unsigned width)
+{
+      unsigned bit = width;
+
+	/* Do the leading partial nibble first, so that the rest of
+	   the vector is whole nibbles. */
+      if (bit % 4) {
+	    unsigned part = bit % 4;
+	    bit -= part;
+	    unsigned a = (vec[bit/32].aval >> (bit%32)) & 0x0f;
+	    unsigned b = (vec[bit/32].bval >> (bit%32)) & 0x0f;
+	    memcpy(dst, vec_chars[a<<4 | b] + 4 - part, part);
+	    dst += part;
+      }
+
+      while (bit > 0) {
+	    bit -= 4;
+	    unsigned a = (vec[bit/32].aval >> (bit%32)) & 0x0f;
+	    unsigned b = (vec[bit/32].bval >> (bit%32)) & 0x0f;
+	    memcpy(dst, vec_chars[a<<4 | b], 4);
+	    dst += 4;
+      }
+}
+
+/*
+ * Parse a string of width 01xz characters into vector words. The
+ * vector must have room for (width+31)/32 words.
+ */
+static void chars_to_vector(s_vpi_vecval*vec, const char*src, unsigned width)
+{
+      unsigned word = (width+31) / 32;
+      unsigned cnt  = width % 32;
+      if (cnt == 0)
+	    cnt = 32;
+
+      while (word > 0) {
+	    PLI_UINT32 a = 0, b = 0;
+	    unsigned idx;
+	    word -= 1;
+	    for (idx = 0 ; idx < cnt ; idx += 1) {
+		  unsigned code = char_bits[(unsigned char)*src++];
+		  a = (a << 1) | (code & 1);
+		  b = (b << 1) | (code >> 1);
+	    }
+	    vec[word].aval = a;
+	    vec[word].bval = b;
+	    cnt = 32;
+      }
+}
+
+/*
+ * The $simbus_ready and $simbus_until calls each carry a list of
+ * "name", signal pairs (or "name", signal, driver triples for
+ * $simbus_ready) that do not change for the life of the call
+ * site. The compiletf for those calls scans the argument list once
+ * and builds this table, which is attached to the call handle with
+ * vpi_put_userdata. The calltf then only needs to move values.
+ */
+struct port_signal {
+	/* Key name for the signal. For $simbus_ready tables, the
+	   key is pre-formatted with the leading space and trailing
+	   '=' so that it can be copied directly into the message. */
+      char*key;
+      size_t key_len;
+
+	/* The signal, and for $simbus_ready the driver reference. */
+      vpiHandle sig;
+      vpiHandle drv;
+      unsigned width;
+};
+
+struct port_call_table {
+	/* The bus identifier argument. This may be a variable, so
+	   its value is read at each call. */
+      vpiHandle bus;
+
+      unsigned nsig;
+      struct port_signal*sigs;
+
+	/* Open hash of indices into the sigs array, keyed by the
+	   signal name. This is used by $simbus_until to map names in
+	   the UNTIL message back to signals. */
+      unsigned hash_mask;
+      int*hash;
+	/* The server sends signals in a consistent order, so try the
+	   signal after the last match before going to the hash. */
+      unsigned cursor;
+
+	/* Largest message that $simbus_ready can generate from this
+	   table, not including the READY and time prefix. */
+      size_t msg_len;
+
+	/* Time units that $simbus_until uses to scale its result. */
+      int units;
+      int prec;
+
+	/* Scratch space large enough for the widest signal. The
+	   wmask array holds one mask word per vector word. */
+      unsigned max_width;
+      s_vpi_vecval*vec;
+      PLI_UINT32*wmask;
+};
+
+static unsigned hash_key(const char*key, size_t len)
+{
+      unsigned hash = 2166136261U;
+      size_t idx;
+      for (idx = 0 ; idx < len ; idx += 1) {
+	    hash ^= (unsigned char)key[idx];
+	    hash *= 16777619U;
+      }
+      return hash;
+}
+
+static void build_port_hash(struct port_call_table*tab)
+{
+      unsigned size = 8;
+      unsigned idx;
+      while (size < 2*tab->nsig)
+	    size *= 2;
+
+      tab->hash_mask = size-1;
+      tab->hash = malloc(size * sizeof(int));
+      for (idx = 0 ; idx < size ; idx += 1)
+	    tab->hash[idx] = -1;
+
+      for (idx = 0 ; idx < tab->nsig ; idx += 1) {
+	    struct port_signal*cur = tab->sigs + idx;
+	    unsigned slot = hash_key(cur->key, cur->key_len) & tab->hash_mask;
+	    while (tab->hash[slot] >= 0)
+		  slot = (slot+1) & tab->hash_mask;
+	    tab->hash[slot] = idx;
+      }
+}
+
+static struct port_signal* find_port_signal(struct port_call_table*tab,
+					    const char*key, size_t len)
+{
+      struct port_signal*cur;
+
+      if (tab->cursor < tab->nsig) {
+	    cur = tab->sigs + tab->cursor;
+	    if (cur->key_len == len && memcmp(cur->key, key, len) == 0) {
+		  tab->cursor += 1;
+		  return cur;
+	    }
+      }
+
+      unsigned slot = hash_key(key, len) & tab->hash_mask;
+      while (tab->hash[slot] >= 0) {
+	    cur = tab->sigs + tab->hash[slot];
+	    if (cur->key_len == len && memcmp(cur->key, key, len) == 0) {
+		  tab->cursor = tab->hash[slot] + 1;
+		  return cur;
+	    }
+	    slot = (slot+1) & tab->hash_mask;
+      }
+
+      return 0;
+}
+
+/*
+ * Release a call table, including one that build_port_table gave up
+ * on part way through.
+ */
+static void free_port_table(struct port_call_table*tab)
+{
+      unsigned idx;
+      for (idx = 0 ; idx < tab->nsig ; idx += 1)
+	    free(tab->sigs[idx].key);
+
+      free(tab->sigs);
+      free(tab->hash);
+      free(tab->vec);
+      free(tab->wmask);
+      free(tab);
+}
+
+/*
+ * Scan the argument list of a $simbus_ready or $simbus_until call and
+ * build the call table. The "stride" is the number of arguments for
+ * each signal: 3 for $simbus_ready and 2 for $simbus_until. Return
+ * nil and print a message if the argument list is malformed.
+ */
+static struct port_call_table* build_port_table(vpiHandle sys,
+						const char*my_name,
+						int stride)
+{
+      s_vpi_value value;
+      vpiHandle argv = vpi_iterate(vpiArgument, sys);
+      vpiHandle arg;
+
+      if (argv == 0) {
+	    vpi_printf("%s:%d: %s requires a bus argument.\n",
+		       vpi_get_str(vpiFile, sys), (int)vpi_get(vpiLineNo, sys),
+		       my_name);
+	    return 0;
+      }
+
+      struct port_call_table*tab = calloc(1, sizeof(struct port_call_table));
+      tab->bus = vpi_scan(argv);
+
+      unsigned nalloc = 0;
+      for (arg = vpi_scan(argv) ; arg ; arg = vpi_scan(argv)) {
+	    vpiHandle sig = vpi_scan(argv);
+	    vpiHandle drv = sig && stride > 2? vpi_scan(argv) : 0;
+
+	    if (sig == 0 || (stride > 2 && drv == 0)) {
+		  vpi_printf("%s:%d: %s: Incomplete signal argument list.\n",
+			     vpi_get_str(vpiFile, sys),
+			     (int)vpi_get(vpiLineNo, sys), my_name);
+		  free_port_table(tab);
+		  return 0;
+	    }
+
+	    if (! is_string_obj(arg)) {
+		  vpi_printf("%s:%d: %s: Signal names must be constant strings.\n",
+			     vpi_get_str(vpiFile, sys),
+			     (int)vpi_get(vpiLineNo, sys), my_name);
+		  vpi_free_object(argv);
+		  free_port_table(tab);
+		  return 0;
+	    }
+
+	    if (tab->nsig >= nalloc) {
+		  nalloc = nalloc? 2*nalloc : 16;
+		  tab->sigs = realloc(tab->sigs, nalloc*sizeof(struct port_signal));
+	    }
+
+	    struct port_signal*cur = tab->sigs + tab->nsig;
+	    tab->nsig += 1;
+
+	    value.format = vpiStringVal;
+	    vpi_get_value(arg, &value);
+	    assert(value.format == vpiStringVal);
+
+	    cur->sig = sig;
+	    cur->drv = drv;
+	    cur->width = vpi_get(vpiSize, sig);
+
+	    if (stride > 2) {
+		  cur->key_len = strlen(value.value.str) + 2;
+		  cur->key = malloc(cur->key_len + 1);
+		  snprintf(cur->key, cur->key_len+1, " %s=", value.value.str);
+	    } else {
+		  cur->key = strdup(value.value.str);
+		  cur->key_len = strlen(cur->key);
+	    }
+
+	    if (drv && vpi_get(vpiSize, drv) != cur->width) {
+		  vpi_printf("%s:%d: %s: Driver for %s is %d bits, signal is %u bits.\n",
+			     vpi_get_str(vpiFile, sys),
+			     (int)vpi_get(vpiLineNo, sys), my_name,
+			     value.value.str, (int)vpi_get(vpiSize, drv),
+			     cur->width);
+		  vpi_free_object(argv);
+		  free_port_table(tab);
+		  return 0;
+	    }
+
+	    if (stride == 2 && vpi_get(vpiType, sig) != vpiReg) {
+		  vpi_printf("%s:%d: %s: Signal %s must be a reg.\n",
+			     vpi_get_str(vpiFile, sys),
+			     (int)vpi_get(vpiLineNo, sys), my_name,
+			     value.value.str);
+		  vpi_free_object(argv);
+		  free_port_table(tab);
+		  return 0;
+	    }
+
+	    if (cur->width > tab->max_width)
+		  tab->max_width = cur->width;
+
+	    tab->msg_len += cur->key_len + cur->width;
+      }
+
+      tab->vec = calloc((tab->max_width+31)/32 + 1, sizeof(s_vpi_vecval));
+      tab->wmask = calloc((tab->max_width+31)/32 + 1, sizeof(PLI_UINT32));
+      build_port_hash(tab);
+
+      vpiHandle scope = vpi_handle(vpiScope, sys);
+      tab->units = vpi_get(vpiTimeUnit, scope);
+      tab->prec  = vpi_get(vpiTimePrecision, 0);
+
+      return tab;
+}
+
+static struct port_call_table* get_port_table(vpiHandle sys)
+{
+      struct port_call_table*tab = vpi_get_userdata(sys);
+      assert(tab);
+      return tab;
+}
+
 static PLI_INT32 simbus_ready_compiletf(char*my_name)
 {
       vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
 
-      vpi_printf("%s:%d: %s() STUB compiletf\n",
-		 vpi_get_str(vpiFile, sys), (int)vpi_get(vpiLineNo, sys),
-		 my_name);
+      struct port_call_table*tab = build_port_table(sys, my_name, 3);
+      if (tab == 0) {
+	    vpi_control(vpiFinish, 1);
+	    return 0;
+      }
+
+      vpi_put_userdata(sys, tab);
       return 0;
 }
 
@@ -581,20 +1120,14 @@ static PLI_INT32 simbus_ready_calltf(char*my_name)
       s_vpi_time now;
 
       vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
-	/* vpiHandle scope = vpi_handle(vpiScope, sys); */
-      vpiHandle argv = vpi_iterate(vpiArgument, sys);
-      vpiHandle arg;
-      assert(argv);
-
-      arg = vpi_scan(argv);
-      assert(arg);
+      struct port_call_table*tab = get_port_table(sys);
 
 	/* Get the BUS identifier to use. */
       value.format = vpiIntVal;
-      vpi_get_value(arg, &value);
+      vpi_get_value(tab->bus, &value);
       int bus_id = value.value.integer;
-      assert(bus_id < MAX_INSTANCES);
-      assert(instance_table[bus_id].fd >= 0);
+      struct port_instance*inst = get_instance(bus_id);
+      assert(inst->fd >= 0);
 
       DEBUG(SIMBUS_DEBUG_CALLS, "Call $ready(%d...)\n", bus_id);
 
@@ -604,127 +1137,103 @@ static PLI_INT32 simbus_ready_calltf(char*my_name)
       uint64_t now_int = ((uint64_t)now.high) << 32;
       now_int += (uint64_t) now.low;
 
-	/* Get the units for the simulation. */
-      int scale  = vpi_get(vpiTimePrecision, 0);
+	/* The simulation time is in units of the precision. Send it
+	   as femtoseconds, like the server. */
+      now_int = scale_time(now_int, tab->prec - SIMBUS_TIME_EXP);
 
-	/* Minimize the mantissa by increasing the scale so long as
-	   the mantissa is a multiple of 10. This is not a functional
-	   requirement, but it does help prevent a runaway precision
-	   expansion. */
-      while (now_int >= 10 && (now_int%10 == 0)) {
-	    now_int /= 10;
-	    scale += 1;
+	/* Make sure the message buffer can hold the prefix, all the
+	   signals, and the newline. */
+      size_t need = tab->msg_len + 64;
+      if (inst->write_siz < need) {
+	    inst->write_siz = need;
+	    inst->write_buf = realloc(inst->write_buf, inst->write_siz);
       }
 
-      char message[MAX_MESSAGE+1];
-      snprintf(message, sizeof message, "READY %" PRIu64 "e%d", now_int, scale);
+      char*message = inst->write_buf;
+      snprintf(message, 64, "READY %" PRIu64 "e%d", now_int, SIMBUS_TIME_EXP);
 
       char*cp = message + strlen(message);
 
 	/* Send the current state of all the named signals. The format
 	   passed in to the argument list is "name", value. Write
 	   these values in the proper message format. */
-      for (arg = vpi_scan(argv) ; arg ; arg = vpi_scan(argv)) {
-	    *cp++ = ' ';
+      unsigned idx;
+      for (idx = 0 ; idx < tab->nsig ; idx += 1) {
+	    struct port_signal*cur = tab->sigs + idx;
 
-	    value.format = vpiStringVal;
-	    vpi_get_value(arg, &value);
-	    strcpy(cp, value.value.str);
-	    cp += strlen(cp);
+	    memcpy(cp, cur->key, cur->key_len);
+	    cp += cur->key_len;
 
-	    *cp++ = '=';
-
-	    vpiHandle sig = vpi_scan(argv);
-	    assert(sig);
+	    unsigned nword = (cur->width+31) / 32;
+	    unsigned word;
+	    s_vpi_vecval*sv = tab->vec;
+	    PLI_UINT32*weak = tab->wmask;
+	    PLI_UINT32 any_weak = 0;
 
 	    value.format = vpiVectorVal;
-	    vpi_get_value(sig, &value);
-	    int bit;
-	    char*sig_string = cp;
-	    for (bit = vpi_get(vpiSize, sig) ; bit > 0 ; bit -= 1) {
-		  int word = (bit-1) / 32;
-		  int mask = 1 << ((bit-1) % 32);
-		  if (value.value.vector[word].aval & mask)
-			if (value.value.vector[word].bval & mask)
-			      *cp++ = 'x';
-			else
-			      *cp++ = '1';
-		  else
-			if (value.value.vector[word].bval & mask)
-			      *cp++ = 'z';
-			else
-			      *cp++ = '0';
-	    }
+	    vpi_get_value(cur->sig, &value);
+	    memcpy(sv, value.value.vector, nword*sizeof(s_vpi_vecval));
 
 	      /* The second value after the signal name is the drive
 		 reference. It is the value that the server is driving
 		 (or 'bz if this is output-only). Look at the driver
 		 value, and if it is non-z and equal to the value that
 		 I see in the verilog, then assume that this is the
-		 driver driving the value and subtract it. */
-	    vpiHandle drv = vpi_scan(argv);
-	    assert(drv);
-	    assert(vpi_get(vpiSize,drv) == vpi_get(vpiSize,sig));
-
+		 driver driving the value and subtract it. Bits that
+		 are 0 or 1 but not equal to the driver may be
+		 pullups, so note them in the weak mask for checking
+		 against the strengths. */
 	    value.format = vpiVectorVal;
-	    vpi_get_value(drv, &value);
-
-	    char*drv_reference = malloc(vpi_get(vpiSize,drv));
-	    for (bit = vpi_get(vpiSize,drv) ; bit > 0 ; bit -= 1) {
-		  int word = (bit-1) / 32;
-		  int mask = 1 << ((bit-1) % 32);
-		  if (value.value.vector[word].aval & mask)
-			if (value.value.vector[word].bval & mask)
-			      drv_reference[bit-1] = 'x';
-			else
-			      drv_reference[bit-1] = '1';
-		  else
-			if (value.value.vector[word].bval & mask)
-			      drv_reference[bit-1] = 'z';
-			else
-			      drv_reference[bit-1] = '0';
-
+	    vpi_get_value(cur->drv, &value);
+
+	    for (word = 0 ; word < nword ; word += 1) {
+		  const s_vpi_vecval*dv = value.value.vector + word;
+		  PLI_UINT32 same = ~((sv[word].aval ^ dv->aval)
+				     | (sv[word].bval ^ dv->bval));
+		  sv[word].aval &= ~same;
+		  sv[word].bval |= same;
+		  weak[word] = ~sv[word].bval;
+		  if (word == nword-1 && cur->width%32)
+			weak[word] &= (1U << cur->width%32) - 1;
+		  any_weak |= weak[word];
 	    }
 
-	      /* Get the strength values from the signal. */
-	    value.format = vpiStrengthVal;
-	    vpi_get_value(sig, &value);
-
-	      /* Now given the sig_string that is the current result,
-		 and the drive reference that is the value that is
-		 being driven by the server, subtract out from the
-		 sig_string the server driver, and any pullups from
-		 the port. */
-	    for (bit = vpi_get(vpiSize,drv); bit > 0; bit -= 1, sig_string+=1) {
-
-		  if (drv_reference[bit-1] == *sig_string) {
-			*sig_string = 'z';
-			continue;
+	      /* Do not pass pullup/pulldown values to the server. If
+		 the strength of the net is less then a strong drive,
+		 then clear it to z. Only get the strengths if there
+		 are any bits that might need it. */
+	    if (any_weak) {
+		  value.format = vpiStrengthVal;
+		  vpi_get_value(cur->sig, &value);
+
+		  for (word = 0 ; word < nword ; word += 1) {
+			PLI_UINT32 mask = weak[word];
+			unsigned bit;
+			for (bit = 0 ; mask ; bit += 1, mask >>= 1) {
+			      if (! (mask & 1))
+				    continue;
+			      struct t_vpi_strengthval*str = value.value.strength + word*32 + bit;
+			      if (str->s0 < vpiStrongDrive && str->s1 < vpiStrongDrive) {
+				    sv[word].aval &= ~(1U << bit);
+				    sv[word].bval |=  (1U << bit);
+			      }
+			}
 		  }
-
-		  if (*sig_string == 'z')
-			continue;
-		  if (*sig_string == 'x')
-			continue;
-
-		    /* Do not pass pullup/pulldown values to the
-		       server. If the strength of the net is less then
-		       a strong drive, then clear it to z. */
-		  struct t_vpi_strengthval*str = value.value.strength + bit - 1;
-		  if (str->s0 < vpiStrongDrive && str->s1 < vpiStrongDrive)
-			*sig_string = 'z';
 	    }
 
-	    free(drv_reference);
-	    assert(sig_string == cp);
+	    vector_to_chars(cp, sv, cur->width);
+	    cp += cur->width;
       }
 
       *cp++ = '\n';
       *cp = 0;
 
       DEBUG(SIMBUS_DEBUG_PROTOCOL, "Send %s", message);
-      int rc = write(instance_table[bus_id].fd, message, strlen(message));
-      assert(rc == strlen(message));
+      if (write_message(bus_id, message, cp-message) < 0) {
+	    vpi_printf("ERROR:$simbus_ready:%s\n", strerror(errno));
+	    vpi_control(vpiFinish, 1);
+	    return 0;
+      }
 
       DEBUG(SIMBUS_DEBUG_CALLS, "Return from $ready(%d...)\n", bus_id);
 
@@ -779,7 +1288,7 @@ static PLI_INT32 simbus_poll_calltf(char*my_name)
       vpi_get_value(bus_h, &value);
 
       int bus = value.value.integer;
-      assert(bus >= 0 && bus < MAX_INSTANCES);
+      struct port_instance*inst = get_instance(bus);
 
       vpiHandle trig = vpi_scan(argv);
       assert(trig);
@@ -788,29 +1297,21 @@ static PLI_INT32 simbus_poll_calltf(char*my_name)
 
       DEBUG(SIMBUS_DEBUG_CALLS, "Call $poll(%d...)\n", bus);
 
-      poll_state = check_readable(bus);
+	/* Take whatever the server has already sent. If that
+	   completes the message, the trigger fires right away and
+	   there is no need for a callback. */
+      poll_state = poll_readable(bus);
 
       value.format = vpiScalarVal;
       value.value.scalar = poll_state? vpi1 : vpi0;
       vpi_put_value(trig, &value, 0, vpiNoDelay);
 
       if (poll_state == 0) {
-	    struct t_cb_data cb_data;
-	    struct t_vpi_time cb_time;
-	    cb_time.type = vpiSuppressTime;
-	    cb_data.reason = cbReadWriteSynch;
-	    cb_data.cb_rtn = poll_for_simbus_bus;
-	    cb_data.obj = 0;
-	    cb_data.time   = &cb_time;
-	    cb_data.value = 0;
-	    cb_data.index = 0;
-	    cb_data.user_data = 0;
-	    vpi_register_cb(&cb_data);
-
-	    instance_table[bus].trig = trig;
+	    inst->trig = trig;
+	    schedule_poll_callback();
 
       } else {
-	    instance_table[bus].trig = 0;
+	    inst->trig = 0;
       }
 
       DEBUG(SIMBUS_DEBUG_CALLS, "return $poll(%d...)\n", bus);
@@ -821,87 +1322,36 @@ static PLI_INT32 simbus_until_compiletf(char*my_name)
 {
       vpiHandle sys  = vpi_handle(vpiSysTfCall, 0);
 
-      vpi_printf("%s:%d: %s() STUB compiletf\n",
-		 vpi_get_str(vpiFile, sys), (int)vpi_get(vpiLineNo, sys),
-		 my_name);
-      return 0;
-}
-
-struct signal_list_cell {
-      struct signal_list_cell*next;
-      char*key;
-      vpiHandle sig;
-};
-
-static struct signal_list_cell* find_key_in_list(struct signal_list_cell*ll, const char*key)
-{
-      while (ll && strcmp(ll->key,key)!=0)
-	    ll = ll->next;
-
-      return ll;
-}
-
-static void free_signal_list(struct signal_list_cell*ll)
-{
-      while (ll) {
-	    struct signal_list_cell*tmp = ll->next;
-	    free(ll->key);
-	    free(ll);
-	    ll = tmp;
+      struct port_call_table*tab = build_port_table(sys, my_name, 2);
+      if (tab == 0) {
+	    vpi_control(vpiFinish, 1);
+	    return 0;
       }
+
+      vpi_put_userdata(sys, tab);
+      return 0;
 }
 
-static void set_handle_to_value(vpiHandle sig, const char*val)
+static void set_handle_to_value(struct port_call_table*tab,
+				struct port_signal*cur, const char*val)
 {
       size_t width = strlen(val);
-      size_t vv_count = (width+31)/32;
 
       s_vpi_value value;
 
-      value.value.vector = calloc(vv_count, sizeof(s_vpi_vecval));
-      int idx;
-      for (idx = 0 ; idx < width ; idx += 1) {
-	    int word = idx / 32;
-	    int bit = idx % 32;
-	    char src = val[width-idx-1];
-	    PLI_INT32 amask = 0;
-	    PLI_INT32 bmask = 0;
-	    switch (src) {
-		case '0':
-		  continue;
-		case '1':
-		  amask = 1;
-		  bmask = 0;
-		  break;
-		case 'x':
-		  amask = 1;
-		  bmask = 1;
-		  break;
-		case 'z':
-		  amask = 0;
-		  bmask = 1;
-		  break;
-	    }
-
-	    s_vpi_vecval*vp = value.value.vector+word;
-
-	    vp->aval |= amask << bit;
-	    vp->bval |= bmask << bit;
-      }
-
-      if (vpi_get(vpiSize, sig) != width) {
-	    vpi_printf("ERROR: %s is %d bits, got %zu from server\n",
-		       vpi_get_str(vpiName, sig), vpi_get(vpiSize, sig), width);
+      if (cur->width != width) {
+	    vpi_printf("ERROR: %s is %u bits, got %zu from server\n",
+		       cur->key, cur->width, width);
 	    vpi_flush();
       }
 
-      assert(vpi_get(vpiSize, sig) == width);
-      assert(vpi_get(vpiType, sig) == vpiReg);
+      assert(cur->width == width);
 
-      value.format = vpiVectorVal;
-      vpi_put_value(sig, &value, 0, vpiNoDelay);
+      value.value.vector = tab->vec;
+      chars_to_vector(value.value.vector, val, width);
 
-      free(value.value.vector);
+      value.format = vpiVectorVal;
+      vpi_put_value(cur->sig, &value, 0, vpiNoDelay);
 }
 
 static PLI_INT32 simbus_until_calltf(char*my_name)
@@ -910,44 +1360,21 @@ static PLI_INT32 simbus_until_calltf(char*my_name)
       s_vpi_value value;
 
       vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
-      vpiHandle scope = vpi_handle(vpiScope, sys);
-      vpiHandle argv = vpi_iterate(vpiArgument, sys);
-
-      vpiHandle bus_h = vpi_scan(argv);
-      assert(bus_h);
+      struct port_call_table*tab = get_port_table(sys);
 
       value.format = vpiIntVal;
-      vpi_get_value(bus_h, &value);
+      vpi_get_value(tab->bus, &value);
 
       int bus = value.value.integer;
-      assert(bus >= 0 && bus < MAX_INSTANCES);
+      struct port_instance*inst = get_instance(bus);
 
       DEBUG(SIMBUS_DEBUG_CALLS, "Call $until(%d...)\n", bus);
 
-	/* Get a list of the signals and their mapping to a handle. We
-	   will use list list to map names from the UNTIL command back
-	   to the handle. */
-      struct signal_list_cell*signal_list = 0;
-      vpiHandle key, sig;
-      for (key = vpi_scan(argv) ; key ; key = vpi_scan(argv)) {
-	    sig = vpi_scan(argv);
-	    assert(sig);
-
-	    struct signal_list_cell*tmp = calloc(1, sizeof(struct signal_list_cell));
-	    value.format = vpiStringVal;
-	    vpi_get_value(key, &value);
-	    assert(value.format == vpiStringVal);
-	    assert(value.value.str);
-	    tmp->key = strdup(value.value.str);
-	    tmp->sig = sig;
-	    tmp->next = signal_list;
-	    signal_list = tmp;
-      }
-
 	/* Now read the command from the server. This will block until
-	   the server data actually arrives. */
-      char buf[MAX_MESSAGE+1];
-      int rc = read_message(bus, buf, sizeof buf);
+	   the server data actually arrives. The message is left in
+	   the read buffer of the instance, and is chopped up there. */
+      char*buf;
+      int rc = read_message(bus, &buf);
 
       if (rc <= 0) {
 	    vpi_printf("%s:%d: %s() read from server failed\n",
@@ -956,8 +1383,6 @@ static PLI_INT32 simbus_until_calltf(char*my_name)
 
 	    vpi_control(vpiStop);
 
-	    free_signal_list(signal_list);
-
 	      /* Set the return value and return. */
 	    value.format = vpiIntVal;
 	    value.value.integer = 0;
@@ -970,10 +1395,15 @@ static PLI_INT32 simbus_until_calltf(char*my_name)
 
 	/* Chop the message into tokens. */
       int   msg_argc = 0;
-      char* msg_argv[MAX_MESSAGE/2];
+      char**msg_argv = inst->msg_argv;
 
       char*cp = buf;
       while (*cp != 0) {
+	    if (msg_argc + 2 > inst->msg_argv_siz) {
+		  inst->msg_argv_siz *= 2;
+		  inst->msg_argv = realloc(inst->msg_argv, inst->msg_argv_siz*sizeof(char*));
+		  msg_argv = inst->msg_argv;
+	    }
 	    msg_argv[msg_argc++] = cp;
 	    cp += strcspn(cp, " ");
 	    if (*cp) {
@@ -988,7 +1418,6 @@ static PLI_INT32 simbus_until_calltf(char*my_name)
       if (strcmp(msg_argv[0],"FINISH") == 0) {
 	    vpi_printf("Server disconnected with FINISH command\n");
 	    vpi_control(vpiFinish);
-	    free_signal_list(signal_list);
 
 	      /* Set the return value and return. */
 	    value.format = vpiIntVal;
@@ -1007,30 +1436,16 @@ static PLI_INT32 simbus_until_calltf(char*my_name)
       cp += 1;
       int until_exp = strtol(cp,0,0);
 
-	/* Get the units for the scope */
-      int units = vpi_get(vpiTimeUnit, scope);
-
 	/* Put the until time into units of the scope. */
-      while (units < until_exp) {
-	    until_mant *= 10;
-	    until_exp -= 1;
-      }
-      while (units > until_exp) {
-	    until_mant = (until_mant + 5)/10;
-	    until_exp += 1;
-      }
+      int units = tab->units;
+      until_mant = scale_time(until_mant, until_exp - units);
 
       	/* Get the simulation time and put it into scope units. */
       now.type = vpiSimTime;
       vpi_get_time(0, &now);
       uint64_t deltatime = ((uint64_t)now.high) << 32;
       deltatime += (uint64_t) now.low;
-
-      int prec  = vpi_get(vpiTimePrecision, 0);
-      while (prec < units) {
-	    prec += 1;
-	    deltatime = (until_mant + 5)/10;
-      }
+      deltatime = scale_time(deltatime, tab->prec - units);
 
 	/* Now we can calculate the delta time. */
       if (deltatime > until_mant)
@@ -1045,6 +1460,7 @@ static PLI_INT32 simbus_until_calltf(char*my_name)
 
 	/* Process the signal values. */
       int idx;
+      tab->cursor = 0;
       for (idx = 2 ; idx < msg_argc ; idx += 1) {
 
 	    char*mkey = msg_argv[idx];
@@ -1052,7 +1468,7 @@ static PLI_INT32 simbus_until_calltf(char*my_name)
 	    assert(val && *val=='=');
 	    *val++ = 0;
 
-	    struct signal_list_cell*cur = find_key_in_list(signal_list, mkey);
+	    struct port_signal*cur = find_port_signal(tab, mkey, val-mkey-1);
 	    if (cur == 0) {
 		  vpi_printf("%s:%d: %s() Unexpected signal %s from bus.\n",
 			     vpi_get_str(vpiFile, sys),
@@ -1061,15 +1477,81 @@ static PLI_INT32 simbus_until_calltf(char*my_name)
 		  continue;
 	    }
 
-	    set_handle_to_value(cur->sig, val);
+	    set_handle_to_value(tab, cur, val);
       }
 
-      free_signal_list(signal_list);
-
       DEBUG(SIMBUS_DEBUG_CALLS, "Return %" PRIu64 " from $until(%d...)\n", deltatime, bus);
       return 0;
 }
 
+static PLI_INT32 simbus_finish_compiletf(char*my_name)
+{
+      vpiHandle sys  = vpi_handle(vpiSysTfCall, 0);
+      vpiHandle argv = vpi_iterate(vpiArgument, sys);
+
+      vpiHandle bus_h = argv? vpi_scan(argv) : 0;
+      vpiHandle status_h = bus_h? vpi_scan(argv) : 0;
+      if (status_h == 0) {
+	    vpi_printf("%s:%d: %s requires bus and status arguments\n",
+		       vpi_get_str(vpiFile, sys), (int)vpi_get(vpiLineNo, sys),
+		       my_name);
+	    vpi_control(vpiFinish, 1);
+	    return 0;
+      }
+
+      if (vpi_scan(argv) != 0) {
+	    vpi_printf("%s:%d: Too many arguments to %s\n",
+		       vpi_get_str(vpiFile, sys), (int)vpi_get(vpiLineNo, sys),
+		       my_name);
+	    vpi_control(vpiFinish, 1);
+	    return 0;
+      }
+
+      return 0;
+}
+
+/*
+ * Send the FINISH command with the status. The server answers with
+ * FINISH to all the clients, and the $simbus_until of this client
+ * gets it and ends the simulation.
+ */
+static PLI_INT32 simbus_finish_calltf(char*my_name)
+{
+      s_vpi_value value;
+      char message[32];
+
+      vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
+      vpiHandle argv = vpi_iterate(vpiArgument, sys);
+
+      value.format = vpiIntVal;
+      vpi_get_value(vpi_scan(argv), &value);
+      int bus = value.value.integer;
+
+      value.format = vpiIntVal;
+      vpi_get_value(vpi_scan(argv), &value);
+      int status = value.value.integer;
+
+      vpi_free_object(argv);
+
+      struct port_instance*inst = get_instance(bus);
+      assert(inst->fd >= 0);
+
+      DEBUG(SIMBUS_DEBUG_CALLS, "Call $finish(%d, %d)\n", bus, status);
+
+      if (status == 0)
+	    snprintf(message, sizeof message, "FINISH\n");
+      else
+	    snprintf(message, sizeof message, "FINISH %d\n", status);
+
+      DEBUG(SIMBUS_DEBUG_PROTOCOL, "Send %s", message);
+      if (write_message(bus, message, strlen(message)) < 0) {
+	    vpi_printf("ERROR:%s:%s\n", my_name, strerror(errno));
+	    vpi_control(vpiFinish, 1);
+	    return 0;
+      }
+
+      return 0;
+}
 
 static struct t_vpi_systf_data simbus_connect_tf = {
       vpiSysFunc,
@@ -1111,12 +1593,23 @@ static struct t_vpi_systf_data simbus_until_tf = {
       "$simbus_until"
 };
 
+static struct t_vpi_systf_data simbus_finish_tf = {
+      vpiSysTask,
+      0,
+      "$simbus_finish",
+      simbus_finish_calltf,
+      simbus_finish_compiletf,
+      0 /* sizetf */,
+      "$simbus_finish"
+};
+
 static void simbus_register(void)
 {
       vpi_register_systf(&simbus_connect_tf);
       vpi_register_systf(&simbus_ready_tf);
       vpi_register_systf(&simbus_poll_tf);
       vpi_register_systf(&simbus_until_tf);
+      vpi_register_systf(&simbus_finish_tf);
 }
 
 static void simbus_setup(void)
@@ -1150,11 +1643,7 @@ static void simbus_setup(void)
       if (simbus_debug_mask)
 	    vpi_printf("Using -simbus-debug-mask=0x%04x\n", simbus_debug_mask);
 
-      for (idx = 0 ; idx < MAX_INSTANCES ; idx += 1) {
-	    instance_table[idx].name = 0;
-	    instance_table[idx].fd = -1;
-	    instance_table[idx].trig = 0;
-      }
+      init_vector_tables();
 }
 
 void (*vlog_startup_routines[])(void) = {
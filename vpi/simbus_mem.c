@@ -20,6 +20,8 @@
 
 # include  <vpi_user.h>
 # include  <stdlib.h>
+# include  <stdint.h>
+# include  <stdio.h>
 # include  <string.h>
 # include  <sys/types.h>
 # include  <sys/stat.h>
@@ -35,27 +37,81 @@
 # define CMD_COMPARE 0x0001
 # define CMD_LOAD    0x0002
 # define CMD_SAVE    0x0003
+# define CMD_SNAPSHOT 0x0004
+# define CMD_RESTORE 0x0005
 
 # define CONTROL_COUNT (4096/4)
-# define MEMORY_INSTANCES 4
+
+/* The last words of the control page are the high 32 bits of the
+   base, size and second base arguments. The file name of LOAD and
+   SAVE ends before them. */
+# define CONTROL_BASE_HI  (CONTROL_COUNT-3)
+# define CONTROL_SIZE_HI  (CONTROL_COUNT-2)
+# define CONTROL_BASE2_HI (CONTROL_COUNT-1)
+
+/* Granularity for skipping zero or unchanged blocks in LOAD/SAVE. */
+# define SPARSE_BLOCK 4096
+
+/*
+ * Each $simbus_mem_open creates one of these. The table grows as
+ * needed, and the id returned to the simulation is the index.
+ */
 static struct memory_map_t {
       int fd;
       char*path;
       unsigned char*base;
       size_t size;
+	/* If the size is a power of 2, this is size-1 and is used to
+	   wrap addresses. Otherwise it is 0. */
+      size_t size_mask;
+	/* After a SNAPSHOT, the image is mapped MAP_PRIVATE so that
+	   the file keeps the snapshot and writes go to private copies
+	   of the pages. This is then a bitmap of the pages written
+	   since the snapshot, with a bit per system page, and is nil
+	   before the first snapshot. */
+      uint64_t*dirty;
 
       unsigned control_regs[CONTROL_COUNT];
-} memory_map[MEMORY_INSTANCES] = {
-      { -1, 0, 0 },
-      { -1, 0, 0 },
-      { -1, 0, 0 },
-      { -1, 0, 0 }
-};
+} *memory_map = 0;
+static unsigned memory_count = 0;
+
+/* The system page size, which is the unit of the dirty bitmap. */
+static size_t memory_page_size = 0;
+
+/*
+ * Mark the pages of the region dirty, if the image has a snapshot.
+ * All the writes to the image go through here so that SNAPSHOT and
+ * RESTORE only need to touch the pages that changed.
+ */
+static void mark_dirty(int id, size_t off, size_t len)
+{
+      size_t page, last;
+
+      if (memory_map[id].dirty == 0 || len == 0)
+	    return;
+
+      page = off / memory_page_size;
+      last = (off + len - 1) / memory_page_size;
+      for ( ; page <= last ; page += 1)
+	    memory_map[id].dirty[page/64] |= 1ULL << (page%64);
+}
+
+/* Set by the +simbus-mem-hugepages flag. */
+static int memory_hugepages = 0;
+
+/*
+ * Get a 64bit command argument from its low and high words.
+ */
+static uint64_t control_arg(int id, unsigned lo, unsigned hi)
+{
+      return ((uint64_t)memory_map[id].control_regs[hi] << 32)
+	    | memory_map[id].control_regs[lo];
+}
 
 static void cmd_fill(int id)
 {
-      unsigned base = memory_map[id].control_regs[1];
-      unsigned size = memory_map[id].control_regs[2];
+      uint64_t base64 = control_arg(id, 1, CONTROL_BASE_HI);
+      uint64_t size64 = control_arg(id, 2, CONTROL_SIZE_HI);
       unsigned fill = memory_map[id].control_regs[3];
 
       unsigned char fill0 = (fill >>  0) & 0xff;
@@ -63,63 +119,100 @@ static void cmd_fill(int id)
       unsigned char fill2 = (fill >> 16) & 0xff;
       unsigned char fill3 = (fill >> 24) & 0xff;
 
-      unsigned idx;
       unsigned char* ptr;
 
-      if (base >= memory_map[id].size)
+      if (base64 >= memory_map[id].size)
 	    return;
 
-      if (size == 0)
+      if (size64 == 0)
 	    return;
 
-      vpi_printf("MEM%d: fill 0x%x - 0x%x with 0x%x\n",
-		 id, base, base+size*4-1, fill);
+	/* The size is in words. Clip it to the end of the image. */
+      size_t base = base64;
+      if (size64 > (memory_map[id].size - base) / 4)
+	    size64 = (memory_map[id].size - base) / 4;
+      size_t size = size64;
 
-      if ((base + size*4) > memory_map[id].size)
-	    size = (memory_map[id].size - base) / 4;
+      vpi_printf("MEM%d: fill 0x%zx - 0x%zx with 0x%x\n",
+		 id, base, base+size*4-1, fill);
 
       ptr = memory_map[id].base + base;
-      for (idx = 0 ;  idx < size ;  idx += 1) {
-	    *ptr++ = fill0;
-	    *ptr++ = fill1;
-	    *ptr++ = fill2;
-	    *ptr++ = fill3;
+      mark_dirty(id, base, size*4);
+
+	/* A fill with the same byte everywhere is a memset. Otherwise,
+	   write the first word and double the filled region with
+	   memcpy until it covers the whole range. */
+      if (fill0 == fill1 && fill0 == fill2 && fill0 == fill3) {
+	    memset(ptr, fill0, size*4);
+	    return;
       }
 
+      size_t done = 4;
+      size_t total = size * 4;
+      ptr[0] = fill0;
+      ptr[1] = fill1;
+      ptr[2] = fill2;
+      ptr[3] = fill3;
+      while (done < total) {
+	    size_t trans = done < total-done? done : total-done;
+	    memcpy(ptr+done, ptr, trans);
+	    done += trans;
+      }
 }
 
+/*
+ * Count the bytes that differ between the two regions, and print the
+ * first few differences. Compare 8 bytes at a time, and only look at
+ * the individual bytes of words that differ.
+ */
 static void cmd_compare(int id)
 {
-      unsigned base1 = memory_map[id].control_regs[1];
-      unsigned size1 = memory_map[id].control_regs[2];
-      unsigned base2 = memory_map[id].control_regs[3];
-      unsigned idx, rc = 0;
+      uint64_t base1_64 = control_arg(id, 1, CONTROL_BASE_HI);
+      uint64_t size1_64 = control_arg(id, 2, CONTROL_SIZE_HI);
+      uint64_t base2_64 = control_arg(id, 3, CONTROL_BASE2_HI);
+      size_t idx;
+      unsigned rc = 0;
 
       const unsigned char*ba, *bb;
       unsigned message_limit = 20;
 
-      if (base1 >= memory_map[id].size)
+      if (base1_64 >= memory_map[id].size)
 	    return;
 
-      if (base2 >= memory_map[id].size)
+      if (base2_64 >= memory_map[id].size)
 	    return;
 
-      if (size1 == 0)
+      if (size1_64 == 0)
 	    return;
 
-      if ((base1 + size1) > memory_map[id].size)
-	    size1 = memory_map[id].size - base1;
-
-      memory_map[id].control_regs[0] = memcmp(memory_map[id].base+base1,
-					      memory_map[id].base+base2,
-					      size1);
+      size_t base1 = base1_64;
+      size_t base2 = base2_64;
+      if (size1_64 > memory_map[id].size - base1)
+	    size1_64 = memory_map[id].size - base1;
+      if (size1_64 > memory_map[id].size - base2)
+	    size1_64 = memory_map[id].size - base2;
+      size_t size1 = size1_64;
 
       ba = memory_map[id].base+base1;
       bb = memory_map[id].base+base2;
 
-      for (idx = 0 ;  idx < size1 ;  idx += 1) {
+      for (idx = 0 ;  idx < size1 ;  ) {
+
+	    if (idx + 8 <= size1) {
+		  uint64_t wa, wb;
+		  memcpy(&wa, ba+idx, 8);
+		  memcpy(&wb, bb+idx, 8);
+		  if (wa == wb) {
+			idx += 8;
+			continue;
+		  }
+	    }
+
+	    size_t end = idx + 8 <= size1? idx + 8 : size1;
+	    for ( ; idx < end ; idx += 1) {
+		  if (ba[idx] == bb[idx])
+			continue;
 
-	    if (ba[idx] != bb[idx]) {
 		  switch (message_limit) {
 		      case 0:
 			break;
@@ -128,7 +221,7 @@ static void cmd_compare(int id)
 			message_limit = 0;
 			break;
 		      default:
-			vpi_printf("MEM%d: %02x at 0x%x != %02x at 0x%x\n",
+			vpi_printf("MEM%d: %02x at 0x%zx != %02x at 0x%zx\n",
 				   id, ba[idx], base1+idx, bb[idx], base2+idx);
 			message_limit -= 1;
 			break;
@@ -140,7 +233,7 @@ static void cmd_compare(int id)
 
       memory_map[id].control_regs[0] = rc;
 
-      vpi_printf("MEM%d: compare 0x%x-0x%x and 0x%x-0x%x returns %x\n", id,
+      vpi_printf("MEM%d: compare 0x%zx-0x%zx and 0x%zx-0x%zx returns %x\n", id,
 		 base1, base1+size1-1, base2, base2+size1-1,
 		 memory_map[id].control_regs[0]);
 
@@ -150,9 +243,9 @@ static void extract_path_from_load(char*path, int id)
 {
       int idx;
 
-      assert(id < MEMORY_INSTANCES);
+      assert((unsigned)id < memory_count);
 
-      for (idx = 0 ;  idx < (CONTROL_COUNT-3) ;  idx += 1) {
+      for (idx = 0 ;  idx < (CONTROL_BASE_HI-3) ;  idx += 1) {
 	    char byte;
 	    char*dp = path + 4*idx;
 	    unsigned word = memory_map[id].control_regs[3+idx];
@@ -174,11 +267,52 @@ static void extract_path_from_load(char*path, int id)
       }
 }
 
+/*
+ * Copy the file into the image a block at a time, skipping blocks
+ * that already match. Untouched pages of a sparse image stay
+ * unallocated this way, and loading an image that mostly matches
+ * the current contents dirties only the pages that differ.
+ */
+static size_t load_sparse(int id, FILE*fd, size_t off, size_t size)
+{
+      unsigned char*dst = memory_map[id].base + off;
+      unsigned char buf[SPARSE_BLOCK];
+      size_t total = 0;
+
+      while (total < size) {
+	    size_t want = size - total < SPARSE_BLOCK? size - total : SPARSE_BLOCK;
+	    size_t got = fread(buf, 1, want, fd);
+	    if (got == 0)
+		  break;
+
+	    if (memcmp(dst + total, buf, got) != 0) {
+		  memcpy(dst + total, buf, got);
+		  mark_dirty(id, off + total, got);
+	    }
+
+	    total += got;
+	    if (got < want)
+		  break;
+      }
+
+      return total;
+}
+
+/*
+ * LOAD and SAVE return the byte count in the command word, and its
+ * high 32 bits in the high word of the size.
+ */
+static void set_count_result(int id, uint64_t cnt)
+{
+      memory_map[id].control_regs[0] = cnt;
+      memory_map[id].control_regs[CONTROL_SIZE_HI] = cnt >> 32;
+}
+
 static void cmd_load(int id)
 {
-      unsigned base1 = memory_map[id].control_regs[1];
-      unsigned size1 = memory_map[id].control_regs[2];
-      unsigned cnt;
+      uint64_t base64 = control_arg(id, 1, CONTROL_BASE_HI);
+      uint64_t size64 = control_arg(id, 2, CONTROL_SIZE_HI);
+      size_t cnt;
 
       char path[4096];
 
@@ -187,6 +321,18 @@ static void cmd_load(int id)
       extract_path_from_load(path, id);
       path[sizeof(path) - 1] = 0;
 
+      if (base64 > memory_map[id].size) {
+	    vpi_printf("MEM%d: Error: LOAD offset 0x%08llx is past 0x%08zx\n",
+		       id, (unsigned long long)base64, memory_map[id].size);
+	    memory_map[id].control_regs[0] = -1;
+	    return;
+      }
+
+      size_t base1 = base64;
+      if (size64 > memory_map[id].size - base1)
+	    size64 = memory_map[id].size - base1;
+      size_t size1 = size64;
+
       fd = fopen(path, "rb");
       if (fd == NULL) {
 	    vpi_printf("MEM%d: Error opening %s for read\n", id, path);
@@ -194,17 +340,62 @@ static void cmd_load(int id)
 	    return;
       }
 
-      cnt = fread(memory_map[id].base + base1, 1, size1, fd);
-      vpi_printf("MEM%d: Read %u bytes from %s to offset 0x%08x\n",
+      cnt = load_sparse(id, fd, base1, size1);
+      vpi_printf("MEM%d: Read %zu bytes from %s to offset 0x%08zx\n",
 		 id, cnt, path, base1);
-      memory_map[id].control_regs[0] = cnt;
+      set_count_result(id, cnt);
+
+      fclose(fd);
+}
+
+static int block_is_zero(const unsigned char*ptr, size_t cnt)
+{
+      static const unsigned char zero[SPARSE_BLOCK];
+      assert(cnt <= SPARSE_BLOCK);
+      return memcmp(ptr, zero, cnt) == 0;
+}
+
+/*
+ * Write the region, seeking over all-zero blocks so that the saved
+ * file is sparse like the image it came from. The final ftruncate
+ * fixes the length if the region ends in a hole.
+ */
+static size_t save_sparse(FILE*fd, const unsigned char*src, size_t size)
+{
+      size_t total = 0;
+      int hole = 0;
+
+      while (total < size) {
+	    size_t cnt = size - total < SPARSE_BLOCK? size - total : SPARSE_BLOCK;
+
+	    if (block_is_zero(src + total, cnt)) {
+		  if (fseeko(fd, cnt, SEEK_CUR) != 0)
+			break;
+		  hole = 1;
+
+	    } else {
+		  if (fwrite(src + total, 1, cnt, fd) != cnt)
+			break;
+		  hole = 0;
+	    }
+
+	    total += cnt;
+      }
+
+      if (hole) {
+	    fflush(fd);
+	    if (ftruncate(fileno(fd), total) < 0)
+		  return 0;
+      }
+
+      return total;
 }
 
 static void cmd_save(int id)
 {
-      unsigned base1 = memory_map[id].control_regs[1];
-      unsigned size1 = memory_map[id].control_regs[2];
-      unsigned cnt;
+      uint64_t base64 = control_arg(id, 1, CONTROL_BASE_HI);
+      uint64_t size64 = control_arg(id, 2, CONTROL_SIZE_HI);
+      size_t cnt;
 
       char path[sizeof(memory_map[id].control_regs)];
 
@@ -219,6 +410,17 @@ static void cmd_save(int id)
       extract_path_from_load(path, id);
       path[sizeof(path) - 1] = 0;
 
+      if (base64 > memory_map[id].size || size64 > memory_map[id].size - base64) {
+	    vpi_printf("MEM%d: Error: SAVE region 0x%08llx-0x%08llx is past 0x%08zx\n",
+		       id, (unsigned long long)base64,
+		       (unsigned long long)(base64+size64-1), memory_map[id].size);
+	    memory_map[id].control_regs[0] = -1;
+	    return;
+      }
+
+      size_t base1 = base64;
+      size_t size1 = size64;
+
       fd = fopen(path, "wb");
       if (fd == NULL) {
 	    vpi_printf("MEM%d: Error opening %s for write\n", id, path);
@@ -226,29 +428,159 @@ static void cmd_save(int id)
 	    return;
       }
 
-      if (base1 + size1 > memory_map[id].size) {
-	    vpi_printf("MEM%d: Error: SAVE region 0x%08x-0x%08x is past 0x%08zx\n",
-		       id, base1, base1+size1-1, memory_map[id].size);
+      cnt = save_sparse(fd, memory_map[id].base + base1, size1);
+      vpi_printf("MEM%d: Wrote %zu bytes from offset 0x%08zx to %s\n",
+		 id, cnt, base1, path);
+      set_count_result(id, cnt);
+
+      fclose(fd);
+}
+
+static void advise_hugepages(int id)
+{
+#ifdef MADV_HUGEPAGE
+      if (memory_hugepages
+	  && madvise(memory_map[id].base, memory_map[id].size, MADV_HUGEPAGE) < 0) {
+	    vpi_printf("MEM%d: Huge pages not available for %s: %s\n",
+		       id, memory_map[id].path, strerror(errno));
+      }
+#endif
+}
+
+/*
+ * Walk the dirty bitmap and handle each run of dirty pages. If the
+ * write_back flag is set, write the pages to the file, and if the
+ * drop flag is set, drop the private copies so that the image reverts
+ * to the file. The handled pages are then clean. Return -1 with errno
+ * set if a write fails.
+ */
+static int flush_dirty_pages(int id, int write_back, int drop)
+{
+      uint64_t*dirty = memory_map[id].dirty;
+      size_t npages = (memory_map[id].size + memory_page_size - 1) / memory_page_size;
+      size_t page = 0;
+
+      while (page < npages) {
+	    if (dirty[page/64] == 0) {
+		  page = (page/64 + 1) * 64;
+		  continue;
+	    }
+	    if (! (dirty[page/64] & (1ULL << (page%64)))) {
+		  page += 1;
+		  continue;
+	    }
+
+	    size_t first = page;
+	    while (page < npages && (dirty[page/64] & (1ULL << (page%64)))) {
+		  dirty[page/64] &= ~(1ULL << (page%64));
+		  page += 1;
+	    }
+
+	    size_t off = first * memory_page_size;
+	    size_t len = page * memory_page_size - off;
+	    if (off + len > memory_map[id].size)
+		  len = memory_map[id].size - off;
+
+	    if (write_back) {
+		  size_t done = 0;
+		  while (done < len) {
+			ssize_t rc = pwrite(memory_map[id].fd,
+					    memory_map[id].base + off + done,
+					    len - done, off + done);
+			if (rc < 0 && errno == EINTR)
+			      continue;
+			if (rc <= 0) {
+				/* Leave the rest of the run dirty so
+				   that a later flush can retry it. */
+			      mark_dirty(id, off + done, len - done);
+			      return -1;
+			}
+			done += rc;
+		  }
+	    }
+
+	    if (drop)
+		  madvise(memory_map[id].base + off, len, MADV_DONTNEED);
+      }
+
+      return 0;
+}
+
+/*
+ * The SNAPSHOT command makes the current contents of the image the
+ * state that RESTORE returns to. The first snapshot replaces the
+ * shared mapping of the file with a private mapping at the same
+ * address. Until then, all the contents are in the page cache of the
+ * file, so the private mapping starts with the same contents.
+ */
+static void cmd_snapshot(int id)
+{
+      void*base;
+
+      if (memory_map[id].dirty) {
+	      /* Write the pages changed since the last snapshot to the
+		 file. Then the file matches the image, so the private
+		 pages can be dropped. */
+	    if (flush_dirty_pages(id, 1, 1) < 0) {
+		  vpi_printf("MEM%d: Error writing snapshot to %s: %s\n",
+			     id, memory_map[id].path, strerror(errno));
+		  memory_map[id].control_regs[0] = -1;
+		  return;
+	    }
+
+	    vpi_printf("MEM%d: Snapshot updated\n", id);
+	    memory_map[id].control_regs[0] = 0;
+	    return;
+      }
+
+      size_t npages = (memory_map[id].size + memory_page_size - 1) / memory_page_size;
+      uint64_t*dirty = calloc((npages + 63) / 64, sizeof(uint64_t));
+      assert(dirty);
+
+      base = mmap(memory_map[id].base, memory_map[id].size,
+		  PROT_READ|PROT_WRITE,
+		  MAP_PRIVATE|MAP_FIXED|MAP_NORESERVE, memory_map[id].fd, 0);
+      if (base == MAP_FAILED) {
+	    vpi_printf("MEM%d: Error mapping snapshot of %s: %s\n",
+		       id, memory_map[id].path, strerror(errno));
+	    free(dirty);
 	    memory_map[id].control_regs[0] = -1;
 	    return;
       }
 
-      cnt = fwrite(memory_map[id].base + base1, 1, size1, fd);
-      vpi_printf("MEM%d: Wrote %u bytes from offset 0x%08x to %s\n",
-		 id, cnt, base1, path);
-      memory_map[id].control_regs[0] = cnt;
+      assert(base == memory_map[id].base);
+      memory_map[id].dirty = dirty;
+      advise_hugepages(id);
 
-      fclose(fd);
+      vpi_printf("MEM%d: Snapshot taken\n", id);
+      memory_map[id].control_regs[0] = 0;
+}
+
+/*
+ * The RESTORE command drops the private pages, so that the image
+ * reverts to the contents of the file. This only touches the pages
+ * that were written since the snapshot.
+ */
+static void cmd_restore(int id)
+{
+      if (! memory_map[id].dirty) {
+	    vpi_printf("MEM%d: Error: RESTORE without a snapshot.\n", id);
+	    memory_map[id].control_regs[0] = -1;
+	    return;
+      }
+
+      flush_dirty_pages(id, 0, 1);
+      vpi_printf("MEM%d: Snapshot restored\n", id);
+      memory_map[id].control_regs[0] = 0;
 }
 
 static void memdev_command(int id)
 {
-      if (id >= MEMORY_INSTANCES) {
+      if (id < 0 || (unsigned)id >= memory_count) {
 	    vpi_printf("PCI: ERROR: Memory command to invalid id=%d\n", id);
 	    assert(0);
       }
 
-      assert(id < MEMORY_INSTANCES);
       switch (memory_map[id].control_regs[0]) {
 	  case CMD_FILL:
 	    cmd_fill(id);
@@ -266,6 +598,14 @@ static void memdev_command(int id)
 	    cmd_save(id);
 	    break;
 
+	  case CMD_SNAPSHOT:
+	    cmd_snapshot(id);
+	    break;
+
+	  case CMD_RESTORE:
+	    cmd_restore(id);
+	    break;
+
 	  default:
 	    break;
       }
@@ -293,10 +633,52 @@ static int memory_open_compiletf(char*cd)
       return 0;
 }
 
+/*
+ * Get the value of an argument as an unsigned 64bit number, so that
+ * sizes and addresses may be wider than 32 bits. Bits that are x or z
+ * are taken as 0.
+ */
+static uint64_t get_uint64_arg(vpiHandle arg)
+{
+      s_vpi_value value;
+      uint64_t res;
+
+      value.format = vpiVectorVal;
+      vpi_get_value(arg, &value);
+
+      res = (uint32_t)(value.value.vector[0].aval & ~value.value.vector[0].bval);
+      if (vpi_get(vpiSize, arg) > 32) {
+	    uint32_t hi = value.value.vector[1].aval & ~value.value.vector[1].bval;
+	    res |= (uint64_t)hi << 32;
+      }
+
+      return res;
+}
+
+static void check_hugepages_flag(void)
+{
+      static int checked = 0;
+      s_vpi_vlog_info info;
+      int idx;
+
+      if (checked)
+	    return;
+      checked = 1;
+
+      if (! vpi_get_vlog_info(&info))
+	    return;
+
+      for (idx = 0 ; idx < info.argc ; idx += 1) {
+	    if (strcmp(info.argv[idx], "+simbus-mem-hugepages") == 0)
+		  memory_hugepages = 1;
+      }
+}
+
 static int memory_open_calltf(char*cd)
 {
       int id;
       s_vpi_value value;
+      uint64_t size_val;
 
       vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
       vpiHandle argv = vpi_iterate(vpiArgument, sys);
@@ -310,37 +692,56 @@ static int memory_open_calltf(char*cd)
       size = vpi_scan(argv);
       assert(size);
 
-      id = 0;
-      while (memory_map[id].fd >= 0 && id < MEMORY_INSTANCES)
-	    id += 1;
+      vpi_free_object(argv);
+      check_hugepages_flag();
 
-      assert(id < MEMORY_INSTANCES);
+      id = memory_count;
+      memory_map = realloc(memory_map, (memory_count+1) * sizeof(struct memory_map_t));
+      assert(memory_map);
+      memory_count += 1;
+      memset(memory_map+id, 0, sizeof(struct memory_map_t));
+      memory_map[id].fd = -1;
 
       value.format = vpiStringVal;
       vpi_get_value(path, &value);
 
       memory_map[id].path = strdup(value.value.str);
 
-      value.format = vpiIntVal;
-      vpi_get_value(size, &value);
+      size_val = get_uint64_arg(size);
+      if (size_val == 0 || size_val != (size_t)size_val) {
+	    vpi_printf("MEM%d: Invalid size 0x%llx for %s\n", id,
+		       (unsigned long long)size_val, memory_map[id].path);
+	    vpi_control(vpiFinish, 1);
+	    return 0;
+      }
 
       memory_map[id].fd = open(memory_map[id].path, O_RDWR|O_CREAT, 0666);
       if (memory_map[id].fd == -1) {
 	    perror(memory_map[id].path);
       }
 
-      memory_map[id].size = value.value.integer;
-      ftruncate(memory_map[id].fd, value.value.integer);
+      memory_map[id].size = size_val;
+      if ((memory_map[id].size & (memory_map[id].size-1)) == 0)
+	    memory_map[id].size_mask = memory_map[id].size - 1;
+      else
+	    memory_map[id].size_mask = 0;
+
+	/* The file is extended without writing, so the image is
+	   sparse and only pages that are touched take up space. */
+      if (ftruncate(memory_map[id].fd, memory_map[id].size) < 0)
+	    perror(memory_map[id].path);
 
-      memory_map[id].base = mmap(0, value.value.integer,
+      memory_map[id].base = mmap(0, memory_map[id].size,
 				 PROT_READ|PROT_WRITE,
-				 MAP_SHARED, memory_map[id].fd, 0);
+				 MAP_SHARED|MAP_NORESERVE, memory_map[id].fd, 0);
       if (memory_map[id].base == MAP_FAILED) {
 	    vpi_printf("pci: Failed to map %s: errno=%d\n",
 		       memory_map[id].path, errno);
       }
       assert(memory_map[id].base != MAP_FAILED);
 
+      advise_hugepages(id);
+
       value.format = vpiIntVal;
       value.value.integer = id;
       vpi_put_value(sys, &value, 0, vpiNoDelay);
@@ -348,6 +749,93 @@ static int memory_open_calltf(char*cd)
       return 0;
 }
 
+/*
+ * The peek, poke and block transfer calls keep the handles of their
+ * arguments in this structure. The compiletf builds it once for each
+ * call site and attaches it to the call with vpi_put_userdata, so the
+ * calltf only needs to read the argument values.
+ */
+struct mem_call_args {
+      vpiHandle fd;
+      vpiHandle addr;
+      vpiHandle data;
+      vpiHandle count;
+      vpiHandle bar;
+
+	/* If the data argument of a block transfer is a memory, these
+	   are the handles of its words in address order. Otherwise,
+	   the data argument is a vector of data_width bits. */
+      vpiHandle*words;
+      unsigned nwords;
+      unsigned data_width;
+      s_vpi_vecval*vec;
+};
+
+static int get_int_arg(vpiHandle arg)
+{
+      s_vpi_value value;
+      value.format = vpiIntVal;
+      vpi_get_value(arg, &value);
+      return value.value.integer;
+}
+
+/*
+ * Convert an address from the simulation into an offset in the memory
+ * image. Addresses wrap around the image, so that a BAR that is
+ * larger than the image aliases it.
+ */
+static size_t image_offset(int id, uint64_t address)
+{
+      if (memory_map[id].size_mask)
+	    return address & memory_map[id].size_mask;
+      else
+	    return address % memory_map[id].size;
+}
+
+static unsigned get_image_word(int id, uint64_t address)
+{
+      const unsigned char*ptr = memory_map[id].base + image_offset(id, address);
+      return (ptr[0] <<  0) | (ptr[1] <<  8) | (ptr[2] << 16) | ((unsigned)ptr[3] << 24);
+}
+
+static void put_image_word(int id, uint64_t address, unsigned word_val)
+{
+      unsigned char*ptr = memory_map[id].base + image_offset(id, address);
+      ptr[0] = (word_val >>  0) & 0xff;
+      ptr[1] = (word_val >>  8) & 0xff;
+      ptr[2] = (word_val >> 16) & 0xff;
+      ptr[3] = (word_val >> 24) & 0xff;
+      mark_dirty(id, ptr - memory_map[id].base, 4);
+}
+
+/*
+ * The control registers are a 4K window that is aliased through the
+ * whole of BAR 1.
+ */
+static unsigned control_index(uint64_t address)
+{
+      return (address / 4) % CONTROL_COUNT;
+}
+
+static int check_memory_id(vpiHandle sys, int id)
+{
+      if (id >= 0 && (unsigned)id < memory_count && memory_map[id].base)
+	    return 1;
+
+      vpi_printf("%s:%d: ERROR: Invalid memory id=%d\n",
+		 vpi_get_str(vpiFile, sys), (int)vpi_get(vpiLineNo, sys), id);
+      vpi_control(vpiStop);
+      return 0;
+}
+
+static struct mem_call_args* get_mem_call_args(void)
+{
+      vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
+      struct mem_call_args*args = vpi_get_userdata(sys);
+      assert(args);
+      return args;
+}
+
 static PLI_INT32 memory_peek_sizetf(char*x)
 {
       return 32;
@@ -357,71 +845,54 @@ static int memory_peek_compiletf(char*cd)
 {
       vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
       vpiHandle argv = vpi_iterate(vpiArgument, sys);
-      vpiHandle fd, addr, bar, junk;
+      vpiHandle junk;
 
       assert(argv);
 
-      fd = vpi_scan(argv);
-      assert(fd);
+      struct mem_call_args*args = calloc(1, sizeof(struct mem_call_args));
+
+      args->fd = vpi_scan(argv);
+      assert(args->fd);
 
-      addr = vpi_scan(argv);
-      assert(addr);
+      args->addr = vpi_scan(argv);
+      assert(args->addr);
 
-      bar = vpi_scan(argv);
-      assert(bar);
+      args->bar = vpi_scan(argv);
+      assert(args->bar);
 
       junk = vpi_scan(argv);
       assert(junk == 0);
 
+      vpi_put_userdata(sys, args);
       return 0;
 }
 
 static int memory_peek_calltf(char*cd)
 {
       int id;
-      unsigned address, bar_select;
+      uint64_t address;
+      unsigned bar_select;
       s_vpi_value value;
       vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
-      vpiHandle argv = vpi_iterate(vpiArgument, sys);
-      vpiHandle fd, addr, bar;
-
-      assert(argv);
+      struct mem_call_args*args = get_mem_call_args();
 
-      fd = vpi_scan(argv);
-      assert(fd);
+      id = get_int_arg(args->fd);
+      if (! check_memory_id(sys, id))
+	    return 0;
 
-      value.format = vpiIntVal;
-      vpi_get_value(fd, &value);
-      id = value.value.integer;
-
-      addr = vpi_scan(argv);
-      assert(addr);
-
-      value.format = vpiIntVal;
-      vpi_get_value(addr, &value);
-      address = value.value.integer % memory_map[id].size;
-
-      bar = vpi_scan(argv);
-      assert(bar);
-
-      value.format = vpiIntVal;
-      vpi_get_value(bar, &value);
-      bar_select = value.value.integer;
+      address = get_uint64_arg(args->addr);
+      bar_select = get_int_arg(args->bar);
 
       switch (bar_select) {
 
 	  case 0:
 	    value.format = vpiIntVal;
-	    value.value.integer =
-		    (memory_map[id].base[address+0] <<  0)
-		  | (memory_map[id].base[address+1] <<  8)
-		  | (memory_map[id].base[address+2] << 16)
-		  | (memory_map[id].base[address+3] << 24);
+	    value.value.integer = get_image_word(id, address);
 	    break;
 
 	  case 1:
 	    value.format = vpiIntVal;
-	    value.value.integer = memory_map[id].control_regs[address/4];
+	    value.value.integer = memory_map[id].control_regs[control_index(address)];
 	    break;
 
 	  default:
@@ -439,88 +910,301 @@ static int memory_poke_compiletf(char*cd)
 {
       vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
       vpiHandle argv = vpi_iterate(vpiArgument, sys);
-      vpiHandle fd, addr, word, bar, junk;
+      vpiHandle junk;
 
       assert(argv);
 
-      fd = vpi_scan(argv);
-      assert(fd);
+      struct mem_call_args*args = calloc(1, sizeof(struct mem_call_args));
+
+      args->fd = vpi_scan(argv);
+      assert(args->fd);
 
-      addr = vpi_scan(argv);
-      assert(addr);
+      args->addr = vpi_scan(argv);
+      assert(args->addr);
 
-      word = vpi_scan(argv);
-      assert(word);
+      args->data = vpi_scan(argv);
+      assert(args->data);
 
-      bar = vpi_scan(argv);
-      assert(bar);
+      args->bar = vpi_scan(argv);
+      assert(args->bar);
 
       junk = vpi_scan(argv);
       assert(junk == 0);
 
+      vpi_put_userdata(sys, args);
       return 0;
 }
 
 static int memory_poke_calltf(char*cd)
 {
       int id;
-      unsigned address, bar_select;
+      uint64_t address;
+      unsigned bar_select, reg;
       unsigned long word_val;
-      s_vpi_value value;
 
+      vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
+      struct mem_call_args*args = get_mem_call_args();
+
+      id = get_int_arg(args->fd);
+      if (! check_memory_id(sys, id))
+	    return 0;
+
+      address = get_uint64_arg(args->addr);
+      word_val = (unsigned)get_int_arg(args->data);
+      bar_select = get_int_arg(args->bar);
+
+      switch (bar_select) {
+	  case 0:
+	    put_image_word(id, address, word_val);
+	    break;
+
+	  case 1:
+	    reg = control_index(address);
+	    memory_map[id].control_regs[reg] = word_val;
+	    if (reg == 0)
+		  memdev_command(id);
+	    break;
+
+	  default:
+	    break;
+      }
+
+      return 0;
+}
+
+static int compare_word_index(const void*a, const void*b)
+{
+      const vpiHandle*wa = a;
+      const vpiHandle*wb = b;
+      s_vpi_value va, vb;
+
+      va.format = vpiIntVal;
+      vpi_get_value(vpi_handle(vpiIndex, *wa), &va);
+      vb.format = vpiIntVal;
+      vpi_get_value(vpi_handle(vpiIndex, *wb), &vb);
+
+      return va.value.integer - vb.value.integer;
+}
+
+/*
+ * $simbus_mem_read_block(<id>, <address>, <data>, <count>, <bar>)
+ * $simbus_mem_write_block(<id>, <address>, <data>, <count>, <bar>)
+ *
+ * Copy <count> 32bit words between the memory image at <address> and
+ * the <data> argument. The <data> may be a memory of 32bit words, in
+ * which case the transfer starts at its lowest address, or a vector
+ * that is a multiple of 32 bits wide, in which case the first word is
+ * the least significant. The <bar> selects the image (0) or the
+ * control registers (1), as with $simbus_mem_peek.
+ */
+static int memory_block_compiletf(char*my_name)
+{
       vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
       vpiHandle argv = vpi_iterate(vpiArgument, sys);
-      vpiHandle fd, addr, word, bar;
+      vpiHandle junk;
 
-      assert(argv);
+      struct mem_call_args*args = calloc(1, sizeof(struct mem_call_args));
 
-      fd = vpi_scan(argv);
-      assert(fd);
+      if (argv) {
+	    args->fd    = vpi_scan(argv);
+	    args->addr  = args->fd?    vpi_scan(argv) : 0;
+	    args->data  = args->addr?  vpi_scan(argv) : 0;
+	    args->count = args->data?  vpi_scan(argv) : 0;
+	    args->bar   = args->count? vpi_scan(argv) : 0;
+      }
 
-      value.format = vpiIntVal;
-      vpi_get_value(fd, &value);
-      id = value.value.integer;
+      if (args->bar == 0) {
+	    vpi_printf("%s:%d: %s requires 5 arguments.\n",
+		       vpi_get_str(vpiFile, sys), (int)vpi_get(vpiLineNo, sys),
+		       my_name);
+	    vpi_control(vpiFinish, 1);
+	    return 0;
+      }
 
-      addr = vpi_scan(argv);
-      assert(addr);
+      junk = vpi_scan(argv);
+      if (junk != 0) {
+	    vpi_printf("%s:%d: %s has too many arguments.\n",
+		       vpi_get_str(vpiFile, sys), (int)vpi_get(vpiLineNo, sys),
+		       my_name);
+	    vpi_free_object(argv);
+	    vpi_control(vpiFinish, 1);
+	    return 0;
+      }
 
-      value.format = vpiIntVal;
-      vpi_get_value(addr, &value);
-      address = value.value.integer % memory_map[id].size;
+      switch (vpi_get(vpiType, args->data)) {
+	  case vpiMemory: {
+		vpiHandle iter = vpi_iterate(vpiMemoryWord, args->data);
+		vpiHandle word;
+		unsigned nalloc = 0;
+		while (iter && (word = vpi_scan(iter))) {
+		      if (args->nwords >= nalloc) {
+			    nalloc = nalloc? 2*nalloc : 64;
+			    args->words = realloc(args->words, nalloc*sizeof(vpiHandle));
+		      }
+		      args->words[args->nwords++] = word;
+		}
+		qsort(args->words, args->nwords, sizeof(vpiHandle), compare_word_index);
+
+		if (args->nwords == 0 || vpi_get(vpiSize, args->words[0]) != 32) {
+		      vpi_printf("%s:%d: %s: Memory words must be 32 bits.\n",
+				 vpi_get_str(vpiFile, sys),
+				 (int)vpi_get(vpiLineNo, sys), my_name);
+		      vpi_control(vpiFinish, 1);
+		      return 0;
+		}
+		break;
+	  }
+
+	  case vpiReg:
+	    args->data_width = vpi_get(vpiSize, args->data);
+	    if (args->data_width % 32 != 0) {
+		  vpi_printf("%s:%d: %s: Vector width must be a multiple of 32.\n",
+			     vpi_get_str(vpiFile, sys),
+			     (int)vpi_get(vpiLineNo, sys), my_name);
+		  vpi_control(vpiFinish, 1);
+		  return 0;
+	    }
+	    args->vec = calloc(args->data_width/32, sizeof(s_vpi_vecval));
+	    break;
 
-      word = vpi_scan(argv);
-      assert(word);
+	  default:
+	    vpi_printf("%s:%d: %s: Data argument must be a memory or reg.\n",
+		       vpi_get_str(vpiFile, sys), (int)vpi_get(vpiLineNo, sys),
+		       my_name);
+	    vpi_control(vpiFinish, 1);
+	    return 0;
+      }
 
-      value.format = vpiIntVal;
-      vpi_get_value(word, &value);
-      word_val = value.value.integer;
+      vpi_put_userdata(sys, args);
+      return 0;
+}
 
-      bar = vpi_scan(argv);
-      assert(bar);
+/*
+ * Get the word count for the block transfer, limited to the size of
+ * the data argument.
+ */
+static unsigned get_block_count(vpiHandle sys, struct mem_call_args*args)
+{
+      unsigned count = get_int_arg(args->count);
+      unsigned limit = args->words? args->nwords : args->data_width/32;
+
+      if (count > limit) {
+	    vpi_printf("%s:%d: Block count %u is larger than the %u words of %s.\n",
+		       vpi_get_str(vpiFile, sys), (int)vpi_get(vpiLineNo, sys),
+		       count, limit, vpi_get_str(vpiName, args->data));
+	    count = limit;
+      }
 
-      value.format = vpiIntVal;
-      vpi_get_value(bar, &value);
-      bar_select = value.value.integer;
+      return count;
+}
 
+static unsigned get_block_word(int id, unsigned bar_select, uint64_t address)
+{
       switch (bar_select) {
 	  case 0:
-	    memory_map[id].base[address+0] = word_val & 0xff;
-	    word_val >>= 8;
-	    memory_map[id].base[address+1] = word_val & 0xff;
-	    word_val >>= 8;
-	    memory_map[id].base[address+2] = word_val & 0xff;
-	    word_val >>= 8;
-	    memory_map[id].base[address+3] = word_val & 0xff;
-	    break;
-
+	    return get_image_word(id, address);
 	  case 1:
-	    memory_map[id].control_regs[address/4] = word_val;
-	    if (address == 0)
-		  memdev_command(id);
-	    break;
-
+	    return memory_map[id].control_regs[control_index(address)];
 	  default:
-	    break;
+	    return 0xffffffff;
+      }
+}
+
+static int memory_read_block_calltf(char*my_name)
+{
+      vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
+      struct mem_call_args*args = get_mem_call_args();
+      s_vpi_value value;
+      s_vpi_vecval word_val;
+      unsigned idx;
+
+      int id = get_int_arg(args->fd);
+      if (! check_memory_id(sys, id))
+	    return 0;
+
+      uint64_t address = get_uint64_arg(args->addr);
+      unsigned bar_select = get_int_arg(args->bar);
+      unsigned count = get_block_count(sys, args);
+
+      value.format = vpiVectorVal;
+
+      if (args->words) {
+	    value.value.vector = &word_val;
+	    word_val.bval = 0;
+	    for (idx = 0 ; idx < count ; idx += 1) {
+		  word_val.aval = get_block_word(id, bar_select, address + 4*idx);
+		  vpi_put_value(args->words[idx], &value, 0, vpiNoDelay);
+	    }
+	    return 0;
+      }
+
+	/* For a vector, the words past the count are left unchanged,
+	   so start with the current value. */
+      unsigned nvec = args->data_width / 32;
+      vpi_get_value(args->data, &value);
+      memcpy(args->vec, value.value.vector, nvec*sizeof(s_vpi_vecval));
+
+      for (idx = 0 ; idx < count ; idx += 1) {
+	    args->vec[idx].aval = get_block_word(id, bar_select, address + 4*idx);
+	    args->vec[idx].bval = 0;
+      }
+
+      value.value.vector = args->vec;
+      vpi_put_value(args->data, &value, 0, vpiNoDelay);
+      return 0;
+}
+
+static int memory_write_block_calltf(char*my_name)
+{
+      vpiHandle sys = vpi_handle(vpiSysTfCall, 0);
+      struct mem_call_args*args = get_mem_call_args();
+      s_vpi_value value;
+      unsigned idx;
+
+      int id = get_int_arg(args->fd);
+      if (! check_memory_id(sys, id))
+	    return 0;
+
+      uint64_t address = get_uint64_arg(args->addr);
+      unsigned bar_select = get_int_arg(args->bar);
+      unsigned count = get_block_count(sys, args);
+
+	/* Writes to the control registers may execute commands, so
+	   do those a word at a time through the poke path. */
+      if (bar_select != 0) {
+	    for (idx = 0 ; idx < count ; idx += 1) {
+		  unsigned reg = control_index(address + 4*idx);
+		  if (bar_select != 1)
+			continue;
+
+		  value.format = vpiVectorVal;
+		  if (args->words)
+			vpi_get_value(args->words[idx], &value);
+		  else
+			vpi_get_value(args->data, &value);
+		  s_vpi_vecval*vp = value.value.vector + (args->words? 0 : idx);
+		  memory_map[id].control_regs[reg] = vp->aval & ~vp->bval;
+		  if (reg == 0)
+			memdev_command(id);
+	    }
+	    return 0;
+      }
+
+	/* Bits that are x or z are written as 0. */
+      value.format = vpiVectorVal;
+      if (args->words) {
+	    for (idx = 0 ; idx < count ; idx += 1) {
+		  vpi_get_value(args->words[idx], &value);
+		  put_image_word(id, address + 4*idx,
+				 value.value.vector->aval & ~value.value.vector->bval);
+	    }
+
+      } else {
+	    vpi_get_value(args->data, &value);
+	    for (idx = 0 ; idx < count ; idx += 1) {
+		  s_vpi_vecval*vp = value.value.vector + idx;
+		  put_image_word(id, address + 4*idx, vp->aval & ~vp->bval);
+	    }
       }
 
       return 0;
@@ -556,11 +1240,63 @@ static struct t_vpi_systf_data simbus_mem_poke_tf = {
       "$simbus_ready"
 };
 
+static struct t_vpi_systf_data simbus_mem_read_block_tf = {
+      vpiSysTask,
+      0,
+      "$simbus_mem_read_block",
+      memory_read_block_calltf,
+      memory_block_compiletf,
+      0 /* sizetf */,
+      "$simbus_mem_read_block"
+};
+
+static struct t_vpi_systf_data simbus_mem_write_block_tf = {
+      vpiSysTask,
+      0,
+      "$simbus_mem_write_block",
+      memory_write_block_calltf,
+      memory_block_compiletf,
+      0 /* sizetf */,
+      "$simbus_mem_write_block"
+};
+
+/*
+ * At the end of the simulation, write the pages changed since the
+ * last snapshot to the file, so that the file holds the final
+ * contents of the image as it would without a snapshot.
+ */
+static PLI_INT32 memory_end_of_sim(p_cb_data cb)
+{
+      unsigned id;
+
+      (void)cb;
+      for (id = 0 ; id < memory_count ; id += 1) {
+	    if (memory_map[id].dirty == 0)
+		  continue;
+	    if (flush_dirty_pages(id, 1, 0) < 0)
+		  vpi_printf("MEM%u: Error writing image to %s: %s\n",
+			     id, memory_map[id].path, strerror(errno));
+      }
+
+      return 0;
+}
+
 void simbus_mem_register(void)
 {
+      struct t_cb_data cb_data;
+
+      memory_page_size = sysconf(_SC_PAGESIZE);
+
+      memset(&cb_data, 0, sizeof cb_data);
+      cb_data.reason = cbEndOfSimulation;
+      cb_data.cb_rtn = memory_end_of_sim;
+      vpi_register_cb(&cb_data);
+
       vpi_register_systf(&simbus_mem_open_tf);
       vpi_register_systf(&simbus_mem_peek_tf);
       vpi_register_systf(&simbus_mem_poke_tf);
+      vpi_register_systf(&simbus_mem_read_block_tf);
+      vpi_register_systf(&simbus_mem_write_block_tf);
 }
 
 